@@ -150,6 +150,19 @@ struct mt_msg_list {
     struct mt_msg *pList;
 };
 
+/*!
+ * @enum mt_msg_iface_state
+ * @brief Connection state of a message interface
+ */
+enum mt_msg_iface_state {
+    /*! not connected */
+    MT_MSG_IFACE_STATE_down,
+    /*! a reconnect is in progress */
+    MT_MSG_IFACE_STATE_connecting,
+    /*! connected */
+    MT_MSG_IFACE_STATE_up
+};
+
 /*!
  * @struct msg_interface
  * @brief Messages come from and go to a message interface.
@@ -180,9 +193,19 @@ struct mt_msg_interface {
     /*! non-null if interface is a uart */
     struct uart_cfg *u_cfg;
 
+    /*! non-null if interface is shared memory */
+    struct shm_cfg *m_cfg;
+
     /*! Rx thread reading on this interface */
     intptr_t rx_thread;
 
+    /*!
+     * If true, MT_MSG_interfaceCreate() does not create an rx thread,
+     * instead the owner calls MT_MSG_rxReady() when the handle is
+     * readable (ie: from an event loop, see evloop.h)
+     */
+    bool no_rx_thread;
+
     /*! what is the fragment size we should use? */
     int tx_frag_size;
 
@@ -221,6 +244,24 @@ struct mt_msg_interface {
     /*! Is this interface dead? should the rx thread exit? */
     bool is_dead;
 
+    /*!
+     * Client sockets and shared memory clients only (a restarted
+     * creator makes a new object), if non-zero a lost connection is not
+     * dead, the rx thread reconnects waiting at least this long
+     * between attempts, the wait doubles (with jitter) each attempt.
+     */
+    int reconnect_min_mSecs;
+
+    /*! The reconnect wait does not grow beyond this */
+    int reconnect_max_mSecs;
+
+    /*! current connection state */
+    enum mt_msg_iface_state state;
+
+    /*! if not NULL, called (from the rx thread) when the state changes */
+    void (*state_cb)(struct mt_msg_interface *pMI,
+                     enum mt_msg_iface_state new_state);
+
     /*! points to the current message we are trying to receive */
     struct mt_msg *pCurRxMsg;
 
@@ -589,6 +630,22 @@ void MT_MSG_parseComplete(struct mt_msg *pMsg);
  */
 int MT_MSG_interfaceCreate(struct mt_msg_interface *pMI);
 
+/*
+ * @brief Receive what is available on an interface without an rx thread
+ * @param pMI - the interface, created with no_rx_thread = true
+ * @returns negative if the interface is dead, 0 otherwise
+ *
+ * Call this when the interface handle is readable, received messages
+ * are handled exactly as the rx thread would, ie: async messages go
+ * into the rx_list, use MT_MSG_LIST_remove() with a zero timeout.
+ * It never waits for more bytes, the part of a message received so
+ * far is kept in the interface until the handle is readable again.
+ *
+ * Note: The caller is the rx thread, it must not send an SREQ (or a
+ * fragmented message) on this interface and wait for the reply.
+ */
+int MT_MSG_rxReady(struct mt_msg_interface *pMI);
+
 /*
  * @brief Destroy this interface
  * @param pMI - pointer to the msg interface to destroy
@@ -56,6 +56,7 @@
 #include "stream.h"
 #include "stream_socket.h"
 #include "stream_uart.h"
+#include "stream_shm.h"
 #include "timer.h"
 #include "ti_semaphore.h"
 #include "fatal.h"
@@ -1496,15 +1497,214 @@ void MT_MSG_interfaceDestroy(struct mt_msg_interface *pMI)
     /* The caller may need to release destroy the handle. */
 }
 
+/*!
+ * @brief Can this interface reconnect after the connection is lost?
+ * @param pMI - the interface
+ * @returns true if it can
+ */
+static bool mt_msg_can_reconnect(struct mt_msg_interface *pMI)
+{
+    /* shared memory: attach to the object of a restarted creator */
+    if((pMI->m_cfg != NULL) && (pMI->m_cfg->cs == 'c'))
+    {
+        return (pMI->reconnect_min_mSecs > 0);
+    }
+    if(pMI->s_cfg == NULL)
+    {
+        return (false);
+    }
+    if(pMI->s_cfg->ascp != 'c')
+    {
+        return (false);
+    }
+    return (pMI->reconnect_min_mSecs > 0);
+}
+
+/*!
+ * @brief Change the connection state, and tell the user.
+ * @param pMI - the interface
+ * @param new_state - the new state
+ */
+static void mt_msg_set_state(struct mt_msg_interface *pMI,
+                             enum mt_msg_iface_state new_state)
+{
+    static const char * const names[] = {
+        "down", "connecting", "up"
+    };
+
+    if(pMI->state == new_state)
+    {
+        return;
+    }
+    pMI->state = new_state;
+    LOG_printf(LOG_DBG_MT_MSG_traffic, "%s: state: %s\n",
+               pMI->dbg_name, names[new_state]);
+    if(pMI->state_cb)
+    {
+        (*(pMI->state_cb))(pMI, new_state);
+    }
+}
+
+/*!
+ * @brief Sleep, but wake up early if the interface is destroyed.
+ * @param pMI - the interface
+ * @param mSecs - how long to sleep
+ * @returns false if the interface died.
+ */
+static bool mt_msg_reconnect_sleep(struct mt_msg_interface *pMI, int mSecs)
+{
+    int n;
+
+    while(mSecs > 0)
+    {
+        if(pMI->is_dead)
+        {
+            return (false);
+        }
+        n = mSecs;
+        if(n > 100)
+        {
+            n = 100;
+        }
+        TIMER_sleep(n);
+        mSecs -= n;
+    }
+    return (!(pMI->is_dead));
+}
+
+/*!
+ * @brief Reconnect a lost client socket (or shared memory), exponential
+ *        backoff with jitter.
+ * @param pMI - the interface
+ * @returns true when connected, false if the interface was destroyed
+ *
+ * Called from the rx thread, the interface (and the handle) stays
+ * the same so users of the interface do not need to do anything.
+ */
+static bool mt_msg_reconnect(struct mt_msg_interface *pMI)
+{
+    unsigned int seed;
+    timertoken_t tstart;
+    int delay_mSecs;
+    int wait_mSecs;
+    int max_mSecs;
+    int r;
+
+    delay_mSecs = pMI->reconnect_min_mSecs;
+    max_mSecs = pMI->reconnect_max_mSecs;
+    if(max_mSecs < delay_mSecs)
+    {
+        max_mSecs = delay_mSecs;
+    }
+    seed = (unsigned int)(TIMER_getAbsNow()) ^ (unsigned int)((intptr_t)(pMI));
+
+    LOG_printf(LOG_ERROR, "%s: connection lost, reconnecting\n",
+               pMI->dbg_name);
+    mt_msg_set_state(pMI, MT_MSG_IFACE_STATE_down);
+
+    /* whatever we had in progress is gone */
+    if(pMI->pCurRxMsg)
+    {
+        MT_MSG_free(pMI->pCurRxMsg);
+        pMI->pCurRxMsg = NULL;
+    }
+
+    for(;;)
+    {
+        if(pMI->is_dead)
+        {
+            return (false);
+        }
+        mt_msg_set_state(pMI, MT_MSG_IFACE_STATE_connecting);
+
+        /* a transmit must not write to the socket while we swap it */
+        MUTEX_lock(pMI->tx_lock, -1);
+        if(pMI->m_cfg)
+        {
+            r = (STREAM_reattachShm(pMI->hndl) == 0) ? 1 : -1;
+        }
+        else
+        {
+            r = SOCKET_CLIENT_connectStart(pMI->hndl);
+        }
+        MUTEX_unLock(pMI->tx_lock);
+
+        /* wait for the connect, but not forever */
+        tstart = TIMER_timeoutStart();
+        while((r == 0) && !(pMI->is_dead))
+        {
+            if(TIMER_timeoutIsExpired(tstart, max_mSecs))
+            {
+                r = -1;
+                break;
+            }
+            r = SOCKET_CLIENT_connectPoll(pMI->hndl, 100);
+        }
+
+        if(r > 0)
+        {
+            LOG_printf(LOG_ALWAYS, "%s: reconnected\n", pMI->dbg_name);
+            mt_msg_set_state(pMI, MT_MSG_IFACE_STATE_up);
+            return (true);
+        }
+
+        /* jitter: wait somewhere between 1/2 and all of the delay */
+        /* so a group of clients do not all retry at the same time */
+        wait_mSecs = (delay_mSecs / 2) + (rand_r(&seed) % ((delay_mSecs / 2) + 1));
+        LOG_printf(LOG_DBG_MT_MSG_traffic, "%s: reconnect in %d mSecs\n",
+                   pMI->dbg_name, wait_mSecs);
+        if(!mt_msg_reconnect_sleep(pMI, wait_mSecs))
+        {
+            return (false);
+        }
+        delay_mSecs = delay_mSecs * 2;
+        if(delay_mSecs > max_mSecs)
+        {
+            delay_mSecs = max_mSecs;
+        }
+    }
+}
+
+/*!
+ * @brief Read up to N bytes that are already available, without blocking
+ * @param h - the stream
+ * @param pBuf - where to put them
+ * @param n - how many bytes we want
+ * @returns negative on error, 0..number of bytes read
+ *
+ * A stream read of more bytes than have arrived waits for the rest,
+ * so this reads one byte at a time while STREAM_rxAvail() says so.
+ */
+static int mt_msg_rd_nowait(intptr_t h, uint8_t *pBuf, int n)
+{
+    int r;
+    int x;
+
+    for(x = 0 ; x < n ; x++)
+    {
+        if(STREAM_rxAvail(h, 0) == 0)
+        {
+            break;
+        }
+        r = STREAM_rdBytes(h, pBuf + x, 1, 0);
+        if(r <= 0)
+        {
+            return ((x > 0) ? x : r);
+        }
+    }
+    return (x);
+}
+
 /*!
  * @brief Read N bytes from the interface and insert into the message
  * @param pMsg - the message to insert into
  * @param n - how many bytes we need
- * @param timeout_mSecs - how long to wait
+ * @param timeout_mSecs - how long to wait, not used if nowait
+ * @param nowait - only take the bytes that are already available
  * @returns nbytes valid in the rx buffer (total)
  */
 static int mt_msg_rx_bytes(struct mt_msg_interface *pMI,
-                            int n, int timeout_mSecs)
+                            int n, int timeout_mSecs, bool nowait)
 {
     struct mt_msg *pMsg;
     int r;
@@ -1521,10 +1721,19 @@ static int mt_msg_rx_bytes(struct mt_msg_interface *pMI,
     nneed = n - pMsg->iobuf_nvalid;
 
     /* go read */
-    r = STREAM_rdBytes(pMI->hndl,
-                       pMsg->iobuf + pMsg->iobuf_nvalid,
-                       nneed,
-                       timeout_mSecs);
+    if(nowait)
+    {
+        r = mt_msg_rd_nowait(pMI->hndl,
+                             pMsg->iobuf + pMsg->iobuf_nvalid,
+                             nneed);
+    }
+    else
+    {
+        r = STREAM_rdBytes(pMI->hndl,
+                           pMsg->iobuf + pMsg->iobuf_nvalid,
+                           nneed,
+                           timeout_mSecs);
+    }
     if(r > 0)
     {
         /* great success? */
@@ -1540,12 +1749,17 @@ static int mt_msg_rx_bytes(struct mt_msg_interface *pMI,
                 LOG_printf(LOG_DBG_MT_MSG_traffic,
                            "%s: Socket is dead\n",
                            pMI->dbg_name);
-                pMI->is_dead = true;
+                /* the rx thread will reconnect if it can */
+                if(!mt_msg_can_reconnect(pMI))
+                {
+                    pMI->is_dead = true;
+                }
             }
         }
         else
         {
-            if(r < 0)
+            /* the rx thread reattaches shared memory if it can */
+            if((r < 0) && !mt_msg_can_reconnect(pMI))
             {
                 /* USB uarts die if they are disconnected */
                 pMI->is_dead = true;
@@ -1621,7 +1835,7 @@ try_again:
         (pMI->include_chksum ? 1 : 0)); /* checksum */
 
 read_more:
-    r = mt_msg_rx_bytes(pMI, nneed, pMI->intermsg_timeout_mSecs);
+    r = mt_msg_rx_bytes(pMI, nneed, pMI->intermsg_timeout_mSecs, false);
     if(r == 0)
     {
         LOG_printf(LOG_DBG_MT_MSG_traffic, "%s: rx-silent\n", pMI->dbg_name);
@@ -1697,7 +1911,8 @@ read_more:
     nneed += pMsg->expected_len;
 
     /* read the data component */
-    r = mt_msg_rx_bytes(pMI, nneed, pMI->intersymbol_timeout_mSecs);
+    r = mt_msg_rx_bytes(pMI, nneed, pMI->intersymbol_timeout_mSecs,
+                        false);
     if(r != nneed)
     {
         /* something is wrong? */
@@ -1753,6 +1968,133 @@ read_more:
     return (pMsg);
 }
 
+/*!
+ * @brief Drop bytes from the front of the message being received
+ * @param pMsg - the partial message
+ * @param n - how many bytes
+ */
+static void mt_msg_rx_drop(struct mt_msg *pMsg, int n)
+{
+    pMsg->iobuf_nvalid -= n;
+    memmove((void *)(&pMsg->iobuf[0]),
+            (void *)(&pMsg->iobuf[n]),
+            pMsg->iobuf_nvalid);
+}
+
+/*!
+ * @brief Receive what has arrived of a message, without waiting
+ * @param pMI - the interface
+ * @returns a complete message, or NULL if none is complete yet
+ *
+ * Unlike mt_msg_rx(), this never waits for bytes: the part of a
+ * message received so far stays in pMI->pCurRxMsg until the next
+ * call, so a slow sender cannot hold the caller. Garbage and bad
+ * checksums are skipped up to the next sync byte.
+ */
+static struct mt_msg *mt_msg_rx_nowait(struct mt_msg_interface *pMI)
+{
+    struct mt_msg *pMsg;
+    uint8_t *p8;
+    int nhdr;
+    int nneed;
+    int n;
+
+    /* do we allocate a new message? */
+    if(pMI->pCurRxMsg == NULL)
+    {
+        pMI->pCurRxMsg = MT_MSG_alloc(-1, -1, -1);
+        /* allocation error :-(*/
+        if(pMI->pCurRxMsg == NULL)
+        {
+            return (NULL);
+        }
+        pMI->pCurRxMsg->pLogPrefix = _incomming_msg;
+        MT_MSG_setSrcIface(pMI->pCurRxMsg, pMI);
+    }
+    pMsg = pMI->pCurRxMsg;
+
+    nhdr = (
+        (pMI->frame_sync ? 1 : 0) + /* sync */
+        (pMI->len_2bytes ? 2 : 1) + /* len */
+        1 + /* cmd0 */
+        1); /* cmd1 */
+
+    for(;;)
+    {
+        if(mt_msg_rx_bytes(pMI, nhdr, 0, true) < nhdr)
+        {
+            /* the rest comes later */
+            return (NULL);
+        }
+
+        /* the frame must start with the sync byte */
+        if(pMI->frame_sync && (pMsg->iobuf[0] != 0xfe))
+        {
+            MT_MSG_log(LOG_DBG_MT_MSG_traffic | LOG_DBG_MT_MSG_raw,
+                       pMsg, "Garbage data...\n");
+            p8 = (uint8_t *)memchr((void *)(&pMsg->iobuf[1]),
+                                   0xfe,
+                                   pMsg->iobuf_nvalid - 1);
+            n = (p8 == NULL) ? pMsg->iobuf_nvalid :
+                (int)(p8 - &(pMsg->iobuf[0]));
+            mt_msg_rx_drop(pMsg, n);
+            continue;
+        }
+
+        /* Found start, parse the header */
+        pMsg->iobuf_idx = pMI->frame_sync ? 1 : 0;
+        if(pMI->len_2bytes)
+        {
+            pMsg->expected_len = MT_MSG_rdU16(pMsg);
+        }
+        else
+        {
+            pMsg->expected_len = MT_MSG_rdU8(pMsg);
+        }
+        pMsg->cmd0 = MT_MSG_rdU8(pMsg);
+        pMsg->cmd1 = MT_MSG_rdU8(pMsg);
+
+        nneed = nhdr + pMsg->expected_len + (pMI->include_chksum ? 1 : 0);
+        if(nneed > (int)(sizeof(pMsg->iobuf)))
+        {
+            MT_MSG_log(LOG_ERROR, pMsg, "%s: too long: %d\n",
+                       pMI->dbg_name, pMsg->expected_len);
+            mt_msg_rx_drop(pMsg, pMI->frame_sync ? 1 : pMsg->iobuf_nvalid);
+            continue;
+        }
+
+        if(mt_msg_rx_bytes(pMI, nneed, 0, true) < nneed)
+        {
+            return (NULL);
+        }
+
+        /* Dummy read to the end of the data. */
+        /* this puts us at the checksum byte (if present) */
+        MT_MSG_rdBuf(pMsg, NULL, pMsg->expected_len);
+
+        if(pMI->include_chksum &&
+           (MT_MSG_calc_chksum(pMsg, 'f', nneed) != 0))
+        {
+            MT_MSG_log(LOG_ERROR, pMsg, "%s: chksum error\n",
+                       pMI->dbg_name);
+            LOG_hexdump(!LOG_ERROR, 0, pMsg->iobuf, nneed);
+            /* look for the next sync byte */
+            mt_msg_rx_drop(pMsg, pMI->frame_sync ? 1 : pMsg->iobuf_nvalid);
+            continue;
+        }
+        break;
+    }
+
+    /* We have a message */
+    MT_MSG_set_type(pMsg, pMsg->pSrcIface);
+    /* Set the iobuf_idx to the start of the payload */
+    pMsg->iobuf_idx = nhdr;
+    /* next time we need to allocate a new message */
+    pMI->pCurRxMsg = NULL;
+
+    return (pMsg);
+}
+
 /*!
  * @brief We have received an extended status message handle it
  * @param pMsg - the message
@@ -2151,6 +2493,95 @@ static struct mt_msg *handle_extend_packet(struct mt_msg *pMsg)
     return (pMsg);
 }
 
+/*!
+ * @brief Route a received message to the rx_list or the waiting SREQ
+ * @param pMI - the interface the message came from
+ * @param pRxMsg - the message
+ */
+static void mt_msg_rx_dispatch(struct mt_msg_interface *pMI,
+                               struct mt_msg *pRxMsg)
+{
+    int a;
+    int b;
+
+    /* Debug dump if requested */
+    MT_MSG_dbg_decode(pRxMsg, pRxMsg->pSrcIface, ALL_MT_MSG_DBG);
+
+    /* if this message has the extension bit.. */
+    if(pRxMsg->cmd0 & _bit7)
+    {
+        pRxMsg = handle_extend_packet(pRxMsg);
+    }
+
+    /* did we complete the decoding of a the extended packet? */
+    /* or if we got a normall packet... */
+    if(pRxMsg == NULL)
+    {
+        /* nothing left to do... */
+        return;
+    }
+
+    if(pRxMsg->m_type == MT_MSG_TYPE_areq)
+    {
+    areq_msg:
+        MT_MSG_log(LOG_DBG_MT_MSG_traffic, pRxMsg, "rx areq\n");
+        /* async request */
+        MT_MSG_LIST_insert(pMI, &(pMI->rx_list), pRxMsg);
+        return;
+    }
+
+    if(pRxMsg->m_type == MT_MSG_TYPE_poll)
+    {
+        /* polls are handled as an areq */
+        goto areq_msg;
+    }
+
+    if(pRxMsg->m_type == MT_MSG_TYPE_sreq)
+    {
+        /* polls are handled as an areq */
+        goto areq_msg;
+    }
+
+    /* it should match our current Sreq */
+    /* and it might not match our Sreq */
+    if(pMI->pCurSreq == NULL)
+    {
+        /* But there is no current sreq? */
+        MT_MSG_log(LOG_DBG_MT_MSG_traffic, pRxMsg, "no pending sreq?\n");
+        /* treat as an areq */
+        goto areq_msg;
+    }
+
+    /* Does this match? */
+
+    /* Upper bits[7:5] = message type */
+    /* Lower bits[4:0] = subsystem number */
+    /* We only care about the subsystem number */
+    a = _bitsXYof(pMI->pCurSreq->cmd0, 4, 0);
+    b = _bitsXYof(pRxMsg->cmd0, 4, 0);
+    if((a == b) && (pMI->pCurSreq->cmd1 == pRxMsg->cmd1))
+    {
+        /* All is well */
+    }
+    else
+    {
+        /* does not match.. */
+        MT_MSG_log(LOG_DBG_MT_MSG_traffic,
+            pRxMsg,
+            "sreq(cmd0=0x%02x, cmd1=0x%02x) does not match\n",
+            pMI->pCurSreq->cmd0,
+            pMI->pCurSreq->cmd1);
+        /* treat as areq */
+        goto areq_msg;
+    }
+
+    /* attach it to the request */
+    pMI->pCurSreq->pSrsp = pRxMsg;
+    pMI->pCurSreq = NULL;
+    /* wake up the waiter */
+    SEMAPHORE_put(pMI->srsp_semaphore);
+}
+
 /*!
  * @brief rx thread that handles all incomming messages.
  * @param cookie - the message interface in disguise
@@ -2158,8 +2589,6 @@ static struct mt_msg *handle_extend_packet(struct mt_msg *pMsg)
  */
 static intptr_t mt_msg_rx_thread(intptr_t cookie)
 {
-    int a;
-    int b;
     struct mt_msg_interface *pMI;
     struct mt_msg *pRxMsg;
 
@@ -2173,6 +2602,18 @@ static intptr_t mt_msg_rx_thread(intptr_t cookie)
             break;
         }
 
+        if(mt_msg_can_reconnect(pMI) &&
+           (STREAM_isError(pMI->hndl) ||
+            ((pMI->m_cfg == NULL) &&
+             !STREAM_SOCKET_isConnected(pMI->hndl))))
+        {
+            if(mt_msg_reconnect(pMI))
+            {
+                continue;
+            }
+            break;
+        }
+
         if(STREAM_isError(pMI->hndl))
         {
             LOG_printf(LOG_ERROR, "%s: Dead\n", pMI->dbg_name);
@@ -2185,87 +2626,45 @@ static intptr_t mt_msg_rx_thread(intptr_t cookie)
         {
             continue;
         }
-        /* Debug dump if requested */
-        MT_MSG_dbg_decode(pRxMsg, pRxMsg->pSrcIface, ALL_MT_MSG_DBG);
-
-        /* if this message has the extension bit.. */
-        if(pRxMsg->cmd0 & _bit7)
-        {
-            pRxMsg = handle_extend_packet(pRxMsg);
-        }
-
-        /* did we complete the decoding of a the extended packet? */
-        /* or if we got a normall packet... */
-        if(pRxMsg == NULL)
-        {
-            /* nothing left to do... */
-            continue;
-        }
-
-        if(pRxMsg->m_type == MT_MSG_TYPE_areq)
-        {
-        areq_msg:
-            MT_MSG_log(LOG_DBG_MT_MSG_traffic, pRxMsg, "rx areq\n");
-            /* async request */
-            MT_MSG_LIST_insert(pMI, &(pMI->rx_list), pRxMsg);
-            pRxMsg = NULL;
-            continue;
-        }
-
-        if(pRxMsg->m_type == MT_MSG_TYPE_poll)
-        {
-            /* polls are handled as an areq */
-            goto areq_msg;
-        }
+        mt_msg_rx_dispatch(pMI, pRxMsg);
+    }
+    LOG_printf(LOG_ERROR, "%s: rx-thread dead\n", pMI->dbg_name);
+    /* we die */
+    return (0);
+}
 
-        if(pRxMsg->m_type == MT_MSG_TYPE_sreq)
-        {
-            /* polls are handled as an areq */
-            goto areq_msg;
-        }
+/*
+  Receive without an rx thread
+  see mt_msg.h
+*/
+int MT_MSG_rxReady(struct mt_msg_interface *pMI)
+{
+    struct mt_msg *pRxMsg;
 
-        /* it should match our current Sreq */
-        /* and it might not match our Sreq */
-        if(pMI->pCurSreq == NULL)
+    /* several messages may have arrived together */
+    for(;;)
+    {
+        if(pMI->is_dead || STREAM_isError(pMI->hndl))
         {
-            /* But there is no current sreq? */
-            MT_MSG_log(LOG_DBG_MT_MSG_traffic, pRxMsg, "no pending sreq?\n");
-            /* treat as an areq */
-            goto areq_msg;
+            pMI->is_dead = true;
+            return (-1);
         }
 
-        /* Does this match? */
-
-        /* Upper bits[7:5] = message type */
-        /* Lower bits[4:0] = subsystem number */
-        /* We only care about the subsystem number */
-        a = _bitsXYof(pMI->pCurSreq->cmd0, 4, 0);
-        b = _bitsXYof(pRxMsg->cmd0, 4, 0);
-        if((a == b) && (pMI->pCurSreq->cmd1 == pRxMsg->cmd1))
-        {
-            /* All is well */
-        }
-        else
+        pRxMsg = mt_msg_rx_nowait(pMI);
+        if(pRxMsg == NULL)
         {
-            /* does not match.. */
-            MT_MSG_log(LOG_DBG_MT_MSG_traffic,
-                pRxMsg,
-                "sreq(cmd0=0x%02x, cmd1=0x%02x) does not match\n",
-                pMI->pCurSreq->cmd0,
-                pMI->pCurSreq->cmd1);
-            /* treat as areq */
-            goto areq_msg;
+            /* ie: the other end closed the socket? */
+            if(pMI->is_dead || STREAM_isError(pMI->hndl))
+            {
+                pMI->is_dead = true;
+                return (-1);
+            }
+            /* a partial message waits for the next call */
+            break;
         }
-
-        /* attach it to the request */
-        pMI->pCurSreq->pSrsp = pRxMsg;
-        pMI->pCurSreq = NULL;
-        pRxMsg = NULL;
-        /* wake up the waiter */
-        SEMAPHORE_put(pMI->srsp_semaphore);
+        mt_msg_rx_dispatch(pMI, pRxMsg);
     }
-    LOG_printf(LOG_ERROR, "%s: rx-thread dead\n", pMI->dbg_name);
-    /* we die */
+
     return (0);
 }
 
@@ -2325,6 +2724,16 @@ int MT_MSG_interfaceCreate(struct mt_msg_interface *pMI)
                 STREAM_rdDump(pMI->hndl, pMI->flush_timeout_mSecs);
         }
     }
+    else if(pMI->m_cfg)
+    {
+        pMI->hndl = STREAM_createShm(pMI->m_cfg);
+        if(pMI->hndl)
+        {
+            /* the other side may have left data from a previous run */
+            if( pMI->startup_flush )
+                STREAM_rdDump(pMI->hndl, pMI->flush_timeout_mSecs);
+        }
+    }
     else
     {
         /* Connection is a *SOCKET* */
@@ -2414,13 +2823,23 @@ int MT_MSG_interfaceCreate(struct mt_msg_interface *pMI)
         pMI->tx_lock_timeout = 3000;
     }
 
+    if((pMI->reconnect_min_mSecs > 0) && (pMI->reconnect_max_mSecs == 0))
+    {
+        pMI->reconnect_max_mSecs = 30000;
+    }
+
+    pMI->state = MT_MSG_IFACE_STATE_up;
+
     /* create the thread last... because it is going to run */
-    pMI->rx_thread = THREAD_create(pMI->dbg_name,
-                                    mt_msg_rx_thread,
-                                    (intptr_t)(pMI),
-                                    THREAD_FLAGS_DEFAULT);
+    if(!(pMI->no_rx_thread))
+    {
+        pMI->rx_thread = THREAD_create(pMI->dbg_name,
+                                        mt_msg_rx_thread,
+                                        (intptr_t)(pMI),
+                                        THREAD_FLAGS_DEFAULT);
+    }
 
-    if((pMI->hndl == 0) || (pMI->rx_thread == 0))
+    if((pMI->hndl == 0) || ((pMI->rx_thread == 0) && !(pMI->no_rx_thread)))
     {
     bad:
         /* problem? */
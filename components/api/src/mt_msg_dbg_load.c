@@ -391,6 +391,7 @@ struct mt_msg_dbg *MT_MSG_dbg_load(const char *filename)
     {
         return NULL;
     }
+    (void)STREAM_setRdBuffer(dli.m_handle, STREAM_RD_BUFFER_DEFAULT);
 
     dli.pCurParseFunc = parse_state_no_msg;
     while( next_line( &dli ) != EOF )
@@ -146,6 +146,18 @@ int MT_MSG_INI_settings(struct ini_parser *pINI,
         goto igood;
     }
 
+    if(INI_itemMatches(pINI, NULL, "reconnect-min-msecs"))
+    {
+        iptr = &(pMI->reconnect_min_mSecs);
+        goto igood;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "reconnect-max-msecs"))
+    {
+        iptr = &(pMI->reconnect_max_mSecs);
+        goto igood;
+    }
+
     if(INI_itemMatches(pINI, NULL, "len-2bytes"))
     {
         bptr = &pMI->len_2bytes;
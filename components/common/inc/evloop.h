@@ -0,0 +1,145 @@
+/******************************************************************************
+ @file evloop.h
+
+ @brief Readiness event loop, feeds a worker pool
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#if !defined(EVLOOP_H)
+#define EVLOOP_H
+
+/*!
+ * OVERVIEW
+ * ========
+ *
+ * An event loop is one thread that waits for many file descriptors
+ * (ie: accepted sockets) to become readable. When one is readable
+ * its callback is posted to a worker pool (see workers.h).
+ *
+ * Each descriptor is "one shot", it is not watched again until its
+ * callback returns, so at most one callback per descriptor runs at
+ * a time, and it sees the data in order. The callback should read
+ * what is available and return, not block waiting for more.
+ *
+ * This replaces a thread per connection with one thread plus a
+ * fixed number of workers.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*!
+ * @typedef evloop_ready_fn
+ * @brief Called (on a worker thread) when a descriptor is readable
+ * @param ev_h - the registration handle from EVLOOP_add()
+ * @param cookie - parameter given to EVLOOP_add()
+ */
+typedef void evloop_ready_fn(intptr_t ev_h, intptr_t cookie);
+
+/*!
+ * @brief Create an event loop
+ *
+ * @param dbg_name - name for debug purposes
+ * @param workers_h - the worker pool the callbacks run on
+ *
+ * @returns non-zero handle on success, 0 on error
+ */
+intptr_t EVLOOP_create(const char *dbg_name, intptr_t workers_h);
+
+/*!
+ * @brief Watch a file descriptor for readability
+ *
+ * @param h - handle from EVLOOP_create()
+ * @param fd - the file descriptor, see STREAM_SOCKET_getFd()
+ * @param pFunc - the ready callback
+ * @param cookie - parameter for the callback
+ *
+ * @returns non-zero registration handle on success, 0 on error
+ */
+intptr_t EVLOOP_add(intptr_t h, int fd, evloop_ready_fn *pFunc, intptr_t cookie);
+
+/*!
+ * @brief Stop watching a file descriptor
+ *
+ * @param ev_h - registration handle from EVLOOP_add()
+ *
+ * This must be called from within the ready callback (the only
+ * time it is known not to be running elsewhere) and before the
+ * descriptor is closed. The registration is released after the
+ * callback returns.
+ */
+void EVLOOP_remove(intptr_t ev_h);
+
+/*!
+ * @brief Stop the event loop and release all registrations
+ *
+ * @param h - handle from EVLOOP_create()
+ *
+ * The worker pool is not destroyed, callbacks already posted to it
+ * may still run, so destroy the workers first.
+ */
+void EVLOOP_destroy(intptr_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
@@ -137,6 +137,36 @@ uint64_t _TIMER_getAbsNow(void);
  */
 void _TIMER_sleep(uint32_t mSecs);
 
+/*
+ * @brief Get a monotonic (never jumps) clock in nano seconds.
+ * The starting point is arbitrary, only differences are meaningful.
+ */
+uint64_t _TIMER_getMonoNs(void);
+
+/*
+ * @brief Sleep for n nano seconds, against the monotonic clock.
+ */
+void _TIMER_sleepNs(uint64_t nSecs);
+
+/*
+ * @brief Create a high resolution waiter for the timer thread
+ * @returns 0 on error
+ */
+intptr_t _TIMER_waiterCreate(void);
+
+/*
+ * @brief Block until the timeout, or until _TIMER_waiterWake()
+ * @param h - from _TIMER_waiterCreate()
+ * @param timeout_nSecs - how long to wait
+ * @returns 1 if woken, 0 if the timeout occured
+ */
+int _TIMER_waiterWait(intptr_t h, uint64_t timeout_nSecs);
+
+/*
+ * @brief Wake up a waiter before its timeout
+ */
+void _TIMER_waiterWake(intptr_t h);
+
 /*
  * @brief Return the current thread id.
  */
@@ -146,11 +176,35 @@ intptr_t _THREAD_self(void);
  * @brief Create a thread
  * @param thread_func - the thread code
  * @param param - a parameter for the thread
+ * @param stack_size - stack size in bytes, 0 means the system default
  * Note: the thread runs when created.
  */
 intptr_t _THREAD_create(const char *dbg_name,
                         intptr_t (*thread_func)(intptr_t threadparam),
-                         intptr_t param);
+                        intptr_t param,
+                        size_t stack_size);
+
+/* forward decloration (see: threads.h) */
+struct thread_stats;
+
+/*
+ * @brief Get cpu time and context switch counts for a thread
+ * @param os_token - from _THREAD_create()
+ * @param pStats - filled in
+ * @returns 0 on success, negative if the thread is gone
+ */
+int      _THREAD_getStats(intptr_t os_token, struct thread_stats *pStats);
+
+/*
+ * @brief Set scheduling for the calling thread
+ * @param policy - one of THREAD_SCHED_* from threads.h
+ * @param priority - real time priority, for FIFO and RR
+ * @param nice - nice value, for OTHER
+ * @param cpu_mask - bit N allows cpu N, 0 means leave unchanged
+ * @returns 0 on success, otherwise an errno value
+ */
+int      _THREAD_setSched(int policy, int priority, int nice,
+                          uint64_t cpu_mask);
 
 /*
  * @brief The thread wants to exit instead of returning.
@@ -0,0 +1,138 @@
+/******************************************************************************
+ @file latch.h
+
+ @brief TIMAC 2.0 API One shot latch, wait for N events
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#if !defined(LATCH_H)
+#define LATCH_H
+
+/*!
+ * OVERVIEW
+ * ========
+ *
+ * A latch starts closed with a count, each LATCH_countDown() reduces
+ * the count and when it reaches zero the latch opens and stays open.
+ * Any number of threads may wait for it to open.
+ *
+ * This replaces "set a flag then poll with TIMER_sleep()" handshakes,
+ * waiters wake as soon as the latch opens, and sleep until then.
+ *
+ * Example: two threads that must both be ready before either starts
+ * share a latch with a count of 2, each counts down then waits.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*!
+ * @brief Create a latch
+ *
+ * @param dbg_name - name for debug purposes
+ * @param count - number of LATCH_countDown() calls needed to open it
+ *
+ * @returns non-zero handle on success, 0 on error
+ */
+intptr_t LATCH_create(const char *dbg_name, int count);
+
+/*!
+ * @brief Release a latch
+ *
+ * @param h - handle from LATCH_create()
+ *
+ * Nobody may be waiting on, or counting down, the latch.
+ */
+void LATCH_destroy(intptr_t h);
+
+/*!
+ * @brief Count down, opening the latch when the count reaches zero
+ *
+ * @param h - handle from LATCH_create()
+ *
+ * Counting down an open latch does nothing.
+ */
+void LATCH_countDown(intptr_t h);
+
+/*!
+ * @brief Wait for a latch to open
+ *
+ * @param h - handle from LATCH_create()
+ * @param timeout_mSecs - negative=forever, 0=non-blocking, >0 timeout
+ *
+ * @returns 1 if open, 0 on timeout, negative on error
+ */
+int LATCH_wait(intptr_t h, int timeout_mSecs);
+
+/*!
+ * @brief Test if a latch is open without waiting
+ *
+ * @param h - handle from LATCH_create()
+ *
+ * @returns true if open
+ */
+bool LATCH_isOpen(intptr_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
@@ -96,6 +96,33 @@ bool MUTEX_isLocked(intptr_t h);
  */
 const char *MUTEX_lockerName(intptr_t h);
 
+/*!
+ * @brief Enable or disable the lock contention profiler
+ *
+ * @param enable - true to start collecting statistics
+ *
+ * Statistics are kept per mutex name, so all mutexes created with
+ * the same name (ie: every "mi-tx-lock") are reported as one line.
+ * When disabled (the default) MUTEX_lock() does not read the clock.
+ */
+void MUTEX_profileEnable(bool enable);
+
+/*!
+ * @brief Log the contention profile via LOG_printf(LOG_ALWAYS)
+ *
+ * For each mutex name reports the number of acquisitions, how many
+ * were contended, the total and maximum wait time and the total and
+ * maximum hold time, with the name of the thread that held it longest.
+ * Lines are sorted by total wait time, worst first.
+ * It allocates and logs, do not call it from a signal handler.
+ */
+void MUTEX_profileReport(void);
+
+/*!
+ * @brief Reset all contention profile statistics to zero
+ */
+void MUTEX_profileClear(void);
+
 #endif
 
 /*
@@ -271,16 +271,53 @@ int STREAM_fputc(int c, intptr_t h);
  */
 int STREAM_fgetc(intptr_t h);
 
+/*!
+ * @def STREAM_UNGET_MAX
+ * @brief Number of bytes that can be pushed back with STREAM_ungetc()
+ */
+#define STREAM_UNGET_MAX  8
+
 /*!
  * @brief emulate stdio ungetc()
  * @param h - the io stream
  * @param c - the byte being ungot
  * @returns negative on error, or the byte value cast as an unsigned char.
  *
+ * Up to STREAM_UNGET_MAX bytes can be pushed back, they are read
+ * back in the reverse order they where pushed (same as stdio).
+ *
  * Note: This purposely has the same parameter order as fgetc()
  */
 int STREAM_ungetc(int c, intptr_t h);
 
+/*!
+ * @def STREAM_RD_BUFFER_DEFAULT
+ * @brief Suggested read buffer size for STREAM_setRdBuffer()
+ */
+#define STREAM_RD_BUFFER_DEFAULT  4096
+
+/*!
+ * @brief Give a stream a read buffer, or remove it.
+ * @param h - the io stream
+ * @param nbytes - size of the buffer, 0 removes the buffer.
+ * @returns negative on error, 0 on success
+ *
+ * By default streams are not buffered, and STREAM_fgetc() and
+ * STREAM_fgets() call the underlying stream once per byte.
+ * With a buffer, these read as many bytes as are available
+ * in one call and consume them from the buffer.
+ *
+ * STREAM_rdBytes() and STREAM_rxAvail() take buffered bytes into
+ * account, but code that polls the underlying file descriptor
+ * directly will not see bytes that are sitting in the buffer.
+ *
+ * Do not use this on interactive FILE streams (ie: a terminal)
+ * because filling the buffer could block for a full buffer.
+ *
+ * If the buffer is resized or removed any unread data is kept.
+ */
+int STREAM_setRdBuffer(intptr_t h, size_t nbytes);
+
 /*!
  * @brief Simple printf() access to the io stream
  * @param h - the io stream
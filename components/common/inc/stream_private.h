@@ -80,8 +80,21 @@ struct io_stream {
     /*! for use internal by stream specific funcs */
     intptr_t opaque_ptr;
 
-    /*! for use internal by the io stream to handle unget operations */
-    int      unget_buf;
+    /*! pushback bytes from STREAM_ungetc(), last in first out */
+    uint8_t  unget_buf[STREAM_UNGET_MAX];
+
+    /*! number of bytes in unget_buf */
+    int      n_unget;
+
+    /*! optional read buffer, see STREAM_setRdBuffer() */
+    uint8_t  *rd_buf;
+
+    /*! size of the rd_buf in bytes, 0 if not buffered */
+    size_t   rd_buf_size;
+
+    /*! bytes rd_buf[rd_head .. rd_tail-1] have not been consumed */
+    size_t   rd_head;
+    size_t   rd_tail;
 
     /* set to true when an error occurs. */
     bool     is_error;
@@ -0,0 +1,178 @@
+/******************************************************************************
+ @file stream_shm.h
+
+ @brief TIMAC 2.0 API Header for streams that are shared memory rings
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#if !defined(STREAM_SHM_H)
+#define STREAM_SHM_H
+
+/*!
+ * OVERVIEW
+ * ========
+ *
+ * A shared memory stream connects two processes on the same host
+ * through a pair of byte rings in a POSIX shared memory object
+ * (see "man 3 shm_open"), one ring for each direction.
+ *
+ * The creator ('s') makes and initializes the shared memory object,
+ * the other side ('c') attaches to it. After that both sides use the
+ * normal STREAM_rdBytes() and STREAM_wrBytes() calls.
+ *
+ * Data is copied directly into and out of the ring, there is no
+ * system call unless one side must sleep because the ring is empty
+ * (reader) or full (writer), in which case a futex is used to wake
+ * the sleeping side.
+ *
+ * Unlike a socket there is no disconnect notification. Instead the
+ * client notices when the creator closes the object, is replaced by a
+ * new creator (which marks the old object stale before it unlinks it),
+ * or its process no longer exists (checked at least once a second
+ * while waiting). The client stream is then in error, reads and writes
+ * fail until STREAM_reattachShm() succeeds. The creator is not told
+ * if the client dies, the stream simply goes quiet.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*!
+ * @struct shm_cfg
+ *
+ * @brief How a shared memory stream is configured.
+ */
+struct shm_cfg {
+    /*! Name of the shared memory object, example: "/npi_server2" */
+    const char *name;
+
+    /*! Set cs to the a letter representing the side of the stream
+     * - set to 's' to create the shared memory (ie: server)
+     * - set to 'c' to attach to an existing one (ie: client)
+     */
+    int cs;
+
+    /*! Size in bytes of each ring, must be a power of 2.
+     * Zero selects STREAM_SHM_DEFAULT_RING_SIZE
+     */
+    size_t ring_size;
+
+    /*! Client only, how long to wait for the creator to appear */
+    int attach_timeout_mSecs;
+};
+
+/*!
+ * @def STREAM_SHM_DEFAULT_RING_SIZE
+ * @hideinitializer
+ * @brief Ring size used when the configuration does not specify one
+ */
+#define STREAM_SHM_DEFAULT_RING_SIZE (64 * 1024)
+
+/*!
+ * @brief Create (or attach to) a shared memory stream
+ *
+ * @param pCFG - the configuration to use.
+ *
+ * @returns non-zero on success
+ */
+intptr_t STREAM_createShm(const struct shm_cfg *pCFG);
+
+/*!
+ * @brief Test if this stream is a shared memory stream or not
+ * @param h - the io stream to test
+ * @returns true if io stream is shared memory
+ */
+bool STREAM_isShm(intptr_t h);
+
+/*!
+ * @brief Attach a client stream again, after the creator went away
+ *
+ * @param h - a client ('c') shared memory stream
+ *
+ * @returns 0 on success, negative if there is no (ready) object yet
+ *
+ * Does not wait for the creator, the caller retries. The handle stays
+ * the same, but nothing may read or write the stream during the call.
+ * On success the error state is cleared and both rings start empty
+ * as seen by the new creator.
+ */
+int STREAM_reattachShm(intptr_t h);
+
+/* forward decloration */
+struct ini_parser;
+
+/*
+ * @brief Handle INI File settings for a shared memory stream.
+ *
+ * This function ignores the section name.
+ *
+ * @param pINI - ini file parse information
+ * @param handled - set to true if this settings was handled.
+ * @param pCfg - the configuration to structure to fill in.
+ * @returns negative on error
+ *
+ * This parses a configuration like this:
+ *     [some-section]
+ *        type = server (or client)
+ *        name = /some/name
+ *        ring-size = VALUE
+ *        attach-timeout-msecs = VALUE
+ */
+int SHM_INI_settingsOne(struct ini_parser *pINI,
+                         bool *handled,
+                         struct shm_cfg *pCfg);
+
+#endif
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
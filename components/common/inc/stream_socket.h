@@ -59,6 +59,15 @@
  * the appropriate function calls, etc, it is just that the INET6 code path
  * has not been tested. Thus for INET6: Your milage may vary
  *
+ * UNIX Domain Support
+ * ===================
+ * When all processes run on the same host (ie: the collector and the
+ * npi_server2 on one board) set inet_4or6 to 'u' ("inet = unix" in the
+ * INI file) to use an AF_UNIX stream socket instead of TCP loopback.
+ * In this mode the "host" is the socket path, and the "service" is
+ * not used. A path starting with '@' selects the Linux abstract
+ * namespace, ie: "@npi_server2" does not create a file in the filesystem.
+ *
  * Client Mode
  * ===========
  * To use this in a client mode, you generally do this:
@@ -156,6 +165,13 @@
 
 #include <stdbool.h>
 
+/*!
+ * @def SOCKET_INET_UNIX
+ * @hideinitializer
+ * @brief Value for socket_cfg.inet_4or6 that selects a unix domain socket
+ */
+#define SOCKET_INET_UNIX 'u'
+
 /*!
  * @struct socket_cfg
  *
@@ -175,6 +191,7 @@ struct socket_cfg {
     *  0 - pick randomly any form that works.
     *  4 - pick only inet4 protocol
     *  6 - pick only inet6 protocol
+    *  'u' - unix domain socket, see SOCKET_INET_UNIX
     */
     int        inet_4or6;
 
@@ -191,6 +208,9 @@ struct socket_cfg {
      *  For clients what server connect to
      * The underling api uses "man 3 getaddrinfo"
      * SEE: http://linux.die.net/man/3/getaddrinfo
+     *
+     * For unix domain sockets, this is the socket path
+     * a leading '@' means the path is in the abstract namespace.
      */
     const char  *host;
     /*! What service (port number) to use
@@ -241,6 +261,16 @@ bool STREAM_isSocket(intptr_t h);
  */
 bool STREAM_SOCKET_isConnected(intptr_t h);
 
+/*!
+ * @brief Get the operating system file descriptor of a socket
+ * @param h - the socket in question.
+ * @returns -1 if not a socket (or not open), otherwise the descriptor
+ *
+ * This is for use with poll() style event loops (see evloop.h),
+ * all IO should still be done with the STREAM functions.
+ */
+int STREAM_SOCKET_getFd(intptr_t h);
+
 /*!
  * @brief Create a client socket [that connects to a server]
  * @param cfg - configuration details.
@@ -252,9 +282,35 @@ intptr_t SOCKET_CLIENT_create(struct socket_cfg *pCFG);
  * @brief Connect a socket to a server.
  * @param h - handle from SOCKET_CLIENT_create()
  * @param return 0 on success
+ *
+ * This blocks until the connection succeeds or all addresses fail,
+ * see SOCKET_CLIENT_connectStart() for the non-blocking form.
  */
 int SOCKET_CLIENT_connect(intptr_t h);
 
+/*!
+ * @brief Start a non-blocking connect to the server
+ * @param h - handle from SOCKET_CLIENT_create()
+ * @returns negative on error, 0 if in progress, 1 if connected
+ *
+ * If 0 is returned, call SOCKET_CLIENT_connectPoll() until it
+ * returns non-zero. Any existing connection is closed first.
+ *
+ * Note: The host name lookup (getaddrinfo) is not asynchronous.
+ */
+int SOCKET_CLIENT_connectStart(intptr_t h);
+
+/*!
+ * @brief Wait for a connect started by SOCKET_CLIENT_connectStart()
+ * @param h - handle from SOCKET_CLIENT_create()
+ * @param timeout_mSecs - how long to wait, see the timeout mSec rule
+ * @returns negative on error, 0 if still in progress, 1 if connected
+ *
+ * If the host has multiple addresses, a failed address moves on
+ * to the next address and 0 (in progress) is returned.
+ */
+int SOCKET_CLIENT_connectPoll(intptr_t h, int timeout_mSecs);
+
 /*!
  * @def SOCKET_CLIENT_Destroy
  * @hideinitializer
@@ -48,6 +48,7 @@
 
 #include "bitsnbits.h"
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 /*!
@@ -60,6 +61,118 @@ typedef intptr_t threadfunc_t(intptr_t cookie);
 #define THREAD_FLAGS_DEFAULT  0 /*! default flags when creating a thread */
 #define THREAD_FLAGS_JOINABLE _bit0 /*! make the thread joinable */
 
+#define THREAD_SCHED_DEFAULT  0 /*! inherit scheduling from the creator */
+#define THREAD_SCHED_OTHER    1 /*! normal time sharing, uses nice */
+#define THREAD_SCHED_FIFO     2 /*! real time, uses priority */
+#define THREAD_SCHED_RR       3 /*! real time round robin, uses priority */
+
+/*!
+ * @struct thread_cfg
+ * @brief Scheduling settings applied to threads by name
+ *
+ * When a thread is created its name is compared with each
+ * configuration, the first match is applied to the new thread.
+ */
+struct thread_cfg {
+    /*! thread name to match, a trailing '*' matches a prefix */
+    const char *name;
+
+    /*! One of THREAD_SCHED_* */
+    int sched_policy;
+
+    /*! real time priority (1..99) for FIFO and RR */
+    int sched_priority;
+
+    /*! nice value (-20..19) for OTHER */
+    int nice;
+
+    /*! bit N allows the thread to run on cpu N, 0 means any cpu */
+    uint64_t cpu_mask;
+
+    /*! stack size in bytes, 0 means the system default */
+    size_t stack_size;
+};
+
+/*!
+ * @struct thread_stats
+ * @brief Resource usage of a thread, see THREAD_getStats()
+ */
+struct thread_stats {
+    /*! cpu time used (user + system) */
+    uint64_t cpu_nSecs;
+
+    /*! times the thread blocked, each is followed by a wakeup */
+    uint64_t n_voluntary;
+
+    /*! times the thread was preempted while it wanted to run */
+    uint64_t n_involuntary;
+};
+
+/*!
+ * @def INI_MAX_THREAD_CFGS
+ * @brief Number of [thread-N] sections supported
+ */
+#define INI_MAX_THREAD_CFGS 10
+
+/*!
+ * @var ALL_INI_THREADS
+ * @brief Thread settings from the [thread-N] sections of an INI file
+ */
+extern struct thread_cfg ALL_INI_THREADS[INI_MAX_THREAD_CFGS];
+
+/* forward decloration */
+struct ini_parser;
+
+/*!
+ * @brief Handle the INI file settings for [thread-N] sections
+ *
+ * @param pINI - ini file parse information
+ * @param handled - set to true if this setting was handled
+ *
+ * @returns 0 on success, negative on error
+ *
+ * Example:
+ *
+ * \verbatim
+ *     [thread-0]
+ *         name = timer-thread
+ *         policy = fifo
+ *         priority = 50
+ *         cpus = 1
+ *     [thread-1]
+ *         name = appsrv-worker*
+ *         policy = other
+ *         nice = 5
+ *         cpus = 2 3
+ *         stack-size = 65536
+ * \endverbatim
+ *
+ * Settings apply to threads created after the file is read.
+ */
+int THREAD_INI_settingsNth(struct ini_parser *pINI, bool *handled);
+
+/*!
+ * @brief building block for THREAD_INI_settingsNth()
+ *
+ * @param pINI - ini file parse information
+ * @param handled - set to true if this setting was handled
+ * @param pCFG - the thread configuration to fill in
+ *
+ * @returns 0 on success, negative on error
+ */
+int THREAD_INI_settingsOne(struct ini_parser *pINI,
+                           bool *handled,
+                           struct thread_cfg *pCFG);
+
+/*!
+ * @brief Find the configuration for a thread name
+ *
+ * @param name - the thread name
+ *
+ * @returns NULL if no configuration matches
+ */
+const struct thread_cfg *THREAD_cfgFind(const char *name);
+
 /*!
  * @brief Create a thread
  *
@@ -98,6 +211,17 @@ void     THREAD_exit(intptr_t exit_code);
  */
 bool     THREAD_isAlive(intptr_t h);
 
+/*!
+ * @brief Wait for a thread to exit
+ * @param h - thread ID
+ * @param timeout_mSecs - negative=forever, 0=non-blocking, >0 timeout
+ * @return 1 if the thread has exited, 0 on timeout, negative on error
+ *
+ * Unlike polling THREAD_isAlive() this returns as soon as the
+ * thread exits, and does not wake up until then.
+ */
+int      THREAD_join(intptr_t h, int timeout_mSecs);
+
 /*!
  * @brief Get the exit code of a thread
  * @param - thread id to get exit code of
@@ -105,6 +229,22 @@ bool     THREAD_isAlive(intptr_t h);
  */
 intptr_t THREAD_getExitValue(intptr_t h);
 
+/*!
+ * @brief Get the resource usage of a thread
+ * @param h - thread id
+ * @param pStats - filled in, all zero on error
+ * @return 0 on success, negative if not a thread or not running
+ */
+int      THREAD_getStats(intptr_t h, struct thread_stats *pStats);
+
+/*!
+ * @brief Log the resource usage of all threads via LOG_printf(LOG_ALWAYS)
+ *
+ * Each line shows the totals and the cpu load and wakeup rate
+ * since the previous report.
+ */
+void     THREAD_statsReport(void);
+
 /*!
  * @brief Get debug name of this thread
  * @param h - thread handle
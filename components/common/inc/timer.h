@@ -104,6 +104,19 @@ uint64_t TIMER_getEpoch(void);
  */
 uint32_t TIMER_getNow(void);
 
+/*!
+ * @brief Get the run time in nSecs from the epoch
+ *
+ * This is a monotonic clock, it does not jump if the wall clock
+ * is changed and it does not wrap. TIMER_getNow() is this value
+ * in mSecs (truncated to 32bits).
+ *
+ * Use this for latency measurements and other sub-millisecond work.
+ *
+ * @returns runtime in nSecs since the epoch
+ */
+uint64_t TIMER_getNowNs(void);
+
 /*!
  * @brief Get wall-clocktime, as reported by the system
  *
@@ -195,6 +208,10 @@ typedef void timer_callback_fn(intptr_t tmr_h, intptr_t cookie);
  * 0 .. (UINT32_MAX/2) in milliseconds.
  * This amounts to approximately 22 days on a 32bit machine.
  *
+ * Periodic timers are rescheduled from when they should have expired
+ * not from when the callback ran, so they do not drift. If a period
+ * is missed entirely (ie: a very slow callback) it is skipped.
+ *
  * @return non-zero handle upon success, 0 on failure.
  */
 intptr_t  TIMER_CB_create(const char *dbg_name,
@@ -229,6 +246,36 @@ bool TIMER_CB_isValid(intptr_t h);
  */
 int TIMER_CB_getRemain(intptr_t h);
 
+/*! Number of buckets in the timer callback jitter histogram */
+#define TIMER_CB_JITTER_BUCKETS 5
+
+/*
+ * @struct timer_cb_stats
+ * @brief How late timer callbacks are, compared to when they should run
+ */
+struct timer_cb_stats {
+    /*! number of callbacks made */
+    uint64_t n_fired;
+    /*! sum of all the jitter, divide by n_fired for the average */
+    uint64_t jitter_total_nSecs;
+    /*! the worst case */
+    uint64_t jitter_max_nSecs;
+    /*! count of callbacks: <10uS, <100uS, <1mS, <10mS, >= 10mS late */
+    uint32_t jitter_histogram[TIMER_CB_JITTER_BUCKETS];
+};
+
+/*
+ * @brief Get the callback timer jitter statistics
+ *
+ * @param pStats - where to put the statistics
+ */
+void TIMER_CB_getStats(struct timer_cb_stats *pStats);
+
+/*
+ * @brief Reset the callback timer jitter statistics
+ */
+void TIMER_CB_clearStats(void);
+
 #endif
 
 /*
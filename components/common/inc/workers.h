@@ -0,0 +1,138 @@
+/******************************************************************************
+ @file workers.h
+
+ @brief A fixed size pool of worker threads
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#if !defined(WORKERS_H)
+#define WORKERS_H
+
+/*!
+ * OVERVIEW
+ * ========
+ *
+ * A worker pool is a fixed number of threads that run jobs posted
+ * to a shared queue. It is used when the amount of work (ie: the
+ * number of client connections) grows, but the number of threads
+ * and their stacks should not.
+ *
+ * Jobs run in the order posted, but with more then one worker two
+ * jobs may run at the same time; jobs that must not overlap need
+ * their own locking (or see EVLOOP, which never runs two callbacks
+ * for the same file descriptor at once).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*!
+ * @typedef workers_job_fn
+ * @brief A job to run on a worker thread
+ * @param cookie - parameter given to WORKERS_post()
+ */
+typedef void workers_job_fn(intptr_t cookie);
+
+/*!
+ * @brief Create a pool of worker threads
+ *
+ * @param dbg_name - name for debug purposes, threads are named from this
+ * @param n_threads - number of worker threads, must be > 0
+ *
+ * @returns non-zero handle on success, 0 on error
+ */
+intptr_t WORKERS_create(const char *dbg_name, int n_threads);
+
+/*!
+ * @brief Queue a job to be run by a worker
+ *
+ * @param h - handle from WORKERS_create()
+ * @param pFunc - the job function
+ * @param cookie - parameter for the job function
+ *
+ * @returns 0 on success, negative on error
+ */
+int WORKERS_post(intptr_t h, workers_job_fn *pFunc, intptr_t cookie);
+
+/*!
+ * @brief How many jobs are waiting for a worker?
+ *
+ * @param h - handle from WORKERS_create()
+ *
+ * @returns negative if invalid, otherwise the queue depth
+ */
+int WORKERS_pending(intptr_t h);
+
+/*!
+ * @brief Stop the workers and release the pool
+ *
+ * @param h - handle from WORKERS_create()
+ *
+ * Jobs already running are allowed to finish, jobs that have not
+ * yet started are discarded. Must not be called from a worker.
+ */
+void WORKERS_destroy(intptr_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
@@ -0,0 +1,470 @@
+/******************************************************************************
+ @file linux_evloop.c
+
+ @brief Linux (epoll) readiness event loop
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#include "compiler.h"
+#include "evloop.h"
+#include "workers.h"
+#include "log.h"
+#include "mutex.h"
+#include "threads.h"
+#include "ti_semaphore.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/*! Max number of events handled per epoll_wait() */
+#define EVLOOP_MAX_EVENTS 32
+
+static const int evloop_check = 'E';
+static const int evloop_reg_check = 'e';
+
+struct evloop;
+
+/*!
+ * @struct evloop_reg
+ * @brief A watched file descriptor
+ */
+struct evloop_reg {
+    /*! used to verify this is a registration */
+    const int *test_ptr;
+    /*! the loop we belong to */
+    struct evloop *pEV;
+    /*! the descriptor */
+    int fd;
+    /*! callback when readable */
+    evloop_ready_fn *pFunc;
+    /*! parameter for the callback */
+    intptr_t cookie;
+    /*! set by EVLOOP_remove(), released after the callback */
+    bool removed;
+    /*! all registrations are in a list */
+    struct evloop_reg *pNext;
+};
+
+/*!
+ * @struct evloop
+ * @brief Private event loop implimentation details
+ */
+struct evloop {
+    /*! used to verify this is an event loop */
+    const int *test_ptr;
+    /*! name for debug purposes */
+    const char *dbg_name;
+    /*! the epoll descriptor */
+    int epfd;
+    /*! eventfd used to wake the loop thread when destroying */
+    int wake_fd;
+    /*! callbacks are run by these workers */
+    intptr_t workers_h;
+    /*! protects the registration list */
+    intptr_t lock;
+    /*! the loop thread */
+    intptr_t thread_id;
+    /*! the loop thread puts here when it exits */
+    intptr_t exit_sem;
+    /*! set when being destroyed */
+    bool is_dead;
+    /*! all registrations */
+    struct evloop_reg *pRegs;
+};
+
+/*!
+ * @brief convert a handle into an event loop pointer
+ * @param h - the handle
+ * @returns NULL if not valid
+ */
+static struct evloop *h2ev(intptr_t h)
+{
+    struct evloop *pEV;
+
+    pEV = (struct evloop *)(h);
+    if(pEV)
+    {
+        if(pEV->test_ptr != &evloop_check)
+        {
+            LOG_printf(LOG_ERROR, "not an event loop: %p\n", (void *)(pEV));
+            pEV = NULL;
+        }
+    }
+    return (pEV);
+}
+
+/*!
+ * @brief convert a handle into a registration pointer
+ * @param h - the handle
+ * @returns NULL if not valid
+ */
+static struct evloop_reg *h2reg(intptr_t h)
+{
+    struct evloop_reg *pR;
+
+    pR = (struct evloop_reg *)(h);
+    if(pR)
+    {
+        if(pR->test_ptr != &evloop_reg_check)
+        {
+            LOG_printf(LOG_ERROR, "not an event: %p\n", (void *)(pR));
+            pR = NULL;
+        }
+    }
+    return (pR);
+}
+
+/*!
+ * @brief Arm (or re-arm) a one shot registration
+ * @param pR - the registration
+ * @param op - EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * @returns 0 on success
+ */
+static int _evloop_arm(struct evloop_reg *pR, int op)
+{
+    struct epoll_event ev;
+    int r;
+
+    memset((void *)(&ev), 0, sizeof(ev));
+    ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = (void *)(pR);
+    r = epoll_ctl(pR->pEV->epfd, op, pR->fd, &ev);
+    if(r != 0)
+    {
+        LOG_printf(LOG_ERROR, "%s: epoll_ctl(fd=%d) %s\n",
+                   pR->pEV->dbg_name, pR->fd, strerror(errno));
+    }
+    return (r);
+}
+
+/*!
+ * @brief Unlink and release a registration, the lock must be held
+ * @param pR - the registration
+ */
+static void _evloop_reg_free(struct evloop_reg *pR)
+{
+    struct evloop_reg **ppR;
+
+    for(ppR = &(pR->pEV->pRegs) ; *ppR ; ppR = &((*ppR)->pNext))
+    {
+        if(*ppR == pR)
+        {
+            *ppR = pR->pNext;
+            break;
+        }
+    }
+    memset((void *)(pR), 0, sizeof(*pR));
+    free((void *)(pR));
+}
+
+/*!
+ * @brief Worker job, runs the ready callback then re-arms
+ * @param cookie - the registration in disguise
+ */
+static void evloop_job(intptr_t cookie)
+{
+    struct evloop_reg *pR;
+    struct evloop *pEV;
+
+    pR  = (struct evloop_reg *)(cookie);
+    pEV = pR->pEV;
+
+    (*(pR->pFunc))((intptr_t)(pR), pR->cookie);
+
+    MUTEX_lock(pEV->lock, -1);
+    if(pR->removed)
+    {
+        _evloop_reg_free(pR);
+    }
+    else
+    {
+        (void)_evloop_arm(pR, EPOLL_CTL_MOD);
+    }
+    MUTEX_unLock(pEV->lock);
+}
+
+/*!
+ * @brief The event loop thread
+ * @param cookie - the event loop in disguise
+ * @returns nothing useful
+ */
+static intptr_t evloop_thread(intptr_t cookie)
+{
+    struct evloop *pEV;
+    struct epoll_event events[EVLOOP_MAX_EVENTS];
+    int n;
+    int x;
+
+    pEV = (struct evloop *)(cookie);
+
+    while(!(pEV->is_dead))
+    {
+        n = epoll_wait(pEV->epfd, events, EVLOOP_MAX_EVENTS, -1);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            LOG_printf(LOG_ERROR, "%s: epoll_wait() %s\n",
+                       pEV->dbg_name, strerror(errno));
+            break;
+        }
+        for(x = 0 ; x < n ; x++)
+        {
+            /* the wake_fd has no registration */
+            if(events[x].data.ptr == NULL)
+            {
+                continue;
+            }
+            if(WORKERS_post(pEV->workers_h,
+                            evloop_job,
+                            (intptr_t)(events[x].data.ptr)) != 0)
+            {
+                LOG_printf(LOG_ERROR, "%s: cannot post event\n",
+                           pEV->dbg_name);
+            }
+        }
+    }
+    SEMAPHORE_put(pEV->exit_sem);
+    return (0);
+}
+
+/*
+ * Create an event loop
+ *
+ * Public function defined in evloop.h
+ */
+intptr_t EVLOOP_create(const char *dbg_name, intptr_t workers_h)
+{
+    struct evloop *pEV;
+    struct epoll_event ev;
+
+    pEV = calloc(1, sizeof(*pEV));
+    if(pEV == NULL)
+    {
+        LOG_printf(LOG_ERROR, "no memory for event loop\n");
+        return (0);
+    }
+    if(dbg_name == NULL)
+    {
+        dbg_name = "evloop";
+    }
+    pEV->test_ptr  = &evloop_check;
+    pEV->workers_h = workers_h;
+    pEV->dbg_name  = strdup(dbg_name);
+    pEV->epfd      = epoll_create1(EPOLL_CLOEXEC);
+    pEV->wake_fd   = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    pEV->lock      = MUTEX_create(dbg_name);
+    pEV->exit_sem  = SEMAPHORE_create(dbg_name, 0);
+    if((pEV->dbg_name == NULL) ||
+       (pEV->epfd     <  0   ) ||
+       (pEV->wake_fd  <  0   ) ||
+       (pEV->lock     == 0   ) ||
+       (pEV->exit_sem == 0   ))
+    {
+        LOG_printf(LOG_ERROR, "%s: cannot create event loop\n", dbg_name);
+        EVLOOP_destroy((intptr_t)(pEV));
+        return (0);
+    }
+
+    memset((void *)(&ev), 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;
+    if(epoll_ctl(pEV->epfd, EPOLL_CTL_ADD, pEV->wake_fd, &ev) != 0)
+    {
+        LOG_printf(LOG_ERROR, "%s: epoll_ctl() %s\n",
+                   dbg_name, strerror(errno));
+        EVLOOP_destroy((intptr_t)(pEV));
+        return (0);
+    }
+
+    /* the thread last, because it will run */
+    pEV->thread_id = THREAD_create(dbg_name,
+                                   evloop_thread,
+                                   (intptr_t)(pEV),
+                                   THREAD_FLAGS_DEFAULT);
+    if(pEV->thread_id == 0)
+    {
+        EVLOOP_destroy((intptr_t)(pEV));
+        return (0);
+    }
+    return ((intptr_t)(pEV));
+}
+
+/*
+ * Watch a file descriptor
+ *
+ * Public function defined in evloop.h
+ */
+intptr_t EVLOOP_add(intptr_t h, int fd, evloop_ready_fn *pFunc, intptr_t cookie)
+{
+    struct evloop *pEV;
+    struct evloop_reg *pR;
+
+    pEV = h2ev(h);
+    if((pEV == NULL) || (fd < 0))
+    {
+        return (0);
+    }
+
+    pR = calloc(1, sizeof(*pR));
+    if(pR == NULL)
+    {
+        LOG_printf(LOG_ERROR, "%s: no memory for event\n", pEV->dbg_name);
+        return (0);
+    }
+    pR->test_ptr = &evloop_reg_check;
+    pR->pEV      = pEV;
+    pR->fd       = fd;
+    pR->pFunc    = pFunc;
+    pR->cookie   = cookie;
+
+    MUTEX_lock(pEV->lock, -1);
+    pR->pNext  = pEV->pRegs;
+    pEV->pRegs = pR;
+    if(_evloop_arm(pR, EPOLL_CTL_ADD) != 0)
+    {
+        _evloop_reg_free(pR);
+        pR = NULL;
+    }
+    MUTEX_unLock(pEV->lock);
+
+    return ((intptr_t)(pR));
+}
+
+/*
+ * Stop watching a file descriptor
+ *
+ * Public function defined in evloop.h
+ */
+void EVLOOP_remove(intptr_t ev_h)
+{
+    struct evloop_reg *pR;
+
+    pR = h2reg(ev_h);
+    if(pR == NULL)
+    {
+        return;
+    }
+    MUTEX_lock(pR->pEV->lock, -1);
+    (void)epoll_ctl(pR->pEV->epfd, EPOLL_CTL_DEL, pR->fd, NULL);
+    pR->removed = true;
+    MUTEX_unLock(pR->pEV->lock);
+}
+
+/*
+ * Release an event loop
+ *
+ * Public function defined in evloop.h
+ */
+void EVLOOP_destroy(intptr_t h)
+{
+    struct evloop *pEV;
+    uint64_t v;
+    ssize_t n;
+
+    pEV = h2ev(h);
+    if(pEV == NULL)
+    {
+        return;
+    }
+
+    pEV->is_dead = true;
+    if(pEV->thread_id)
+    {
+        v = 1;
+        n = write(pEV->wake_fd, (const void *)(&v), sizeof(v));
+        (void)(n);
+        SEMAPHORE_waitWithTimeout(pEV->exit_sem, -1);
+        THREAD_destroy(pEV->thread_id);
+        pEV->thread_id = 0;
+    }
+
+    if(pEV->lock)
+    {
+        MUTEX_lock(pEV->lock, -1);
+        while(pEV->pRegs)
+        {
+            _evloop_reg_free(pEV->pRegs);
+        }
+        MUTEX_unLock(pEV->lock);
+        MUTEX_destroy(pEV->lock);
+    }
+    if(pEV->exit_sem)
+    {
+        SEMAPHORE_destroy(pEV->exit_sem);
+    }
+    if(pEV->wake_fd >= 0)
+    {
+        close(pEV->wake_fd);
+    }
+    if(pEV->epfd >= 0)
+    {
+        close(pEV->epfd);
+    }
+    if(pEV->dbg_name)
+    {
+        free_const((const void *)(pEV->dbg_name));
+    }
+    memset((void *)(pEV), 0, sizeof(*pEV));
+    free((void *)(pEV));
+}
+
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
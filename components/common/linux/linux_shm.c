@@ -0,0 +1,971 @@
+/******************************************************************************
+ @file linux_shm.c
+
+ @brief TIMAC 2.0 API Linux specific HLOS implimentation for shared memory stream
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#include "compiler.h"
+#include "stream.h"
+#include "stream_shm.h"
+#include "log.h"
+#include "timer.h"
+#include "void_ptr.h"
+
+#define _STREAM_IMPLIMENTOR_ 1
+#include "stream_private.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+/*!
+ * @var [private] test variable to determine if stream is shm or not
+ */
+static const int shm_test = 'H';
+
+/*!
+ * @def SHM_MAGIC
+ * @brief Written last by the creator, the client waits for this value.
+ */
+#define SHM_MAGIC 0x53484d31 /* "SHM1" */
+
+/*!
+ * @def SHM_PEER_CHECK_MSECS
+ * @brief A client sleeps at most this long before checking the creator
+ */
+#define SHM_PEER_CHECK_MSECS 1000
+
+/*!
+ * @struct shm_ring
+ *
+ * One direction of the stream, lives in the shared memory.
+ *
+ * The head and tail are free running byte counters, the position
+ * within the ring is the counter modulo the (power of 2) ring size.
+ * Each is on its own cache line so the writer and reader do not
+ * fight over the same line.
+ */
+struct shm_ring {
+    /*! total bytes written, only changed by the writer */
+    volatile uint32_t head;
+    /*! set by the reader before it sleeps on head */
+    volatile uint32_t rd_waiting;
+    uint32_t _pad0[14];
+
+    /*! total bytes read, only changed by the reader */
+    volatile uint32_t tail;
+    /*! set by the writer before it sleeps on tail */
+    volatile uint32_t wr_waiting;
+    uint32_t _pad1[14];
+};
+
+/*!
+ * @struct shm_header
+ *
+ * Start of the shared memory object, the ring data follows this.
+ */
+struct shm_header {
+    /*! SHM_MAGIC once the creator has initialized everything */
+    volatile uint32_t magic;
+    /*! size of each ring in bytes */
+    uint32_t ring_size;
+    /*! process ID of the creator */
+    uint32_t owner_pid;
+    /*! set when the creator closes, or a new creator replaces it */
+    volatile uint32_t stale;
+    uint32_t _pad[12];
+    /*! [0] is written by the creator, [1] by the client */
+    struct shm_ring ring[2];
+};
+
+/*!
+ * @struct linux_shm
+ *
+ * Private details for a shared memory stream on Linux
+ */
+struct linux_shm {
+    /*! Parent owning stream */
+    struct io_stream *pParent;
+    /*! used to verify pointer, should point to shm_test */
+    const int  *test_ptr;
+
+    /*! our configuration */
+    struct shm_cfg cfg;
+
+    /*! shm file descriptor */
+    int h;
+
+    /*! the mapping and its size */
+    struct shm_header *pHdr;
+    size_t map_size;
+
+    /*! the rings as seen from this side */
+    struct shm_ring *pTx;
+    struct shm_ring *pRx;
+    uint8_t *pTxData;
+    uint8_t *pRxData;
+    uint32_t mask;
+};
+
+/*!
+ * @brief [private] wait on a futex word in shared memory
+ * @param pWord - the futex word
+ * @param val - sleep only if the word still has this value
+ * @param mSecs - timeout, negative means forever
+ * @returns true if the timeout expired
+ */
+static bool _shm_futex_wait(volatile uint32_t *pWord, uint32_t val, int mSecs)
+{
+    struct timespec ts;
+    struct timespec *pTs;
+
+    pTs = NULL;
+    if(mSecs >= 0)
+    {
+        ts.tv_sec  = mSecs / 1000;
+        ts.tv_nsec = (mSecs % 1000) * 1000000L;
+        pTs = &ts;
+    }
+    /* not FUTEX_WAIT_PRIVATE, the other side is another process */
+    if(syscall(SYS_futex, pWord, FUTEX_WAIT, val, pTs, NULL, 0) != 0)
+    {
+        return (errno == ETIMEDOUT);
+    }
+    return (false);
+}
+
+/*!
+ * @brief [private] wake everybody sleeping on a futex word
+ * @param pWord - the futex word
+ */
+static void _shm_futex_wake(volatile uint32_t *pWord)
+{
+    (void)syscall(SYS_futex, pWord, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*!
+ * @brief [private] Mark an object stale and wake everybody sleeping on it
+ * @param pHdr - the mapped header
+ */
+static void _shm_markStale(struct shm_header *pHdr)
+{
+    int x;
+
+    __atomic_store_n(&(pHdr->stale), 1, __ATOMIC_SEQ_CST);
+    for(x = 0 ; x < 2 ; x++)
+    {
+        _shm_futex_wake(&(pHdr->ring[x].head));
+        _shm_futex_wake(&(pHdr->ring[x].tail));
+    }
+}
+
+/*!
+ * @brief [private] how many milliseconds are left of a timeout
+ * @param tstart - from TIMER_getNow()
+ * @param mSecs_timeout - the total timeout, negative is forever
+ * @returns remaining, or negative for forever
+ */
+static int _shm_remain(uint32_t tstart, int mSecs_timeout)
+{
+    uint32_t used;
+
+    if(mSecs_timeout < 0)
+    {
+        return (-1);
+    }
+    used = TIMER_getNow() - tstart;
+    if(used >= (uint32_t)(mSecs_timeout))
+    {
+        return (0);
+    }
+    return (mSecs_timeout - (int)(used));
+}
+
+/*!
+ * @brief [private] Convert a io_stream to a Linux shm Pointer
+ * @param pIO - the io stream
+ * @return linux shm pointer, or NULL if not valid
+ */
+static struct linux_shm *_shm_pio_to_pls(struct io_stream *pIO)
+{
+    struct linux_shm *pLS;
+
+    if(pIO == NULL)
+    {
+        return (NULL);
+    }
+    pLS = (struct linux_shm *)(pIO->opaque_ptr);
+    if(pLS)
+    {
+        if(pLS->test_ptr != &shm_test)
+        {
+            pLS = NULL;
+        }
+    }
+    return (pLS);
+}
+
+/*!
+ * @brief get the linux shm struct from the stream
+ * @param pIO - the io stream
+ * @returns linux shm struct.
+ */
+static struct linux_shm *shm_pio_to_pls(struct io_stream *pIO)
+{
+    struct linux_shm *pLS;
+
+    pLS = _shm_pio_to_pls(pIO);
+    if(pLS == NULL)
+    {
+        LOG_printf(LOG_ERROR, "not a shm: %p\n", (void *)(pIO));
+    }
+    return (pLS);
+}
+
+/*
+  Determine if this is a shm handle.
+  public function in stream_shm.h
+*/
+bool STREAM_isShm(intptr_t h)
+{
+    if(_shm_pio_to_pls(STREAM_hToStruct(h)))
+    {
+        return (true);
+    }
+    else
+    {
+        return (false);
+    }
+}
+
+/*!
+ * @brief Common routine to log a shm error
+ * @param pLS - the linux shm
+ * @param msg1 - message
+ * @param msg2 - second message (or null)
+ */
+static void _shm_error(struct linux_shm *pLS,
+                        const char *msg1, const char *msg2)
+{
+    int e;
+
+    e = errno;
+    if(pLS->pParent)
+    {
+        pLS->pParent->is_error = true;
+    }
+    if(msg2 == NULL)
+    {
+        msg2 = strerror(e);
+    }
+    LOG_printf(LOG_ERROR, "shm(%s): %s (%d) %s\n",
+                pLS->cfg.name, msg1, e, msg2);
+}
+
+/*!
+ * @brief [private] Has the creator gone away? (client only)
+ * @param pLS - the linux shm
+ * @param check_pid - also check if the creator process still exists
+ * @returns true (and the stream is in error) if it has
+ *
+ * A restarted creator makes a new object under the same name, this
+ * mapping would then never see data again.
+ */
+static bool _shm_peerGone(struct linux_shm *pLS, bool check_pid)
+{
+    uint32_t pid;
+
+    if(pLS->cfg.cs != 'c')
+    {
+        return (false);
+    }
+    if(pLS->pParent->is_error)
+    {
+        return (true);
+    }
+    if(__atomic_load_n(&(pLS->pHdr->stale), __ATOMIC_SEQ_CST))
+    {
+        _shm_error(pLS, "creator closed or restarted", "");
+        return (true);
+    }
+    pid = pLS->pHdr->owner_pid;
+    if(check_pid && (pid != 0) &&
+       (kill((pid_t)(pid), 0) != 0) && (errno == ESRCH))
+    {
+        _shm_error(pLS, "creator died", "");
+        return (true);
+    }
+    return (false);
+}
+
+/*!
+ * @brief [private] How long to sleep in one futex wait
+ * @param pLS - the linux shm
+ * @param remain - from _shm_remain()
+ * @returns milliseconds, negative is forever
+ *
+ * The client wakes up now and then to check the creator is alive.
+ */
+static int _shm_sleepMax(struct linux_shm *pLS, int remain)
+{
+    if((pLS->cfg.cs == 'c') &&
+       ((remain < 0) || (remain > SHM_PEER_CHECK_MSECS)))
+    {
+        return (SHM_PEER_CHECK_MSECS);
+    }
+    return (remain);
+}
+
+/*!
+ * @brief [private] Code to handle the STREAM_WrBytes() for shm
+ * @param pIO - the io stream
+ * @param databytes - pointer to data buffer
+ * @param nbytes- count of bytes to write
+ * @param timeout_mSecs - write timeout
+ *
+ * @returns negative on error, 0..actual written
+ */
+static int _shm_wrBytes(struct io_stream *pIO,
+                         const void *databytes,
+                         size_t nbytes, int timeout_mSecs)
+{
+    struct linux_shm *pLS;
+    struct shm_ring *pR;
+    const uint8_t *pSrc;
+    uint32_t head, tail, space, idx, n, n1;
+    uint32_t tstart;
+    size_t done;
+    int remain;
+
+    pLS = shm_pio_to_pls(pIO);
+    if(pLS == NULL)
+    {
+        return (-1);
+    }
+    pR = pLS->pTx;
+    pSrc = (const uint8_t *)(databytes);
+    tstart = TIMER_getNow();
+
+    /* only we change the head */
+    head = pR->head;
+    for(done = 0 ; done < nbytes ;)
+    {
+        tail  = __atomic_load_n(&(pR->tail), __ATOMIC_ACQUIRE);
+        space = (pLS->mask + 1) - (head - tail);
+        if(space == 0)
+        {
+            if(_shm_peerGone(pLS, false))
+            {
+                return ((done == 0) ? -1 : (int)(done));
+            }
+            remain = _shm_remain(tstart, timeout_mSecs);
+            if(remain == 0)
+            {
+                break;
+            }
+            /* tell the reader, then check again before we sleep */
+            __atomic_store_n(&(pR->wr_waiting), 1, __ATOMIC_SEQ_CST);
+            if((__atomic_load_n(&(pR->tail), __ATOMIC_SEQ_CST) == tail) &&
+               _shm_futex_wait(&(pR->tail), tail,
+                               _shm_sleepMax(pLS, remain)) &&
+               _shm_peerGone(pLS, true))
+            {
+                return ((done == 0) ? -1 : (int)(done));
+            }
+            continue;
+        }
+
+        n = (uint32_t)(nbytes - done);
+        if(n > space)
+        {
+            n = space;
+        }
+
+        /* copy, in two parts if it wraps */
+        idx = head & pLS->mask;
+        n1  = (pLS->mask + 1) - idx;
+        if(n1 > n)
+        {
+            n1 = n;
+        }
+        memcpy(pLS->pTxData + idx, pSrc + done, n1);
+        memcpy(pLS->pTxData, pSrc + done + n1, n - n1);
+
+        head += n;
+        done += n;
+        __atomic_store_n(&(pR->head), head, __ATOMIC_SEQ_CST);
+
+        /* only make a system call if the reader is asleep */
+        if(__atomic_load_n(&(pR->rd_waiting), __ATOMIC_SEQ_CST))
+        {
+            __atomic_store_n(&(pR->rd_waiting), 0, __ATOMIC_SEQ_CST);
+            _shm_futex_wake(&(pR->head));
+        }
+    }
+    return ((int)(done));
+}
+
+/*!
+ * @brief [private] wait until the rx ring is not empty
+ * @param pLS - the linux shm
+ * @param tstart - from TIMER_getNow()
+ * @param timeout_mSecs - how long to wait
+ * @returns number of bytes available, 0 on timeout or if the creator
+ *          has gone away (the stream is then in error)
+ */
+static uint32_t _shm_rxWait(struct linux_shm *pLS,
+                             uint32_t tstart,
+                             int timeout_mSecs)
+{
+    struct shm_ring *pR;
+    uint32_t head;
+    int remain;
+
+    pR = pLS->pRx;
+    for(;;)
+    {
+        head = __atomic_load_n(&(pR->head), __ATOMIC_ACQUIRE);
+        if(head != pR->tail)
+        {
+            return (head - pR->tail);
+        }
+        if(_shm_peerGone(pLS, false))
+        {
+            return (0);
+        }
+        remain = _shm_remain(tstart, timeout_mSecs);
+        if(remain == 0)
+        {
+            return (0);
+        }
+        /* tell the writer, then check again before we sleep */
+        __atomic_store_n(&(pR->rd_waiting), 1, __ATOMIC_SEQ_CST);
+        if((__atomic_load_n(&(pR->head), __ATOMIC_SEQ_CST) == head) &&
+           _shm_futex_wait(&(pR->head), head, _shm_sleepMax(pLS, remain)) &&
+           _shm_peerGone(pLS, true))
+        {
+            return (0);
+        }
+    }
+}
+
+/*!
+ * @brief [private] Code to handle the STREAM_RdBytes() for shm
+ * @param pIO - the io stream
+ * @param databytes - pointer to data buffer
+ * @param nbytes- count of bytes to read
+ * @param timeout_mSecs - read timeout
+ *
+ * @returns negative on error, 0..actual read
+ */
+static int _shm_rdBytes(struct io_stream *pIO,
+                         void *databytes,
+                         size_t nbytes, int timeout_mSecs)
+{
+    struct linux_shm *pLS;
+    struct shm_ring *pR;
+    uint8_t *pDst;
+    uint32_t tail, avail, idx, n, n1;
+    uint32_t tstart;
+    size_t done;
+
+    pLS = shm_pio_to_pls(pIO);
+    if(pLS == NULL)
+    {
+        return (-1);
+    }
+    pR = pLS->pRx;
+    pDst = (uint8_t *)(databytes);
+    tstart = TIMER_getNow();
+
+    for(done = 0 ; done < nbytes ;)
+    {
+        avail = _shm_rxWait(pLS, tstart, timeout_mSecs);
+        if(avail == 0)
+        {
+            if((done == 0) && pIO->is_error)
+            {
+                return (-1);
+            }
+            break;
+        }
+
+        n = (uint32_t)(nbytes - done);
+        if(n > avail)
+        {
+            n = avail;
+        }
+
+        /* only we change the tail */
+        tail = pR->tail;
+        idx  = tail & pLS->mask;
+        n1   = (pLS->mask + 1) - idx;
+        if(n1 > n)
+        {
+            n1 = n;
+        }
+        memcpy(pDst + done, pLS->pRxData + idx, n1);
+        memcpy(pDst + done + n1, pLS->pRxData, n - n1);
+
+        done += n;
+        __atomic_store_n(&(pR->tail), tail + n, __ATOMIC_SEQ_CST);
+
+        /* only make a system call if the writer is asleep */
+        if(__atomic_load_n(&(pR->wr_waiting), __ATOMIC_SEQ_CST))
+        {
+            __atomic_store_n(&(pR->wr_waiting), 0, __ATOMIC_SEQ_CST);
+            _shm_futex_wake(&(pR->tail));
+        }
+    }
+    return ((int)(done));
+}
+
+/*!
+ * @brief [private] Determine if bytes are available
+ * @param pIO - the io stream
+ * @param mSec_timeout - how long to wait
+ * @returns true if readable
+ */
+static bool _shm_pollRxAvail(struct io_stream *pIO, int mSec_timeout)
+{
+    struct linux_shm *pLS;
+
+    pLS = shm_pio_to_pls(pIO);
+    if(pLS == NULL)
+    {
+        return (false);
+    }
+    return (_shm_rxWait(pLS, TIMER_getNow(), mSec_timeout) != 0);
+}
+
+/*!
+ * @brief [private] Flush, writes are visible immediately
+ * @param pIO - the io stream
+ * @returns 0
+ */
+static int _shm_flush(struct io_stream *pIO)
+{
+    (void)(pIO);
+    return (0);
+}
+
+/*!
+ * @brief [private] Clear errors, nothing to do at this level
+ * @param pIO - the io stream
+ */
+static void _shm_clear(struct io_stream *pIO)
+{
+    (void)(pIO);
+}
+
+/*!
+ * @brief Close/Deallocate the shm information.
+ * @param pLS - pointer to linux shm
+ */
+static void _shm_closePtr(struct linux_shm *pLS)
+{
+    if(pLS == NULL)
+    {
+        return;
+    }
+
+    if(pLS->pHdr)
+    {
+        /* the creator owns the object, tell the client it is gone */
+        if(pLS->cfg.cs == 's')
+        {
+            _shm_markStale(pLS->pHdr);
+        }
+        munmap((void *)(pLS->pHdr), pLS->map_size);
+        pLS->pHdr = NULL;
+    }
+    if(pLS->h >= 0)
+    {
+        close(pLS->h);
+        pLS->h = -1;
+    }
+    if(pLS->cfg.name)
+    {
+        /* the creator owns the name */
+        if(pLS->cfg.cs == 's')
+        {
+            (void)shm_unlink(pLS->cfg.name);
+        }
+        free_const((const void *)(pLS->cfg.name));
+        pLS->cfg.name = NULL;
+    }
+    if(pLS->pParent)
+    {
+        STREAM_destroyPrivate(pLS->pParent);
+        pLS->pParent = NULL;
+    }
+    memset((void *)(pLS), 0, sizeof(*pLS));
+    free((void *)(pLS));
+}
+
+/*!
+ * @brief [private] Close the shm stream
+ * @param pIO - the io stream
+ */
+static void _shm_close(struct io_stream *pIO)
+{
+    _shm_closePtr(shm_pio_to_pls(pIO));
+}
+
+/*!
+ * @var STREAM_shm_funcs
+ * @brief [private] Method table for shared memory streams
+ */
+static const struct io_stream_funcs STREAM_shm_funcs = {
+    .name          = "shm",
+    .close_fn      = _shm_close,
+    .wr_fn         = _shm_wrBytes,
+    .rd_fn         = _shm_rdBytes,
+    .flush_fn      = _shm_flush,
+    .poll_fn       = _shm_pollRxAvail,
+    .clear_fn      = _shm_clear
+};
+
+/*!
+ * @brief [private] Create and initialize the shared memory object
+ * @param pLS - the linux shm
+ * @returns 0 on success
+ */
+static int _shm_doCreate(struct linux_shm *pLS)
+{
+    struct stat st;
+    void *p;
+    int h;
+
+    /*
+     * A previous instance may have died without cleaning up, a client
+     * may still be using its object: tell it before it is replaced.
+     */
+    h = shm_open(pLS->cfg.name, O_RDWR, 0);
+    if(h >= 0)
+    {
+        if((fstat(h, &st) == 0) &&
+           ((size_t)(st.st_size) >= sizeof(struct shm_header)))
+        {
+            p = mmap(NULL, sizeof(struct shm_header),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, h, 0);
+            if(p != MAP_FAILED)
+            {
+                _shm_markStale((struct shm_header *)(p));
+                munmap(p, sizeof(struct shm_header));
+            }
+        }
+        close(h);
+    }
+    (void)shm_unlink(pLS->cfg.name);
+
+    pLS->h = shm_open(pLS->cfg.name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(pLS->h < 0)
+    {
+        _shm_error(pLS, "shm_open()", NULL);
+        return (-1);
+    }
+    if(ftruncate(pLS->h, (off_t)(pLS->map_size)) != 0)
+    {
+        _shm_error(pLS, "ftruncate()", NULL);
+        return (-1);
+    }
+    pLS->pHdr = mmap(NULL, pLS->map_size,
+                     PROT_READ | PROT_WRITE, MAP_SHARED, pLS->h, 0);
+    if(pLS->pHdr == MAP_FAILED)
+    {
+        pLS->pHdr = NULL;
+        _shm_error(pLS, "mmap()", NULL);
+        return (-1);
+    }
+    /* ftruncate() gave us zeros, the rings are empty */
+    pLS->pHdr->ring_size = (uint32_t)(pLS->cfg.ring_size);
+    pLS->pHdr->owner_pid = (uint32_t)(getpid());
+    __atomic_store_n(&(pLS->pHdr->magic), SHM_MAGIC, __ATOMIC_SEQ_CST);
+    return (0);
+}
+
+/*!
+ * @brief [private] Attach to a shared memory object made by the creator
+ * @param pLS - the linux shm
+ * @returns 0 on success
+ */
+static int _shm_doAttach(struct linux_shm *pLS)
+{
+    struct stat st;
+    timertoken_t tstart;
+
+    tstart = TIMER_timeoutStart();
+    for(;;)
+    {
+        pLS->h = shm_open(pLS->cfg.name, O_RDWR, 0);
+        if(pLS->h >= 0)
+        {
+            if((fstat(pLS->h, &st) == 0) &&
+               ((size_t)(st.st_size) >= sizeof(struct shm_header)))
+            {
+                break;
+            }
+            /* creator has not sized it yet */
+            close(pLS->h);
+            pLS->h = -1;
+        }
+        if(TIMER_timeoutIsExpired(tstart, pLS->cfg.attach_timeout_mSecs))
+        {
+            _shm_error(pLS, "attach timeout", NULL);
+            return (-1);
+        }
+        TIMER_sleep(10);
+    }
+
+    pLS->map_size = (size_t)(st.st_size);
+    pLS->pHdr = mmap(NULL, pLS->map_size,
+                     PROT_READ | PROT_WRITE, MAP_SHARED, pLS->h, 0);
+    if(pLS->pHdr == MAP_FAILED)
+    {
+        pLS->pHdr = NULL;
+        _shm_error(pLS, "mmap()", NULL);
+        return (-1);
+    }
+
+    while(__atomic_load_n(&(pLS->pHdr->magic), __ATOMIC_SEQ_CST) != SHM_MAGIC)
+    {
+        if(TIMER_timeoutIsExpired(tstart, pLS->cfg.attach_timeout_mSecs))
+        {
+            _shm_error(pLS, "not initialized", "");
+            return (-1);
+        }
+        TIMER_sleep(10);
+    }
+
+    /* the creator decides the ring size */
+    pLS->cfg.ring_size = pLS->pHdr->ring_size;
+    if(pLS->map_size < (sizeof(struct shm_header) + 2 * pLS->cfg.ring_size))
+    {
+        _shm_error(pLS, "object too small", "");
+        return (-1);
+    }
+    return (0);
+}
+
+/*!
+ * @brief [private] Find the rings in the mapping
+ * @param pLS - the linux shm
+ */
+static void _shm_setRings(struct linux_shm *pLS)
+{
+    uint8_t *pData;
+
+    /* the creator writes ring 0 and reads ring 1, the client the opposite */
+    pData = ((uint8_t *)(pLS->pHdr)) + sizeof(struct shm_header);
+    pLS->mask = (uint32_t)(pLS->cfg.ring_size - 1);
+    if(pLS->cfg.cs == 's')
+    {
+        pLS->pTx     = &(pLS->pHdr->ring[0]);
+        pLS->pRx     = &(pLS->pHdr->ring[1]);
+        pLS->pTxData = pData;
+        pLS->pRxData = pData + pLS->cfg.ring_size;
+    }
+    else
+    {
+        pLS->pTx     = &(pLS->pHdr->ring[1]);
+        pLS->pRx     = &(pLS->pHdr->ring[0]);
+        pLS->pTxData = pData + pLS->cfg.ring_size;
+        pLS->pRxData = pData;
+    }
+}
+
+/*
+ * Create a shared memory stream
+ *
+ * Public function defined in stream_shm.h
+ */
+intptr_t STREAM_createShm(const struct shm_cfg *pCFG)
+{
+    struct linux_shm *pLS;
+    int r;
+
+    if((pCFG->name == NULL) || (pCFG->name[0] != '/'))
+    {
+        LOG_printf(LOG_ERROR, "shm: name must begin with '/'\n");
+        return (0);
+    }
+    if((pCFG->cs != 's') && (pCFG->cs != 'c'))
+    {
+        LOG_printf(LOG_ERROR, "shm: incorrect cfg type\n");
+        return (0);
+    }
+
+    pLS = calloc(1, sizeof(*pLS));
+    if(pLS == NULL)
+    {
+        LOG_printf(LOG_ERROR, "shm: no memory\n");
+        return (0);
+    }
+    pLS->h        = -1;
+    pLS->test_ptr = &shm_test;
+    pLS->cfg      = *pCFG;
+    pLS->cfg.name = strdup(pCFG->name);
+    pLS->pParent  = STREAM_createPrivate(&STREAM_shm_funcs, (intptr_t)(pLS));
+    if((pLS->cfg.name == NULL) || (pLS->pParent == NULL))
+    {
+        LOG_printf(LOG_ERROR, "shm: no memory\n");
+        goto fail;
+    }
+
+    if(pLS->cfg.ring_size == 0)
+    {
+        pLS->cfg.ring_size = STREAM_SHM_DEFAULT_RING_SIZE;
+    }
+    /* power of 2, and the free running counters must not wrap into it */
+    if((pLS->cfg.ring_size & (pLS->cfg.ring_size - 1)) ||
+       (pLS->cfg.ring_size > 0x40000000))
+    {
+        _shm_error(pLS, "ring size must be a power of 2", "");
+        goto fail;
+    }
+
+    if(pLS->cfg.cs == 's')
+    {
+        pLS->map_size = sizeof(struct shm_header) + (2 * pLS->cfg.ring_size);
+        r = _shm_doCreate(pLS);
+    }
+    else
+    {
+        r = _shm_doAttach(pLS);
+    }
+    if(r != 0)
+    {
+        goto fail;
+    }
+
+    _shm_setRings(pLS);
+
+    LOG_printf(LOG_DBG_SOCKET, "shm(%s,%c): ready, ring size %u\n",
+                pLS->cfg.name, pLS->cfg.cs, (unsigned)(pLS->cfg.ring_size));
+    return (STREAM_structToH(pLS->pParent));
+
+fail:
+    /* only the creator unlinks, and only if it created the object */
+    if(pLS->h < 0)
+    {
+        pLS->cfg.cs = 'c';
+    }
+    _shm_closePtr(pLS);
+    return (0);
+}
+
+/*
+ * Attach a client stream to the creator's current object
+ *
+ * Public function defined in stream_shm.h
+ */
+int STREAM_reattachShm(intptr_t h)
+{
+    struct linux_shm *pLS;
+    int timeout_mSecs;
+    int r;
+
+    pLS = shm_pio_to_pls(STREAM_hToStruct(h));
+    if((pLS == NULL) || (pLS->cfg.cs != 'c'))
+    {
+        return (-1);
+    }
+
+    if(pLS->pHdr)
+    {
+        munmap((void *)(pLS->pHdr), pLS->map_size);
+        pLS->pHdr = NULL;
+    }
+    if(pLS->h >= 0)
+    {
+        close(pLS->h);
+        pLS->h = -1;
+    }
+
+    /* the caller retries, do not wait here */
+    timeout_mSecs = pLS->cfg.attach_timeout_mSecs;
+    pLS->cfg.attach_timeout_mSecs = 0;
+    r = _shm_doAttach(pLS);
+    pLS->cfg.attach_timeout_mSecs = timeout_mSecs;
+    if(r != 0)
+    {
+        return (-1);
+    }
+    _shm_setRings(pLS);
+
+    /* the name may still be the object of a creator that died */
+    pLS->pParent->is_error = false;
+    if(_shm_peerGone(pLS, true))
+    {
+        return (-1);
+    }
+
+    LOG_printf(LOG_DBG_SOCKET, "shm(%s,%c): attached again, ring size %u\n",
+                pLS->cfg.name, pLS->cfg.cs, (unsigned)(pLS->cfg.ring_size));
+    return (0);
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
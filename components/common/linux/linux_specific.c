@@ -61,7 +61,6 @@
 #include "stream.h"
 #include "stream_socket.h"
 #include "fatal.h"
-#include <semaphore.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -74,6 +73,15 @@
 #include "termios.h"
 
 #include "sys/syscall.h" /* required for SYS_gettid() */
+#include <linux/futex.h>
+#include <limits.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <poll.h>
+#include <sched.h>
+#include "threads.h"
 
 /* this is here so we can log things in *VERY* special cases
 ** For example, when the system crashes horribly and locks are held
@@ -106,6 +114,8 @@ struct p_thread {
     pthread_t t;
     pid_t tid;
     pid_t pid;
+    /*! name for top -H and ps, the kernel limits this to 15 chars */
+    char name[16];
     /*! for use by the thread function */
     intptr_t cookie;
     /*! indicates the thread is alive/dead/exited */
@@ -121,32 +131,40 @@ static struct p_thread *all_p_threads;
 
 /*
  * Holds Linux specific atomic (mutex) structures.
+ *
+ * This is a futex, the uncontended lock and unlock are a single
+ * atomic operation in user space, the kernel is only entered to
+ * sleep or to wake a sleeping thread.
  */
 struct p_atomic {
     /*! used to verify if this is an atomic (mutex) structure */
     const int *check_ptr;
-    /*! what thread owns this mutex */
-    pthread_t owner;
-    /*! is this thread locked or not? */
+    /*! 0=unlocked, 1=locked, 2=locked and there may be waiters */
+    int state;
+    /*! the kernel thread id that owns this mutex, 0 if none */
+    pid_t owner;
+    /*! recursion depth, only touched by the owner */
     int lock_depth;
-
-    /* The condition variable */
-    pthread_cond_t cond;
-
-    /*! the pthread mutex */
-    pthread_mutex_t mtx;
 };
 
 /*
  * Holds Linux specific semaphore (counting) structures.
+ *
+ * Also a futex, put and get do not enter the kernel
+ * unless a thread has to sleep, or a sleeping thread must be woken.
  */
 struct p_sem {
     /*! used to veriify if this is a semaphore structure */
     const int *check_ptr;
-    /*! the linux semaphore */
-    sem_t s;
+    /*! the semaphore count */
+    int count;
+    /*! number of threads sleeping (or about to) in _ATOMIC_sem_get() */
+    int n_waiters;
 };
 
+/*! this thread's kernel thread id, cached, 0 until first used */
+static __thread pid_t atomic_my_tid;
+
 /*
  * private Convert a handle to a Linux specific mutex (atomic) wrapper.
  *
@@ -375,6 +393,80 @@ void _ATOMIC_global_unlock(void)
     _ATOMIC_local_unlock(atomic_global);
 }
 
+/*
+ * private, wrapper for the futex() system call
+ *
+ * @param addr - the futex word
+ * @param op - FUTEX_WAIT or FUTEX_WAKE
+ * @param val - expected value (wait) or number to wake
+ * @param timeout_nSecs - wait only, relative timeout, 0 = forever
+ * @returns the system call result
+ */
+static int _atomic_futex(int *addr, int op, int val, uint64_t timeout_nSecs)
+{
+    struct timespec ts;
+    struct timespec *pTs;
+
+    pTs = NULL;
+    if(timeout_nSecs)
+    {
+        ts.tv_sec  = (time_t)(timeout_nSecs / 1000000000ULL);
+        ts.tv_nsec = (long)(timeout_nSecs % 1000000000ULL);
+        pTs = &ts;
+    }
+    return ((int)syscall(SYS_futex, addr, op | FUTEX_PRIVATE_FLAG,
+                         val, pTs, NULL, 0));
+}
+
+/*
+ * private, how much longer may we wait?
+ *
+ * @param deadline - from _TIMER_getMonoNs(), 0 means wait forever
+ * @returns -1 if the deadline has passed, 0 forever, else nSecs remaining
+ */
+static int64_t _atomic_remain(uint64_t deadline)
+{
+    uint64_t tnow;
+
+    if(deadline == 0)
+    {
+        return (0);
+    }
+    tnow = _TIMER_getMonoNs();
+    if(tnow >= deadline)
+    {
+        return (-1);
+    }
+    return ((int64_t)(deadline - tnow));
+}
+
+/*
+ * private, turn a timeout into a deadline for _atomic_remain()
+ *
+ * @param timeout_mSecs - a positive timeout, or negative (forever)
+ * @returns the deadline
+ */
+static uint64_t _atomic_deadline(int timeout_mSecs)
+{
+    if(timeout_mSecs < 0)
+    {
+        return (0);
+    }
+    return (_TIMER_getMonoNs() + ((uint64_t)(timeout_mSecs) * 1000000ULL));
+}
+
+/*
+ * private, the calling thread's kernel thread id
+ */
+static pid_t _atomic_tid(void)
+{
+    if(atomic_my_tid == 0)
+    {
+        atomic_my_tid = (pid_t)syscall(SYS_gettid);
+    }
+    return (atomic_my_tid);
+}
+
 /*
  * Linux specific function to create a mutex local to some structure
  *
@@ -392,9 +484,9 @@ intptr_t _ATOMIC_local_create(void)
 
     pA->check_ptr = &is_atomic;
 
+    pA->state      = 0;
+    pA->owner      = 0;
     pA->lock_depth = 0;
-    pthread_cond_init( &(pA->cond), NULL );
-    pthread_mutex_init(&(pA->mtx), NULL);
     return ((intptr_t)(pA));
 }
 
@@ -410,9 +502,8 @@ void _ATOMIC_local_destroy(intptr_t h)
     pA = h2pA(h);
     if(pA)
     {
-        pthread_cond_destroy( &(pA->cond) );
-        pthread_mutex_destroy(&(pA->mtx));
         memset((void *)(pA), 0, sizeof(*pA));
+        free((void *)(pA));
     }
 }
 
@@ -431,9 +522,7 @@ void _ATOMIC_local_unlock(intptr_t h)
         return;
     }
 
-    pthread_mutex_lock( &(pA->mtx) );
-
-    if(!pthread_equal(pA->owner, pthread_self()))
+    if(__atomic_load_n(&(pA->owner), __ATOMIC_RELAXED) != _atomic_tid())
     {
         /* we choose not to allow this.
          * there are cases when this is valid.
@@ -448,34 +537,20 @@ void _ATOMIC_local_unlock(intptr_t h)
     }
 
     pA->lock_depth -= 1;
-    if( pA->lock_depth == 0 )
+    if( pA->lock_depth != 0 )
     {
-        /* first clear ownership */
-        memset(&(pA->owner), 0, sizeof(pA->owner));
+        /* still locked (recursive) */
+        return;
     }
-    pthread_cond_signal( &(pA->cond) );
-
-    pthread_mutex_unlock( &(pA->mtx) );
-}
 
-/*
- * private common code to create a timespec for the purposes of a timeout.
- */
-static void make_timespec(struct timespec *tv, int timeout_mSecs)
-{
-    int r;
+    /* first clear ownership */
+    __atomic_store_n(&(pA->owner), 0, __ATOMIC_RELAXED);
 
-    clock_gettime(CLOCK_REALTIME, tv);
-    tv->tv_sec += (timeout_mSecs / 1000);
-    /* get just the mSecs portion */
-    r = timeout_mSecs % 1000;
-    /* convert to nSecs */
-    r = r * 1000 * 1000;
-    tv->tv_nsec += r;
-    while(tv->tv_nsec > (1000 * 1000 * 1000))
+    /* 1 -> 0 means nobody is waiting, otherwise wake one waiter */
+    if(__atomic_fetch_sub(&(pA->state), 1, __ATOMIC_RELEASE) != 1)
     {
-            tv->tv_sec += 1;
-            tv->tv_nsec -= (1000 * 1000 * 1000);
+        __atomic_store_n(&(pA->state), 0, __ATOMIC_RELEASE);
+        _atomic_futex(&(pA->state), FUTEX_WAKE, 1, 0);
     }
 }
 
@@ -487,13 +562,10 @@ static void make_timespec(struct timespec *tv, int timeout_mSecs)
 int _ATOMIC_local_lock(intptr_t h, int timeout_mSecs)
 {
     struct p_atomic *pA;
-    struct timespec tv;
-    unsigned tstart;
-    unsigned tnow;
-    unsigned twaited;
-    int tremain;
-
-    int r;
+    uint64_t deadline;
+    int64_t remain;
+    pid_t me;
+    int c;
 
     pA = h2pA(h);
     if(pA == NULL)
@@ -501,75 +573,44 @@ int _ATOMIC_local_lock(intptr_t h, int timeout_mSecs)
         return (-1);
     }
 
-    if( timeout_mSecs > 0 )
-    {
-        tstart = TIMER_getNow();
-    }
-    else
-    {
-        tstart = 0;
-    }
-
-    pthread_mutex_lock( &(pA->mtx) );
-    /* assume fail */
-    r = -1;
-
-    if(pthread_equal(pA->owner, pthread_self()))
+    me = _atomic_tid();
+    if(__atomic_load_n(&(pA->owner), __ATOMIC_RELAXED) == me)
     {
         /* recursive lock */
-        /* success */
-        r = 0;
-        goto done;
+        pA->lock_depth += 1;
+        return (0);
     }
 
-    for(;;){
-        if( pA->lock_depth == 0 )
+    /* fast path: unlocked -> locked, no system call */
+    c = 0;
+    if(!__atomic_compare_exchange_n(&(pA->state), &c, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        if( timeout_mSecs == 0 )
         {
-            r = 0;
-            break;
-        }
-
-        if( timeout_mSecs == 0 ){
             /* locked, so we fail */
-            r = -1;
-            break;
-        }
-        if( timeout_mSecs < 0 )
-        {
-            /* forever */
-            pthread_cond_wait( &(pA->cond), &(pA->mtx) );
-            /* check again */
-            continue;
-        }
-
-        /* Wait timeout period */
-        tnow = TIMER_getNow();
-        /* how long have we waited already? */
-        twaited = tnow - tstart;
-
-        tremain = timeout_mSecs - ((int)(twaited));
-        if( tremain <= 0 ){
-            /* ran out of time */
-            r = -1;
-            break;
+            return (-1);
         }
-        make_timespec( &tv, tremain );
 
-        pthread_cond_timedwait( &(pA->cond), &(pA->mtx), &tv );
-        continue;
-    }
-done:
-    if( r == 0 )
-    {
-        /* success */
-        pA->lock_depth += 1;
-        if( pA->lock_depth == 1 )
+        /* slow path, mark as contended and sleep until we get it */
+        deadline = _atomic_deadline(timeout_mSecs);
+        while(__atomic_exchange_n(&(pA->state), 2, __ATOMIC_ACQUIRE) != 0)
         {
-            pA->owner = pthread_self();
+            remain = _atomic_remain(deadline);
+            if(remain < 0)
+            {
+                /* ran out of time */
+                return (-1);
+            }
+            /* EINTR, EAGAIN and ETIMEDOUT all mean: check again */
+            _atomic_futex(&(pA->state), FUTEX_WAIT, 2, (uint64_t)(remain));
         }
     }
-    pthread_mutex_unlock( &(pA->mtx) );
-    return r;
+
+    /* success */
+    __atomic_store_n(&(pA->owner), me, __ATOMIC_RELAXED);
+    pA->lock_depth = 1;
+    return (0);
 }
 
 /*
@@ -587,7 +628,8 @@ intptr_t _ATOMIC_sem_create(void)
         _atomic_fatal("no mem for sem\n");
     }
     pS->check_ptr = &is_sem;
-    sem_init(&(pS->s), 0, 0);
+    pS->count     = 0;
+    pS->n_waiters = 0;
     return ((intptr_t)(pS));
 }
 
@@ -603,7 +645,6 @@ void _ATOMIC_sem_destroy(intptr_t h)
     pS = h2pS(h);
     if(pS)
     {
-        sem_destroy(&(pS->s));
         memset((void *)(pS), 0, sizeof(*pS));
         free((void*)(pS));
     }
@@ -625,7 +666,34 @@ void _ATOMIC_sem_put(intptr_t h)
         return;
     }
 
-    sem_post(&(pS->s));
+    __atomic_fetch_add(&(pS->count), 1, __ATOMIC_SEQ_CST);
+    /* only enter the kernel if somebody might be sleeping */
+    if(__atomic_load_n(&(pS->n_waiters), __ATOMIC_SEQ_CST) > 0)
+    {
+        _atomic_futex(&(pS->count), FUTEX_WAKE, 1, 0);
+    }
+}
+
+/*
+ * private, try to take one from the semaphore without waiting
+ *
+ * @returns true if successful
+ */
+static bool _atomic_sem_tryget(struct p_sem *pS)
+{
+    int c;
+
+    c = __atomic_load_n(&(pS->count), __ATOMIC_RELAXED);
+    while(c > 0)
+    {
+        if(__atomic_compare_exchange_n(&(pS->count), &c, c - 1, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return (true);
+        }
+        /* c was updated, try again */
+    }
+    return (false);
 }
 
 /*
@@ -635,9 +703,9 @@ void _ATOMIC_sem_put(intptr_t h)
  */
 int _ATOMIC_sem_get(intptr_t h, int timeout_mSecs)
 {
-    struct timespec tv;
     struct p_sem *pS;
-    int r;
+    uint64_t deadline;
+    int64_t remain;
 
     pS = h2pS(h);
     if(pS == NULL)
@@ -645,30 +713,36 @@ int _ATOMIC_sem_get(intptr_t h, int timeout_mSecs)
         _atomic_fatal("not a semaphore\n");
     }
 
-    if(timeout_mSecs < 0)
-    {
-        r = sem_wait(&(pS->s));
-    }
-    else if(timeout_mSecs == 0)
+    if(_atomic_sem_tryget(pS))
     {
-        r = sem_trywait(&(pS->s));
+        /* we have success */
+        return (1);
     }
-    else
+    if(timeout_mSecs == 0)
     {
-        make_timespec(&tv, timeout_mSecs);
-        r = sem_timedwait(&(pS->s), &tv);
+        return (0);
     }
 
-    if(r == 0)
-    {
-        /* we have success */
-        r = 1;
-    }
-    else
+    deadline = _atomic_deadline(timeout_mSecs);
+    for(;;)
     {
-        r = 0;
+        remain = _atomic_remain(deadline);
+        if(remain < 0)
+        {
+            /* timeout */
+            return (0);
+        }
+        /* the waiter count must be visible before we test count */
+        __atomic_fetch_add(&(pS->n_waiters), 1, __ATOMIC_SEQ_CST);
+        _atomic_futex(&(pS->count), FUTEX_WAIT, 0, (uint64_t)(remain));
+        __atomic_fetch_sub(&(pS->n_waiters), 1, __ATOMIC_SEQ_CST);
+
+        if(_atomic_sem_tryget(pS))
+        {
+            /* we have success */
+            return (1);
+        }
     }
-    return (r);
 }
 
 /*
@@ -679,7 +753,6 @@ int _ATOMIC_sem_get(intptr_t h, int timeout_mSecs)
 int _ATOMIC_sem_cnt(intptr_t h)
 {
     struct p_sem *pS;
-    int r,v;
 
     pS = h2pS(h);
     if(pS == NULL)
@@ -687,9 +760,7 @@ int _ATOMIC_sem_cnt(intptr_t h)
         _atomic_fatal("not a semaphore\n");
     }
 
-    r = sem_getvalue(&(pS->s), &v);
-    (void)(r); /* ignored */
-    return (v);
+    return (__atomic_load_n(&(pS->count), __ATOMIC_RELAXED));
 }
 
 /*
@@ -713,21 +784,37 @@ uint64_t _TIMER_getAbsNow(void)
 }
 
 /*
- * Linux specific sleep function
+ * Linux specific monotonic clock in nano seconds
  *
  * Defined in hlos_specific.h
  */
-void _TIMER_sleep(uint32_t mSecs)
+uint64_t _TIMER_getMonoNs(void)
+{
+    struct timespec tv;
+
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (((uint64_t)(tv.tv_sec) * 1000000000ULL) + (uint64_t)(tv.tv_nsec));
+}
+
+/*
+ * Linux specific sleep function, nano seconds
+ *
+ * Defined in hlos_specific.h
+ */
+void _TIMER_sleepNs(uint64_t nSecs)
 {
     struct timespec ts;
-    struct timespec rem;
+    uint64_t t;
     int r;
 
-    make_timespec(&ts, mSecs);
+    /* absolute, so EINTR does not make us sleep longer */
+    t = _TIMER_getMonoNs() + nSecs;
+    ts.tv_sec  = (time_t)(t / 1000000000ULL);
+    ts.tv_nsec = (long)(t % 1000000000ULL);
 
     for(;;)
     {
-        r = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, &rem);
+        r = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
         if(r == 0)
         {
             break;
@@ -739,6 +826,127 @@ void _TIMER_sleep(uint32_t mSecs)
     }
 }
 
+/*
+ * Linux specific sleep function
+ *
+ * Defined in hlos_specific.h
+ */
+void _TIMER_sleep(uint32_t mSecs)
+{
+    _TIMER_sleepNs((uint64_t)(mSecs) * 1000000ULL);
+}
+
+/*
+ * @struct linux_timer_waiter
+ * @brief A timerfd for the timeout, and an eventfd to wake up early
+ */
+struct linux_timer_waiter {
+    /*! the timerfd, against the monotonic clock */
+    int tfd;
+    /*! the eventfd used to wake up */
+    int efd;
+};
+
+/*
+ * Linux specific timer thread waiter create
+ *
+ * Defined in hlos_specific.h
+ */
+intptr_t _TIMER_waiterCreate(void)
+{
+    struct linux_timer_waiter *pW;
+
+    pW = calloc(1, sizeof(*pW));
+    if(pW == NULL)
+    {
+        return (0);
+    }
+    pW->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    pW->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if((pW->tfd < 0) || (pW->efd < 0))
+    {
+        LOG_printf(LOG_ERROR, "timer waiter: %s\n", strerror(errno));
+        if(pW->tfd >= 0)
+        {
+            close(pW->tfd);
+        }
+        if(pW->efd >= 0)
+        {
+            close(pW->efd);
+        }
+        free((void *)(pW));
+        return (0);
+    }
+    return ((intptr_t)(pW));
+}
+
+/*
+ * Linux specific timer thread waiter wait
+ *
+ * Defined in hlos_specific.h
+ */
+int _TIMER_waiterWait(intptr_t h, uint64_t timeout_nSecs)
+{
+    struct linux_timer_waiter *pW;
+    struct itimerspec its;
+    struct pollfd pfds[2];
+    uint64_t v;
+    ssize_t n;
+    int r;
+
+    pW = (struct linux_timer_waiter *)(h);
+
+    /* a zero value would disarm the timer */
+    if(timeout_nSecs == 0)
+    {
+        timeout_nSecs = 1;
+    }
+    memset((void *)(&its), 0, sizeof(its));
+    its.it_value.tv_sec  = (time_t)(timeout_nSecs / 1000000000ULL);
+    its.it_value.tv_nsec = (long)(timeout_nSecs % 1000000000ULL);
+    timerfd_settime(pW->tfd, 0, &its, NULL);
+
+    memset((void *)(pfds), 0, sizeof(pfds));
+    pfds[0].fd     = pW->efd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd     = pW->tfd;
+    pfds[1].events = POLLIN;
+
+    r = 0;
+    if(poll(pfds, 2, -1) > 0)
+    {
+        if(pfds[0].revents & POLLIN)
+        {
+            n = read(pW->efd, (void *)(&v), sizeof(v));
+            (void)(n);
+            r = 1;
+        }
+        if(pfds[1].revents & POLLIN)
+        {
+            n = read(pW->tfd, (void *)(&v), sizeof(v));
+            (void)(n);
+        }
+    }
+    /* else: most likely EINTR, treat as a timeout */
+    return (r);
+}
+
+/*
+ * Linux specific timer thread waiter wakeup
+ *
+ * Defined in hlos_specific.h
+ */
+void _TIMER_waiterWake(intptr_t h)
+{
+    struct linux_timer_waiter *pW;
+    uint64_t v;
+    ssize_t n;
+
+    pW = (struct linux_timer_waiter *)(h);
+    v = 1;
+    n = write(pW->efd, (const void *)(&v), sizeof(v));
+    (void)(n);
+}
 
 /*
  * Linux specific thread startup wrapper function
@@ -753,6 +961,8 @@ static void * p_thread_wrapper(void *pParm)
     pT->is_alive = true;
     pT->pid = getpid();
     pT->tid = syscall(SYS_gettid);
+    /* name ourself, longer names are truncated not rejected */
+    prctl(PR_SET_NAME, (unsigned long)(pT->name), 0, 0, 0);
     _ATOMIC_global_lock();
     /* We do this to ensure the create() function is complete */
     _ATOMIC_global_unlock();
@@ -770,13 +980,12 @@ static void * p_thread_wrapper(void *pParm)
  */
 intptr_t _THREAD_create(const char *dbg_name,
                         intptr_t(*thread_func)(intptr_t param),
-                        intptr_t cookie)
+                        intptr_t cookie,
+                        size_t stack_size)
 {
     struct p_thread *pT;
+    pthread_attr_t attr;
     int r;
-    /* http://man7.org/linux/man-pages/man3/pthread_setname_np.3.html */
-    /* Names are limited to 16bytes */
-    char smallbuf[17];
 
     pT = calloc(1, sizeof(*pT));
     if(pT == NULL)
@@ -786,6 +995,9 @@ intptr_t _THREAD_create(const char *dbg_name,
     pT->check_ptr = &thread_check;
     pT->cookie = cookie;
     pT->thread_func = thread_func;
+    /* http://man7.org/linux/man-pages/man3/pthread_setname_np.3.html */
+    /* Names are limited to 16bytes, including the terminating null */
+    strncpy(pT->name, dbg_name, sizeof(pT->name) - 1);
 
     /* add to list */
     _ATOMIC_global_lock();
@@ -793,21 +1005,138 @@ intptr_t _THREAD_create(const char *dbg_name,
     all_p_threads = pT;
     pT->is_alive = false;
 
+    pthread_attr_init(&attr);
+    if(stack_size)
+    {
+        if(stack_size < PTHREAD_STACK_MIN)
+        {
+            stack_size = PTHREAD_STACK_MIN;
+        }
+        r = pthread_attr_setstacksize(&attr, stack_size);
+        if(r != 0)
+        {
+            LOG_printf(LOG_ERROR, "%s: invalid stack size %u\n",
+                       dbg_name, (unsigned)(stack_size));
+        }
+    }
+
     /* create.. */
-    r = pthread_create(&(pT->t), NULL, p_thread_wrapper, (void *)(pT));
+    r = pthread_create(&(pT->t), &attr, p_thread_wrapper, (void *)(pT));
+    pthread_attr_destroy(&attr);
     if(r != 0)
     {
         _atomic_fatal("cannot create thread\n");
     }
 
-    strncpy(smallbuf, dbg_name, sizeof(smallbuf)-1);
-    smallbuf[sizeof(smallbuf)-1] = 0;
-
-    pthread_setname_np(pT->t, smallbuf);
     _ATOMIC_global_unlock();
     return ((intptr_t)(pT));
 }
 
+/*
+ * Linux specific thread statistics
+ *
+ * Defined in hlos_specific.h
+ */
+int _THREAD_getStats(intptr_t os_token, struct thread_stats *pStats)
+{
+    struct p_thread *pT;
+    struct timespec ts;
+    clockid_t cid;
+    char buf[80];
+    unsigned long long v;
+    FILE *fp;
+
+    pT = (struct p_thread *)(os_token);
+    memset((void *)(pStats), 0, sizeof(*pStats));
+    if((pT == NULL) || (!pT->is_alive) || (pT->tid == 0))
+    {
+        return (-1);
+    }
+
+    if((pthread_getcpuclockid(pT->t, &cid) != 0) ||
+       (clock_gettime(cid, &ts) != 0))
+    {
+        return (-1);
+    }
+    pStats->cpu_nSecs = (((uint64_t)(ts.tv_sec)) * 1000000000ULL) +
+        ((uint64_t)(ts.tv_nsec));
+
+    /* the kernel only reports context switches via /proc */
+    (void)snprintf(buf, sizeof(buf), "/proc/%d/task/%d/status",
+                   (int)(pT->pid), (int)(pT->tid));
+    fp = fopen(buf, "r");
+    if(fp == NULL)
+    {
+        return (-1);
+    }
+    while(fgets(buf, sizeof(buf), fp))
+    {
+        if(1 == sscanf(buf, "voluntary_ctxt_switches: %llu", &v))
+        {
+            pStats->n_voluntary = v;
+        }
+        if(1 == sscanf(buf, "nonvoluntary_ctxt_switches: %llu", &v))
+        {
+            pStats->n_involuntary = v;
+        }
+    }
+    fclose(fp);
+    return (0);
+}
+
+/*
+ * Linux specific thread scheduling
+ *
+ * Defined in hlos_specific.h
+ */
+int _THREAD_setSched(int policy, int priority, int nice, uint64_t cpu_mask)
+{
+    struct sched_param sp;
+    cpu_set_t cpus;
+    int r;
+    int x;
+
+    memset(&sp, 0, sizeof(sp));
+    r = 0;
+    switch(policy)
+    {
+    default:
+    case THREAD_SCHED_DEFAULT:
+        break;
+    case THREAD_SCHED_OTHER:
+        sp.sched_priority = 0;
+        r = pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+        /* on Linux the nice value is per thread */
+        if((r == 0) &&
+           (setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice) != 0))
+        {
+            r = errno;
+        }
+        break;
+    case THREAD_SCHED_FIFO:
+        sp.sched_priority = priority;
+        r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        break;
+    case THREAD_SCHED_RR:
+        sp.sched_priority = priority;
+        r = pthread_setschedparam(pthread_self(), SCHED_RR, &sp);
+        break;
+    }
+    if((r == 0) && cpu_mask)
+    {
+        CPU_ZERO(&cpus);
+        for(x = 0 ; x < 64 ; x++)
+        {
+            if(cpu_mask & (((uint64_t)1) << x))
+            {
+                CPU_SET(x, &cpus);
+            }
+        }
+        r = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    return (r);
+}
+
 /*
  * Linux specific thread id  function
  *
@@ -0,0 +1,496 @@
+/******************************************************************************
+ @file mutex_test.c
+
+ @brief TIMAC 2.0 API Mutex and semaphore micro benchmark
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+/*
+ * OVERVIEW
+ * ========
+ *
+ * Micro benchmark for the locks the collector uses most.
+ *
+ * Build & run with:
+ *
+ *     make testapps
+ *     ./host_mutex_test [NLOOPS]
+ *
+ * It measures, per lock/unlock pair:
+ *   - MUTEX_lock(-1), as used by the mt_msg list_lock and the NV mutex
+ *   - MUTEX_lock(timeout), as used by the mt_msg tx_lock
+ *   - a recursive MUTEX_lock()
+ *   - LOG_lock(), which every LOG_printf() line takes
+ *   - SEMAPHORE_put() + SEMAPHORE_waitWithTimeout()
+ * And with contention:
+ *   - NTHREADS threads sharing one mutex
+ *   - two threads ping-ponging through a pair of semaphores
+ *   - NTHREADS threads putting to one semaphore
+ *
+ * It checks that only one thread at a time holds the mutex, that a
+ * recursive lock is released by the same number of unlocks and that
+ * no semaphore count is lost or made up. The exit status is 1 if any
+ * check fails.
+ */
+
+#include "compiler.h"
+#include "mutex.h"
+#include "ti_semaphore.h"
+#include "threads.h"
+#include "timer.h"
+#include "log.h"
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! number of threads in the contended test */
+#define TEST_NTHREADS 4
+
+/*! lock/unlock pairs per test */
+static int n_loops;
+
+/*! the mutex used by the tests */
+static intptr_t test_mutex;
+
+/*! semaphores for the ping pong test */
+static intptr_t test_ping;
+static intptr_t test_pong;
+
+/*! shared counter, protected by test_mutex */
+static volatile int test_counter;
+
+/*! threads holding test_mutex, must never be more than 1 */
+static volatile int test_inside;
+
+/*! contended test threads put here when they are done */
+static intptr_t test_done;
+
+/*! result of the MUTEX_lock(0) in test_trylock_thread() */
+static int test_trylock_result;
+
+/*! number of failed checks */
+static int test_n_errors;
+
+/*!
+ * @brief Count and print a failed check
+ * @param what - what went wrong
+ * @param have - the value found
+ * @param want - the value expected
+ */
+static void test_check(const char *what, int have, int want)
+{
+    if(have != want)
+    {
+        printf("ERROR: %s is %d, expected %d\n", what, have, want);
+        test_n_errors++;
+    }
+}
+
+/*!
+ * @brief Print the result of one test
+ * @param name - test name
+ * @param t0 - start time in nSecs
+ * @param n - number of operations
+ */
+static void test_result(const char *name, uint64_t t0, int n)
+{
+    uint64_t t1;
+
+    t1 = TIMER_getNowNs();
+    printf("%-28s %8.1f nSecs/op\n",
+           name, (double)(t1 - t0) / (double)(n));
+}
+
+/*!
+ * @brief Uncontended tests
+ */
+static void test_uncontended(void)
+{
+    uint64_t t0;
+    int x;
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        MUTEX_lock(test_mutex, -1);
+        MUTEX_unLock(test_mutex);
+    }
+    test_result("mutex (list_lock, nv)", t0, n_loops);
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        MUTEX_lock(test_mutex, 3000);
+        MUTEX_unLock(test_mutex);
+    }
+    test_result("mutex timeout (tx_lock)", t0, n_loops);
+
+    MUTEX_lock(test_mutex, -1);
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        MUTEX_lock(test_mutex, -1);
+        MUTEX_unLock(test_mutex);
+    }
+    test_result("mutex recursive", t0, n_loops);
+    MUTEX_unLock(test_mutex);
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        LOG_lock();
+        LOG_unLock();
+    }
+    test_result("log lock", t0, n_loops);
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        SEMAPHORE_put(test_ping);
+        SEMAPHORE_waitWithTimeout(test_ping, -1);
+    }
+    test_result("semaphore put+get", t0, n_loops);
+    test_check("semaphore count after put+get", SEMAPHORE_inspect(test_ping), 0);
+
+    /* each put is taken exactly once */
+    SEMAPHORE_putN(test_ping, 5);
+    test_check("semaphore count after put 5", SEMAPHORE_inspect(test_ping), 5);
+    for(x = 0 ; x < 5 ; x++)
+    {
+        test_check("semaphore wait", SEMAPHORE_waitWithTimeout(test_ping, 0), 1);
+    }
+    test_check("semaphore wait when empty",
+               SEMAPHORE_waitWithTimeout(test_ping, 0), 0);
+}
+
+/*!
+ * @brief Thread that tries to take test_mutex without waiting
+ * @param cookie - not used
+ * @returns 0
+ */
+static intptr_t test_trylock_thread(intptr_t cookie)
+{
+    (void)(cookie);
+    test_trylock_result = MUTEX_lock(test_mutex, 0);
+    if(test_trylock_result == 0)
+    {
+        MUTEX_unLock(test_mutex);
+    }
+    SEMAPHORE_put(test_done);
+    return (0);
+}
+
+/*!
+ * @brief Can another thread take test_mutex right now?
+ * @returns true if it can
+ */
+static bool test_other_can_lock(void)
+{
+    intptr_t id;
+
+    id = THREAD_create("trylock", test_trylock_thread, 0,
+                       THREAD_FLAGS_DEFAULT);
+    SEMAPHORE_waitWithTimeout(test_done, -1);
+    THREAD_destroy(id);
+    return (test_trylock_result == 0);
+}
+
+/*!
+ * @brief A recursive lock holds the mutex until the last unlock
+ * @param depth - how deep to lock
+ */
+static void test_recursive(int depth)
+{
+    int x;
+
+    for(x = 0 ; x < depth ; x++)
+    {
+        test_check("recursive lock", MUTEX_lock(test_mutex, -1), 0);
+    }
+    for(x = 0 ; x < depth ; x++)
+    {
+        if(test_other_can_lock())
+        {
+            printf("ERROR: another thread took the mutex at depth %d\n",
+                   depth - x);
+            test_n_errors++;
+        }
+        MUTEX_unLock(test_mutex);
+    }
+    if(!test_other_can_lock())
+    {
+        printf("ERROR: mutex still locked after %d unlocks\n", depth);
+        test_n_errors++;
+    }
+}
+
+/*!
+ * @brief Thread for the contended mutex test
+ * @param cookie - not used
+ * @returns 0
+ */
+static intptr_t test_contended_thread(intptr_t cookie)
+{
+    int x;
+
+    (void)(cookie);
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        MUTEX_lock(test_mutex, -1);
+        if(test_inside++ != 0)
+        {
+            test_n_errors++;
+        }
+        test_counter++;
+        test_inside--;
+        MUTEX_unLock(test_mutex);
+    }
+    SEMAPHORE_put(test_done);
+    return (0);
+}
+
+/*!
+ * @brief Thread for the semaphore count test
+ * @param cookie - not used
+ * @returns 0
+ */
+static intptr_t test_put_thread(intptr_t cookie)
+{
+    int x;
+
+    (void)(cookie);
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        SEMAPHORE_put(test_ping);
+    }
+    return (0);
+}
+
+/*!
+ * @brief Thread for the ping pong test, answers each ping with a pong
+ * @param cookie - not used
+ * @returns 0
+ */
+static intptr_t test_pong_thread(intptr_t cookie)
+{
+    int x;
+
+    (void)(cookie);
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        SEMAPHORE_waitWithTimeout(test_ping, -1);
+        SEMAPHORE_put(test_pong);
+    }
+    SEMAPHORE_put(test_done);
+    return (0);
+}
+
+/*!
+ * @brief Contended tests
+ */
+static void test_threads(const char *name)
+{
+    intptr_t ids[TEST_NTHREADS];
+    uint64_t t0;
+    int x;
+
+    test_counter = 0;
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < TEST_NTHREADS ; x++)
+    {
+        ids[x] = THREAD_create("contend", test_contended_thread, 0,
+                               THREAD_FLAGS_DEFAULT);
+    }
+    for(x = 0 ; x < TEST_NTHREADS ; x++)
+    {
+        SEMAPHORE_waitWithTimeout(test_done, -1);
+    }
+    test_result(name, t0, n_loops * TEST_NTHREADS);
+    test_check("counter", test_counter, n_loops * TEST_NTHREADS);
+    for(x = 0 ; x < TEST_NTHREADS ; x++)
+    {
+        THREAD_destroy(ids[x]);
+    }
+}
+
+static void test_contended(void)
+{
+    intptr_t ids[1];
+    uint64_t t0;
+    int x;
+
+    test_threads("mutex, 4 threads");
+
+    t0 = TIMER_getNowNs();
+    ids[0] = THREAD_create("pong", test_pong_thread, 0, THREAD_FLAGS_DEFAULT);
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        SEMAPHORE_put(test_ping);
+        SEMAPHORE_waitWithTimeout(test_pong, -1);
+    }
+    SEMAPHORE_waitWithTimeout(test_done, -1);
+    test_result("semaphore ping pong", t0, n_loops);
+    THREAD_destroy(ids[0]);
+    test_check("ping count after ping pong", SEMAPHORE_inspect(test_ping), 0);
+    test_check("pong count after ping pong", SEMAPHORE_inspect(test_pong), 0);
+}
+
+/*!
+ * @brief NTHREADS threads put, this one takes every count
+ */
+static void test_sem_count(void)
+{
+    intptr_t ids[TEST_NTHREADS];
+    uint64_t t0;
+    int x;
+    int n;
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < TEST_NTHREADS ; x++)
+    {
+        ids[x] = THREAD_create("put", test_put_thread, 0,
+                               THREAD_FLAGS_DEFAULT);
+    }
+    n = 0;
+    for(x = 0 ; x < (n_loops * TEST_NTHREADS) ; x++)
+    {
+        if(SEMAPHORE_waitWithTimeout(test_ping, 1000) != 1)
+        {
+            break;
+        }
+        n++;
+    }
+    test_result("semaphore, 4 threads put", t0, n_loops * TEST_NTHREADS);
+    for(x = 0 ; x < TEST_NTHREADS ; x++)
+    {
+        THREAD_destroy(ids[x]);
+    }
+    test_check("semaphore counts taken", n, n_loops * TEST_NTHREADS);
+    test_check("semaphore count left", SEMAPHORE_inspect(test_ping), 0);
+}
+
+/*!
+ * @brief The same mutex tests with the contention profiler on
+ */
+static void test_profiled(void)
+{
+    uint64_t t0;
+    int x;
+
+    MUTEX_profileEnable(true);
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_loops ; x++)
+    {
+        MUTEX_lock(test_mutex, -1);
+        MUTEX_unLock(test_mutex);
+    }
+    test_result("mutex, profiled", t0, n_loops);
+
+    test_recursive(3);
+    test_threads("mutex, 4 threads, profiled");
+
+    MUTEX_profileEnable(false);
+    MUTEX_profileReport();
+}
+
+/*!
+ * @brief the test main program
+ * @param argc - arg count
+ * @param argv - arg vector
+ * @returns zero if every check passed
+ */
+int main(int argc, char **argv)
+{
+    n_loops = 1000000;
+    if(argc > 1)
+    {
+        n_loops = atoi(argv[1]);
+    }
+    if(n_loops <= 0)
+    {
+        fprintf(stderr, "Usage: %s [NLOOPS]\n", argv[0]);
+        exit(1);
+    }
+
+    STREAM_init();
+    TIMER_init();
+    LOG_init("/dev/stdout");
+
+    test_mutex = MUTEX_create("test-mutex");
+    test_ping  = SEMAPHORE_create("test-ping", 0);
+    test_pong  = SEMAPHORE_create("test-pong", 0);
+    test_done  = SEMAPHORE_create("test-done", 0);
+
+    test_uncontended();
+    test_recursive(3);
+    test_contended();
+    test_sem_count();
+    test_profiled();
+
+    SEMAPHORE_destroy(test_done);
+    SEMAPHORE_destroy(test_pong);
+    SEMAPHORE_destroy(test_ping);
+    MUTEX_destroy(test_mutex);
+    if(test_n_errors)
+    {
+        printf("FAILED: %d checks\n", test_n_errors);
+        return (1);
+    }
+    return (0);
+}
+
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
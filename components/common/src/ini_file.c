@@ -284,6 +284,8 @@ int INI_read(const char *filename,
     {
         return (-1);
     }
+    /* the parser reads char by char, a buffer saves many reads */
+    (void)STREAM_setRdBuffer(s, STREAM_RD_BUFFER_DEFAULT);
     r = INI_parse(s, filename, rd_fn, client_cookie);
     STREAM_close(s);
     return (r);
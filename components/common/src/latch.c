@@ -0,0 +1,243 @@
+/******************************************************************************
+ @file latch.c
+
+ @brief TIMAC 2.0 API One shot latch implementation
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#include "compiler.h"
+#include "latch.h"
+#include "log.h"
+
+#include <string.h>
+#include <malloc.h>
+
+#include "hlos_specific.h"
+
+static const int latch_check = 'L';
+
+/*!
+ * @struct latch
+ * @brief Private latch implimentation details
+ */
+struct latch {
+    /*! used to verify this is a latch */
+    const int *test_ptr;
+
+    /*! name for debug purposes */
+    const char *dbg_name;
+
+    /*! remaining count downs, open when <= 0 */
+    int count;
+
+    /*!
+     * Put once when the latch opens, each waiter that takes
+     * it puts it back so the next waiter also wakes.
+     */
+    intptr_t sem;
+};
+
+/*!
+ * @brief convert a handle into a latch pointer
+ * @param h - the handle
+ * @returns NULL if not valid
+ */
+static struct latch *h2l(intptr_t h)
+{
+    struct latch *pL;
+
+    pL = (struct latch *)(h);
+    if(pL)
+    {
+        if(pL->test_ptr != &latch_check)
+        {
+            pL = NULL;
+        }
+    }
+    if(pL == NULL)
+    {
+        LOG_printf(LOG_ERROR, "not a latch: %p\n", (void *)(h));
+    }
+    return (pL);
+}
+
+/*
+ * Create a latch
+ *
+ * Public function defined in latch.h
+ */
+intptr_t LATCH_create(const char *dbg_name, int count)
+{
+    struct latch *pL;
+
+    if(dbg_name == NULL)
+    {
+        dbg_name = "latch-no-name";
+    }
+
+    pL = calloc(1, sizeof(*pL));
+    if(pL == NULL)
+    {
+        LOG_printf(LOG_ERROR, "%s: no memory\n", dbg_name);
+        return (0);
+    }
+    pL->test_ptr = &latch_check;
+    pL->count    = count;
+    pL->dbg_name = strdup(dbg_name);
+    pL->sem      = _ATOMIC_sem_create();
+    if((pL->dbg_name == NULL) || (pL->sem == 0))
+    {
+        LOG_printf(LOG_ERROR, "%s: no memory\n", dbg_name);
+        LATCH_destroy((intptr_t)(pL));
+        return (0);
+    }
+    if(count <= 0)
+    {
+        /* created open */
+        _ATOMIC_sem_put(pL->sem);
+    }
+    return ((intptr_t)(pL));
+}
+
+/*
+ * Destroy a latch
+ *
+ * Public function defined in latch.h
+ */
+void LATCH_destroy(intptr_t h)
+{
+    struct latch *pL;
+
+    pL = h2l(h);
+    if(pL == NULL)
+    {
+        return;
+    }
+    if(pL->sem)
+    {
+        _ATOMIC_sem_destroy(pL->sem);
+    }
+    if(pL->dbg_name)
+    {
+        free_const((const void *)(pL->dbg_name));
+    }
+    memset((void *)(pL), 0, sizeof(*pL));
+    free((void *)(pL));
+}
+
+/*
+ * Count down a latch
+ *
+ * Public function defined in latch.h
+ */
+void LATCH_countDown(intptr_t h)
+{
+    struct latch *pL;
+
+    pL = h2l(h);
+    if(pL == NULL)
+    {
+        return;
+    }
+    /* only the count down that reaches zero opens it */
+    if(__atomic_sub_fetch(&(pL->count), 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        _ATOMIC_sem_put(pL->sem);
+    }
+}
+
+/*
+ * Wait for a latch to open
+ *
+ * Public function defined in latch.h
+ */
+int LATCH_wait(intptr_t h, int timeout_mSecs)
+{
+    struct latch *pL;
+
+    pL = h2l(h);
+    if(pL == NULL)
+    {
+        return (-1);
+    }
+    if(__atomic_load_n(&(pL->count), __ATOMIC_SEQ_CST) <= 0)
+    {
+        return (1);
+    }
+    if(_ATOMIC_sem_get(pL->sem, timeout_mSecs) == 0)
+    {
+        return (0);
+    }
+    /* pass it on to the next waiter */
+    _ATOMIC_sem_put(pL->sem);
+    return (1);
+}
+
+/*
+ * Is a latch open?
+ *
+ * Public function defined in latch.h
+ */
+bool LATCH_isOpen(intptr_t h)
+{
+    struct latch *pL;
+
+    pL = h2l(h);
+    if(pL == NULL)
+    {
+        return (false);
+    }
+    return (__atomic_load_n(&(pL->count), __ATOMIC_SEQ_CST) <= 0);
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
@@ -50,6 +50,7 @@
 #include "threads.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 #include <errno.h>
@@ -57,6 +58,42 @@
 
 static const int is_mutex = 'm';
 
+/*
+ * @struct mutex_prof - contention statistics shared by all mutexes
+ * with the same name. These are never freed, so a report can still
+ * include mutexes that have been destroyed.
+ */
+struct mutex_prof {
+    /*! next in mutex_prof_list */
+    struct mutex_prof *pNext;
+
+    /*! the mutex name */
+    const char *name;
+
+    /*! number of (outer most) successful locks */
+    uint64_t n_acquired;
+
+    /*! number of lock attempts that found the mutex already held */
+    uint64_t n_contended;
+
+    /*! time spent waiting on a held mutex */
+    uint64_t wait_total_nSecs;
+    uint64_t wait_max_nSecs;
+
+    /*! time from the outer most lock to the final unlock */
+    uint64_t hold_total_nSecs;
+    uint64_t hold_max_nSecs;
+
+    /*! the thread responsible for hold_max_nSecs */
+    char hold_max_thread[32];
+};
+
+/* all profile entries, protected by the global atomic lock */
+static struct mutex_prof *mutex_prof_list;
+
+/* are we collecting statistics? */
+static volatile bool mutex_prof_enabled;
+
 /*
  * @struct mutex - internal representation of a mutex
  */
@@ -67,14 +104,20 @@ struct mutex {
     /*! for structure pointing checks */
     const int *check_val;
 
-    /*! Underlying implimentation is a linux semaphore */
+    /*! Underlying implimentation, a recursive hlos atomic */
     intptr_t    m;
 
-    /*! Who owns this, requird for recursive mutexes */
+    /*! Who owns this, for MUTEX_lockerName() */
     intptr_t  owner;
 
-    /*! non-zero recursive lock depth counter */
+    /*! non-zero recursive lock depth counter, only changed by the owner */
     int        recursive_lock;
+
+    /*! contention statistics for this mutex name */
+    struct mutex_prof *prof;
+
+    /*! when the owner took the lock, 0 if not profiled */
+    uint64_t   hold_start_nSecs;
 };
 
 /* get a safe debug name for this mutex */
@@ -111,6 +154,120 @@ static struct mutex * h2m(intptr_t h)
     return (pM);
 }
 
+/* find or create the profile entry for this mutex name */
+static struct mutex_prof *_mutex_prof_find(const char *name)
+{
+    struct mutex_prof *pP;
+
+    _ATOMIC_global_lock();
+    for(pP = mutex_prof_list ; pP ; pP = pP->pNext)
+    {
+        if(0 == strcmp(pP->name, name))
+        {
+            break;
+        }
+    }
+    if(pP == NULL)
+    {
+        pP = calloc(1, sizeof(*pP));
+        if(pP)
+        {
+            pP->name = strdup(name);
+            if(pP->name == NULL)
+            {
+                free((void *)(pP));
+                pP = NULL;
+            }
+        }
+        if(pP)
+        {
+            pP->pNext = mutex_prof_list;
+            mutex_prof_list = pP;
+        }
+    }
+    _ATOMIC_global_unlock();
+    /* NULL (no memory) simply means this mutex is not profiled */
+    return (pP);
+}
+
+/* record a new maximum, returns true if it was a new maximum */
+static bool _mutex_prof_max(uint64_t *pMax, uint64_t v)
+{
+    bool answer;
+
+    /* the common case: not a new maximum, no locking required */
+    if(v <= __atomic_load_n(pMax, __ATOMIC_RELAXED))
+    {
+        return (false);
+    }
+    _ATOMIC_global_lock();
+    answer = (v > *pMax);
+    if(answer)
+    {
+        __atomic_store_n(pMax, v, __ATOMIC_RELAXED);
+    }
+    _ATOMIC_global_unlock();
+    return (answer);
+}
+
+/*
+ * Lock with statistics, first try without waiting so we know
+ * if the lock was contended and only then measure the wait.
+ */
+static int _mutex_prof_lock(struct mutex *pM, int timeout_mSecs)
+{
+    struct mutex_prof *pP;
+    uint64_t tstart;
+    uint64_t waited;
+    int r;
+
+    r = _ATOMIC_local_lock(pM->m, 0);
+    if((r == 0) || (pM->prof == NULL))
+    {
+        if((r != 0) && (timeout_mSecs != 0))
+        {
+            r = _ATOMIC_local_lock(pM->m, timeout_mSecs);
+        }
+        return (r);
+    }
+
+    pP = pM->prof;
+    __atomic_fetch_add(&(pP->n_contended), 1, __ATOMIC_RELAXED);
+    if(timeout_mSecs == 0)
+    {
+        return (r);
+    }
+
+    tstart = TIMER_getNowNs();
+    r = _ATOMIC_local_lock(pM->m, timeout_mSecs);
+    waited = TIMER_getNowNs() - tstart;
+
+    __atomic_fetch_add(&(pP->wait_total_nSecs), waited, __ATOMIC_RELAXED);
+    _mutex_prof_max(&(pP->wait_max_nSecs), waited);
+    return (r);
+}
+
+/* the owner is about to release the mutex, record how long it was held */
+static void _mutex_prof_unlock(struct mutex *pM)
+{
+    struct mutex_prof *pP;
+    uint64_t held;
+
+    pP = pM->prof;
+    held = TIMER_getNowNs() - pM->hold_start_nSecs;
+    pM->hold_start_nSecs = 0;
+
+    __atomic_fetch_add(&(pP->hold_total_nSecs), held, __ATOMIC_RELAXED);
+    if(_mutex_prof_max(&(pP->hold_max_nSecs), held))
+    {
+        /* rare, only when a new maximum is set */
+        _ATOMIC_global_lock();
+        strncpy(pP->hold_max_thread, THREAD_selfName(),
+                sizeof(pP->hold_max_thread) - 1);
+        _ATOMIC_global_unlock();
+    }
+}
+
 /*
  * Create a mutex
  *
@@ -153,6 +310,7 @@ intptr_t MUTEX_create(const char *name)
     {
         BUG_HERE("no memory\n");
     }
+    pM->prof = _mutex_prof_find(name);
 
     /*LOG_printf(LOG_ALWAYS, "Create mutex: %s @ %p\n", pM->dbg_name, (void *)(pM)); */
     return ((intptr_t)(pM));
@@ -203,8 +361,6 @@ int MUTEX_lock(intptr_t h, int timeout_mSecs)
 {
     struct mutex *pM;
     int r;
-    bool need_lock;
-    intptr_t whoami;
     uint32_t tstart, tend;
 
     /* recover our mutex pointer */
@@ -214,35 +370,38 @@ int MUTEX_lock(intptr_t h, int timeout_mSecs)
         return (-1);
     }
 
-    /* inspect.. */
-    whoami = THREAD_self();
-    need_lock = true;
-    _ATOMIC_global_lock();
-    if(pM->recursive_lock)
+    /* the atomic handles recursion, uncontended this is one CAS */
+    tstart = (timeout_mSecs > 0) ? TIMER_getNow() : 0;
+    if(mutex_prof_enabled)
     {
-        if(pM->owner == whoami)
-        {
-            need_lock = false;
-        }
+        r = _mutex_prof_lock(pM, timeout_mSecs);
     }
-    _ATOMIC_global_unlock();
-    tstart = TIMER_getNow();
-    r = 0;
-    if(need_lock)
+    else
     {
         r = _ATOMIC_local_lock(pM->m, timeout_mSecs);
     }
     if(r == 0)
     {
-        /* success */
-        /* so we can detect recursive locks */
-        pM->owner = THREAD_self();
+        /* success, we own it so no other locking is needed */
         pM->recursive_lock += 1;
-        LOG_printf(LOG_DBG_MUTEX,
-                   "%s: MUTEX_lock(%s) success (recursion=%d)\n",
-                   THREAD_selfName(),
-                    _mutex_name(pM),
-            pM->recursive_lock);
+        if(pM->recursive_lock == 1)
+        {
+            pM->owner = THREAD_self();
+            if(mutex_prof_enabled && pM->prof)
+            {
+                __atomic_fetch_add(&(pM->prof->n_acquired), 1,
+                                   __ATOMIC_RELAXED);
+                pM->hold_start_nSecs = TIMER_getNowNs();
+            }
+        }
+        if(LOG_test(LOG_DBG_MUTEX))
+        {
+            LOG_printf(LOG_DBG_MUTEX,
+                       "%s: MUTEX_lock(%s) success (recursion=%d)\n",
+                       THREAD_selfName(),
+                       _mutex_name(pM),
+                       pM->recursive_lock);
+        }
     }
     else
     {
@@ -270,7 +429,7 @@ int MUTEX_unLock(intptr_t h)
         return (-1);
     }
 
-    _ATOMIC_global_lock();
+    /* we own it, so no other locking is needed */
     r = pM->recursive_lock;
     if(r == 0)
     {
@@ -281,10 +440,17 @@ int MUTEX_unLock(intptr_t h)
     if(r == 0)
     {
         pM->owner = 0; /* nobody owns this */
-        _ATOMIC_local_unlock(pM->m);
+        if(pM->hold_start_nSecs)
+        {
+            _mutex_prof_unlock(pM);
+        }
     }
-    _ATOMIC_global_unlock();
-    if(r)
+    _ATOMIC_local_unlock(pM->m);
+    if(!LOG_test(LOG_DBG_MUTEX))
+    {
+        /* nothing to log */
+    }
+    else if(r)
     {
         LOG_printf(LOG_DBG_MUTEX,
             "%s: MUTEX_unLock(%s) still locked(%d)\n",
@@ -338,6 +504,123 @@ bool MUTEX_isLocked(intptr_t h)
     return (answer);
 }
 
+/* qsort() helper, the largest total wait first */
+static int _mutex_prof_cmp(const void *a, const void *b)
+{
+    const struct mutex_prof *pA;
+    const struct mutex_prof *pB;
+
+    pA = *((const struct mutex_prof * const *)(a));
+    pB = *((const struct mutex_prof * const *)(b));
+
+    if(pA->wait_total_nSecs > pB->wait_total_nSecs)
+    {
+        return (-1);
+    }
+    if(pA->wait_total_nSecs < pB->wait_total_nSecs)
+    {
+        return (1);
+    }
+    return (strcmp(pA->name, pB->name));
+}
+
+/*
+ * Enable or disable contention profiling
+ *
+ * Public function defined in mutex.h
+ */
+void MUTEX_profileEnable(bool enable)
+{
+    mutex_prof_enabled = enable;
+}
+
+/*
+ * Log the contention profile
+ *
+ * Public function defined in mutex.h
+ */
+void MUTEX_profileReport(void)
+{
+    struct mutex_prof *pP;
+    struct mutex_prof **pList;
+    int n;
+    int x;
+
+    /* the list only grows at the head, so snapshot it */
+    _ATOMIC_global_lock();
+    n = 0;
+    for(pP = mutex_prof_list ; pP ; pP = pP->pNext)
+    {
+        n++;
+    }
+    pList = calloc(n + 1, sizeof(*pList));
+    if(pList)
+    {
+        n = 0;
+        for(pP = mutex_prof_list ; pP ; pP = pP->pNext)
+        {
+            pList[n++] = pP;
+        }
+    }
+    _ATOMIC_global_unlock();
+
+    if(pList == NULL)
+    {
+        LOG_printf(LOG_ERROR, "MUTEX_profileReport() no memory\n");
+        return;
+    }
+    qsort((void *)(pList), n, sizeof(*pList), _mutex_prof_cmp);
+
+    LOG_printf(LOG_ALWAYS, "mutex profile (%s), times in uSecs\n",
+               mutex_prof_enabled ? "enabled" : "disabled");
+    LOG_printf(LOG_ALWAYS, "%-20s %10s %10s %12s %10s %12s %10s %s\n",
+               "name", "locks", "contended",
+               "wait-total", "wait-max",
+               "hold-total", "hold-max", "max-holder");
+    for(x = 0 ; x < n ; x++)
+    {
+        pP = pList[x];
+        if(pP->n_acquired == 0)
+        {
+            continue;
+        }
+        LOG_printf(LOG_ALWAYS,
+                   "%-20s %10llu %10llu %12llu %10llu %12llu %10llu %s\n",
+                   pP->name,
+                   (unsigned long long)(pP->n_acquired),
+                   (unsigned long long)(pP->n_contended),
+                   (unsigned long long)(pP->wait_total_nSecs / 1000),
+                   (unsigned long long)(pP->wait_max_nSecs / 1000),
+                   (unsigned long long)(pP->hold_total_nSecs / 1000),
+                   (unsigned long long)(pP->hold_max_nSecs / 1000),
+                   pP->hold_max_thread[0] ? pP->hold_max_thread : "-");
+    }
+    free((void *)(pList));
+}
+
+/*
+ * Clear the contention profile
+ *
+ * Public function defined in mutex.h
+ */
+void MUTEX_profileClear(void)
+{
+    struct mutex_prof *pP;
+
+    _ATOMIC_global_lock();
+    for(pP = mutex_prof_list ; pP ; pP = pP->pNext)
+    {
+        pP->n_acquired       = 0;
+        pP->n_contended      = 0;
+        pP->wait_total_nSecs = 0;
+        pP->wait_max_nSecs   = 0;
+        pP->hold_total_nSecs = 0;
+        pP->hold_max_nSecs   = 0;
+        pP->hold_max_thread[0] = 0;
+    }
+    _ATOMIC_global_unlock();
+}
+
 /*
  *  ========================================
  *  Texas Instruments Micro Controller Style
@@ -68,6 +68,124 @@ intptr_t STREAM_debug_stdout;
 /* used to verify a stream pointer */
 static const int stream_check = 'S' + 'C';
 
+/*!
+ * @brief [private] release the read buffer of a stream, if any.
+ * @param pIO - the io stream
+ */
+static void _stream_rdBufRelease(struct io_stream *pIO)
+{
+    if(pIO->rd_buf)
+    {
+        free((void *)(pIO->rd_buf));
+    }
+    pIO->rd_buf      = NULL;
+    pIO->rd_buf_size = 0;
+    pIO->rd_head     = 0;
+    pIO->rd_tail     = 0;
+}
+
+/*!
+ * @brief [private] Number of bytes that can be read without the backend
+ * @param pIO - the io stream
+ * @returns count of pushback plus buffered bytes
+ */
+static size_t _stream_nBuffered(const struct io_stream *pIO)
+{
+    return ((size_t)(pIO->n_unget) + (pIO->rd_tail - pIO->rd_head));
+}
+
+/*!
+ * @brief [private] Refill the (empty) read buffer
+ * @param pIO - the io stream, must have a buffer
+ * @param timeout_mSecs - how long to wait for the first byte
+ * @returns same as the rd_fn, negative error, 0 nothing, else count
+ *
+ * We wait (with timeout) only for the first byte, after that we only
+ * take what is already available, because the rd_fn would otherwise
+ * wait for the entire buffer to be filled.
+ */
+static int _stream_rdFill(struct io_stream *pIO, int timeout_mSecs)
+{
+    int r;
+    int n;
+
+    pIO->rd_head = 0;
+    pIO->rd_tail = 0;
+
+    r = (*(pIO->pFuncs->rd_fn))(pIO, pIO->rd_buf, 1, timeout_mSecs);
+    if(r <= 0)
+    {
+        return (r);
+    }
+    if((pIO->rd_buf_size > 1) && (*(pIO->pFuncs->poll_fn))(pIO, 0))
+    {
+        n = (*(pIO->pFuncs->rd_fn))(pIO,
+                                    pIO->rd_buf + 1,
+                                    pIO->rd_buf_size - 1,
+                                    0);
+        /* an error here is reported on the next fill */
+        if(n > 0)
+        {
+            r += n;
+        }
+    }
+    pIO->rd_tail = (size_t)(r);
+    return (r);
+}
+
+/*!
+ * @brief [private] The guts of STREAM_fgetc()
+ * @param pIO - the io stream
+ * @returns EOF or the byte value
+ */
+static int _stream_getc(struct io_stream *pIO)
+{
+    int r;
+
+    /* pushback first */
+    if(pIO->n_unget)
+    {
+        pIO->n_unget--;
+        return ((int)(pIO->unget_buf[pIO->n_unget]));
+    }
+
+    /* then the buffer */
+    if(pIO->rd_buf)
+    {
+        if(pIO->rd_head == pIO->rd_tail)
+        {
+            r = _stream_rdFill(pIO, -1);
+        }
+        else
+        {
+            r = 1;
+        }
+        if(r > 0)
+        {
+            r = (int)(pIO->rd_buf[pIO->rd_head]);
+            pIO->rd_head++;
+            return (r);
+        }
+    }
+    else
+    {
+        uint8_t c;
+
+        r = (*(pIO->pFuncs->rd_fn))(pIO, &c, 1, -1);
+        if(r > 0)
+        {
+            return ((int)(c));
+        }
+    }
+
+    if(r < 0)
+    {
+        pIO->is_error = true;
+    }
+    /* we read nothing, thus we return EOF */
+    return (EOF);
+}
+
 /*
  * Destroy a pseudo-private stream internal structure
  *
@@ -79,7 +197,7 @@ void STREAM_destroyPrivate(struct io_stream *pIO)
     {
         return;
     }
-    /* we have nothing to release */
+    _stream_rdBufRelease(pIO);
     memset((void *)(pIO), 0, sizeof(*pIO));
     free((void *)(pIO));
 }
@@ -275,10 +393,16 @@ int STREAM_ungetc(int c, intptr_t s)
     pIO = STREAM_hToStruct(s);
     if(pIO == NULL)
     {
-        return (-1);
+        return (EOF);
     }
-    pIO->unget_buf = (c & 0x0ff) | 0x0100;
-    return (0);
+    if((c == EOF) || (pIO->n_unget >= STREAM_UNGET_MAX))
+    {
+        return (EOF);
+    }
+    c = c & 0x0ff;
+    pIO->unget_buf[pIO->n_unget] = (uint8_t)(c);
+    pIO->n_unget++;
+    return (c);
 }
 
 /*
@@ -289,8 +413,6 @@ int STREAM_ungetc(int c, intptr_t s)
 int STREAM_fgetc(intptr_t s)
 {
     struct io_stream *pIO;
-    char c;
-    int r;
 
     pIO = STREAM_hToStruct(s);
     if(pIO == NULL)
@@ -298,29 +420,7 @@ int STREAM_fgetc(intptr_t s)
         return (-1);
     }
 
-    if(pIO->unget_buf)
-    {
-        c = (char)(pIO->unget_buf);
-        pIO->unget_buf = 0;
-        return ((int)(c) & 0x0ff);
-    }
-    r = STREAM_rdBytes(s, &c, 1, -1);
-    if(r > 0)
-    {
-        r = c;
-        r = r & 0x0ff;
-    }
-    else if(r == 0)
-    {
-        /* we read nothing, thus we return EOF */
-        r = EOF;
-    }
-    else
-    {
-        pIO->is_error = true;
-        r = EOF;
-    }
-    return (r);
+    return (_stream_getc(pIO));
 }
 
 /*
@@ -332,9 +432,16 @@ char *STREAM_fgets(char *buf, int size, intptr_t h)
 {
     /* read a line of ascii until a universal line ending is found. */
     /* universal means: UNIX, DOS, or MAC - or MIXED formats are ok. */
+    struct io_stream *pIO;
     int c;
     int n;
 
+    pIO = STREAM_hToStruct(h);
+    if(pIO == NULL)
+    {
+        return (NULL);
+    }
+
     /* for debug reasons */
     buf[0] = 0;
     /* always terminate */
@@ -350,7 +457,7 @@ char *STREAM_fgets(char *buf, int size, intptr_t h)
     /* read till terminator */
     for(n = 0 ; n < size ; )
     {
-        c = STREAM_fgetc(h);
+        c = _stream_getc(pIO);
         if(c < 0)
         {
             /* EOF or err */
@@ -374,7 +481,7 @@ char *STREAM_fgets(char *buf, int size, intptr_t h)
         /* DOS line endings: text<CR><LF>text */
         /* ----- */
         /* Peek ahead look for the DOS <lf> */
-        c = STREAM_fgetc(h);
+        c = _stream_getc(pIO);
         if(c < 0)
         {
             /* odd situation */
@@ -461,9 +568,10 @@ int STREAM_rdBytes(intptr_t h,
                     size_t nbytes,
                     int timeout_mSecs)
 {
-    /* read (raw) from file and honor the ungetc case. */
+    /* read (raw) from file and honor the ungetc and buffered case. */
     struct io_stream *pIO;
-    int n;
+    size_t n;
+    size_t this_n;
     int r;
 
     if(nbytes == 0)
@@ -478,45 +586,60 @@ int STREAM_rdBytes(intptr_t h,
     }
 
     n = 0;
-    /* do we have an unget case? */
-    if(pIO->unget_buf)
-    {
-        /* we have an unget byte! */
-        ((char *)(databytes))[0]  = (char)(pIO->unget_buf & 0x0ff);
-        pIO->unget_buf = 0;
-        nbytes    -= 1;
-        databytes = void_ptr_add(databytes, 1);
-        n = 1;
-        /* Do we have great success! */
-        if(nbytes == 0)
-        {
-            return (1);
-        }
+    /* do we have unget bytes? */
+    while(pIO->n_unget && (n < nbytes))
+    {
+        pIO->n_unget--;
+        ((uint8_t *)(databytes))[n] = pIO->unget_buf[pIO->n_unget];
+        n++;
+    }
+
+    /* and buffered bytes? */
+    this_n = pIO->rd_tail - pIO->rd_head;
+    if(this_n > (nbytes - n))
+    {
+        this_n = nbytes - n;
+    }
+    if(this_n)
+    {
+        memcpy(void_ptr_add(databytes, n),
+               (const void *)(pIO->rd_buf + pIO->rd_head),
+               this_n);
+        pIO->rd_head += this_n;
+        n += this_n;
+    }
+
+    /* Do we have great success! */
+    if(n == nbytes)
+    {
+        return ((int)(n));
     }
 
     /* call specific */
-    r = (*(pIO->pFuncs->rd_fn))(pIO, databytes, nbytes, timeout_mSecs);
+    r = (*(pIO->pFuncs->rd_fn))(pIO,
+                                void_ptr_add(databytes, n),
+                                nbytes - n,
+                                timeout_mSecs);
 
-    /* if UNGET did not occur */
+    /* if nothing came from the buffers */
     /*  just return what we got. */
     if(n == 0)
     {
         return (r);
     }
 
-    /* we did an UNGET */
-    /*  But maybe the read call failed? */
+    /* But maybe the read call failed? */
     if(r >= 0)
     {
         /* no it did not, return succes */
-        r += n;
+        r += (int)(n);
         return (r);
     }
 
     /* we had a failure */
-    /* But we got something from the undo buffer. */
+    /* But we got something from the buffers. */
     /* So... it is success (posix rules!) */
-    return (1);
+    return ((int)(n));
 }
 
 /*
@@ -539,15 +662,62 @@ int STREAM_rxAvail(intptr_t h, int timeout_mSec)
         return (0);
     }
     /* yes we do have at least 1 */
-    if(pIO->unget_buf)
+    if(_stream_nBuffered(pIO))
     {
-        return (1);
+        return ((int)(_stream_nBuffered(pIO)));
     }
 
     /* call handler otherwise */
     return ((*(pIO->pFuncs->poll_fn))(pIO,timeout_mSec));
 }
 
+/*
+ * Give a stream a read buffer (or remove it)
+ *
+ * Public function defined in stream.h
+ */
+int STREAM_setRdBuffer(intptr_t h, size_t nbytes)
+{
+    struct io_stream *pIO;
+    uint8_t *pNew;
+    size_t n;
+
+    pIO = STREAM_hToStruct(h);
+    if(pIO == NULL)
+    {
+        return (-1);
+    }
+
+    n = pIO->rd_tail - pIO->rd_head;
+    if(n > nbytes)
+    {
+        /* unread data would be lost */
+        LOG_printf(LOG_ERROR, "%s: rd-buffer: %d bytes unread\n",
+                   pIO->pFuncs->name, (int)(n));
+        return (-1);
+    }
+
+    pNew = NULL;
+    if(nbytes)
+    {
+        pNew = malloc(nbytes);
+        if(pNew == NULL)
+        {
+            return (-1);
+        }
+        if(n)
+        {
+            memcpy((void *)(pNew), (const void *)(pIO->rd_buf + pIO->rd_head), n);
+        }
+    }
+
+    _stream_rdBufRelease(pIO);
+    pIO->rd_buf      = pNew;
+    pIO->rd_buf_size = nbytes;
+    pIO->rd_tail     = n;
+    return (0);
+}
+
 /*
  * Flush (write-commit) all data in a stream to the output device
  *
@@ -582,6 +752,9 @@ void STREAM_close(intptr_t h)
     pIO = STREAM_hToStruct(h);
     if(pIO)
     {
+        /* some close functions wipe the io_stream */
+        _stream_rdBufRelease(pIO);
+        pIO->n_unget = 0;
         (*(pIO->pFuncs->close_fn))(pIO);
     }
 }
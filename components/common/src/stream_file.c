@@ -160,13 +160,14 @@ static int _file_rd_fn(struct io_stream *pIO,
     if(fp)
     {
         _r = fread(pData, sizeof(char), n,fp);
-        if(_r == n)
+        if((_r == 0) && ferror(fp))
         {
-            r = (int)(n);
+            r = -1;
         }
         else
         {
-            r = -1;
+            /* short read at the end of the file is not an error */
+            r = (int)(_r);
         }
     }
     else
@@ -0,0 +1,136 @@
+/******************************************************************************
+ @file stream_shm_ini.c
+
+ @brief TIMAC 2.0 API Parse INI files to configure shared memory streams
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#include "compiler.h"
+#include "stream.h"
+#include "ini_file.h"
+#include "stream_shm.h"
+
+#include <string.h>
+
+static const struct ini_flag_name shm_types[] = {
+    { .name = "server", .value = 's' },
+    { .name = "client", .value = 'c' },
+    { .name = NULL }
+};
+
+/*
+ * Public function defined in stream_shm.h
+ */
+int SHM_INI_settingsOne(struct ini_parser *pINI,
+                         bool *handled,
+                         struct shm_cfg *pCFG)
+{
+    bool is_not;
+    const struct ini_flag_name *pF;
+    int r;
+
+    if(pINI->item_name == NULL)
+    {
+        return (0);
+    }
+
+    r = -1;
+
+    if(INI_itemMatches(pINI, NULL, "type"))
+    {
+        r = 0;
+        is_not = false;
+        INI_dequote(pINI);
+        pF = INI_flagLookup(shm_types, pINI->item_value, &is_not);
+        if(pF == NULL)
+        {
+            INI_syntaxError(pINI, "unknown type: %s\n", pINI->item_value);
+        }
+        else
+        {
+            pCFG->cs = (int)(pF->value);
+        }
+    }
+
+    if(INI_itemMatches(pINI, NULL, "name"))
+    {
+        INI_dequote(pINI);
+        pCFG->name = INI_itemValue_strdup(pINI);
+        r = 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "ring-size"))
+    {
+        pCFG->ring_size = (size_t)INI_valueAsU64(pINI);
+        r = 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "attach-timeout-msecs"))
+    {
+        pCFG->attach_timeout_mSecs = INI_valueAsInt(pINI);
+        r = 0;
+    }
+
+    if(r == 0)
+    {
+        /* we handle it here */
+        *handled = true;
+    }
+    else
+    {
+        INI_syntaxError(pINI, "unknown shm item\n");
+    }
+    return (r);
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
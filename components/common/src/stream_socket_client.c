@@ -55,10 +55,13 @@
 #include <sys/types.h>
 #if defined(__linux__)
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #endif
 #if defined(_MSC_VER)
 #include "winsock2.h"
@@ -205,6 +208,20 @@ static bool socket_client_poll(struct io_stream *pIO, int mSec_timeout)
     return (_stream_socket_poll(pS, mSec_timeout));
 }
 
+/*!
+ * @brief [private] release the address list from a connect
+ * @param pS - the socket
+ */
+static void socket_client_addr_free(struct linux_socket *pS)
+{
+    if(pS->pAddrList)
+    {
+        freeaddrinfo(pS->pAddrList);
+    }
+    pS->pAddrList = NULL;
+    pS->pAddrNext = NULL;
+}
+
 /*!
  * @brief [private] method handler for the STREAM_Flush() for the client socket
  * @param pIO - the io stream
@@ -217,6 +234,7 @@ static void socket_client_close(struct io_stream *pIO)
     pS = _stream_socket_io2ps(pIO, 'c');
     if(pS)
     {
+        socket_client_addr_free(pS);
         _stream_socket_close(pS);
     }
 }
@@ -257,7 +275,9 @@ intptr_t SOCKET_CLIENT_create(struct socket_cfg *pCFG)
 
     /* sanity checks */
     /* these are required for client */
-    if((pCFG->host == NULL) || (pCFG->service == NULL))
+    /* unix sockets only need the host (path) */
+    if((pCFG->host == NULL) ||
+       ((pCFG->service == NULL) && (pCFG->inet_4or6 != SOCKET_INET_UNIX)))
     {
         LOG_printf(LOG_ERROR, "socket_client: create bad host/service\n");
         return (0);
@@ -280,57 +300,97 @@ intptr_t SOCKET_CLIENT_create(struct socket_cfg *pCFG)
     }
 }
 
-/*
- * Connect a stream socket
- *
- * Public function defined in stream_socket.h
+/*!
+ * @brief [private] connect a unix domain client socket
+ * @param pS - the socket information
+ * @returns 0 on success, negative on error
  */
-int SOCKET_CLIENT_connect(intptr_t h)
+static int socket_client_connect_unix(struct linux_socket *pS)
 {
-    struct linux_socket *pS;
-    struct addrinfo hints;
-    struct addrinfo *result;
-    struct addrinfo *rp;
+    struct sockaddr_un addr;
+    socklen_t addr_len;
     int r;
 
-    pS = _stream_socket_h2ps(h,'c');
-    if(pS == NULL)
+    r = _stream_socket_unix_addr(pS, &addr, &addr_len);
+    if(r < 0)
+    {
+        return (r);
+    }
+
+    pS->h = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(pS->h < 0)
     {
+        _stream_socket_error(pS, "socket()", _socket_errno(), NULL);
         return (-1);
     }
 
-    /* close if already open & ignore failures */
-    _stream_socket_close(pS);
+    r = connect(pS->h, (const struct sockaddr *)(&addr), addr_len);
+    if(r == -1)
+    {
+        _stream_socket_error(pS, "connect()", _socket_errno(), NULL);
+        _stream_socket_close(pS);
+        return (-1);
+    }
 
-    /* reset error & connection state. */
-    pS->pParent->is_error = false;
-    pS->is_connected      = false;
-    pS->err_action        = "connect()";
+    /* Great Success :-) */
+    pS->is_connected = true;
+    LOG_printf(LOG_DBG_SOCKET,
+                "client: (connection=%d) Connect success (unix)\n",
+                pS->connection_id);
+    return (0);
+}
 
-    /* setup for getaddrinfo() */
-    memset((void *)(&hints), 0, sizeof(hints));
-    hints.ai_family   = AF_UNSPEC;    /* Allow IPv4 or IPv6 */
-    hints.ai_socktype = SOCK_STREAM;  /* simple streaming socket */
-    hints.ai_flags    = 0;
-    hints.ai_protocol = 0;            /* Any protocol */
+/*!
+ * @brief [private] The connect succeeded, finish up
+ * @param pS - the socket information
+ * @returns 1 (connected)
+ */
+static int socket_client_connected(struct linux_socket *pS)
+{
+    int f;
 
-    /* Parse the address info */
-    r = getaddrinfo(pS->cfg.host, pS->cfg.service, &(hints), &result);
-    if(r != 0)
+    /* the read & write code expect a blocking socket */
+    f = fcntl(pS->h, F_GETFL, 0);
+    if(f != -1)
     {
-        _stream_socket_error(pS, "getaddrinfo()", r,gai_strerror(r));
-        return (-1);
+        (void)fcntl(pS->h, F_SETFL, f & (~O_NONBLOCK));
     }
+    socket_client_addr_free(pS);
 
-    /* try each address result */
-    rp = result;
-    for(rp = result ; rp != NULL ; rp = rp->ai_next)
+    /* Great Success :-) */
+    pS->is_connected = true;
+    LOG_printf(LOG_DBG_SOCKET,
+                "client: (connection=%d) Connect success\n",
+                pS->connection_id);
+    return (1);
+}
+
+/*!
+ * @brief [private] Start a non-blocking connect to the next address
+ * @param pS - the socket information
+ * @returns negative if no address works, 0 in progress, 1 connected
+ */
+static int socket_client_connect_next(struct linux_socket *pS)
+{
+    struct addrinfo *rp;
+    int r;
+    int f;
+
+    for(;;)
     {
+        rp = pS->pAddrNext;
+        if(rp == NULL)
+        {
+            break;
+        }
+        pS->pAddrNext = rp->ai_next;
+
         /* what INET should we use? */
 #define _support_inet4 _bit0
 #define _support_inet6 _bit1
         switch (pS->cfg.inet_4or6)
         {
+        default:
         case 0:
             r = (_support_inet4 | _support_inet6);
             break;
@@ -388,33 +448,180 @@ int SOCKET_CLIENT_connect(intptr_t h)
             goto next_socket;
         }
 
+        /* do not block, the caller polls for completion */
+        f = fcntl(pS->h, F_GETFL, 0);
+        if((f == -1) || (fcntl(pS->h, F_SETFL, f | O_NONBLOCK) == -1))
+        {
+            _stream_socket_error(pS, "fcntl()", _socket_errno(), NULL);
+            goto next_socket;
+        }
+
         /* go for it! */
         r = connect(pS->h, rp->ai_addr, (socklen_t)(rp->ai_addrlen));
-        if(r == -1)
+        if(r == 0)
         {
-            _stream_socket_error(pS, "connect()", _socket_errno(), NULL);
-            goto next_socket;
+            /* can happen with local connections */
+            return (socket_client_connected(pS));
         }
-        /* Great Success :-) */
-        break;
+        if(_socket_errno() == EINPROGRESS)
+        {
+            return (0);
+        }
+        _stream_socket_error(pS, "connect()", _socket_errno(), NULL);
+        goto next_socket;
     }
 
-    /* release the addresses we have */
-    freeaddrinfo(result);
-    result = NULL;
+    /* nothing worked */
+    socket_client_addr_free(pS);
+    _stream_socket_error(pS, "client-nomore", 0, "");
+    return (-1);
+}
+
+/*
+ * Start connecting a stream socket
+ *
+ * Public function defined in stream_socket.h
+ */
+int SOCKET_CLIENT_connectStart(intptr_t h)
+{
+    struct linux_socket *pS;
+    struct addrinfo hints;
+    int r;
 
-    /* did anything work/ */
+    pS = _stream_socket_h2ps(h,'c');
+    if(pS == NULL)
+    {
+        return (-1);
+    }
+
+    /* close if already open & ignore failures */
+    socket_client_addr_free(pS);
+    _stream_socket_close(pS);
+
+    /* reset error & connection state. */
+    pS->pParent->is_error = false;
+    pS->is_connected      = false;
+    pS->err_action        = "connect()";
+
+    /* unix sockets do not use getaddrinfo() */
+    /* and a local connect does not need to wait */
+    if(pS->cfg.inet_4or6 == SOCKET_INET_UNIX)
+    {
+        r = socket_client_connect_unix(pS);
+        if(r == 0)
+        {
+            r = 1;
+        }
+        return (r);
+    }
+
+    /* setup for getaddrinfo() */
+    memset((void *)(&hints), 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;    /* Allow IPv4 or IPv6 */
+    hints.ai_socktype = SOCK_STREAM;  /* simple streaming socket */
+    hints.ai_flags    = 0;
+    hints.ai_protocol = 0;            /* Any protocol */
+
+    /* Parse the address info */
+    r = getaddrinfo(pS->cfg.host, pS->cfg.service, &(hints), &(pS->pAddrList));
+    if(r != 0)
+    {
+        pS->pAddrList = NULL;
+        _stream_socket_error(pS, "getaddrinfo()", r,gai_strerror(r));
+        return (-1);
+    }
+
+    /* try each address result */
+    pS->pAddrNext = pS->pAddrList;
+    return (socket_client_connect_next(pS));
+}
+
+/*
+ * Wait for a connect to complete
+ *
+ * Public function defined in stream_socket.h
+ */
+int SOCKET_CLIENT_connectPoll(intptr_t h, int timeout_mSecs)
+{
+    struct linux_socket *pS;
+    struct pollfd pfd;
+    socklen_t len;
+    int err;
+    int r;
+
+    pS = _stream_socket_h2ps(h,'c');
+    if(pS == NULL)
+    {
+        return (-1);
+    }
+
+    if(pS->is_connected)
+    {
+        return (1);
+    }
     if(pS->h < 0)
     {
-        _stream_socket_error(pS, "client-nomore", 0, "");
+        /* not connecting */
         return (-1);
     }
-    /* Great Success :-) */
-    pS->is_connected = true;
-    LOG_printf(LOG_DBG_SOCKET,
-                "client: (connection=%d) Connect success\n",
-                pS->connection_id);
-    return (0);
+
+    memset((void *)(&pfd), 0, sizeof(pfd));
+    pfd.fd     = (int)(pS->h);
+    pfd.events = POLLOUT;
+    r = poll(&pfd, 1, timeout_mSecs);
+    if(r < 0)
+    {
+        if(_socket_errno() == EINTR)
+        {
+            return (0);
+        }
+        _stream_socket_error(pS, "poll()", _socket_errno(), NULL);
+        return (-1);
+    }
+    if(r == 0)
+    {
+        /* timeout, still in progress */
+        return (0);
+    }
+
+    /* it finished, did it work? */
+    err = 0;
+    len = sizeof(err);
+    r = getsockopt((int)(pS->h), SOL_SOCKET, SO_ERROR, (void *)(&err), &len);
+    if(r < 0)
+    {
+        err = _socket_errno();
+    }
+    if(err == 0)
+    {
+        return (socket_client_connected(pS));
+    }
+
+    /* this address failed, try the next */
+    _stream_socket_error(pS, "connect()", err, NULL);
+    _stream_socket_close(pS);
+    return (socket_client_connect_next(pS));
+}
+
+/*
+ * Connect a stream socket
+ *
+ * Public function defined in stream_socket.h
+ */
+int SOCKET_CLIENT_connect(intptr_t h)
+{
+    int r;
+
+    r = SOCKET_CLIENT_connectStart(h);
+    while(r == 0)
+    {
+        r = SOCKET_CLIENT_connectPoll(h, -1);
+    }
+    if(r > 0)
+    {
+        r = 0;
+    }
+    return (r);
 }
 
 /*
@@ -177,11 +177,17 @@ int SOCKET_INI_settingsOne(struct ini_parser *pINI,
                 pCFG->inet_4or6 = 0;
                 goto done;
             }
+            else if(0 == strcmp(pINI->item_value, "unix"))
+            {
+                r = 0;
+                pCFG->inet_4or6 = SOCKET_INET_UNIX;
+                goto done;
+            }
             else
             {
             bad_inet46:
                 INI_syntaxError(pINI,
-                                "inet must be 4, 6 or any, not: %s\n",
+                                "inet must be 4, 6, any or unix, not: %s\n",
                                 pINI->item_value);
                 return (-1);
             }
@@ -54,6 +54,7 @@
 #include <sys/types.h>
 #if defined(__linux__)
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -194,6 +195,13 @@ struct linux_socket *_stream_socket_create(const struct socket_cfg *pCFG,
     case 4: /* specifically inet4 */
     case 6: /* specifically inet6 */
         break;
+    case SOCKET_INET_UNIX: /* local unix domain socket */
+        if((pCFG->host == NULL) || (pCFG->host[0] == 0))
+        {
+            LOG_printf(LOG_ERROR, "unix socket requires a path (host)\n");
+            return (0);
+        }
+        break;
     default:
         LOG_printf(LOG_ERROR, "invalid inet_4or6\n");
         return (0);
@@ -256,6 +264,23 @@ bool STREAM_SOCKET_isConnected(intptr_t h)
     return (answer);
 }
 
+/*
+ * Get the OS file descriptor of a socket
+ *
+ * Public function defined in stream_socket.h
+ */
+int STREAM_SOCKET_getFd(intptr_t h)
+{
+    struct linux_socket *pS;
+
+    pS = _stream_socket_h2ps(h,0);
+    if(pS == NULL)
+    {
+        return (-1);
+    }
+    return ((int)(pS->h));
+}
+
 /*
  * Destroy a socket created by various SOCKET_<name>_create() calls
  *
@@ -285,6 +310,12 @@ void _stream_socket_destroy(struct linux_socket *pS)
     {
         _stream_socket_close(pS);
     }
+    /* destroyed while a client connect was in progress? */
+    if(pS->pAddrList)
+    {
+        freeaddrinfo(pS->pAddrList);
+        pS->pAddrList = NULL;
+    }
     if(pS->pParent)
     {
         STREAM_destroyPrivate(pS->pParent);
@@ -364,6 +395,46 @@ int _stream_socket_bind_to_device(struct linux_socket *pS)
     return (r);
 }
 
+/*
+ * Fill in a unix domain socket address from the configured path
+ * Pseudo-private to socket implimentations.
+ *
+ * Pseudo-private function defined in stream_socket_private
+ */
+int _stream_socket_unix_addr(struct linux_socket *pS,
+                             struct sockaddr_un *pAddr,
+                             socklen_t *pLen)
+{
+    const char *path;
+    size_t l;
+
+    path = pS->cfg.host;
+    memset((void *)(pAddr), 0, sizeof(*pAddr));
+    pAddr->sun_family = AF_UNIX;
+
+    l = strlen(path);
+    /* the name and (for non-abstract names) the terminating null must fit */
+    if((l == 0) || (l >= sizeof(pAddr->sun_path)))
+    {
+        _stream_socket_error(pS, "unix-path-length", 0, path);
+        return (-1);
+    }
+
+    /* copy the name, for the abstract namespace the '@' becomes a null */
+    memcpy((void *)(pAddr->sun_path), path, l);
+    if(path[0] == '@')
+    {
+        pAddr->sun_path[0] = 0;
+        /* abstract names are not null terminated, the length counts */
+        *pLen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + l);
+    }
+    else
+    {
+        *pLen = (socklen_t)(sizeof(*pAddr));
+    }
+    return (0);
+}
+
 /*
  * Print an error message with this socket and mark the stream as in error
  *
@@ -512,6 +583,14 @@ void _stream_socket_close(struct linux_socket *pS)
 #endif
 #if defined(__linux__)
         close(pS->h);
+
+        /* a server leaves its socket file behind, remove it */
+        if((pS->cfg.inet_4or6 == SOCKET_INET_UNIX) &&
+           ((pS->cfg.ascp == 's') || (pS->cfg.ascp == 'l')) &&
+           (pS->cfg.host[0] != '@'))
+        {
+            (void)unlink(pS->cfg.host);
+        }
 #endif
         pS->h = -1;
         if(pS->h != -1)
@@ -55,6 +55,9 @@
 #error "This file is private to the stream socket implementation"
 #endif
 
+/* forward decloration */
+struct addrinfo;
+
 /*!
  * @struct linux_socket
  * @brief  [private] struct common to client & server sockets
@@ -79,6 +82,12 @@ struct linux_socket {
     /*! True if this socket is currently connected */
     bool   is_connected;
 
+    /*! Client only, addresses from getaddrinfo() during a connect */
+    struct addrinfo *pAddrList;
+
+    /*! Client only, the next address to try if this connect fails */
+    struct addrinfo *pAddrNext;
+
     /*! Connection id */
     int    connection_id;
 
@@ -166,6 +175,20 @@ bool _stream_socket_poll(struct linux_socket *pS, int mSecs_timeout);
  */
 int _stream_socket_bind_to_device(struct linux_socket *pS);
 
+/* forward decloration */
+struct sockaddr_un;
+
+/*!
+ * @brief Build the address for a unix domain socket from the cfg.host path
+ * @param pS - the socket information
+ * @param pAddr - the address to fill in
+ * @param pLen - set to the address length to use with bind() or connect()
+ * @return 0 on sucess
+ */
+int _stream_socket_unix_addr(struct linux_socket *pS,
+                             struct sockaddr_un *pAddr,
+                             socklen_t *pLen);
+
 /*!
  * @brief Mark socket as reusable
  * @param pS - the socket
@@ -55,6 +55,7 @@
 #include <sys/types.h>
 #if defined(__linux__)
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -224,7 +225,8 @@ static bool socket_server_poll(struct io_stream *pIO, int mSec_timeout)
 {
     struct linux_socket *pS;
 
-    pS = _stream_socket_io2ps(pIO, 's');
+    /* listening (accept) or accepted socket, type code = don't care */
+    pS = _stream_socket_io2ps(pIO, 0);
     if(pS == NULL)
     {
         return (false);
@@ -275,6 +277,48 @@ static const struct io_stream_funcs socket_server_funcs = {
     .flush_fn = socket_server_flush
 };
 
+/*!
+ * @brief [private] create and bind a unix domain server socket
+ * @param pS - the socket information
+ * @returns 0 on success, negative on error
+ */
+static int socket_server_create_unix(struct linux_socket *pS)
+{
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    int r;
+
+    r = _stream_socket_unix_addr(pS, &addr, &addr_len);
+    if(r < 0)
+    {
+        return (r);
+    }
+
+    pS->h = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(pS->h < 0)
+    {
+        _stream_socket_error(pS, "socket()", _socket_errno(), NULL);
+        return (-1);
+    }
+
+    /* a file left behind by a previous instance would cause EADDRINUSE */
+    if(pS->cfg.host[0] != '@')
+    {
+        (void)unlink(pS->cfg.host);
+    }
+
+    r = bind(pS->h, (const struct sockaddr *)(&addr), addr_len);
+    if(r != 0)
+    {
+        _stream_socket_error(pS, "bind()", _socket_errno(), NULL);
+        /* not ours, do not use _stream_socket_close() it would unlink */
+        close(pS->h);
+        pS->h = -1;
+        return (-1);
+    }
+    return (0);
+}
+
 /*
  * Create a server socket
  *
@@ -296,7 +340,9 @@ intptr_t SOCKET_SERVER_create(struct socket_cfg *pCFG)
 
     /* The host setting is "optional" for the server */
     /* The service (port number) is manditory */
-    if((pCFG->service == NULL))
+    /* Except for unix sockets, where the host (path) is manditory */
+    /* and that is checked by _stream_socket_create() */
+    if((pCFG->service == NULL) && (pCFG->inet_4or6 != SOCKET_INET_UNIX))
     {
         LOG_printf(LOG_ERROR, "socket-server: create() bad service\n");
         return (0);
@@ -319,6 +365,21 @@ intptr_t SOCKET_SERVER_create(struct socket_cfg *pCFG)
     /* house keeping for errors */
     pS->err_action = "server-create";
 
+    /* unix sockets do not use getaddrinfo() */
+    if(pS->cfg.inet_4or6 == SOCKET_INET_UNIX)
+    {
+        r = socket_server_create_unix(pS);
+        if(r < 0)
+        {
+            _stream_socket_destroy(pS);
+            return (0);
+        }
+        LOG_printf(LOG_DBG_SOCKET,
+                    "socket(server:%s) ready to accept\n",
+                    pS->cfg.host);
+        return (STREAM_structToH(pS->pParent));
+    }
+
     /* we are binding to a specific ip address? */
     host = pS->cfg.host;
     if(host)
@@ -517,6 +578,13 @@ static const char *get_ip_str(const struct sockaddr *sa, char *s, size_t maxlen)
         inet_ntop(AF_INET6, &(SA6->sin6_addr),s, maxlen);
         break;
 
+#if defined(__linux__)
+    case AF_UNIX:
+        /* peers on unix sockets are usually unnamed */
+        strncpy(s, "local", maxlen);
+        break;
+#endif
+
     default:
         strncpy(s, "Unknown AF", maxlen);
         break;
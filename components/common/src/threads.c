@@ -48,6 +48,8 @@
 
 #include "log.h"
 #include "fatal.h"
+#include "latch.h"
+#include "timer.h"
 
 #include <malloc.h>
 #include <string.h>
@@ -88,6 +90,15 @@ struct thread {
     /*! Or did we kill this thread? */
     bool          killed;
 
+    /*! Opens when the thread exits, see THREAD_join() */
+    intptr_t      exit_latch;
+
+    /*! Scheduling settings for this thread, NULL if none */
+    const struct thread_cfg *cfg;
+
+    /*! Usage at the previous THREAD_statsReport() */
+    struct thread_stats last_stats;
+
     /* Next thread in list of known threads */
     struct thread *pNext;
 };
@@ -189,6 +200,11 @@ static struct thread *h2p(intptr_t h)
     return (NULL);
 }
 
+/*!
+ * @brief [private] when THREAD_statsReport() was last called
+ */
+static uint64_t thread_last_report_nSecs;
+
 /*!
  * @brief [private] Lock our list of threads
  * @return void
@@ -218,6 +234,20 @@ static intptr_t thread_wrapper(intptr_t param)
     /* recover our data structure from the pthread parameter */
     pT = (struct thread *)(param);
 
+    /* apply the configured scheduling to ourself */
+    if(pT->cfg)
+    {
+        r = _THREAD_setSched(pT->cfg->sched_policy,
+                             pT->cfg->sched_priority,
+                             pT->cfg->nice,
+                             pT->cfg->cpu_mask);
+        if(r != 0)
+        {
+            LOG_printf(LOG_ERROR, "%s: cannot set scheduling (%s)\n",
+                       _thread_name(pT), strerror((int)(r)));
+        }
+    }
+
     /* Future we might do stuff here. */
     pT->is_alive = true;
     /* life begins.... */
@@ -225,6 +255,7 @@ static intptr_t thread_wrapper(intptr_t param)
     /* time to exit */
     pT->exit_value = r;
     pT->is_alive = false;
+    LATCH_countDown(pT->exit_latch);
     return (r);
 }
 
@@ -265,6 +296,13 @@ intptr_t THREAD_create(const char *name,
     pT->is_alive = false;
     pT->is_dead = false;
     pT->exit_value = 0;
+    pT->exit_latch = LATCH_create(name, 1);
+    if(pT->exit_latch == 0)
+    {
+        free_const((const void *)(name));
+        free((void *)(pT));
+        return (0);
+    }
 
     /* we only support default now */
     if(pT->startflags != THREAD_FLAGS_DEFAULT)
@@ -280,7 +318,11 @@ intptr_t THREAD_create(const char *name,
     thread_list_unlock();
 
     /* create the thread */
-    pT->os_id = _THREAD_create(pT->dbg_name, thread_wrapper, (intptr_t)(pT));
+    pT->cfg = THREAD_cfgFind(pT->dbg_name);
+    pT->os_id = _THREAD_create(pT->dbg_name,
+                               thread_wrapper,
+                               (intptr_t)(pT),
+                               pT->cfg ? pT->cfg->stack_size : 0);
     if(pT->os_id == 0)
     {
         THREAD_destroy((intptr_t)(pT));
@@ -359,6 +401,7 @@ void THREAD_destroy(intptr_t h)
          */
         free_const((const void *)(pT->dbg_name));
     }
+    LATCH_destroy(pT->exit_latch);
 
     memset((void *)(pT), 0, sizeof(*pT));
     free((void *)(pT));
@@ -467,6 +510,7 @@ void THREAD_exit(intptr_t value)
     pT->exit_value = value;
     /* we are dead jim.. */
     pT->is_alive = false;
+    LATCH_countDown(pT->exit_latch);
     /* and die */
     _THREAD_exit();
 }
@@ -488,6 +532,94 @@ bool THREAD_isAlive(intptr_t h)
     return (pT->is_alive);
 }
 
+/*
+ * Wait for a thread to exit
+ *
+ * Public function defined in threads.h
+ */
+int THREAD_join(intptr_t h, int timeout_mSecs)
+{
+    struct thread *pT;
+
+    pT = h2p(h);
+    if(pT == NULL)
+    {
+        return (-1);
+    }
+    return (LATCH_wait(pT->exit_latch, timeout_mSecs));
+}
+
+/*
+ * Get the resource usage of a thread
+ *
+ * Public function defined in threads.h
+ */
+int THREAD_getStats(intptr_t h, struct thread_stats *pStats)
+{
+    struct thread *pT;
+
+    pT = h2p(h);
+    if(pT == NULL)
+    {
+        memset((void *)(pStats), 0, sizeof(*pStats));
+        return (-1);
+    }
+    return (_THREAD_getStats(pT->os_id, pStats));
+}
+
+/*
+ * Log the resource usage of all threads
+ *
+ * Public function defined in threads.h
+ */
+void THREAD_statsReport(void)
+{
+    struct thread *pT;
+    struct thread_stats now;
+    uint64_t tnow;
+    uint64_t elapsed;
+    uint64_t cpu;
+    uint64_t wakeups;
+
+    tnow = TIMER_getNowNs();
+    elapsed = tnow - thread_last_report_nSecs;
+    if(elapsed == 0)
+    {
+        elapsed = 1;
+    }
+    thread_last_report_nSecs = tnow;
+
+    LOG_printf(LOG_ALWAYS,
+               "thread stats, last %llu mSecs, cpu times in mSecs\n",
+               (unsigned long long)(elapsed / 1000000));
+    LOG_printf(LOG_ALWAYS, "%-20s %10s %6s %10s %9s %10s\n",
+               "name", "cpu-total", "cpu-%", "wakeups", "wakeups/s",
+               "preempted");
+
+    /* rare, so holding the list lock while reading /proc is ok */
+    thread_list_lock();
+    for(pT = all_threads ; pT ; pT = pT->pNext)
+    {
+        if((!pT->is_alive) || (_THREAD_getStats(pT->os_id, &now) != 0))
+        {
+            /* not started yet, or has exited */
+            continue;
+        }
+        cpu     = now.cpu_nSecs   - pT->last_stats.cpu_nSecs;
+        wakeups = now.n_voluntary - pT->last_stats.n_voluntary;
+        pT->last_stats = now;
+
+        LOG_printf(LOG_ALWAYS, "%-20s %10llu %6.1f %10llu %9.1f %10llu\n",
+                   _thread_name(pT),
+                   (unsigned long long)(now.cpu_nSecs / 1000000),
+                   (100.0 * (double)(cpu)) / (double)(elapsed),
+                   (unsigned long long)(now.n_voluntary),
+                   (1e9 * (double)(wakeups)) / (double)(elapsed),
+                   (unsigned long long)(now.n_involuntary));
+    }
+    thread_list_unlock();
+}
+
 /*
  *  ========================================
  *  Texas Instruments Micro Controller Style
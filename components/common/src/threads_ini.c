@@ -0,0 +1,231 @@
+/******************************************************************************
+ @file threads_ini.c
+
+ @brief TIMAC 2.0 API Thread scheduling settings from an INI file
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#include "compiler.h"
+#include "threads.h"
+#include "ini_file.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct thread_cfg ALL_INI_THREADS[INI_MAX_THREAD_CFGS];
+
+static const struct ini_flag_name thread_ini_policies[] = {
+    { .name = "default", .value = THREAD_SCHED_DEFAULT },
+    { .name = "other",   .value = THREAD_SCHED_OTHER   },
+    { .name = "fifo",    .value = THREAD_SCHED_FIFO    },
+    { .name = "rr",      .value = THREAD_SCHED_RR      },
+    { .name = NULL }
+};
+
+/*
+ * Rd/Parse thread configuration data from an INI file
+ *
+ * Public function defined in threads.h
+ */
+int THREAD_INI_settingsNth(struct ini_parser *pINI, bool *handled)
+{
+    unsigned nth;
+
+    if(pINI->item_name == NULL)
+    {
+        /* this is the section name, we don't care about it. */
+        return (0);
+    }
+
+    /* is this a thread section? */
+    if(!INI_isNth(pINI, "thread-", &nth))
+    {
+        /* Nope, then leave */
+        return (0);
+    }
+    if(nth >= INI_MAX_THREAD_CFGS)
+    {
+        INI_syntaxError(pINI, "invalid thread index %u\n", nth);
+        return (-1);
+    }
+    return (THREAD_INI_settingsOne(pINI, handled, &(ALL_INI_THREADS[nth])));
+}
+
+/*
+ * Public function defined in threads.h
+ */
+int THREAD_INI_settingsOne(struct ini_parser *pINI,
+                           bool *handled,
+                           struct thread_cfg *pCFG)
+{
+    const struct ini_flag_name *pF;
+    struct ini_numlist nl;
+    bool is_not;
+    int r;
+
+    if(pINI->item_name == NULL)
+    {
+        return (0);
+    }
+
+    r = -1;
+
+    if(INI_itemMatches(pINI, NULL, "name"))
+    {
+        INI_dequote(pINI);
+        pCFG->name = INI_itemValue_strdup(pINI);
+        r = 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "policy"))
+    {
+        r = 0;
+        pF = INI_flagLookup(thread_ini_policies, pINI->item_value, &is_not);
+        if((pF == NULL) || is_not)
+        {
+            INI_syntaxError(pINI, "unknown policy: %s\n", pINI->item_value);
+            r = -1;
+        }
+        else
+        {
+            pCFG->sched_policy = (int)(pF->value);
+        }
+    }
+
+    if(INI_itemMatches(pINI, NULL, "priority"))
+    {
+        pCFG->sched_priority = INI_valueAsInt(pINI);
+        r = 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "nice"))
+    {
+        pCFG->nice = INI_valueAsInt(pINI);
+        r = 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "stack-size"))
+    {
+        pCFG->stack_size = (size_t)INI_valueAsInt(pINI);
+        r = 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "cpus"))
+    {
+        r = 0;
+        pCFG->cpu_mask = 0;
+        INI_valueAsNumberList_init(&nl, pINI);
+        while(INI_valueAsNumberList_next(&nl) != EOF)
+        {
+            if((nl.value < 0) || (nl.value >= 64))
+            {
+                INI_syntaxError(pINI, "invalid cpu: %d\n", nl.value);
+                r = -1;
+                break;
+            }
+            pCFG->cpu_mask |= (((uint64_t)1) << nl.value);
+        }
+        if(nl.is_error)
+        {
+            r = -1;
+        }
+    }
+
+    if(r == 0)
+    {
+        /* we handle it here */
+        *handled = true;
+    }
+    else
+    {
+        INI_syntaxError(pINI, "Unknown\n");
+    }
+    return (r);
+}
+
+/*
+ * Find the settings for a thread
+ *
+ * Public function defined in threads.h
+ */
+const struct thread_cfg *THREAD_cfgFind(const char *name)
+{
+    const struct thread_cfg *pCFG;
+    size_t len;
+    int x;
+
+    for(x = 0 ; x < INI_MAX_THREAD_CFGS ; x++)
+    {
+        pCFG = &(ALL_INI_THREADS[x]);
+        if(pCFG->name == NULL)
+        {
+            continue;
+        }
+        len = strlen(pCFG->name);
+        if((len > 0) && (pCFG->name[len - 1] == '*'))
+        {
+            /* prefix match */
+            if(0 == strncmp(pCFG->name, name, len - 1))
+            {
+                return (pCFG);
+            }
+        }
+        else if(0 == strcmp(pCFG->name, name))
+        {
+            return (pCFG);
+        }
+    }
+    return (NULL);
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
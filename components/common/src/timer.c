@@ -51,6 +51,9 @@
 
 static uint64_t epoch_msecs = 0;
 
+/* the monotonic clock at the epoch */
+static uint64_t epoch_mono_nsecs = 0;
+
 /*
  * Initialize the time keeping system
  */
@@ -58,6 +61,7 @@ static void _epoch_init(void)
 {
     if(epoch_msecs == 0)
     {
+        epoch_mono_nsecs = _TIMER_getMonoNs();
         epoch_msecs = TIMER_getAbsNow();
     }
 }
@@ -95,13 +99,25 @@ void TIMER_init(void)
 unsigned TIMER_getNow(void)
 {
     uint64_t t;
+
+    /* monotonic, so changing the wall clock does not upset timeouts */
+    t = TIMER_getNowNs();
+    t = t / 1000000;
+    return ((unsigned)(t));
+}
+
+/*
+ * get runtime in nano seconds
+ *
+ * Public function defined in timer.h
+ */
+uint64_t TIMER_getNowNs(void)
+{
     if(epoch_msecs == 0)
     {
         _epoch_init();
     }
-    t = TIMER_getAbsNow();
-    t = t - epoch_msecs;
-    return ((unsigned)(t));
+    return (_TIMER_getMonoNs() - epoch_mono_nsecs);
 }
 
 /*
@@ -47,22 +47,23 @@
 #include "timer.h"
 #include "compiler.h"
 #include "log.h"
+#include "fatal.h"
 #include "mutex.h"
 #include "threads.h"
-#include "ti_semaphore.h"
+#include "hlos_specific.h"
 
 #include <malloc.h>
 #include <string.h>
 
 /*
- * @var timer_sem_id
- * @brief Timer thread sleeps on this
+ * @var timer_waiter_h
+ * @brief Timer thread sleeps on this (a high resolution timeout)
  */
-static intptr_t timer_sem_id;
+static intptr_t timer_waiter_h;
 
 /*
  * @var timer_mutex_id
- * @brief Controls access to the timer linked list
+ * @brief Controls access to the timer wheel
  */
 static intptr_t timer_mutex_id;
 
@@ -78,6 +79,37 @@ static intptr_t timer_thread_id;
  */
 static const int timer_check = 'T';
 
+/*
+ * OVERVIEW
+ * ========
+ *
+ * Active timers are kept in a hierarchical timing wheel, rather then
+ * a sorted list, so that insert and cancel are O(1) no matter how
+ * many timers (ie: one per device) exist.
+ *
+ * There are TMR_WHEEL_LEVELS wheels, each with TMR_WHEEL_SLOTS slots.
+ * Level 0 has one slot per millisecond, level 1 one slot per 256
+ * milliseconds and so on, 4 levels cover the entire 32bit mSec range.
+ *
+ * A timer goes into the lowest level that can hold its expire time.
+ * When the level 0 wheel wraps, the next level 1 slot is "cascaded"
+ * its timers are re-inserted, which puts them in level 0, and so on.
+ *
+ * Periodic timers are rescheduled relative to when they should have
+ * expired (not when they actually ran) so they do not drift.
+ *
+ * The timer thread sleeps against the monotonic clock until the
+ * exact start of the next tick that has work, so the callback
+ * jitter is the scheduling latency, not up to a full mSec.
+ */
+
+/*! Number of bits of the time used by each level of the wheel */
+#define TMR_WHEEL_BITS   8
+/*! Number of slots in each level of the wheel */
+#define TMR_WHEEL_SLOTS  (1 << TMR_WHEEL_BITS)
+/*! Number of levels, these cover the 32bit mSec range */
+#define TMR_WHEEL_LEVELS 4
+
 /*
  * @struct timer_cb_details
  * @brief Details about a timer with a callback.
@@ -104,8 +136,14 @@ struct timer_cb_details {
     /*! parameter for the timer */
     intptr_t           cookie;
 
-    /* next timer in the list */
+    /*! the wheel level this timer is in, -1 if not in the wheel */
+    int      level;
+
+    /* next timer in the wheel slot */
     struct timer_cb_details *pNext;
+
+    /*! points to the pointer that points to us, for O(1) removal */
+    struct timer_cb_details **ppPrev;
 };
 
 /*
@@ -116,10 +154,40 @@ struct timer_cb_details {
 static  struct timer_cb_details *  pTMR_InService;;
 
 /*
- * @var pTMR_List
- * @brief The list of all active timers
+ * @var pTMR_Zap
+ * @brief The in service timer was destroyed, free it after the callback.
+ */
+static struct timer_cb_details *pTMR_Zap;
+
+/*
+ * @var tmr_wheel
+ * @brief The timing wheel, each slot is a list of timers
+ */
+static struct timer_cb_details *tmr_wheel[TMR_WHEEL_LEVELS][TMR_WHEEL_SLOTS];
+
+/*
+ * @var tmr_wheel_count
+ * @brief Number of timers in each level of the wheel
+ */
+static int tmr_wheel_count[TMR_WHEEL_LEVELS];
+
+/*
+ * @var tmr_wheel_now
+ * @brief The next tick (mSec time) the wheel will process.
+ */
+static uint32_t tmr_wheel_now;
+
+/*
+ * @var tmr_wake_time
+ * @brief When the timer thread will wake up, if not woken earlier
+ */
+static uint32_t tmr_wake_time;
+
+/*
+ * @var tmr_stats
+ * @brief Callback jitter statistics, protected by the timer mutex
  */
-static struct timer_cb_details *pTMR_ActiveList;
+static struct timer_cb_stats tmr_stats;
 
 /*
  * @var timer_done_once
@@ -165,56 +233,300 @@ static void timer_list_unlock(void)
 }
 
 /*!
- * @brief Insert this timer into the list at the proper location
+ * @brief Total number of timers in the wheel
+ * @returns count
+ */
+static int _timer_count(void)
+{
+    int x;
+    int n;
+
+    n = 0;
+    for(x = 0 ; x < TMR_WHEEL_LEVELS ; x++)
+    {
+        n += tmr_wheel_count[x];
+    }
+    return (n);
+}
+
+/*!
+ * @brief Put this timer into the wheel based on its expire_time
  */
 static void _timer_insert(struct timer_cb_details *pTMR)
 {
-    struct timer_cb_details **ppTMR;
-    int tval;
-
-    /* determine when this timer will expire
-     * NOTE:
-     *  This code has a limitation :-(
-     *  It will slowly skew perodic timers
-     *  in real hardware we might choose
-     *  to do this a differnet way that
-     *  will not skew ...
-     *
-     * -------
-     *  Example:
-     *   PEROID = 10
-     *   Actual 1st service occurs at 11
-     *   Resceduled at 12 mSec
-     *   Next schedule will occur at 22mSec
-     *   And the next.. might be off by a few mSecs
-     * -------
-
-     * Determine when this will expire
-    */
-    pTMR->expire_time = TIMER_getNow() + pTMR->period_mSec;
+    struct timer_cb_details **ppSlot;
+    uint32_t delta;
+    int level;
+    int idx;
+
+    /* an empty wheel may be far behind, catch it up */
+    if(_timer_count() == 0)
+    {
+        tmr_wheel_now = TIMER_getNow();
+    }
+
+    delta = pTMR->expire_time - tmr_wheel_now;
+    if(((int32_t)(delta)) <= 0)
+    {
+        /* already expired, run on the next tick */
+        level = 0;
+        idx = (int)(tmr_wheel_now & (TMR_WHEEL_SLOTS - 1));
+    }
+    else
+    {
+        /* find the lowest level that reaches this far */
+        for(level = 0 ; level < (TMR_WHEEL_LEVELS - 1) ; level++)
+        {
+            if(delta < (1UL << (TMR_WHEEL_BITS * (level + 1))))
+            {
+                break;
+            }
+        }
+        idx = (int)((pTMR->expire_time >> (TMR_WHEEL_BITS * level)) &
+                    (TMR_WHEEL_SLOTS - 1));
+    }
+
+    /* insert at the head of the slot */
+    ppSlot = &(tmr_wheel[level][idx]);
+    pTMR->pNext = *ppSlot;
+    if(pTMR->pNext)
+    {
+        pTMR->pNext->ppPrev = &(pTMR->pNext);
+    }
+    pTMR->ppPrev = ppSlot;
+    *ppSlot = pTMR;
+    pTMR->level = level;
+    tmr_wheel_count[level]++;
+}
 
-    /* hunt the list for its insertion position */
-    ppTMR = &(pTMR_ActiveList);
+/*!
+ * @brief Remove this timer from the wheel (if it is in the wheel)
+ */
+static void _timer_remove(struct timer_cb_details *pTMR)
+{
+    if(pTMR->level < 0)
+    {
+        return;
+    }
+    *(pTMR->ppPrev) = pTMR->pNext;
+    if(pTMR->pNext)
+    {
+        pTMR->pNext->ppPrev = pTMR->ppPrev;
+    }
+    tmr_wheel_count[pTMR->level]--;
+    pTMR->level  = -1;
+    pTMR->pNext  = NULL;
+    pTMR->ppPrev = NULL;
+}
+
+/*!
+ * @brief Move all timers from this slot down to lower levels
+ * @param level - the level, always > 0
+ * @param idx - the slot
+ */
+static void _timer_cascade(int level, int idx)
+{
+    struct timer_cb_details *pTMR;
+
+    while((pTMR = tmr_wheel[level][idx]) != NULL)
+    {
+        _timer_remove(pTMR);
+        _timer_insert(pTMR);
+    }
+}
+
+/*!
+ * @brief When does the wheel next need attention?
+ * @param tnow - the current time
+ * @returns mSec tick the timer thread should wake up at
+ *
+ * This is exact for level 0, for higher levels it is when the next
+ * non-empty slot needs to be cascaded. Never more then a minute.
+ */
+static uint32_t _timer_wake_tick(uint32_t tnow)
+{
+    int level;
+    int idx;
+    int off;
+    int shift;
+    uint32_t t;
+
+    for(level = 0 ; level < TMR_WHEEL_LEVELS ; level++)
+    {
+        if(tmr_wheel_count[level] == 0)
+        {
+            continue;
+        }
+        shift = TMR_WHEEL_BITS * level;
+        idx = (int)(tmr_wheel_now >> shift);
+        /* the current slot of an upper level was already cascaded */
+        for(off = (level ? 1 : 0) ; off < TMR_WHEEL_SLOTS ; off++)
+        {
+            if(tmr_wheel[level][(idx + off) & (TMR_WHEEL_SLOTS - 1)])
+            {
+                break;
+            }
+        }
+        if(level == 0)
+        {
+            t = tmr_wheel_now + (uint32_t)(off);
+        }
+        else
+        {
+            t = ((tmr_wheel_now >> shift) + (uint32_t)(off)) << shift;
+        }
+        if(((int32_t)(t - tnow)) > (60 * 1000))
+        {
+            break;
+        }
+        return (t);
+    }
+    /* nothing soon, so sleep for a minute */
+    return (tnow + (60 * 1000));
+}
+
+/*!
+ * @brief Record how late this timer callback is
+ * @param pTMR - the timer about to be called
+ * @param now_nSecs - the current time, from TIMER_getNowNs()
+ */
+static void _timer_stats_update(struct timer_cb_details *pTMR,
+                                uint64_t now_nSecs)
+{
+    uint64_t jitter;
+    uint64_t limit;
+    int32_t late_mSecs;
+    int x;
+
+    /* the ideal time is the start of the expire_time mSec */
+    late_mSecs = (int32_t)(((uint32_t)(now_nSecs / 1000000)) -
+                           pTMR->expire_time);
+    if(late_mSecs < 0)
+    {
+        late_mSecs = 0;
+    }
+    jitter = ((uint64_t)(late_mSecs) * 1000000) + (now_nSecs % 1000000);
+
+    tmr_stats.n_fired++;
+    tmr_stats.jitter_total_nSecs += jitter;
+    if(jitter > tmr_stats.jitter_max_nSecs)
+    {
+        tmr_stats.jitter_max_nSecs = jitter;
+    }
 
-    /* While we have a list.. */
-    while(*ppTMR)
+    /* buckets are: <10uS, <100uS, <1mS, <10mS, and the rest */
+    limit = 10000;
+    for(x = 0 ; x < (TIMER_CB_JITTER_BUCKETS - 1) ; x++)
     {
+        if(jitter < limit)
+        {
+            break;
+        }
+        limit = limit * 10;
+    }
+    tmr_stats.jitter_histogram[x]++;
+}
 
-        /* where does it go? */
-        tval = (int)(pTMR->expire_time - (*ppTMR)->expire_time);
+/*!
+ * @brief Advance the wheel to the next tick that has work
+ * @param tnow - the current time
+ *
+ * Ticks with nothing to do are skipped in bulk, using the per
+ * level counts, so a long sleep does not cost a loop per mSec.
+ */
+static void _timer_advance(uint32_t tnow)
+{
+    uint32_t step;
+    uint32_t next;
+    int level;
 
-        if(tval <= 0)
+    for(level = 0 ; level < TMR_WHEEL_LEVELS ; level++)
+    {
+        if(tmr_wheel_count[level])
         {
-            /* it goes here (before) this one */
             break;
         }
-        /* Try the next one */
-        ppTMR = &((*ppTMR)->pNext);
     }
 
-    /* insert here, before the next one */
-    pTMR->pNext = (*ppTMR);
-    *ppTMR = pTMR;
+    if(level == TMR_WHEEL_LEVELS)
+    {
+        /* empty wheel */
+        tmr_wheel_now = tnow + 1;
+        return;
+    }
+
+    /* if the lower levels are empty, only boundaries matter */
+    step = 1UL << (TMR_WHEEL_BITS * level);
+
+    /* next multiple of step, but not beyond now */
+    next = (tmr_wheel_now | (step - 1)) + 1;
+    if(((int32_t)(next - tnow)) > 0)
+    {
+        next = tnow + 1;
+    }
+    tmr_wheel_now = next;
+}
+
+/*!
+ * @brief Process the wheel up to (and including) tnow, cascading as needed
+ * @param tnow - the current time
+ * @returns the next expired timer (removed from the wheel) or NULL
+ *
+ * Only one timer is returned at a time because the lock is released
+ * during the callback, and other timers might be destroyed.
+ */
+static struct timer_cb_details *_timer_next_expired(uint32_t tnow)
+{
+    struct timer_cb_details *pTMR;
+    int level;
+    int idx;
+
+    while(((int32_t)(tnow - tmr_wheel_now)) >= 0)
+    {
+        idx = (int)(tmr_wheel_now & (TMR_WHEEL_SLOTS - 1));
+        pTMR = tmr_wheel[0][idx];
+        if(pTMR)
+        {
+            _timer_remove(pTMR);
+            return (pTMR);
+        }
+
+        _timer_advance(tnow);
+
+        /* crossing a boundary? cascade the upper levels */
+        for(level = 1 ; level < TMR_WHEEL_LEVELS ; level++)
+        {
+            if(tmr_wheel_now & ((1UL << (TMR_WHEEL_BITS * level)) - 1))
+            {
+                break;
+            }
+            idx = (int)((tmr_wheel_now >> (TMR_WHEEL_BITS * level)) &
+                        (TMR_WHEEL_SLOTS - 1));
+            _timer_cascade(level, idx);
+        }
+    }
+    return (NULL);
+}
+
+/*!
+ * @brief Reschedule a periodic timer relative to its ideal expire time
+ * @param pTMR - the timer
+ * @param tnow - the current time
+ *
+ * If the callback (or the system) was so slow that we missed one or
+ * more periods, those are skipped, the timer stays in phase.
+ */
+static void _timer_rearm(struct timer_cb_details *pTMR, uint32_t tnow)
+{
+    uint32_t late;
+
+    pTMR->expire_time += pTMR->period_mSec;
+    late = tnow - pTMR->expire_time;
+    if(((int32_t)(late)) >= 0)
+    {
+        pTMR->expire_time += ((late / pTMR->period_mSec) + 1) * pTMR->period_mSec;
+    }
+    _timer_insert(pTMR);
 }
 
 /*
@@ -222,58 +534,55 @@ static void _timer_insert(struct timer_cb_details *pTMR)
  * @param cookie - not used in this code
  * @return not really used
  *
- * This implimentation is based on a semaphore timeout
- * We choose this implimentation so as to avoid
+ * This implimentation is based on a timerfd style timeout
+ * We choose this implimentation so as to avoid signals
  */
 static void real_timer_thread_func(void)
 {
+    uint64_t now_nSecs;
+    uint64_t wake_nSecs;
     uint32_t tnow;
-    int timeout_mSecs;
+    int32_t timeout_mSecs;
     struct timer_cb_details *pTMR;
+    timer_callback_fn *callback;
+    intptr_t cookie;
 
     timer_list_lock();
 
     for(;;)
     {
-        pTMR = pTMR_ActiveList;
-        /* Do we have a timer list? */
-        if(pTMR)
-        {
-            /* Check the head item */
-            tnow = TIMER_getNow();
-            tnow = pTMR->expire_time - tnow;
-            timeout_mSecs = (int)(tnow);
-        }
-        else
-        {
-            /* no list, so sleep for a minute */
-            timeout_mSecs = 60 * 1000;
-        }
+        now_nSecs = TIMER_getNowNs();
+        tnow = (uint32_t)(now_nSecs / 1000000);
+        pTMR = _timer_next_expired(tnow);
 
         /* Should we sleep? */
-        if(timeout_mSecs > 0)
+        if(pTMR == NULL)
         {
-            timer_list_unlock();
-            SEMAPHORE_waitWithTimeout(timer_sem_id, timeout_mSecs);
-            timer_list_lock();
+            tmr_wake_time = _timer_wake_tick(tnow);
+            timeout_mSecs = (int32_t)(tmr_wake_time - tnow);
+            if(timeout_mSecs > 0)
+            {
+                /* wake at the exact start of that mSec */
+                wake_nSecs = ((now_nSecs / 1000000) + (uint64_t)(timeout_mSecs));
+                wake_nSecs = wake_nSecs * 1000000;
+                timer_list_unlock();
+                _TIMER_waiterWait(timer_waiter_h, wake_nSecs - now_nSecs);
+                timer_list_lock();
+            }
             /* Try again */
             continue;
         }
 
-        /* Timer at head has expired */
-        /* head item is now the timer "in-service" */
-
-        /* Remove head item from list.. */
-        pTMR_ActiveList = pTMR->pNext;
-        pTMR->pNext = NULL;
-
-        /* NOTE the currently active timer */
+        /* This timer has expired, and is now "in-service" */
         pTMR_InService = pTMR;
+        _timer_stats_update(pTMR, now_nSecs);
 
         /* call the expired timer */
         /* we unlock it during this process */
+        callback = pTMR->callback;
+        cookie   = pTMR->cookie;
         timer_list_unlock();
-        (*(pTMR->callback))((intptr_t)(pTMR), pTMR->cookie);
+        (*(callback))((intptr_t)(pTMR), cookie);
         timer_list_lock();
 
         /*
@@ -287,12 +596,18 @@ static void real_timer_thread_func(void)
          * Option 2: (this is the problem)
          *   The app decides to delete it.
          *   If this happens, we will have NULLed
-         *   the pTMR_InService variable
+         *   the pTMR_InService variable, and we free it here
+         *   because the callback might still have been using it
         */
 
         /* Reclaim our pointer */
         pTMR = pTMR_InService;
         pTMR_InService = NULL;
+        if(pTMR_Zap)
+        {
+            free((void *)(pTMR_Zap));
+            pTMR_Zap = NULL;
+        }
 
         /* Determine: Was it deleted? */
         if(pTMR)
@@ -300,7 +615,7 @@ static void real_timer_thread_func(void)
             /* No it was not.. */
             if(pTMR->periodic)
             {
-                _timer_insert(pTMR);
+                _timer_rearm(pTMR, TIMER_getNow());
             }
         }
         /* continue around */
@@ -331,10 +646,13 @@ static void timer_once_routine(void)
     /* Lock asap ... */
     timer_list_lock();
 
-    /* create our semaphore, preloaded */
-    /* we initalize the semaphore with 1 so it runs */
-    /* when the thread starts */
-    timer_sem_id = SEMAPHORE_create("timer-semaphore", 1);
+    /* create our waiter, the thread checks the wheel */
+    /* before it sleeps so it need not be preloaded */
+    timer_waiter_h = _TIMER_waiterCreate();
+    if(timer_waiter_h == 0)
+    {
+        FATAL_printf("Cannot create timer waiter\n");
+    }
     /* we create the thread *LAST* */
     timer_thread_id = THREAD_create("timer-thread",
                                      timer_thread_func,
@@ -356,6 +674,7 @@ intptr_t TIMER_CB_create(const char *dbg_name,
                           bool periodic)
 {
     struct timer_cb_details *pTMR;
+    bool wake;
 
     timer_once_routine();
 
@@ -385,14 +704,25 @@ intptr_t TIMER_CB_create(const char *dbg_name,
         period_mSec = 1;
     }
     pTMR->period_mSec = period_mSec;
+    pTMR->level       = -1;
 
     timer_list_lock();
+    pTMR->expire_time = TIMER_getNow() + pTMR->period_mSec;
     _timer_insert(pTMR);
+    /* wake up the timer thread only if it would sleep too long */
+    wake = (((int32_t)(pTMR->expire_time - tmr_wake_time)) < 0);
+    if(wake)
+    {
+        tmr_wake_time = pTMR->expire_time;
+    }
     timer_list_unlock();
 
     /* wake up the timer thread
      * so it will check the list */
-    SEMAPHORE_put(timer_sem_id);
+    if(wake)
+    {
+        _TIMER_waiterWake(timer_waiter_h);
+    }
 
     return ((intptr_t)(pTMR));
 }
@@ -405,7 +735,7 @@ intptr_t TIMER_CB_create(const char *dbg_name,
 void TIMER_CB_destroy(intptr_t h)
 {
     struct timer_cb_details *pTMR;
-    struct timer_cb_details **ppTMR;
+    bool in_service;
 
     pTMR = timer_cb_h2tmr(h);
     if(pTMR == NULL)
@@ -417,7 +747,8 @@ void TIMER_CB_destroy(intptr_t h)
     timer_list_lock();
 
     /* are we deleting the timer that is in the callback? */
-    if(pTMR == pTMR_InService)
+    in_service = (pTMR == pTMR_InService);
+    if(in_service)
     {
         /* yes .. so zap this */
         /* otherwise we might try */
@@ -426,37 +757,24 @@ void TIMER_CB_destroy(intptr_t h)
         pTMR_InService = NULL;
     }
 
-    /* Search the timer list for this one */
-    ppTMR = &(pTMR_ActiveList);
-
-    /* while we have items in the active list */
-    while(*ppTMR)
-    {
-        /* If this is the matching timer? */
-        if((*ppTMR) == pTMR)
-        {
-            /* YES! */
-            /* remove this from the list */
-            *ppTMR = pTMR->pNext;
-            pTMR->pNext = NULL;
-            /* and stop looking */
-            break;
-        }
-        else
-        {
-            /* try next one in the list */
-            ppTMR = &((*ppTMR)->pNext);
-        }
-    }
-    timer_list_unlock();
+    /* remove it from the wheel */
+    _timer_remove(pTMR);
 
     if(pTMR->dbg_name)
     {
         free_const((const void *)(pTMR->dbg_name));
     }
     memset(((void *)(pTMR)), 0, sizeof(*pTMR));
-    free((void *)(pTMR));
-
+    if(in_service)
+    {
+        /* the timer thread releases it after the callback */
+        pTMR_Zap = pTMR;
+    }
+    else
+    {
+        free((void *)(pTMR));
+    }
+    timer_list_unlock();
 }
 
 /*
@@ -492,6 +810,32 @@ int TIMER_CB_getRemain(intptr_t h)
     }
 }
 
+/*
+ * Get the callback jitter statistics
+ *
+ * Public function defined in timer.h
+ */
+void TIMER_CB_getStats(struct timer_cb_stats *pStats)
+{
+    timer_once_routine();
+    timer_list_lock();
+    *pStats = tmr_stats;
+    timer_list_unlock();
+}
+
+/*
+ * Reset the callback jitter statistics
+ *
+ * Public function defined in timer.h
+ */
+void TIMER_CB_clearStats(void)
+{
+    timer_once_routine();
+    timer_list_lock();
+    memset((void *)(&tmr_stats), 0, sizeof(tmr_stats));
+    timer_list_unlock();
+}
+
 /*
  *  ========================================
  *  Texas Instruments Micro Controller Style
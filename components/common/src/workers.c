@@ -0,0 +1,381 @@
+/******************************************************************************
+ @file workers.c
+
+ @brief Worker thread pool implementation
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#include "compiler.h"
+#include "workers.h"
+#include "log.h"
+#include "mutex.h"
+#include "threads.h"
+#include "ti_semaphore.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+
+static const int workers_check = 'W';
+
+/*!
+ * @struct workers_job
+ * @brief A queued job
+ */
+struct workers_job {
+    /*! the function to call */
+    workers_job_fn *pFunc;
+    /*! parameter for the function */
+    intptr_t cookie;
+    /*! next job in the queue */
+    struct workers_job *pNext;
+};
+
+/*!
+ * @struct workers
+ * @brief Private worker pool implimentation details
+ */
+struct workers {
+    /*! used to verify this is a worker pool */
+    const int *test_ptr;
+
+    /*! name for debug purposes */
+    const char *dbg_name;
+
+    /*! protects the job queue */
+    intptr_t lock;
+
+    /*! counts queued jobs, workers wait here */
+    intptr_t job_sem;
+
+    /*! each worker puts here as it exits */
+    intptr_t exit_sem;
+
+    /*! the job queue, oldest first */
+    struct workers_job *pHead;
+    struct workers_job *pTail;
+
+    /*! number of jobs in the queue */
+    int n_pending;
+
+    /*! set when the pool is being destroyed */
+    bool is_dead;
+
+    /*! the worker threads */
+    int n_threads;
+    intptr_t *thread_ids;
+};
+
+/*!
+ * @brief convert a handle into a worker pool pointer
+ * @param h - the handle
+ * @returns NULL if not valid
+ */
+static struct workers *h2w(intptr_t h)
+{
+    struct workers *pW;
+
+    pW = (struct workers *)(h);
+    if(pW)
+    {
+        if(pW->test_ptr != &workers_check)
+        {
+            LOG_printf(LOG_ERROR, "not a worker pool: %p\n", (void *)(pW));
+            pW = NULL;
+        }
+    }
+    return (pW);
+}
+
+/*!
+ * @brief Remove the oldest job from the queue
+ * @param pW - the pool
+ * @returns the job, or NULL if the queue is empty
+ */
+static struct workers_job *_workers_dequeue(struct workers *pW)
+{
+    struct workers_job *pJob;
+
+    MUTEX_lock(pW->lock, -1);
+    pJob = pW->pHead;
+    if(pJob)
+    {
+        pW->pHead = pJob->pNext;
+        if(pW->pHead == NULL)
+        {
+            pW->pTail = NULL;
+        }
+        pW->n_pending--;
+    }
+    MUTEX_unLock(pW->lock);
+    return (pJob);
+}
+
+/*!
+ * @brief The worker thread
+ * @param cookie - the pool in disguise
+ * @returns nothing useful
+ */
+static intptr_t workers_thread(intptr_t cookie)
+{
+    struct workers *pW;
+    struct workers_job *pJob;
+
+    pW = (struct workers *)(cookie);
+
+    for(;;)
+    {
+        SEMAPHORE_waitWithTimeout(pW->job_sem, -1);
+        if(pW->is_dead)
+        {
+            break;
+        }
+        pJob = _workers_dequeue(pW);
+        if(pJob == NULL)
+        {
+            continue;
+        }
+        (*(pJob->pFunc))(pJob->cookie);
+        free((void *)(pJob));
+    }
+    SEMAPHORE_put(pW->exit_sem);
+    return (0);
+}
+
+/*
+ * Create a pool of workers
+ *
+ * Public function defined in workers.h
+ */
+intptr_t WORKERS_create(const char *dbg_name, int n_threads)
+{
+    struct workers *pW;
+    char buf[40];
+    int x;
+
+    if(n_threads <= 0)
+    {
+        LOG_printf(LOG_ERROR, "%s: invalid worker count: %d\n",
+                   dbg_name, n_threads);
+        return (0);
+    }
+
+    pW = calloc(1, sizeof(*pW));
+    if(pW == NULL)
+    {
+        LOG_printf(LOG_ERROR, "no memory for workers\n");
+        return (0);
+    }
+    if(dbg_name == NULL)
+    {
+        dbg_name = "workers";
+    }
+    pW->test_ptr  = &workers_check;
+    pW->dbg_name  = strdup(dbg_name);
+    pW->lock      = MUTEX_create(dbg_name);
+    pW->job_sem   = SEMAPHORE_create(dbg_name, 0);
+    pW->exit_sem  = SEMAPHORE_create(dbg_name, 0);
+    pW->thread_ids = calloc((size_t)(n_threads), sizeof(intptr_t));
+    if((pW->dbg_name   == NULL) ||
+       (pW->lock       == 0   ) ||
+       (pW->job_sem    == 0   ) ||
+       (pW->exit_sem   == 0   ) ||
+       (pW->thread_ids == NULL))
+    {
+        LOG_printf(LOG_ERROR, "%s: cannot create workers\n", dbg_name);
+        WORKERS_destroy((intptr_t)(pW));
+        return (0);
+    }
+
+    /* create the threads last, because they will run */
+    for(x = 0 ; x < n_threads ; x++)
+    {
+        (void)snprintf(buf, sizeof(buf), "%s-%d", dbg_name, x);
+        pW->thread_ids[x] = THREAD_create(buf,
+                                          workers_thread,
+                                          (intptr_t)(pW),
+                                          THREAD_FLAGS_DEFAULT);
+        if(pW->thread_ids[x] == 0)
+        {
+            LOG_printf(LOG_ERROR, "%s: cannot create thread\n", buf);
+            WORKERS_destroy((intptr_t)(pW));
+            return (0);
+        }
+        pW->n_threads++;
+    }
+    return ((intptr_t)(pW));
+}
+
+/*
+ * Queue a job for the workers
+ *
+ * Public function defined in workers.h
+ */
+int WORKERS_post(intptr_t h, workers_job_fn *pFunc, intptr_t cookie)
+{
+    struct workers *pW;
+    struct workers_job *pJob;
+
+    pW = h2w(h);
+    if((pW == NULL) || (pW->is_dead))
+    {
+        return (-1);
+    }
+
+    pJob = calloc(1, sizeof(*pJob));
+    if(pJob == NULL)
+    {
+        LOG_printf(LOG_ERROR, "%s: no memory for job\n", pW->dbg_name);
+        return (-1);
+    }
+    pJob->pFunc  = pFunc;
+    pJob->cookie = cookie;
+
+    MUTEX_lock(pW->lock, -1);
+    if(pW->pTail)
+    {
+        pW->pTail->pNext = pJob;
+    }
+    else
+    {
+        pW->pHead = pJob;
+    }
+    pW->pTail = pJob;
+    pW->n_pending++;
+    MUTEX_unLock(pW->lock);
+
+    SEMAPHORE_put(pW->job_sem);
+    return (0);
+}
+
+/*
+ * How many jobs are queued
+ *
+ * Public function defined in workers.h
+ */
+int WORKERS_pending(intptr_t h)
+{
+    struct workers *pW;
+
+    pW = h2w(h);
+    if(pW == NULL)
+    {
+        return (-1);
+    }
+    return (pW->n_pending);
+}
+
+/*
+ * Release a pool of workers
+ *
+ * Public function defined in workers.h
+ */
+void WORKERS_destroy(intptr_t h)
+{
+    struct workers *pW;
+    struct workers_job *pJob;
+    int x;
+
+    pW = h2w(h);
+    if(pW == NULL)
+    {
+        return;
+    }
+
+    /* wake every worker, they see is_dead and exit */
+    pW->is_dead = true;
+    if(pW->n_threads)
+    {
+        SEMAPHORE_putN(pW->job_sem, (unsigned)(pW->n_threads));
+        for(x = 0 ; x < pW->n_threads ; x++)
+        {
+            SEMAPHORE_waitWithTimeout(pW->exit_sem, -1);
+        }
+    }
+    for(x = 0 ; x < pW->n_threads ; x++)
+    {
+        THREAD_destroy(pW->thread_ids[x]);
+    }
+
+    /* toss jobs that never ran */
+    while((pJob = _workers_dequeue(pW)) != NULL)
+    {
+        free((void *)(pJob));
+    }
+
+    if(pW->thread_ids)
+    {
+        free((void *)(pW->thread_ids));
+    }
+    if(pW->exit_sem)
+    {
+        SEMAPHORE_destroy(pW->exit_sem);
+    }
+    if(pW->job_sem)
+    {
+        SEMAPHORE_destroy(pW->job_sem);
+    }
+    if(pW->lock)
+    {
+        MUTEX_destroy(pW->lock);
+    }
+    if(pW->dbg_name)
+    {
+        free_const((const void *)(pW->dbg_name));
+    }
+    memset((void *)(pW), 0, sizeof(*pW));
+    free((void *)(pW));
+}
+
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
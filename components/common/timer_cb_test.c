@@ -0,0 +1,434 @@
+/******************************************************************************
+ @file timer_cb_test.c
+
+ @brief TIMAC 2.0 API Callback timer micro benchmark
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+/*
+ * OVERVIEW
+ * ========
+ *
+ * Micro benchmark for the callback timers (timer_cb.c)
+ *
+ * Build & run with:
+ *
+ *     make testapps
+ *     ./host_timer_cb_test [NTIMERS]
+ *
+ * It measures:
+ *   - the cost of TIMER_CB_create() with NTIMERS (default 10000) active
+ *   - the cost of TIMER_CB_destroy() in random order
+ *   - how far NTIMERS periodic timers drift from their ideal schedule
+ *   - the callback jitter, via TIMER_CB_getStats()
+ *
+ * It checks that one shot timers fire exactly once, that no timer
+ * fires before it is due and that destroyed timers never fire. The
+ * exit status is 1 if any check fails.
+ */
+
+#include "compiler.h"
+#include "timer.h"
+#include "log.h"
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! period of the periodic timers in the drift test */
+#define TEST_PERIOD_mSecs  20
+
+/*! how long the drift test runs */
+#define TEST_RUN_mSecs     3000
+
+/*! one shot timers are due within this many mSecs */
+#define TEST_ONESHOT_mSecs 200
+
+/*! destroyed one shot timers would be due after this many mSecs */
+#define TEST_CANCEL_mSecs  500
+
+/*!
+ * @struct test_timer
+ * @brief Per timer test details
+ */
+struct test_timer {
+    /*! the timer handle */
+    intptr_t h;
+    /*! how many times it has fired */
+    int      n_fired;
+    /*! mSec time of the first & last callback */
+    uint64_t t_first;
+    uint64_t t_last;
+    /*! TIMER_getNow() just before the timer was created */
+    uint32_t t_create;
+    /*! the timer period */
+    uint32_t period;
+    /*! callbacks that came before they were due */
+    int      n_early;
+};
+
+/*! all of our test timers */
+static struct test_timer *all_timers;
+
+/*! number of failed checks */
+static int test_n_errors;
+
+/*!
+ * @brief Monotonic time in nano seconds, used to time the test
+ * @returns time in nSecs
+ */
+static uint64_t test_nsecs(void)
+{
+    return (TIMER_getNowNs());
+}
+
+/*!
+ * @brief Callback for timers that should not fire
+ * @param h - timer handle
+ * @param cookie - not used
+ */
+static void test_never_cb(intptr_t h, intptr_t cookie)
+{
+    (void)(h);
+    (void)(cookie);
+    fprintf(stderr, "ERROR: timer fired early\n");
+    test_n_errors++;
+}
+
+/*!
+ * @brief Count a callback, and check it is not early
+ * @param pT - the test timer
+ *
+ * Timers expire at the start of a TIMER_getNow() mSec, periodic ones
+ * stay in phase, so callback N is at least N periods after creation.
+ */
+static void test_count(struct test_timer *pT)
+{
+    uint32_t elapsed;
+
+    pT->n_fired++;
+    elapsed = TIMER_getNow() - pT->t_create;
+    if(elapsed < ((uint32_t)(pT->n_fired) * pT->period))
+    {
+        pT->n_early++;
+    }
+}
+
+/*!
+ * @brief Callback for the one shot test
+ * @param h - timer handle
+ * @param cookie - the test_timer in disguise
+ */
+static void test_oneshot_cb(intptr_t h, intptr_t cookie)
+{
+    (void)(h);
+    test_count((struct test_timer *)(cookie));
+}
+
+/*!
+ * @brief Callback for the periodic (drift) test
+ * @param h - timer handle
+ * @param cookie - the test_timer in disguise
+ */
+static void test_periodic_cb(intptr_t h, intptr_t cookie)
+{
+    struct test_timer *pT;
+    uint64_t t;
+
+    (void)(h);
+    pT = (struct test_timer *)(cookie);
+    t = test_nsecs() / 1000000;
+    if(pT->n_fired == 0)
+    {
+        pT->t_first = t;
+    }
+    pT->t_last = t;
+    test_count(pT);
+}
+
+/*!
+ * @brief Create & destroy many timers that do not expire
+ * @param n - number of timers
+ */
+static void test_create_destroy(int n)
+{
+    uint64_t t0;
+    uint64_t t1;
+    int x;
+    int y;
+    intptr_t tmp;
+
+    t0 = test_nsecs();
+    for(x = 0 ; x < n ; x++)
+    {
+        /* between 1 and 600 seconds, so they do not fire */
+        all_timers[x].h = TIMER_CB_create("bench",
+                                          test_never_cb,
+                                          0,
+                                          1000 + (rand() % 599000),
+                                          false);
+    }
+    t1 = test_nsecs();
+    printf("create:   %6d timers, %8.1f nSecs/timer\n",
+           n, (double)(t1 - t0) / (double)(n));
+
+    /* destroy in random order */
+    for(x = 0 ; x < n ; x++)
+    {
+        y = rand() % n;
+        tmp = all_timers[x].h;
+        all_timers[x].h = all_timers[y].h;
+        all_timers[y].h = tmp;
+    }
+    t0 = test_nsecs();
+    for(x = 0 ; x < n ; x++)
+    {
+        TIMER_CB_destroy(all_timers[x].h);
+    }
+    t1 = test_nsecs();
+    printf("destroy:  %6d timers, %8.1f nSecs/timer\n",
+           n, (double)(t1 - t0) / (double)(n));
+}
+
+/*!
+ * @brief Run many periodic timers, and measure drift
+ * @param n - number of timers
+ */
+static void test_periodic(int n)
+{
+    int x;
+    uint64_t avg;
+    int64_t drift;
+    int64_t worst;
+    int64_t total;
+    int64_t expected;
+    int64_t fired;
+    struct timer_cb_stats stats;
+
+    memset((void *)(all_timers), 0, sizeof(all_timers[0]) * n);
+    TIMER_CB_clearStats();
+    for(x = 0 ; x < n ; x++)
+    {
+        all_timers[x].period = TEST_PERIOD_mSecs;
+        all_timers[x].t_create = TIMER_getNow();
+        all_timers[x].h = TIMER_CB_create("bench",
+                                          test_periodic_cb,
+                                          (intptr_t)(&all_timers[x]),
+                                          TEST_PERIOD_mSecs,
+                                          true);
+    }
+    TIMER_sleep(TEST_RUN_mSecs);
+    for(x = 0 ; x < n ; x++)
+    {
+        TIMER_CB_destroy(all_timers[x].h);
+    }
+
+    total = 0;
+    worst = 0;
+    fired = 0;
+    for(x = 0 ; x < n ; x++)
+    {
+        if(all_timers[x].n_early)
+        {
+            fprintf(stderr, "ERROR: periodic timer %d: %d early callbacks\n",
+                    x, all_timers[x].n_early);
+            test_n_errors++;
+        }
+        if(all_timers[x].n_fired < 2)
+        {
+            continue;
+        }
+        fired += all_timers[x].n_fired;
+        /* how late is the last callback vs the ideal schedule? */
+        expected = (int64_t)(all_timers[x].n_fired - 1) * TEST_PERIOD_mSecs;
+        drift = (int64_t)(all_timers[x].t_last - all_timers[x].t_first);
+        drift = drift - expected;
+        total += drift;
+        if(drift > worst)
+        {
+            worst = drift;
+        }
+    }
+    expected = ((int64_t)(n) * TEST_RUN_mSecs) / TEST_PERIOD_mSecs;
+    printf("periodic: %6d timers, %d mSec period, fired %lld of ~%lld\n",
+           n, TEST_PERIOD_mSecs, (long long)(fired), (long long)(expected));
+    printf("drift:    avg %.2f mSecs, worst %lld mSecs after %d mSecs\n",
+           (double)(total) / (double)(n), (long long)(worst), TEST_RUN_mSecs);
+
+    TIMER_CB_getStats(&stats);
+    avg = 0;
+    if(stats.n_fired)
+    {
+        avg = stats.jitter_total_nSecs / stats.n_fired;
+    }
+    printf("jitter:   avg %llu nSecs, max %llu nSecs\n",
+           (unsigned long long)(avg),
+           (unsigned long long)(stats.jitter_max_nSecs));
+    printf("jitter:   <10uS %u, <100uS %u, <1mS %u, <10mS %u, more %u\n",
+           stats.jitter_histogram[0], stats.jitter_histogram[1],
+           stats.jitter_histogram[2], stats.jitter_histogram[3],
+           stats.jitter_histogram[4]);
+}
+
+/*!
+ * @brief One shot timers, every other one destroyed before it is due
+ * @param n - number of timers
+ */
+static void test_oneshot(int n)
+{
+    struct test_timer *pT;
+    int n_fired;
+    int n_early;
+    int x;
+
+    memset((void *)(all_timers), 0, sizeof(all_timers[0]) * n);
+    for(x = 0 ; x < n ; x++)
+    {
+        pT = &all_timers[x];
+        if(x & 1)
+        {
+            pT->period = TEST_CANCEL_mSecs + (rand() % TEST_CANCEL_mSecs);
+        }
+        else
+        {
+            pT->period = 1 + (rand() % TEST_ONESHOT_mSecs);
+        }
+        pT->t_create = TIMER_getNow();
+        pT->h = TIMER_CB_create("oneshot",
+                                test_oneshot_cb,
+                                (intptr_t)(pT),
+                                pT->period,
+                                false);
+    }
+    for(x = 1 ; x < n ; x += 2)
+    {
+        TIMER_CB_destroy(all_timers[x].h);
+    }
+
+    TIMER_sleep(2 * TEST_CANCEL_mSecs + 100);
+
+    n_fired = n_early = 0;
+    for(x = 0 ; x < n ; x++)
+    {
+        pT = &all_timers[x];
+        if(pT->n_fired != ((x & 1) ? 0 : 1))
+        {
+            fprintf(stderr, "ERROR: %s timer %d fired %d times\n",
+                    (x & 1) ? "destroyed" : "one shot", x, pT->n_fired);
+            test_n_errors++;
+        }
+        if(pT->n_early)
+        {
+            fprintf(stderr, "ERROR: one shot timer %d: %u mSecs, early\n",
+                    x, (unsigned)(pT->period));
+            test_n_errors++;
+        }
+        n_fired += pT->n_fired;
+        n_early += pT->n_early;
+        if(!(x & 1))
+        {
+            TIMER_CB_destroy(pT->h);
+        }
+    }
+    printf("oneshot:  %6d timers, %d destroyed, %d fired, %d early\n",
+           n, n / 2, n_fired, n_early);
+}
+
+/*!
+ * @brief the test main program
+ * @param argc - arg count
+ * @param argv - arg vector
+ * @returns zero if every check passed
+ */
+int main(int argc, char **argv)
+{
+    int n;
+
+    n = 10000;
+    if(argc > 1)
+    {
+        n = atoi(argv[1]);
+    }
+    if(n <= 0)
+    {
+        fprintf(stderr, "Usage: %s [NTIMERS]\n", argv[0]);
+        exit(1);
+    }
+
+    STREAM_init();
+    TIMER_init();
+    LOG_init("/dev/stderr");
+
+    all_timers = calloc((size_t)(n), sizeof(all_timers[0]));
+    if(all_timers == NULL)
+    {
+        fprintf(stderr, "no memory\n");
+        exit(1);
+    }
+
+    srand(1);
+    test_create_destroy(n);
+    test_oneshot(n);
+    test_periodic(n);
+
+    free((void *)(all_timers));
+    if(test_n_errors)
+    {
+        printf("FAILED: %d checks\n", test_n_errors);
+        return (1);
+    }
+    return (0);
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
@@ -0,0 +1,136 @@
+/******************************************************************************
+ @file nv_kvlog.h
+
+ @brief TIMAC 2.0 API key/value log NV implimentation for linux.
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+#if !defined(NV_KVLOG_H)
+#define NV_KVLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nvintf.h"
+
+/* forward decloration so that this file does not depend upon 'ini_file.h' */
+struct ini_parser;
+
+/*
+ * An NVINTF implementation for Linux hosts that does not simulate flash.
+ * Items live in RAM, in a hash table, and every change is appended to a
+ * log file as CRC protected records, one write per NV operation or
+ * transaction. When the log grows well past the size of the live items
+ * it is replaced by a snapshot holding only their current values.
+ *
+ * Selected with "[nv] backend = kvlog", NVOCTP_loadApiPtrs() then
+ * hands out these functions. Use "host_nv_convert" to carry the items
+ * of an existing NV simulation file over.
+ */
+
+/*!
+ * @struct nv_kvlog_stats
+ * @brief Key/value log statistics, see NV_KVLOG_getStats()
+ */
+struct nv_kvlog_stats {
+    /*! number of items */
+    uint32_t n_items;
+
+    /*! bytes of item data */
+    uint64_t live_bytes;
+
+    /*! current size of the log file */
+    uint64_t log_bytes;
+
+    /*! operations (or transactions) written to the log */
+    uint64_t n_appends;
+
+    /*! snapshots taken */
+    uint64_t n_snapshots;
+};
+
+/*!
+ * @brief Set the NV callback function pointers to the key/value log
+ * @param pfn - pointer to caller's structure of NV function pointers
+ */
+void NV_KVLOG_loadApiPtrs(NVINTF_nvFuncts_t *pfn);
+
+/*!
+ * @brief Process the kvlog-* items of the [nv] configuration section
+ * @returns 0 success
+ *
+ * Called from NV_LINUX_INI_settings().
+ */
+int NV_KVLOG_INI_settings(struct ini_parser *pINI, bool *handled);
+
+/*!
+ * @brief Get key/value log statistics
+ * @param pStats - filled in with the statistics
+ */
+void NV_KVLOG_getStats(struct nv_kvlog_stats *pStats);
+
+/*!
+ * @brief Log key/value log statistics via LOG_printf(LOG_ALWAYS)
+ */
+void NV_KVLOG_statsReport(void);
+
+/*!
+ * @brief fdatasync() the log now, for kvlog-fsync = false
+ *
+ * Called from NV_LINUX_sync().
+ */
+void NV_KVLOG_sync(void);
+
+#endif
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
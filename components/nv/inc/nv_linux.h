@@ -48,6 +48,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /* forward decloration so that this file does not depend upon 'ini_file.h' */
 struct ini_parser;
@@ -135,6 +136,97 @@ void NV_LINUX_save(void);
  */
 void NV_LINUX_load(void);
 
+/*!
+ * @struct nv_linux_stats
+ * @brief NV page compaction and lock statistics, see NV_LINUX_getStats()
+ */
+struct nv_linux_stats {
+    /*! compactions done by a writer, the page was full */
+    uint64_t n_compact_fg;
+
+    /*! compactions done early by the "nv-compact" thread */
+    uint64_t n_compact_bg;
+
+    /*! total time spent compacting */
+    uint64_t compact_nSecs;
+
+    /*! the longest compaction */
+    uint64_t compact_max_nSecs;
+
+    /*! NV API calls that found the NV lock taken and had to wait */
+    uint64_t n_lock_waits;
+
+    /*! total time those calls waited for the NV lock */
+    uint64_t lock_wait_nSecs;
+
+    /*! the longest wait for the NV lock */
+    uint64_t lock_wait_max_nSecs;
+};
+
+/*!
+ * @brief Get NV compaction statistics
+ * @param pStats - filled in with the statistics
+ */
+void NV_LINUX_getStats(struct nv_linux_stats *pStats);
+
+/*!
+ * @brief Log NV compaction statistics via LOG_printf(LOG_ALWAYS)
+ *
+ * Reports how many compactions were done by writers and by the
+ * background thread, how often, their average and maximum duration,
+ * how long NV API calls waited for the NV lock and the free space on
+ * the active page.
+ */
+void NV_LINUX_statsReport(void);
+
+/*!
+ * @brief Make every completed NV operation durable now
+ *
+ * With [nv] journal = true, NV updates are written by a background
+ * thread within journal-delay-msecs, with msync-interval-msecs or
+ * fsync = never (or kvlog-fsync = false) they are left to a thread or
+ * the OS. Call this before a planned exit so nothing queued is lost,
+ * or when an update must survive power loss. Must not be called
+ * inside an NV transaction. Does nothing when every operation is
+ * synced already.
+ */
+void NV_LINUX_sync(void);
+
+/*!
+ * @brief Called by NV_LINUX_forEachItem() for each item
+ * @param cookie - as passed to NV_LINUX_forEachItem()
+ * @param id - the item ID
+ * @param len - number of data bytes
+ * @param pData - the item data, only valid during the call
+ */
+typedef void (*NV_LINUX_itemFn_t)(void *cookie,
+                                  NVINTF_itemID_t id,
+                                  uint32_t len,
+                                  const uint8_t *pData);
+
+/*!
+ * @brief Call a function for every item in the NV simulation file
+ * @param fn - called with the newest active copy of each item,
+ *             oldest first
+ * @param cookie - passed to fn
+ * @returns number of items, negative if the file does not exist
+ *          or holds no valid NV page
+ *
+ * The file named by the [nv] filename setting is only read, queued
+ * journal transactions are applied to the copy in memory. Any page
+ * size is accepted, as when the page size changes. This does not need
+ * NV_LINUX_init() and may be used by offline tools.
+ */
+int NV_LINUX_forEachItem(NV_LINUX_itemFn_t fn, void *cookie);
+
+/*!
+ * @brief CRC32 (the zlib/ethernet polynomial) of a buffer
+ * @param pData - the data
+ * @param len - number of bytes
+ * @returns the crc
+ */
+uint32_t NV_LINUX_crc32(const uint8_t *pData, size_t len);
+
 /*
  * @brief Process NV items from the configuration file
  * @returns 0 success
@@ -134,6 +134,12 @@ typedef uint8_t (*NVINTF_writeItemEx)(NVINTF_itemID_t id,
 //! Function pointer definition for the NVINTF_getItemLen() function
 typedef uint32_t (*NVINTF_getItemLen)(NVINTF_itemID_t id);
 
+//! Function pointer definition for the NVINTF_beginTxn() function
+typedef uint8_t (*NVINTF_beginTxn)(void);
+
+//! Function pointer definition for the NVINTF_commitTxn() function
+typedef uint8_t (*NVINTF_commitTxn)(void);
+
 //! Structure of NV API function pointers
 typedef struct nvintf_nvfuncts_t
 {
@@ -153,6 +159,10 @@ typedef struct nvintf_nvfuncts_t
     NVINTF_writeItemEx writeItemEx;
     //! Get item length function
     NVINTF_getItemLen getItemLen;
+    //! Begin a group of operations, NULL if not supported
+    NVINTF_beginTxn beginTxn;
+    //! Apply and persist the group as one update, NULL if not supported
+    NVINTF_commitTxn commitTxn;
 } NVINTF_nvFuncts_t;
 
 //*****************************************************************************
@@ -0,0 +1,1247 @@
+/******************************************************************************
+ @file nv_kvlog.c
+
+ @brief TIMAC 2.0 API Linux key/value log version of NV module
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+*****************************************************************************/
+
+/******************************************************************************
+ Design Overview
+ *****************************************************************************
+
+nv_linux.c keeps the flash layout of the embedded NV driver, which costs a
+header scan or index per lookup and a page copy per compaction. On a Linux
+host none of that is needed. Here every item is a malloc()ed buffer found
+through a hash table keyed by (system ID, item ID, sub ID).
+
+Each change is added to the end of the log file as a record: a header with a CRC,
+followed by the data. The records of one NV operation, or of everything
+between beginTxn() and commitTxn(), are written with one write() and one
+fdatasync(), the last of them is flagged as the end of the group. Loading
+replays complete groups in order, a group cut short by a crash is dropped,
+so each operation is all or nothing.
+
+The file is grown in zero filled chunks of KV_PREALLOC bytes, so most
+fdatasync() calls only have data to write, not a new file size; loading
+stops at the zeros.
+
+The log only grows. Once it is larger than kvlog-snapshot-bytes and twice
+the size a log of just the current items would have, that log (the
+snapshot) is written to a temp file and renamed over the old one.
+*/
+
+/******************************************************************************
+ Includes
+*****************************************************************************/
+
+#include "compiler.h"
+#include "nvintf.h"
+#include "nv_linux.h"
+#include "nv_kvlog.h"
+
+#include "stream.h"
+#include "log.h"
+#include "mutex.h"
+#include "fatal.h"
+#include "ini_file.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/******************************************************************************
+ Constants and definitions
+*****************************************************************************/
+
+#define KV_MAGIC 0x4b564e54 /* "TNVK" */
+
+/* Record operations */
+#define KV_OP_PUT     1 /* the whole item is 'len' bytes of data */
+#define KV_OP_PATCH   2 /* 'len' bytes at 'ofs' of an existing item */
+#define KV_OP_DELETE  3 /* no data */
+
+/* Record flags */
+#define KV_FLAG_END   0x01 /* last record of an operation or transaction */
+
+/* Log record header, followed by 'len' bytes of data, padded so the next */
+/* record is 4 byte aligned. The crc covers the header after it and the data */
+struct kv_rec {
+    uint32_t magic;
+    uint32_t crc;
+    uint16_t itemid;
+    uint16_t subid;
+    uint16_t ofs;
+    uint16_t len;
+    uint8_t  sysid;
+    uint8_t  op;
+    uint8_t  flags;
+    uint8_t  pad;
+};
+
+#define KV_REC_SIZE(len)  (sizeof(struct kv_rec) + (((len) + 3) & ~3))
+#define KV_REC_CRCOFS     (2 * sizeof(uint32_t))
+
+/* The log file grows this much at a time */
+#define KV_PREALLOC  (64 * 1024)
+
+/* Largest item, the record length field is 16 bits */
+#define KV_MAXLEN  0xFFFF
+
+/* Hash table slot */
+struct kv_item {
+    uint64_t key;       /* KV_INVKEY if the slot is free */
+    uint32_t len;
+    uint8_t *pData;
+};
+
+#define KV_INVKEY  UINT64_MAX
+#define KV_KEY(sys, item, sub) \
+    (((uint64_t)(sys) << 32) | ((uint64_t)(item) << 16) | (uint64_t)(sub))
+
+/******************************************************************************
+ Local variables
+*****************************************************************************/
+
+static const char _kv_default_filename[] = "nv-kvlog.bin";
+static const char *KV_filename = _kv_default_filename;
+static bool       KV_fsync = true;
+static unsigned   KV_snapshot_min = 256 * 1024;
+
+static intptr_t   KV_mutex;
+static bool       KV_ready;
+static int        KV_fd = -1;
+static uint64_t   KV_alloc_end;     /* file size, zeros after the log */
+static int        KV_txn_depth;
+
+/* the items */
+static struct kv_item *KV_tab;
+static uint32_t        KV_mask;
+
+/* records not yet written, and where the last one starts */
+static uint8_t *KV_buf;
+static size_t   KV_buf_len;
+static size_t   KV_buf_size;
+static size_t   KV_buf_last;
+
+static struct nv_kvlog_stats KV_stats;
+
+/******************************************************************************
+ Local functions
+*****************************************************************************/
+
+/*!
+ * @brief Lock the key/value log
+ */
+static void KV_LOCK(void)
+{
+    MUTEX_lock(KV_mutex, -1);
+}
+
+/*!
+ * @brief Unlock the key/value log
+ */
+static void KV_UNLOCK(void)
+{
+    MUTEX_unLock(KV_mutex);
+}
+
+/*!
+ * @brief Hash table slot where the search for a key starts
+ * @param key - item key, see KV_KEY()
+ * @returns slot number
+ */
+static uint32_t kv_hash(uint64_t key)
+{
+    uint64_t h;
+
+    h = key * 0x9E3779B97F4A7C15ULL;
+    return ((uint32_t)(h >> 32) & KV_mask);
+}
+
+/*!
+ * @brief Find an item
+ * @param key - item key
+ * @returns the slot, NULL if there is no such item
+ */
+static struct kv_item *kv_find(uint64_t key)
+{
+    uint32_t x;
+
+    if(KV_tab == NULL)
+    {
+        return (NULL);
+    }
+    for(x = kv_hash(key) ; ; x = (x + 1) & KV_mask)
+    {
+        if(KV_tab[x].key == key)
+        {
+            return (&KV_tab[x]);
+        }
+        if(KV_tab[x].key == KV_INVKEY)
+        {
+            return (NULL);
+        }
+    }
+}
+
+/*!
+ * @brief Make the hash table large enough for one more item
+ *
+ * Kept at most half full, so probe chains stay short.
+ */
+static void kv_grow(void)
+{
+    struct kv_item *pOld;
+    uint32_t oldMask;
+    uint32_t n;
+    uint32_t x, y;
+
+    if((KV_tab != NULL) && (((KV_stats.n_items + 1) * 2) <= (KV_mask + 1)))
+    {
+        return;
+    }
+
+    pOld = KV_tab;
+    oldMask = KV_mask;
+    n = (KV_tab == NULL) ? 64 : ((KV_mask + 1) * 2);
+
+    KV_tab = malloc(n * sizeof(*KV_tab));
+    if(KV_tab == NULL)
+    {
+        FATAL_printf("NV no ram\n");
+    }
+    KV_mask = n - 1;
+    for(x = 0 ; x < n ; x++)
+    {
+        KV_tab[x].key = KV_INVKEY;
+        KV_tab[x].len = 0;
+        KV_tab[x].pData = NULL;
+    }
+
+    if(pOld == NULL)
+    {
+        return;
+    }
+    for(x = 0 ; x <= oldMask ; x++)
+    {
+        if(pOld[x].key == KV_INVKEY)
+        {
+            continue;
+        }
+        for(y = kv_hash(pOld[x].key) ;
+            KV_tab[y].key != KV_INVKEY ;
+            y = (y + 1) & KV_mask)
+        {
+            ;
+        }
+        KV_tab[y] = pOld[x];
+    }
+    free((void *)pOld);
+}
+
+/*!
+ * @brief Remove an item from the hash table
+ * @param pI - its slot
+ */
+static void kv_remove(struct kv_item *pI)
+{
+    uint32_t x, y, h;
+
+    KV_stats.n_items--;
+    KV_stats.live_bytes -= pI->len;
+    free((void *)(pI->pData));
+
+    /* Backward shift delete, keeps every probe chain unbroken */
+    x = (uint32_t)(pI - KV_tab);
+    for(y = (x + 1) & KV_mask ; ; y = (y + 1) & KV_mask)
+    {
+        if(KV_tab[y].key == KV_INVKEY)
+        {
+            break;
+        }
+        h = kv_hash(KV_tab[y].key);
+        /* can the entry at 'y' move to the hole at 'x'? */
+        if(((y - h) & KV_mask) >= ((y - x) & KV_mask))
+        {
+            KV_tab[x] = KV_tab[y];
+            x = y;
+        }
+    }
+    KV_tab[x].key = KV_INVKEY;
+    KV_tab[x].len = 0;
+    KV_tab[x].pData = NULL;
+}
+
+/*!
+ * @brief Forget all items
+ */
+static void kv_clear(void)
+{
+    uint32_t x;
+
+    if(KV_tab)
+    {
+        for(x = 0 ; x <= KV_mask ; x++)
+        {
+            if(KV_tab[x].key != KV_INVKEY)
+            {
+                free((void *)(KV_tab[x].pData));
+            }
+        }
+        free((void *)KV_tab);
+        KV_tab = NULL;
+    }
+    KV_mask = 0;
+    KV_stats.n_items = 0;
+    KV_stats.live_bytes = 0;
+}
+
+/*!
+ * @brief Apply one operation to the items
+ * @param key - item key
+ * @param op - KV_OP_PUT, KV_OP_PATCH or KV_OP_DELETE
+ * @param ofs - KV_OP_PATCH, offset into the item
+ * @param len - number of data bytes
+ * @param pData - the data, for KV_OP_PUT NULL means erased (0xff) bytes
+ * @returns true if the item exists (or for KV_OP_PUT, now exists)
+ */
+static bool kv_apply(uint64_t key, int op, uint32_t ofs, uint32_t len,
+                     const void *pData)
+{
+    struct kv_item *pI;
+    uint32_t x;
+    uint8_t *p;
+
+    pI = kv_find(key);
+    switch(op)
+    {
+    case KV_OP_PUT:
+        if(pI == NULL)
+        {
+            kv_grow();
+            for(x = kv_hash(key) ;
+                KV_tab[x].key != KV_INVKEY ;
+                x = (x + 1) & KV_mask)
+            {
+                ;
+            }
+            pI = &KV_tab[x];
+            pI->key = key;
+            pI->len = 0;
+            pI->pData = NULL;
+            KV_stats.n_items++;
+        }
+        if(pI->len != len)
+        {
+            /* malloc(0) may return NULL, keep a byte */
+            p = realloc(pI->pData, len ? len : 1);
+            if(p == NULL)
+            {
+                FATAL_printf("NV no ram\n");
+            }
+            KV_stats.live_bytes = KV_stats.live_bytes - pI->len + len;
+            pI->pData = p;
+            pI->len = len;
+        }
+        if(pData)
+        {
+            memcpy(pI->pData, pData, len);
+        }
+        else
+        {
+            memset(pI->pData, 0xFF, len);
+        }
+        return (true);
+
+    case KV_OP_PATCH:
+        if((pI == NULL) || ((ofs + len) > pI->len))
+        {
+            return (false);
+        }
+        memcpy(pI->pData + ofs, pData, len);
+        return (true);
+
+    case KV_OP_DELETE:
+        if(pI == NULL)
+        {
+            return (false);
+        }
+        kv_remove(pI);
+        return (true);
+
+    default:
+        return (false);
+    }
+}
+
+/*!
+ * @brief Queue a log record, kv_flush() writes it
+ * @param key - item key
+ * @param op - KV_OP_PUT, KV_OP_PATCH or KV_OP_DELETE
+ * @param ofs - offset into the item (KV_OP_PATCH)
+ * @param len - number of data bytes
+ * @param pData - the data (NULL is erased bytes)
+ */
+static void kv_append(uint64_t key, int op, uint32_t ofs, uint32_t len,
+                      const void *pData)
+{
+    struct kv_rec *pR;
+    size_t need;
+
+    need = KV_REC_SIZE(len);
+    if((KV_buf_len + need) > KV_buf_size)
+    {
+        KV_buf_size = (KV_buf_len + need) * 2;
+        KV_buf = realloc(KV_buf, KV_buf_size);
+        if(KV_buf == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+    }
+
+    pR = (struct kv_rec *)(KV_buf + KV_buf_len);
+    memset((void *)pR, 0, need);
+    pR->magic  = KV_MAGIC;
+    pR->sysid  = (uint8_t)(key >> 32);
+    pR->itemid = (uint16_t)(key >> 16);
+    pR->subid  = (uint16_t)(key);
+    pR->ofs    = (uint16_t)ofs;
+    pR->len    = (uint16_t)len;
+    pR->op     = (uint8_t)op;
+    if(pData)
+    {
+        memcpy((void *)(pR + 1), pData, len);
+    }
+    else if(op == KV_OP_PUT)
+    {
+        memset((void *)(pR + 1), 0xFF, len);
+    }
+    pR->crc = NV_LINUX_crc32(((uint8_t *)pR) + KV_REC_CRCOFS,
+                             sizeof(*pR) - KV_REC_CRCOFS + len);
+
+    KV_buf_last = KV_buf_len;
+    KV_buf_len += need;
+}
+
+/*!
+ * @brief Write everything out to a file
+ * @param fd - the file
+ * @param pBuf - data
+ * @param len - number of bytes
+ * @param ofs - file offset
+ * @param name - filename, for errors
+ */
+static void kv_write(int fd, const uint8_t *pBuf, size_t len, uint64_t ofs,
+                     const char *name)
+{
+    ssize_t r;
+
+    while(len)
+    {
+        r = pwrite(fd, pBuf, len, (off_t)ofs);
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            FATAL_perror(name);
+        }
+        pBuf += r;
+        ofs += (uint64_t)r;
+        len -= (size_t)r;
+    }
+}
+
+/*!
+ * @brief Fill part of a file with zeros
+ * @param fd - the file
+ * @param beg - first byte
+ * @param end - byte after the last one
+ * @param name - filename, for errors
+ */
+static void kv_zero(int fd, uint64_t beg, uint64_t end, const char *name)
+{
+    static const uint8_t zeros[4096];
+    size_t n;
+
+    while(beg < end)
+    {
+        n = ((end - beg) > sizeof(zeros)) ? sizeof(zeros) :
+            (size_t)(end - beg);
+        kv_write(fd, zeros, n, beg, name);
+        beg += n;
+    }
+}
+
+/*!
+ * @brief Make sure the log file has room for more records
+ * @param end - offset after the last byte that will be written
+ */
+static void kv_reserve(uint64_t end)
+{
+    uint64_t new_end;
+
+    if(end <= KV_alloc_end)
+    {
+        return;
+    }
+    new_end = (end + KV_PREALLOC - 1) & ~((uint64_t)KV_PREALLOC - 1);
+    kv_zero(KV_fd, KV_alloc_end, new_end, KV_filename);
+    KV_alloc_end = new_end;
+}
+
+/*!
+ * @brief Make a file durable, if kvlog-fsync is set
+ * @param fd - the file
+ */
+static void kv_sync(int fd)
+{
+    if(KV_fsync && (0 != fdatasync(fd)))
+    {
+        FATAL_perror(KV_filename);
+    }
+}
+
+/*!
+ * @brief Replace the log by one holding only the current items
+ */
+static void kv_snapshot(void)
+{
+    char *tmpname;
+    char *cp;
+    size_t n;
+    uint32_t x;
+    int fd;
+    int dfd;
+
+    /* the queued records are part of the items already */
+    KV_buf_len = 0;
+    if(KV_tab)
+    {
+        for(x = 0 ; x <= KV_mask ; x++)
+        {
+            if(KV_tab[x].key != KV_INVKEY)
+            {
+                kv_append(KV_tab[x].key, KV_OP_PUT, 0, KV_tab[x].len,
+                          KV_tab[x].pData);
+            }
+        }
+    }
+    if(KV_buf_len)
+    {
+        ((struct kv_rec *)(KV_buf + KV_buf_last))->flags = KV_FLAG_END;
+        ((struct kv_rec *)(KV_buf + KV_buf_last))->crc =
+            NV_LINUX_crc32(KV_buf + KV_buf_last + KV_REC_CRCOFS,
+                           KV_buf_len - KV_buf_last - KV_REC_CRCOFS);
+    }
+
+    n = strlen(KV_filename) + 5;
+    tmpname = calloc(1, n);
+    if(tmpname == NULL)
+    {
+        FATAL_printf("NV no ram\n");
+    }
+    snprintf(tmpname, n, "%s.tmp", KV_filename);
+
+    fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+    {
+        FATAL_perror(tmpname);
+    }
+    kv_write(fd, KV_buf, KV_buf_len, 0, tmpname);
+    KV_alloc_end = (KV_buf_len + KV_PREALLOC - 1) &
+        ~((uint64_t)KV_PREALLOC - 1);
+    kv_zero(fd, KV_buf_len, KV_alloc_end, tmpname);
+    kv_sync(fd);
+    if(0 != rename(tmpname, KV_filename))
+    {
+        FATAL_perror(KV_filename);
+    }
+
+    if(KV_fsync)
+    {
+        /* make the rename itself durable */
+        cp = strrchr(tmpname, '/');
+        if(cp == NULL)
+        {
+            strcpy(tmpname, ".");
+        }
+        else
+        {
+            cp[(cp == tmpname) ? 1 : 0] = 0;
+        }
+        dfd = open(tmpname, O_RDONLY | O_DIRECTORY);
+        if(dfd >= 0)
+        {
+            (void)fsync(dfd);
+            close(dfd);
+        }
+    }
+    free((void *)tmpname);
+
+    if(KV_fd >= 0)
+    {
+        close(KV_fd);
+    }
+    KV_fd = fd;
+    KV_stats.log_bytes = KV_buf_len;
+    KV_stats.n_snapshots++;
+    KV_buf_len = 0;
+
+    LOG_printf(LOG_DBG_NV_dbg, "nvram: %s: snapshot, %u items, %u bytes\n",
+               KV_filename,
+               (unsigned)(KV_stats.n_items),
+               (unsigned)(KV_stats.log_bytes));
+}
+
+/*!
+ * @brief Write the queued records as one group, maybe take a snapshot
+ *
+ * Does nothing inside a transaction, the outermost commit writes it all.
+ */
+static void kv_flush(void)
+{
+    struct kv_rec *pR;
+    uint64_t snap;
+
+    if((KV_txn_depth > 0) || (KV_buf_len == 0))
+    {
+        return;
+    }
+
+    pR = (struct kv_rec *)(KV_buf + KV_buf_last);
+    pR->flags |= KV_FLAG_END;
+    pR->crc = NV_LINUX_crc32(KV_buf + KV_buf_last + KV_REC_CRCOFS,
+                             sizeof(*pR) - KV_REC_CRCOFS + pR->len);
+
+    kv_reserve(KV_stats.log_bytes + KV_buf_len);
+    kv_write(KV_fd, KV_buf, KV_buf_len, KV_stats.log_bytes, KV_filename);
+    kv_sync(KV_fd);
+    KV_stats.log_bytes += KV_buf_len;
+    KV_stats.n_appends++;
+    KV_buf_len = 0;
+
+    /* about the size of a snapshot */
+    snap = KV_stats.live_bytes +
+        ((uint64_t)KV_stats.n_items * (sizeof(struct kv_rec) + 3));
+    if((KV_stats.log_bytes > KV_snapshot_min) &&
+       (KV_stats.log_bytes > (2 * snap)))
+    {
+        kv_snapshot();
+    }
+}
+
+/*!
+ * @brief Load the items from the log file
+ *
+ * Complete groups of records are applied in order. Anything after the
+ * last one (a write cut short by a crash) is overwritten with zeros.
+ */
+static void kv_load(void)
+{
+    struct kv_rec *pR;
+    uint8_t *pLog;
+    int64_t filesize;
+    size_t good;
+    size_t pos;
+    size_t grp;
+    intptr_t s;
+
+    kv_clear();
+    KV_buf_len = 0;
+    KV_stats.log_bytes = 0;
+    if(KV_fd >= 0)
+    {
+        close(KV_fd);
+        KV_fd = -1;
+    }
+
+    filesize = CONFIG_NV_RESTORE ? STREAM_FS_getSize(KV_filename) : 0;
+    good = pos = 0;
+    if(filesize > 0)
+    {
+        pLog = malloc((size_t)filesize);
+        if(pLog == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        s = STREAM_createRdFile(KV_filename);
+        if(s == 0)
+        {
+            FATAL_perror(KV_filename);
+        }
+        if(STREAM_rdBytes(s, pLog, (size_t)filesize, 0) != (int)filesize)
+        {
+            FATAL_printf("nvram: %s: cannot read %d bytes\n",
+                         KV_filename, (int)filesize);
+        }
+        STREAM_close(s);
+
+        /* find the end of each complete group, then apply it */
+        grp = pos = 0;
+        while((pos + sizeof(*pR)) <= (size_t)filesize)
+        {
+            pR = (struct kv_rec *)(pLog + pos);
+            if((pR->magic != KV_MAGIC) ||
+               ((pos + KV_REC_SIZE(pR->len)) > (size_t)filesize) ||
+               (NV_LINUX_crc32(pLog + pos + KV_REC_CRCOFS,
+                               sizeof(*pR) - KV_REC_CRCOFS + pR->len) !=
+                pR->crc))
+            {
+                break;
+            }
+            pos += KV_REC_SIZE(pR->len);
+            if(!(pR->flags & KV_FLAG_END))
+            {
+                continue;
+            }
+            while(grp < pos)
+            {
+                pR = (struct kv_rec *)(pLog + grp);
+                (void)kv_apply(KV_KEY(pR->sysid, pR->itemid, pR->subid),
+                               pR->op, pR->ofs, pR->len, pR + 1);
+                grp += KV_REC_SIZE(pR->len);
+            }
+            good = pos;
+        }
+        /* after the log there should only be zeros */
+        for(pos = good ; pos < (size_t)filesize ; pos++)
+        {
+            if(pLog[pos] != 0)
+            {
+                break;
+            }
+        }
+        free((void *)pLog);
+        if(pos < (size_t)filesize)
+        {
+            LOG_printf(LOG_ERROR,
+                       "nvram: %s: dropping an incomplete update at %d\n",
+                       KV_filename, (int)good);
+        }
+    }
+    else
+    {
+        LOG_printf(LOG_DBG_NV_dbg, "nvram: creating: %s\n", KV_filename);
+    }
+
+    KV_fd = open(KV_filename, O_WRONLY | O_CREAT, 0666);
+    if(KV_fd < 0)
+    {
+        FATAL_perror(KV_filename);
+    }
+    if(filesize <= 0)
+    {
+        if(0 != ftruncate(KV_fd, 0))
+        {
+            FATAL_perror(KV_filename);
+        }
+        filesize = 0;
+    }
+    else if(pos < (size_t)filesize)
+    {
+        /* the next records go here, leave no stale bytes behind them */
+        kv_zero(KV_fd, good, (uint64_t)filesize, KV_filename);
+        kv_sync(KV_fd);
+    }
+    KV_alloc_end = (uint64_t)filesize;
+    KV_stats.log_bytes = good;
+
+    LOG_printf(LOG_DBG_NV_dbg, "nvram: Loaded: %s, %u items\n",
+               KV_filename, (unsigned)(KV_stats.n_items));
+}
+
+/******************************************************************************
+ API Functions
+******************************************************************************/
+
+/*!
+ * @brief API function to load the items
+ * @param param - not used
+ * @returns NVINTF_SUCCESS
+ */
+static uint8_t kv_initNvApi(void *param)
+{
+    (void)(param);
+
+    if(KV_mutex == 0)
+    {
+        KV_mutex = MUTEX_create("nv-kvlog-mutex");
+    }
+    KV_LOCK();
+    kv_load();
+    KV_txn_depth = 0;
+    KV_ready = true;
+    KV_UNLOCK();
+
+    return (NVINTF_SUCCESS);
+}
+
+/*!
+ * @brief API function to take a snapshot now
+ * @param minBytes - not used, there are no pages to fill
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_compactNvApi(uint16_t minBytes)
+{
+    (void)(minBytes);
+
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+    KV_LOCK();
+    /* a snapshot would persist half of the open transaction */
+    if(KV_txn_depth == 0)
+    {
+        kv_snapshot();
+    }
+    KV_UNLOCK();
+
+    return (NVINTF_SUCCESS);
+}
+
+/*!
+ * @brief API function to start a group of NV operations
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_beginTxnApi(void)
+{
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+    KV_LOCK();
+    KV_txn_depth++;
+
+    return (NVINTF_SUCCESS);
+}
+
+/*!
+ * @brief API function to finish a group of NV operations
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_commitTxnApi(void)
+{
+    if(!KV_ready || (KV_txn_depth == 0))
+    {
+        /* commit without begin */
+        return (NVINTF_FAILURE);
+    }
+    KV_txn_depth--;
+    kv_flush();
+    KV_UNLOCK();
+
+    return (NVINTF_SUCCESS);
+}
+
+/*!
+ * @brief API function to create a new NV item
+ * @param id - NV item type identifier
+ * @param bLen - length of NV data block
+ * @param pBuf - initial data, NULL for erased (0xff) bytes
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_createItemApi(NVINTF_itemID_t id,
+                                uint32_t bLen,
+                                void *pBuf)
+{
+    uint64_t key;
+    uint8_t err;
+
+    if(bLen > KV_MAXLEN)
+    {
+        return (NVINTF_BADLENGTH);
+    }
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+
+    key = KV_KEY(id.systemID, id.itemID, id.subID);
+    KV_LOCK();
+    if(kv_find(key))
+    {
+        /* Item already exists */
+        err = NVINTF_FAILURE;
+    }
+    else
+    {
+        (void)kv_apply(key, KV_OP_PUT, 0, bLen, pBuf);
+        kv_append(key, KV_OP_PUT, 0, bLen, pBuf);
+        kv_flush();
+        err = NVINTF_SUCCESS;
+    }
+    KV_UNLOCK();
+
+    return (err);
+}
+
+/*!
+ * @brief API function to delete an NV item
+ * @param id - NV item type identifier
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_deleteItemApi(NVINTF_itemID_t id)
+{
+    uint64_t key;
+    uint8_t err;
+
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+
+    key = KV_KEY(id.systemID, id.itemID, id.subID);
+    KV_LOCK();
+    if(kv_apply(key, KV_OP_DELETE, 0, 0, NULL))
+    {
+        kv_append(key, KV_OP_DELETE, 0, 0, NULL);
+        kv_flush();
+        err = NVINTF_SUCCESS;
+    }
+    else
+    {
+        err = NVINTF_NOTFOUND;
+    }
+    KV_UNLOCK();
+
+    return (err);
+}
+
+/*!
+ * @brief API function to return the length of an NV item
+ * @param id - NV item type identifier
+ * @returns NV item length or 0 if item not found
+ */
+static uint32_t kv_getItemLenApi(NVINTF_itemID_t id)
+{
+    struct kv_item *pI;
+    uint32_t len;
+
+    if(!KV_ready)
+    {
+        return (0);
+    }
+
+    KV_LOCK();
+    pI = kv_find(KV_KEY(id.systemID, id.itemID, id.subID));
+    len = pI ? pI->len : 0;
+    KV_UNLOCK();
+
+    return (len);
+}
+
+/*!
+ * @brief API function to read data from an NV item
+ * @param id   - NV item type identifier
+ * @param bOfs - offset into NV data block
+ * @param bLen - length of NV data to return
+ * @param pBuf - pointer to caller's read data buffer
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_readItemApi(NVINTF_itemID_t id,
+                              uint16_t bOfs,
+                              uint16_t bLen,
+                              void *pBuf)
+{
+    struct kv_item *pI;
+    uint8_t err;
+
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+
+    KV_LOCK();
+    pI = kv_find(KV_KEY(id.systemID, id.itemID, id.subID));
+    if(pI == NULL)
+    {
+        err = NVINTF_NOTFOUND;
+    }
+    else if(((uint32_t)bOfs + bLen) > pI->len)
+    {
+        /* Bad length or offset */
+        err = (bLen > pI->len) ? NVINTF_BADLENGTH : NVINTF_BADOFFSET;
+    }
+    else
+    {
+        memcpy(pBuf, pI->pData + bOfs, bLen);
+        err = NVINTF_SUCCESS;
+    }
+    KV_UNLOCK();
+
+    return (err);
+}
+
+/*!
+ * @brief API function to write an NV item, create if not already existing
+ * @param id   - NV item type identifier
+ * @param bLen - data buffer length to write into NV block
+ * @param pBuf - pointer to caller's data buffer to write
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_writeItemApi(NVINTF_itemID_t id,
+                               uint16_t bLen,
+                               void *pBuf)
+{
+    struct kv_item *pI;
+    uint64_t key;
+
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+
+    key = KV_KEY(id.systemID, id.itemID, id.subID);
+    KV_LOCK();
+    pI = kv_find(key);
+    /* like flash, an unchanged item is not written again */
+    if((pI == NULL) || (pI->len != bLen) ||
+       (pBuf == NULL) || (0 != memcmp(pI->pData, pBuf, bLen)))
+    {
+        (void)kv_apply(key, KV_OP_PUT, 0, bLen, pBuf);
+        kv_append(key, KV_OP_PUT, 0, bLen, pBuf);
+        kv_flush();
+    }
+    KV_UNLOCK();
+
+    return (NVINTF_SUCCESS);
+}
+
+/*!
+ * @brief API function to write data to an existing NV item
+ * @param id   - NV item type identifier
+ * @param bOfs - data offset into the NV block
+ * @param bLen - data buffer length to write into NV block
+ * @param pBuf - pointer to caller's data buffer to write
+ * @returns NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t kv_writeItemExApi(NVINTF_itemID_t id,
+                                 uint16_t bOfs,
+                                 uint16_t bLen,
+                                 void *pBuf)
+{
+    struct kv_item *pI;
+    uint64_t key;
+    uint8_t err;
+
+    if(!KV_ready)
+    {
+        return (NVINTF_NOTREADY);
+    }
+
+    key = KV_KEY(id.systemID, id.itemID, id.subID);
+    KV_LOCK();
+    pI = kv_find(key);
+    if(pI == NULL)
+    {
+        err = NVINTF_NOTFOUND;
+    }
+    else if(((uint32_t)bOfs + bLen) > pI->len)
+    {
+        /* Bad offset or length */
+        err = NVINTF_BADOFFSET;
+    }
+    else
+    {
+        if(0 != memcmp(pI->pData + bOfs, pBuf, bLen))
+        {
+            (void)kv_apply(key, KV_OP_PATCH, bOfs, bLen, pBuf);
+            kv_append(key, KV_OP_PATCH, bOfs, bLen, pBuf);
+            kv_flush();
+        }
+        err = NVINTF_SUCCESS;
+    }
+    KV_UNLOCK();
+
+    return (err);
+}
+
+/******************************************************************************
+ Public Functions
+******************************************************************************/
+
+/*
+  Process the kvlog-* INI file settings.
+
+  Public function defined in nv_kvlog.h
+ */
+int NV_KVLOG_INI_settings(struct ini_parser *pINI, bool *handled)
+{
+    int v;
+
+    if(INI_itemMatches(pINI, "nv", "kvlog-filename"))
+    {
+        if(KV_filename != _kv_default_filename)
+        {
+            free_const((const void *)KV_filename);
+        }
+        KV_filename = INI_itemValue_strdup(pINI);
+        *handled = true;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "kvlog-fsync"))
+    {
+        KV_fsync = INI_valueAsBool(pINI);
+        *handled = true;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "kvlog-snapshot-bytes"))
+    {
+        *handled = true;
+        v = INI_valueAsInt(pINI);
+        if(v < 0)
+        {
+            INI_syntaxError(pINI, "kvlog-snapshot-bytes must be positive\n");
+            return (-1);
+        }
+        KV_snapshot_min = (unsigned)v;
+        return (0);
+    }
+
+    /* unknown */
+    return (0);
+}
+
+/*
+  Return key/value log statistics.
+
+  Public function defined in nv_kvlog.h
+ */
+void NV_KVLOG_getStats(struct nv_kvlog_stats *pStats)
+{
+    if(KV_mutex)
+    {
+        KV_LOCK();
+    }
+    *pStats = KV_stats;
+    if(KV_mutex)
+    {
+        KV_UNLOCK();
+    }
+}
+
+/*
+  Log key/value log statistics.
+
+  Public function defined in nv_kvlog.h
+ */
+void NV_KVLOG_statsReport(void)
+{
+    struct nv_kvlog_stats st;
+
+    if(KV_mutex == 0)
+    {
+        return;
+    }
+    NV_KVLOG_getStats(&st);
+
+    LOG_printf(LOG_ALWAYS,
+               "nvram: %s: %u items, %llu data bytes, log %llu bytes, "
+               "%llu appends, %llu snapshots\n",
+               KV_filename,
+               (unsigned)(st.n_items),
+               (unsigned long long)(st.live_bytes),
+               (unsigned long long)(st.log_bytes),
+               (unsigned long long)(st.n_appends),
+               (unsigned long long)(st.n_snapshots));
+}
+
+/*
+  Make every completed NV operation durable now.
+
+  Public function defined in nv_kvlog.h
+ */
+void NV_KVLOG_sync(void)
+{
+    if((KV_mutex == 0) || KV_fsync)
+    {
+        /* each group was synced as it was written */
+        return;
+    }
+    KV_LOCK();
+    if((KV_fd >= 0) && (0 != fdatasync(KV_fd)))
+    {
+        FATAL_perror(KV_filename);
+    }
+    KV_UNLOCK();
+}
+
+/*
+  Set the NV callback function pointers.
+
+  Public function defined in nv_kvlog.h
+ */
+void NV_KVLOG_loadApiPtrs(NVINTF_nvFuncts_t *pfn)
+{
+    /* Load caller's structure with pointers to the NV API functions */
+    pfn->initNV      = &kv_initNvApi;
+    pfn->compactNV   = &kv_compactNvApi;
+    pfn->createItem  = &kv_createItemApi;
+    pfn->deleteItem  = &kv_deleteItemApi;
+    pfn->readItem    = &kv_readItemApi;
+    pfn->writeItem   = &kv_writeItemApi;
+    pfn->writeItemEx = &kv_writeItemExApi;
+    pfn->getItemLen  = &kv_getItemLenApi;
+    pfn->beginTxn    = &kv_beginTxnApi;
+    pfn->commitTxn   = &kv_commitTxnApi;
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
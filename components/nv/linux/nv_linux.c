@@ -77,15 +77,26 @@ by starting the search at the last entry in the page (higher memory address).
 
 #include "nvintf.h"
 #include "nv_linux.h"
+#include "nv_kvlog.h"
 
 #include "stream.h"
 #include "log.h"
 #include "mutex.h"
+#include "ti_semaphore.h"
+#include "threads.h"
+#include "hlos_specific.h"
+#include "timer.h"
 #include "fatal.h"
 #include "ini_file.h"
 #include "bitsnbits.h"
 
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <malloc.h>    /* for calloc */
 
@@ -95,6 +106,163 @@ static const char *NV_filename = _nv_default_filename;
 static uint8_t    *NV_ramSim;
 static unsigned    NV_ramLength;
 
+/*
+ * The simulation file is kept open, NV_LINUX_save() only writes the
+ * byte ranges that changed since the previous save with pwrite().
+ * If the file does not exist (or has the wrong size) it is rebuilt
+ * as a temp file then renamed over the original.
+ */
+static int NV_fd = -1;
+
+/*! Never fsync(), the OS decides when the data reaches the disk */
+#define NV_FSYNC_NEVER   0
+/*! One fdatasync() after all ranges of an NV operation are written */
+#define NV_FSYNC_COMMIT  1
+/*! fdatasync() after each range, the file sees the same write order as
+ * real flash would, which is what the NVOCTP power fail recovery expects */
+#define NV_FSYNC_ORDERED 2
+
+static int NV_fsync_mode = NV_FSYNC_ORDERED;
+
+static const struct ini_flag_name nv_fsync_modes[] = {
+    { .name = "never"   , .value = NV_FSYNC_NEVER   },
+    { .name = "commit"  , .value = NV_FSYNC_COMMIT  },
+    { .name = "ordered" , .value = NV_FSYNC_ORDERED },
+    /* terminate */
+    { .name = NULL }
+};
+
+/*
+ * Dirty ranges are kept in the order they where written, a write is
+ * only merged into the most recent range, and only if the result stays
+ * within one disk sector, so merging never re-orders writes.
+ * The list grows as needed, a compaction of a large page is one save.
+ *
+ * Each range keeps a copy of its bytes as they were when written, a
+ * compaction rewrites the page header it marked XFER a few ranges
+ * earlier, writing that range from the image would put the erase first.
+ *
+ * Items a compaction copies to the destination page need no order among
+ * themselves: until that page is activated an interrupted compaction is
+ * redone from the XFER page. Ranges written meanwhile are marked xfer,
+ * fsync = ordered does not sync between two of them.
+ */
+#define NV_SECTOR_SIZE  512
+
+struct nv_dirty {
+    uint32_t ofs;
+    uint32_t len;
+    uint32_t bofs;      /* offset of the copy in NV_dbuf */
+    bool     xfer;      /* written while copying items to the XFER page */
+};
+
+/* set while NVOCTP_compactPage() copies items */
+static bool             NV_dirty_xfer;
+static struct nv_dirty *NV_dirty;
+static int              NV_n_dirty;
+static int              NV_max_dirty;
+static uint8_t         *NV_dbuf;
+static uint32_t         NV_dbuf_len;
+static uint32_t         NV_dbuf_size;
+
+/*
+ * In mmap mode the file is mapped MAP_SHARED and used as the flash
+ * itself, NV writes are plain memory stores. NV_LINUX_save() becomes
+ * an msync() of the dirty pages, or if an interval is set, the
+ * "nv-msync" thread msync()s the whole map that often.
+ */
+static bool     NV_use_mmap;
+static bool     NV_is_mapped;
+static int      NV_msync_mSecs;
+static bool     NV_msync_pending;
+static intptr_t NV_msync_thread;
+
+/*
+ * In journal mode each NV operation becomes one transaction appended
+ * to "<filename>.journal". Transactions are queued in RAM and written
+ * by the "nv-journal" thread in groups, one write and one fdatasync()
+ * per group, at most journal-delay-msecs after the first one queued.
+ * When the journal grows past journal-max-bytes the image file is
+ * rewritten (checkpoint) and the journal emptied. NV_LINUX_load()
+ * replays complete transactions, a torn one at the end is dropped, so
+ * each NV operation is all or nothing.
+ */
+#define NV_JOURNAL_MAGIC 0x4a564e54 /* "TNVJ" */
+
+/* transaction header, followed by 'len' bytes of nv_jrec records */
+struct nv_jtxn {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;
+    uint32_t image_len; /* NV_ramLength it applies to */
+};
+
+/* record, followed by 'len' bytes of data for image offset 'ofs' */
+/* padded so the next record is 4 byte aligned */
+struct nv_jrec {
+    uint32_t ofs;
+    uint32_t len;
+};
+
+#define NV_JREC_SIZE(len)  (sizeof(struct nv_jrec) + (((len) + 3) & ~3))
+
+static bool     NV_use_journal;
+static int      NV_journal_mSecs = 100;
+static unsigned NV_journal_max = 64 * 1024;
+static char    *NV_journal_name;
+static int      NV_journal_fd = -1;
+static size_t   NV_journal_size;
+static intptr_t NV_journal_sem;
+static intptr_t NV_journal_mutex;
+static intptr_t NV_journal_thread;
+
+/* queued transactions (under the NV lock) and the buffer being written */
+static uint8_t *NV_jbuf;
+static size_t   NV_jbuf_len;
+static size_t   NV_jbuf_size;
+static uint8_t *NV_jbuf_spare;
+static size_t   NV_jbuf_spare_size;
+
+/*
+ * Background compaction: when free space on the active page drops
+ * below compact-free-percent of the page, and enough of the page holds
+ * stale (inactive or superseded) items to make it worth while, the low
+ * priority "nv-compact" thread compacts the page. Writers then only
+ * compact inline when the page is really full.
+ */
+static int      NV_compact_pct = 25;
+static uint32_t NV_compact_stale; /* bytes of stale items on activePg */
+static bool     NV_compact_pending;
+static bool     NV_compact_bg;    /* true while the thread compacts */
+static intptr_t NV_compact_sem;
+static intptr_t NV_compact_thread;
+static uint64_t NV_stats_start_nSecs;
+static struct nv_linux_stats NV_stats;
+
+/*
+ * [nv] backend picks what NVOCTP_loadApiPtrs() hands out: this flash
+ * simulation, or the key/value log in nv_kvlog.c.
+ */
+#define NV_BACKEND_FLASH 0
+#define NV_BACKEND_KVLOG 1
+
+static int NV_backend = NV_BACKEND_FLASH;
+
+static const struct ini_flag_name nv_backends[] = {
+    { .name = "flash" , .value = NV_BACKEND_FLASH },
+    { .name = "kvlog" , .value = NV_BACKEND_KVLOG },
+
+    /* terminate */
+    { .name = NULL }
+};
+
+/*
+ * Between NVOCTP_beginTxnApi() and NVOCTP_commitTxnApi() the caller
+ * holds the NV lock and NV_LINUX_save() is deferred, the whole group
+ * is persisted once, as one journal transaction in journal mode.
+ */
+static int      NV_txn_depth;
+
 const struct ini_flag_name nv_log_flags[] = {
     { .name = "nv-debug" , .value = LOG_DBG_NV_dbg  },
     { .name = "nv-rdwr"  , .value = LOG_DBG_NV_rdwr },
@@ -170,6 +338,11 @@ static EMBEDDED_CONST uint32_t nvEndPage = (SNV_FIRST_PAGE + 1);
 #endif
 static EMBEDDED_CONST uint32_t nvPageSize = FLASH_PAGE_SIZE;
 
+/* Limits for the [nv] page-size-bytes setting, offsets are 32 bits on */
+/* Linux so a page can hold thousands of items; must be a multiple of 4 */
+#define NV_MIN_PAGE_SIZE  0x100
+#define NV_MAX_PAGE_SIZE  0x1000000
+
 #if !defined (NVOCTP_VERSION)
 /* Version of NV page format (do not use 0xFF) */
 #define NVOCTP_VERSION  0x01
@@ -203,8 +376,8 @@ typedef struct
 
 /* Page data size, offset into page */
 #define NVOCTP_PGDATAOFS  (NVOCTP_PGHDRLEN)
-#define NVOCTP_PGDATAEND  ((uint16_t)(nvPageSize - 1))
-#define NVOCTP_PGDATALEN  ((uint16_t)(nvPageSize - NVOCTP_PGHDRLEN))
+#define NVOCTP_PGDATAEND  ((uint32_t)(nvPageSize - 1))
+#define NVOCTP_PGDATALEN  ((uint32_t)(nvPageSize - NVOCTP_PGHDRLEN))
 
 /* Page header state values - transitions change 1 bit in each nybble */
 #define NVOCTP_PGCLEAR   0xFF  /* Erase started, not verified */
@@ -228,7 +401,7 @@ typedef struct
     uint16_t itmid; /* Item ID */
     uint8_t  sysid; /* System ID */
     uint8_t  stats; /* Status 'marks' */
-    uint16_t hofs;  /* Header offset */
+    uint32_t hofs;  /* Header offset */
     uint16_t len;   /* Data length */
 } NVOCTP_itemHdr_t;
 
@@ -270,9 +443,9 @@ typedef uint8_t cmpIH_t[NVOCTP_ITEMHDRLEN];
 typedef struct
 {
     NVOCTP_itemHdr_t *iHdr; /* Ptr to item header */
-    uint16_t          dOfs; /* Source data offset */
-    uint16_t          bOfs; /* Buffer data offset */
-    uint16_t          bLen; /* Buffer data length */
+    uint32_t          dOfs; /* Source data offset */
+    uint32_t          bOfs; /* Buffer data offset */
+    uint32_t          bLen; /* Buffer data length */
     uint8_t          *pBuf; /* Ptr to data buffer */
 } NVOCTP_itemWrp_t;
 
@@ -304,6 +477,20 @@ static uint8_t failW = 0;
 
 static intptr_t nvMutex;
 
+/* Item index, maps a compressed item ID to the offset of its current */
+/* header on page 'idxPg', so lookups do not scan every item header. */
+/* Open addressing, linear probing, empty slots have cmpid INVCMPID.  */
+typedef struct
+{
+    uint32_t cmpid; /* Compressed ID */
+    int32_t  hofs;  /* Header offset */
+} NVOCTP_idxEnt_t;
+
+static NVOCTP_idxEnt_t *idxTab;
+static uint32_t idxMask;
+static uint32_t idxPg;
+static bool     idxOk;
+
 /******************************************************************************
  Local Function Prototypes
 *******************************************************************************/
@@ -376,13 +563,40 @@ static uint32_t NVOCTP_dataChange(uint32_t ofs,
 
 static void NVOCTP_erasePage(uint32_t pg);
 
+static void nv_mark_dirty(uint32_t ofs, uint32_t len);
+
+static void nv_map_order(uint32_t ofs, uint32_t len);
+
+static void nv_msync_dirty(void);
+
 static int32_t NVOCTP_findItem(uint32_t pg,
                                uint32_t ofs,
                                uint32_t cid);
 
+static uint32_t NVOCTP_indexHash(uint32_t cid);
+
+static void NVOCTP_indexReset(uint32_t pg);
+
+static void NVOCTP_indexBuild(uint32_t pg,
+                              uint32_t ofs);
+
+static void NVOCTP_indexSet(uint32_t pg,
+                            uint32_t cid,
+                            uint32_t hOfs);
+
+static void NVOCTP_indexRemove(uint32_t pg,
+                               uint32_t cid,
+                               uint32_t hOfs);
+
 static uint32_t NVOCTP_findOffset(uint32_t pg,
                                   uint32_t bOfs);
 
+static bool NVOCTP_chainOk(uint32_t pg,
+                           uint32_t ofs);
+
+static uint32_t NVOCTP_trimTorn(uint32_t pg,
+                                uint32_t ofs);
+
 static bool NVOCTP_isErased(uint32_t pg,
                             uint32_t ofs,
                             uint32_t num);
@@ -429,7 +643,7 @@ static uint8_t *NVOCTP_FLASHADDR(uint32_t pg, uint32_t ofs)
     uint8_t *p;
     uint32_t x;
 
-    x = (((pg) * FLASH_PAGE_SIZE) + ofs);
+    x = (((pg - nvBegPage) * nvPageSize) + ofs);
     p = NV_ramSim;
     p = p + x;
     return (p);
@@ -445,10 +659,27 @@ static bool NVOCTP_FLASHACCESS(void)
 
 /*!
  * @brief Simulate embedded macro to Lock driver access via mutex
+ *
+ * Time spent waiting for another thread (ie: a compaction) is counted
+ * in NV_stats.
  */
 static void NVOCTP_LOCK(void)
 {
+    uint64_t t0;
+
+    if(MUTEX_lock(nvMutex, 0) == 0)
+    {
+        return;
+    }
+    t0 = TIMER_getNowNs();
     MUTEX_lock(nvMutex, -1);
+    t0 = TIMER_getNowNs() - t0;
+    NV_stats.n_lock_waits++;
+    NV_stats.lock_wait_nSecs += t0;
+    if(t0 > NV_stats.lock_wait_max_nSecs)
+    {
+        NV_stats.lock_wait_max_nSecs = t0;
+    }
 }
 
 /*!
@@ -459,6 +690,14 @@ static void NVOCTP_UNLOCK(void)
     MUTEX_unLock(nvMutex);
 }
 
+/*!
+ * @brief Simulate embedded macro, the smaller of two values
+ */
+static uint32_t NVOCTP_MIN(uint32_t a, uint32_t b)
+{
+    return ((a < b) ? a : b);
+}
+
 /*!
  *@brief Simulate embedded macro to generate a compressed NV ID
  * (NOTE: bit31 must be zero)
@@ -518,6 +757,55 @@ static uint8_t NVOCTP_compactNvApi(uint16_t minAvail)
     return (err);
 }
 
+/*!
+ * @fn      NVOCTP_beginTxnApi
+ *
+ * @brief   API function to start a group of NV operations
+ *
+ *          Until the matching commit, other threads cannot access NV
+ *          and nothing is written to disk. Transactions may be nested,
+ *          the outermost commit persists the group.
+ *
+ * @return  NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t NVOCTP_beginTxnApi(void)
+{
+    NVOCTP_LOCK();
+    NV_txn_depth++;
+
+    return (failF);
+}
+
+/*!
+ * @fn      NVOCTP_commitTxnApi
+ *
+ * @brief   API function to finish a group of NV operations
+ *
+ * @return  NVINTF_SUCCESS or specific failure code
+ */
+static uint8_t NVOCTP_commitTxnApi(void)
+{
+    uint8_t err;
+
+    err = failF;
+    if(NV_txn_depth > 0)
+    {
+        NV_txn_depth--;
+        if(NV_txn_depth == 0)
+        {
+            NV_LINUX_save();
+        }
+        NVOCTP_UNLOCK();
+    }
+    else
+    {
+        /* commit without begin */
+        err = NVINTF_FAILURE;
+    }
+
+    return (err);
+}
+
 /******************************************************************************
  API Functions - NV Data Items
 ******************************************************************************/
@@ -708,7 +996,7 @@ static uint8_t NVOCTP_writeItemApi(NVINTF_itemID_t id,
                                    void *pBuf)
 {
     uint8_t err;
-    uint16_t oOfs;
+    uint32_t oOfs;
     NVOCTP_itemHdr_t iHdr;
 
     /* Prevent RTOS thread contention */
@@ -740,14 +1028,32 @@ static uint8_t NVOCTP_writeItemApi(NVINTF_itemID_t id,
     /* If item not found or was deleted, */
     if(err == NVINTF_NOTFOUND)
     {
-        /* Create a new item */
-        err = NVOCTP_newItem(&iHdr, pBuf);
-        if(oOfs != 0)
+        if((oOfs != 0) &&
+           ((pgOff + NVOCTP_ITEMHDRLEN + iHdr.len) > nvPageSize))
         {
-            /* Mark old item as inactive */
-            NVOCTP_setItemInactive(oOfs);
+            NVOCTP_itemWrp_t iWrp;
+
+            /* Compaction would move the old item away from 'oOfs', */
+            /* let the compactor drop it and write the new one */
+            iWrp.iHdr = &iHdr;
+            iWrp.dOfs = 0;
+            iWrp.bOfs = 0;
+            iWrp.bLen = bLen;
+            iWrp.pBuf = pBuf;
+            (void)NVOCTP_compactPage(activePg, &iWrp);
             err = failW;
         }
+        else
+        {
+            /* Create a new item */
+            err = NVOCTP_newItem(&iHdr, pBuf);
+            if(oOfs != 0)
+            {
+                /* Mark old item as inactive */
+                NVOCTP_setItemInactive(oOfs);
+                err = failW;
+            }
+        }
     }
 
     if(err == NVINTF_SUCCESS)
@@ -882,7 +1188,7 @@ static uint8_t NVOCTP_checkItem(NVINTF_itemID_t id,
     }
 
     /* Read and decompress item header */
-    NVOCTP_readHeader(activePg, (uint16_t)ofs, pHdr);
+    NVOCTP_readHeader(activePg, (uint32_t)ofs, pHdr);
 
     return (failW);
 }
@@ -978,9 +1284,9 @@ static uint8_t NVOCTP_updateItem(NVOCTP_itemHdr_t *iHdr,
             /* Updating the item won't fit on active page, */
             /* Gather item parameters so compactor can do the write */
             iWrp.iHdr = iHdr;
-            iWrp.dOfs = (uint16_t)dOfs;
-            iWrp.bOfs = (uint16_t)bOfs;
-            iWrp.bLen = (uint16_t)bLen;
+            iWrp.dOfs = dOfs;
+            iWrp.bOfs = bOfs;
+            iWrp.bLen = bLen;
             iWrp.pBuf = pBuf;
             /* Compact NV and then write the entire updated item */
             (void)NVOCTP_compactPage(activePg, &iWrp);
@@ -1069,6 +1375,7 @@ static void NVOCTP_writeItem(NVOCTP_itemHdr_t *pHdr,
         /* Mark the IDs as VALID */
         cHdr[0] &= ~NVOCTP_VALIDIDBIT;
         NVOCTP_writeByte(dstPg, hOfs, cHdr[0]);
+        NVOCTP_indexSet(dstPg, pHdr->cmpid, hOfs);
 
         if(NVOCTP_readByte(dstPg, hOfs + NVOCTP_ITEMHDREND) != NVOCTP_ERASEDBYTE)
         {
@@ -1137,7 +1444,7 @@ static void NVOCTP_readHeader(uint32_t pg,
     NVOCTP_flashRead(pg, ofs, NVOCTP_ITEMHDRLEN, (uint8_t *)cHdr);
 
     /* Offset to compressed header */
-    pHdr->hofs = (uint16_t)ofs;
+    pHdr->hofs = ofs;
 
     /* Uncompress the header */
     /* Byte: 44444444 33333333 22222222 11111111 00000000 */
@@ -1164,6 +1471,7 @@ static void NVOCTP_readHeader(uint32_t pg,
 static void NVOCTP_setItemInactive(uint32_t iOfs)
 {
     uint8_t tmp;
+    NVOCTP_itemHdr_t iHdr;
 
     /* Get first byte of item header */
     tmp = NVOCTP_readByte(activePg, iOfs);
@@ -1173,6 +1481,13 @@ static void NVOCTP_setItemInactive(uint32_t iOfs)
 
     /* Mark the item as inactive */
     NVOCTP_writeByte(activePg, iOfs, tmp);
+
+    /* Drop it from the index */
+    NVOCTP_readHeader(activePg, iOfs, &iHdr);
+    NVOCTP_indexRemove(activePg, iHdr.cmpid, iOfs);
+
+    /* A compaction can reclaim it now */
+    NV_compact_stale += NVOCTP_ITEMHDRLEN + iHdr.len;
 }
 
 /*!
@@ -1262,6 +1577,8 @@ static uint32_t NVOCTP_findOffset(uint32_t pg,
  * @return  When >0, offset to the item header for found item
  *          When <=0, -number of items searched when item not found
  *
+ *          If the page is indexed the index answers, 'ofs' is then
+ *          always the end of the written items on that page.
  */
 static int32_t NVOCTP_findItem(uint32_t pg,
                                uint32_t ofs,
@@ -1269,6 +1586,23 @@ static int32_t NVOCTP_findItem(uint32_t pg,
 {
     uint32_t items = 0;
 
+    if(idxOk && (pg == idxPg))
+    {
+        uint32_t x;
+
+        for(x = NVOCTP_indexHash(cid) ; ; x = (x + 1) & idxMask)
+        {
+            if(idxTab[x].cmpid == cid)
+            {
+                return (idxTab[x].hofs);
+            }
+            if(idxTab[x].cmpid == NVOCTP_INVCMPID)
+            {
+                return (0);
+            }
+        }
+    }
+
     while(ofs >= (NVOCTP_PGHDRLEN + NVOCTP_ITEMHDRLEN))
     {
         NVOCTP_itemHdr_t iHdr;
@@ -1313,100 +1647,431 @@ static int32_t NVOCTP_findItem(uint32_t pg,
     }
 
     /* Item not found (negate number of items searched) */
-    return (-(int16_t)items);
+    return (-(int32_t)items);
 }
 
-/*
- * @fn      NVOCTP_compactPage
- *
- * @brief   Compact specified page by copying active items to other page
+/*!
+ * @fn      NVOCTP_indexHash
  *
- *          Compaction occurs under two circumstances: (1) 'maintenance'
- *          activity where an NV page is packed to remove out-of-use items,
- *          (2) 'update' activity where an NV page is packed to make room
- *          for an item being written. The 'update' mode is performed by
- *          writing the item after the rest of the page has been compacted
+ * @brief   Index slot where the search for a compressed ID starts
  *
- * @param   srcPg - Valid NV page to compact from
- * @param   iWrtp - Ptr to item write parameters
+ * @param   cid - Compressed NV item ID
  *
- * @return  Number of available bytes on compacted page, -1 if error
+ * @return  Slot number
  */
-static int32_t NVOCTP_compactPage(uint32_t srcPg,
-                                  NVOCTP_itemWrp_t *iWrtp)
+static uint32_t NVOCTP_indexHash(uint32_t cid)
 {
-    uint32_t loop;
-    uint32_t dstPg;
-    uint32_t dstOff;
-    uint32_t endOff;
-    uint32_t nonOff;
-    uint32_t srcOff;
-    uint32_t uicid;
-#if defined (NVOCTP_DIAGNOSTICS)
-    uint32_t nvcid;
-    uint32_t aitems = 0;
-    uint32_t ritems = 0;
-    uint32_t nvdOfs = 0;
-#endif
+    uint32_t h;
 
-    /* Reset Flash erase/write fail indicator */
-    failW = NVINTF_SUCCESS;
+    h = cid * 0x9E3779B1;
+    h ^= (h >> 16);
+    return (h & idxMask);
+}
 
-    /* Select the destination page */
-    uicid = (iWrtp == NULL) ? NVOCTP_INVCMPID : iWrtp->iHdr->cmpid;
+/*!
+ * @fn      NVOCTP_indexReset
+ *
+ * @brief   Empty the item index, it now describes an empty page
+ *
+ * @param   pg - NV page the index will describe
+ *
+ * @return  none
+ */
+static void NVOCTP_indexReset(uint32_t pg)
+{
+    uint32_t n;
 
-    /* Select the destination page */
-    dstPg = (srcPg == nvBegPage) ? nvEndPage : nvBegPage;
+    /* More than twice the number of headers that fit in a page */
+    for(n = 16 ; n < (2 * (nvPageSize / NVOCTP_ITEMHDRLEN)) ; n *= 2)
+    {
+        ;
+    }
 
-    /* Ensure that destination page is ready */
-    NVOCTP_erasePage(dstPg);
+    if((idxTab == NULL) || (idxMask != (n - 1)))
+    {
+        if(idxTab)
+        {
+            free((void *)idxTab);
+        }
+        idxTab = calloc(n, sizeof(*idxTab));
+        if(idxTab == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        idxMask = n - 1;
+    }
 
-    /* Mark the specified page to be in XFER state */
-    NVOCTP_writeByte(srcPg, NVOCTP_PGHDROFS, (uint8_t)NVOCTP_PGXFER);
+    /* All slots become NVOCTP_INVCMPID */
+    memset((void *)idxTab, 0xFF, n * sizeof(*idxTab));
+    idxPg = pg;
+    idxOk = true;
+}
 
-    /* Destination items start right after page header */
-    dstOff = NVOCTP_PGDATAOFS;
-#if defined (NVOCTP_DIAGNOSTICS)
-    /* Create a compressed item ID for NV diagnostic */
-    nvcid = NVOCTP_CMPRID(NVINTF_SYSID_NVDRVR, 1, 0);
-    /* Reserved space for NV driver diagnostic item */
-    dstOff += NVOCTP_ITEMHDRLEN + sizeof(NVOCTP_diag_t);
-#endif
+/*!
+ * @fn      NVOCTP_indexBuild
+ *
+ * @brief   Rebuild the item index from the headers on a page
+ *
+ * @param   pg  - Valid NV page
+ * @param   ofs - Offset to the end of the written items on the page
+ *
+ * @return  none
+ */
+static void NVOCTP_indexBuild(uint32_t pg,
+                              uint32_t ofs)
+{
+    NVOCTP_itemHdr_t iHdr;
+    uint32_t live;
+    uint32_t end;
+    uint32_t x;
 
-    nonOff = pgOff;
-    endOff = NVOCTP_ITEMHDRLEN;
+    NVOCTP_indexReset(pg);
+    live = 0;
+    end = ofs;
 
-    for(loop = 0; loop < 2; loop++)
+    /* Same walk as NVOCTP_findItem(), newest item first */
+    while(ofs >= (NVOCTP_PGHDRLEN + NVOCTP_ITEMHDRLEN))
     {
-        /* Source items start with the last written item */
-        srcOff = pgOff;
+        ofs -= NVOCTP_ITEMHDRLEN;
+        NVOCTP_readHeader(pg, ofs, &iHdr);
 
-        while(srcOff > endOff)
+        if((iHdr.stats & NVOCTP_ACTIVEIDBIT) &&
+           !(iHdr.stats & NVOCTP_VALIDIDBIT))
         {
-            if(failW == NVINTF_SUCCESS)
+            for(x = NVOCTP_indexHash(iHdr.cmpid) ; ; x = (x + 1) & idxMask)
             {
-                NVOCTP_itemHdr_t srcHdr;
-                uint32_t dataLen;
-                uint32_t itemSize;
+                if(idxTab[x].cmpid == iHdr.cmpid)
+                {
+                    /* Older copy, the newer one wins */
+                    break;
+                }
+                if(idxTab[x].cmpid == NVOCTP_INVCMPID)
+                {
+                    idxTab[x].cmpid = iHdr.cmpid;
+                    idxTab[x].hofs = (int32_t)ofs;
+                    live += NVOCTP_ITEMHDRLEN + iHdr.len;
+                    break;
+                }
+            }
+        }
 
-                /* Align to start of item header */
-                srcOff -= NVOCTP_ITEMHDRLEN;
+        if(!(iHdr.stats & NVOCTP_VALIDLENBIT))
+        {
+            if(iHdr.len < ofs)
+            {
+                ofs -= iHdr.len;
+            }
+            else
+            {
+                /* Corrupt, let NVOCTP_findItem() scan and report it */
+                idxOk = false;
+                return;
+            }
+        }
+        else
+        {
+            ofs = NVOCTP_findOffset(pg, ofs - 1);
+        }
+    }
 
-                /* Read and decompress item header */
-                NVOCTP_readHeader(srcPg, srcOff, &srcHdr);
-                dataLen = srcHdr.len;
-                itemSize = NVOCTP_ITEMHDRLEN + dataLen;
+    /* Everything else written on the page is reclaimable */
+    NV_compact_stale = (end > (NVOCTP_PGDATAOFS + live)) ?
+        (end - NVOCTP_PGDATAOFS - live) : 0;
+}
 
-                if(!(srcHdr.stats & NVOCTP_VALIDIDBIT))
-                {
-                    /* Only search for 'valid' items not being updated */
-                    if((srcHdr.stats & NVOCTP_ACTIVEIDBIT) &&
-                       (srcHdr.cmpid != uicid) &&
-                       (NVOCTP_findItem(dstPg, dstOff, srcHdr.cmpid) <= 0))
-                    {
-                        uint32_t xfrOfd = 0;
+/*!
+ * @fn      NVOCTP_chainOk
+ *
+ * @brief   Check that the item headers walk back to the start of a page
+ *
+ * @param   pg  - Valid NV page
+ * @param   ofs - Candidate offset to the end of the written items
+ *
+ * @return  true if every length lands on another header and the walk
+ *          ends exactly at the first data byte of the page
+ */
+static bool NVOCTP_chainOk(uint32_t pg,
+                           uint32_t ofs)
+{
+    NVOCTP_itemHdr_t iHdr;
 
-                        /* This item has not been transferred yet, */
+    /* Same walk as NVOCTP_indexBuild() */
+    while(ofs >= (NVOCTP_PGDATAOFS + NVOCTP_ITEMHDRLEN))
+    {
+        ofs -= NVOCTP_ITEMHDRLEN;
+        NVOCTP_readHeader(pg, ofs, &iHdr);
+
+        /* NVOCTP_writeHeader() never sets ACTIVEHDRBIT and only */
+        /* validates the IDs after the length */
+        if((iHdr.stats & NVOCTP_ACTIVEHDRBIT) ||
+           ((iHdr.stats & NVOCTP_VALIDLENBIT) &&
+            !(iHdr.stats & NVOCTP_VALIDIDBIT)))
+        {
+            return (false);
+        }
+
+        if(!(iHdr.stats & NVOCTP_VALIDLENBIT))
+        {
+            if(iHdr.len > (ofs - NVOCTP_PGDATAOFS))
+            {
+                return (false);
+            }
+            ofs -= iHdr.len;
+        }
+        else
+        {
+            ofs = NVOCTP_findOffset(pg, ofs - 1);
+        }
+    }
+
+    return (ofs == NVOCTP_PGDATAOFS);
+}
+
+/*!
+ * @fn      NVOCTP_trimTorn
+ *
+ * @brief   Erase a partly written item at the end of a page
+ *
+ * An item is written as data then header, a power loss in between
+ * leaves data bytes that NVOCTP_findOffset() takes for a header.
+ * Everything after the last offset that walks back cleanly is erased.
+ *
+ * @param   pg  - Valid NV page
+ * @param   ofs - Offset to the end of the written items on the page
+ *
+ * @return  Offset to the end of the intact items
+ */
+static uint32_t NVOCTP_trimTorn(uint32_t pg,
+                                uint32_t ofs)
+{
+    uint32_t end;
+
+    if(NVOCTP_chainOk(pg, ofs))
+    {
+        return (ofs);
+    }
+
+    for(end = ofs - 1 ; end > NVOCTP_PGDATAOFS ; end--)
+    {
+        if(NVOCTP_chainOk(pg, end))
+        {
+            break;
+        }
+    }
+
+    LOG_printf(LOG_ERROR, "nv: page %d: erasing %d torn bytes at 0x%04x\n",
+               (int)pg, (int)(ofs - end), (unsigned)end);
+    nv_map_order((uint32_t)(NVOCTP_FLASHADDR(pg, end) - NV_ramSim),
+                 ofs - end);
+    memset(NVOCTP_FLASHADDR(pg, end), NVOCTP_ERASEDBYTE, ofs - end);
+    nv_mark_dirty((uint32_t)(NVOCTP_FLASHADDR(pg, end) - NV_ramSim),
+                  ofs - end);
+
+    return (end);
+}
+
+/*!
+ * @fn      NVOCTP_indexSet
+ *
+ * @brief   Record the current header offset of an item
+ *
+ * @param   pg   - NV page the item was written to
+ * @param   cid  - Compressed NV item ID
+ * @param   hOfs - Offset to the item header
+ *
+ * @return  none
+ */
+static void NVOCTP_indexSet(uint32_t pg,
+                            uint32_t cid,
+                            uint32_t hOfs)
+{
+    uint32_t x;
+
+    if(!idxOk || (pg != idxPg))
+    {
+        return;
+    }
+
+    if(failW != NVINTF_SUCCESS)
+    {
+        /* Flash may not match, go back to scanning */
+        idxOk = false;
+        return;
+    }
+
+    for(x = NVOCTP_indexHash(cid) ; ; x = (x + 1) & idxMask)
+    {
+        if((idxTab[x].cmpid == cid) || (idxTab[x].cmpid == NVOCTP_INVCMPID))
+        {
+            idxTab[x].cmpid = cid;
+            idxTab[x].hofs = (int32_t)hOfs;
+            return;
+        }
+    }
+}
+
+/*!
+ * @fn      NVOCTP_indexRemove
+ *
+ * @brief   Forget an item that has been marked inactive
+ *
+ * @param   pg   - NV page of the item
+ * @param   cid  - Compressed NV item ID
+ * @param   hOfs - Offset to the inactive item header
+ *
+ * @return  none
+ */
+static void NVOCTP_indexRemove(uint32_t pg,
+                               uint32_t cid,
+                               uint32_t hOfs)
+{
+    uint32_t x, y, h;
+
+    if(!idxOk || (pg != idxPg))
+    {
+        return;
+    }
+
+    if(failW != NVINTF_SUCCESS)
+    {
+        idxOk = false;
+        return;
+    }
+
+    for(x = NVOCTP_indexHash(cid) ; ; x = (x + 1) & idxMask)
+    {
+        if(idxTab[x].cmpid == NVOCTP_INVCMPID)
+        {
+            /* Not indexed */
+            return;
+        }
+        if(idxTab[x].cmpid == cid)
+        {
+            break;
+        }
+    }
+
+    if(idxTab[x].hofs != (int32_t)hOfs)
+    {
+        /* An older copy went inactive, the index has the newer one */
+        return;
+    }
+
+    /* Backward shift delete, keeps every probe chain unbroken */
+    for(y = (x + 1) & idxMask ; ; y = (y + 1) & idxMask)
+    {
+        if(idxTab[y].cmpid == NVOCTP_INVCMPID)
+        {
+            break;
+        }
+        h = NVOCTP_indexHash(idxTab[y].cmpid);
+        /* can the entry at 'y' move to the hole at 'x'? */
+        if(((y - h) & idxMask) >= ((y - x) & idxMask))
+        {
+            idxTab[x] = idxTab[y];
+            x = y;
+        }
+    }
+    idxTab[x].cmpid = NVOCTP_INVCMPID;
+    idxTab[x].hofs = -1;
+}
+
+/*
+ * @fn      NVOCTP_compactPage
+ *
+ * @brief   Compact specified page by copying active items to other page
+ *
+ *          Compaction occurs under two circumstances: (1) 'maintenance'
+ *          activity where an NV page is packed to remove out-of-use items,
+ *          (2) 'update' activity where an NV page is packed to make room
+ *          for an item being written. The 'update' mode is performed by
+ *          writing the item after the rest of the page has been compacted
+ *
+ * @param   srcPg - Valid NV page to compact from
+ * @param   iWrtp - Ptr to item write parameters
+ *
+ * @return  Number of available bytes on compacted page, -1 if error
+ */
+static int32_t NVOCTP_compactPage(uint32_t srcPg,
+                                  NVOCTP_itemWrp_t *iWrtp)
+{
+    uint32_t loop;
+    uint32_t dstPg;
+    uint32_t dstOff;
+    uint32_t endOff;
+    uint32_t nonOff;
+    uint32_t srcOff;
+    uint32_t uicid;
+    uint64_t t0;
+#if defined (NVOCTP_DIAGNOSTICS)
+    uint32_t nvcid;
+    uint32_t aitems = 0;
+    uint32_t ritems = 0;
+    uint32_t nvdOfs = 0;
+#endif
+
+    /* Reset Flash erase/write fail indicator */
+    failW = NVINTF_SUCCESS;
+    t0 = TIMER_getNowNs();
+
+    /* Select the destination page */
+    uicid = (iWrtp == NULL) ? NVOCTP_INVCMPID : iWrtp->iHdr->cmpid;
+
+    /* Select the destination page */
+    dstPg = (srcPg == nvBegPage) ? nvEndPage : nvBegPage;
+
+    /* Ensure that destination page is ready */
+    NVOCTP_erasePage(dstPg);
+    /* Index follows the items as they are copied */
+    NVOCTP_indexReset(dstPg);
+
+    /* Mark the specified page to be in XFER state */
+    NVOCTP_writeByte(srcPg, NVOCTP_PGHDROFS, (uint8_t)NVOCTP_PGXFER);
+    NV_dirty_xfer = true;
+
+    /* Destination items start right after page header */
+    dstOff = NVOCTP_PGDATAOFS;
+#if defined (NVOCTP_DIAGNOSTICS)
+    /* Create a compressed item ID for NV diagnostic */
+    nvcid = NVOCTP_CMPRID(NVINTF_SYSID_NVDRVR, 1, 0);
+    /* Reserved space for NV driver diagnostic item */
+    dstOff += NVOCTP_ITEMHDRLEN + sizeof(NVOCTP_diag_t);
+#endif
+
+    nonOff = pgOff;
+    endOff = NVOCTP_ITEMHDRLEN;
+
+    for(loop = 0; loop < 2; loop++)
+    {
+        /* Source items start with the last written item */
+        srcOff = pgOff;
+
+        while(srcOff > endOff)
+        {
+            if(failW == NVINTF_SUCCESS)
+            {
+                NVOCTP_itemHdr_t srcHdr;
+                uint32_t dataLen;
+                uint32_t itemSize;
+
+                /* Align to start of item header */
+                srcOff -= NVOCTP_ITEMHDRLEN;
+
+                /* Read and decompress item header */
+                NVOCTP_readHeader(srcPg, srcOff, &srcHdr);
+                dataLen = srcHdr.len;
+                itemSize = NVOCTP_ITEMHDRLEN + dataLen;
+
+                if(!(srcHdr.stats & NVOCTP_VALIDIDBIT))
+                {
+                    /* Only search for 'valid' items not being updated */
+                    if((srcHdr.stats & NVOCTP_ACTIVEIDBIT) &&
+                       (srcHdr.cmpid != uicid) &&
+                       (NVOCTP_findItem(dstPg, dstOff, srcHdr.cmpid) <= 0))
+                    {
+                        uint32_t xfrOfd = 0;
+
+                        /* This item has not been transferred yet, */
                         if(loop == 0)
                         {
                             /* 1st loop, copy only 'reserved' items (0xFF data) */
@@ -1466,6 +2131,7 @@ static int32_t NVOCTP_compactPage(uint32_t srcPg,
                             /* Mark the IDs as VALID */
                             cHdr[0] &= ~NVOCTP_VALIDIDBIT;
                             NVOCTP_writeByte(dstPg, hdrOfd, cHdr[0]);
+                            NVOCTP_indexSet(dstPg, srcHdr.cmpid, hdrOfd);
                         }
                     }
                     srcOff -= dataLen;
@@ -1490,6 +2156,7 @@ static int32_t NVOCTP_compactPage(uint32_t srcPg,
                             /* Invalid length, source page must be corrupt. */
                             failF = failW = NVINTF_BADLENGTH;
                             NVOCTP_EXCEPTION(srcPg, failW);
+                            NV_dirty_xfer = false;
                             return ((uint32_t)(-1));
                         }
                     }
@@ -1498,6 +2165,7 @@ static int32_t NVOCTP_compactPage(uint32_t srcPg,
             else
             {
                 /* Failure during item xfer makes next findItem() unreliable */
+                NV_dirty_xfer = false;
                 return ((uint32_t)(-1));
             }
         }
@@ -1531,7 +2199,7 @@ static int32_t NVOCTP_compactPage(uint32_t srcPg,
         /* Number of reserved items */
         diags.reserved = (uint16_t)ritems;
         /* Available space after this item uddate */
-        diags.available = (uint16_t)(nvPageSize - dstOff);
+        diags.available = (uint16_t)NVOCTP_MIN(nvPageSize - dstOff, 0xFFFF);
         /* Update with current info */
         NVOCTP_flashWrite(dstPg, NVOCTP_PGDATAOFS, sizeof(diags),
                           (uint8_t *)&diags);
@@ -1539,6 +2207,7 @@ static int32_t NVOCTP_compactPage(uint32_t srcPg,
     }
 
     /* All items have been copied - activate the new page */
+    NV_dirty_xfer = false;
     NVOCTP_setPageActive(dstPg);
 
     if(failW != NVINTF_SUCCESS)
@@ -1552,6 +2221,23 @@ static int32_t NVOCTP_compactPage(uint32_t srcPg,
     /* Erase the previous active page */
     NVOCTP_erasePage(srcPg);
 
+    /* Only live items were copied */
+    NV_compact_stale = 0;
+    t0 = TIMER_getNowNs() - t0;
+    if(NV_compact_bg)
+    {
+        NV_stats.n_compact_bg++;
+    }
+    else
+    {
+        NV_stats.n_compact_fg++;
+    }
+    NV_stats.compact_nSecs += t0;
+    if(t0 > NV_stats.compact_max_nSecs)
+    {
+        NV_stats.compact_max_nSecs = t0;
+    }
+
     /* Tell caller how much room is left on the active page */
     return ((uint32_t)(nvPageSize - dstOff));
 }
@@ -1736,7 +2422,9 @@ static void NVOCTP_flashWrite(uint32_t pg,
     pDst = NVOCTP_FLASHADDR(pg, ofs);
     LOG_printf(LOG_DBG_NV_rdwr, "write: pg:%d, ofs=0x%04x, num=%d\n",pg,ofs,num);
     LOG_hexdump(LOG_DBG_NV_rdwr, (pg * nvPageSize) + ofs, pSrc, num);
+    nv_map_order((uint32_t)(pDst - NV_ramSim), num);
     memmove(pDst, pSrc, num);
+    nv_mark_dirty((uint32_t)(pDst - NV_ramSim), num);
 
     if(0 != memcmp(pSrc, pDst, num))
     {
@@ -1777,7 +2465,13 @@ static void NVOCTP_erasePage(uint32_t pg)
     }
 
     pBuf = NVOCTP_FLASHADDR(pg, 0);
+    nv_map_order((uint32_t)(pBuf - NV_ramSim), nvPageSize);
     memset((void *)(pBuf), NVOCTP_ERASEDBYTE, nvPageSize);
+    if(pg == idxPg)
+    {
+        idxOk = false;
+    }
+    nv_mark_dirty((uint32_t)(pBuf - NV_ramSim), nvPageSize);
 
     if(err)
     {
@@ -1796,7 +2490,7 @@ static void NVOCTP_erasePage(uint32_t pg)
  *          NOTE: this function scans memory bytes backwards (high to low)
  *
  * @param   pg - Flash page to check
- * @param   ofs - Flash page offset of first byte to check
+ * @param   ofs - Flash page offset of last (highest) byte to check
  * @param   num - Number of bytes to check
  *
  * @return  true if erased, false if not erased
@@ -1806,13 +2500,13 @@ static bool NVOCTP_isErased(uint32_t pg,
                             uint32_t num)
 {
     uint8_t *pBuf;
-    uint8_t *pEnd;
+    uint8_t *pBeg;
     bool ok;
 
     pBuf = NVOCTP_FLASHADDR(pg, ofs);
-    pEnd = NVOCTP_FLASHADDR(pg, ofs + num);
+    pBeg = pBuf - num;
     ok = true;
-    while(pBuf < pEnd)
+    while(pBuf > pBeg)
     {
         if(*pBuf != NVOCTP_ERASEDBYTE)
         {
@@ -1820,7 +2514,7 @@ static bool NVOCTP_isErased(uint32_t pg,
             break;
         }
 
-        pBuf++;
+        pBuf--;
     }
     return (ok);
 }
@@ -1856,70 +2550,1287 @@ static void NVOCTP_restoreCache(uint32_t vm)
 }
 
 /*!
- * @brief  Save the NV simulation to disk
+ * @brief fdatasync() the simulation file if the fsync mode requires it
+ * @param mode - the minimum mode that requires a sync at this point
  */
-void NV_LINUX_save(void)
+static void nv_sync(int fd, int mode)
 {
-    intptr_t s;
-    int r;
-
-    LOG_printf(LOG_DBG_NV_dbg, "nvram: save: %s, length=%d\n",
-               NV_filename,
-               NV_ramLength);
-
-    s = STREAM_createWrFile(NV_filename);
-    if(s == 0)
+    if(NV_fsync_mode < mode)
     {
-        FATAL_perror(NV_filename);
+        return;
     }
-    r = STREAM_wrBytes(s, NV_ramSim, NV_ramLength, 0);
-    STREAM_close(s);
-
-    if(r != (int)NV_ramLength)
+    if(0 != fdatasync(fd))
     {
-        FATAL_printf("%s: Cannot write %d bytes, wrote: %d instead\n",
-                     NV_filename,
-                     NV_ramLength,
-                     r);
+        FATAL_perror(NV_filename);
     }
 }
 
 /*!
- * @brief Load the NV simulation file from disk.
+ * @brief Copy the current bytes of a dirty range to the end of NV_dbuf
+ * @param pD - the range, pD->bofs must be NV_dbuf_len
+ *
+ * Not needed when mapped, the map itself is msync()ed.
  */
-void NV_LINUX_load(void)
+static void nv_dirty_copy(struct nv_dirty *pD)
 {
-    int r;
-    int64_t filesize;
-    intptr_t s;
-
-    NV_ramLength = (nvEndPage - nvBegPage + 1) * nvPageSize;
-
-    /* Get memory for the NV implimentation */
-    NV_ramSim = calloc(1,NV_ramLength);
-    if(!NV_ramSim)
+    if(NV_is_mapped)
     {
-        FATAL_printf("NV no ram\n");
+        return;
     }
 
-    /* simuate erased data */
-    memset(NV_ramSim, NVOCTP_ERASEDBYTE, NV_ramLength);
+    if((NV_dbuf_len + pD->len) > NV_dbuf_size)
+    {
+        NV_dbuf_size = (NV_dbuf_len + pD->len) * 2;
+        NV_dbuf = realloc(NV_dbuf, NV_dbuf_size);
+        if(NV_dbuf == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+    }
+    memcpy(NV_dbuf + pD->bofs, NV_ramSim + pD->ofs, pD->len);
+    NV_dbuf_len += pD->len;
+}
 
-    /* Load Linux NV RAM simulation */
+/*!
+ * @brief Can a new range be merged into the last dirty range?
+ * @param ofs - byte offset into the NV image
+ * @param len - number of bytes
+ * @param pBeg - set to the start of the merged range
+ * @param pEnd - set to the end of the merged range
+ * @returns true if it can
+ */
+static bool nv_dirty_merges(uint32_t ofs, uint32_t len,
+                            uint32_t *pBeg, uint32_t *pEnd)
+{
+    struct nv_dirty *pD;
+    uint32_t beg, end;
 
-    if(NV_filename == NULL)
+    if(NV_n_dirty == 0)
     {
-        /* the filename should be specified in the ini file */
-        BUG_HERE("missing nv filename");
+        return (false);
     }
 
-    if(!CONFIG_NV_RESTORE)
+    pD = &NV_dirty[NV_n_dirty - 1];
+    beg = (ofs < pD->ofs) ? ofs : pD->ofs;
+    end = pD->ofs + pD->len;
+    if((ofs + len) > end)
     {
-        LOG_printf(LOG_DBG_NV_dbg, "config: No load NV, clearing old NV file\n");
-        goto over_write;
+        end = ofs + len;
     }
+    *pBeg = beg;
+    *pEnd = end;
+    /* overlapping or adjacent, and within the same sector? */
+    return (((end - beg) <= (pD->len + len)) &&
+            (((beg / NV_SECTOR_SIZE) == ((end - 1) / NV_SECTOR_SIZE)) ||
+             ((beg == pD->ofs) && (end == (pD->ofs + pD->len)))));
+}
 
-    filesize = STREAM_FS_getSize(NV_filename);
+/*!
+ * @brief Must a dirty range be on disk before the next one is written?
+ * @param x - index of the range, not the last one
+ * @returns true if fsync = ordered has to sync between them
+ */
+static bool nv_dirty_ordered(int x)
+{
+    return (!(NV_dirty[x].xfer && NV_dirty[x + 1].xfer));
+}
+
+/*!
+ * @brief Make the earlier dirty ranges durable before a store (mmap mode)
+ * @param ofs - byte offset of the store into the NV image
+ * @param len - number of bytes
+ *
+ * The kernel writes back a dirty mapped page whenever it likes, so with
+ * fsync = ordered nothing may be stored in the map until what was stored
+ * before it is on disk. A store that joins the last range is written
+ * back with it, as a single pwrite() would be.
+ */
+static void nv_map_order(uint32_t ofs, uint32_t len)
+{
+    uint32_t beg, end;
+
+    if(!NV_is_mapped || (NV_fsync_mode != NV_FSYNC_ORDERED) ||
+       (NV_msync_mSecs > 0) || (NV_n_dirty == 0) || (len == 0))
+    {
+        return;
+    }
+    if(NV_dirty_xfer && NV_dirty[NV_n_dirty - 1].xfer)
+    {
+        return;
+    }
+    if(!nv_dirty_merges(ofs, len, &beg, &end))
+    {
+        nv_msync_dirty();
+    }
+}
+
+/*!
+ * @brief Record that a range of the NV image must be written to disk
+ * @param ofs - byte offset into the NV image
+ * @param len - number of bytes
+ */
+static void nv_mark_dirty(uint32_t ofs, uint32_t len)
+{
+    struct nv_dirty *pD;
+    uint32_t beg, end;
+
+    if(len == 0)
+    {
+        return;
+    }
+
+    if(NV_n_dirty)
+    {
+        pD = &NV_dirty[NV_n_dirty - 1];
+        if(nv_dirty_merges(ofs, len, &beg, &end))
+        {
+            pD->ofs = beg;
+            pD->xfer = pD->xfer && NV_dirty_xfer;
+            pD->len = end - beg;
+            /* the last copy is at the end of the buffer, redo it */
+            NV_dbuf_len = pD->bofs;
+            nv_dirty_copy(pD);
+            return;
+        }
+    }
+    else
+    {
+        NV_dbuf_len = 0;
+    }
+
+    if(NV_n_dirty == NV_max_dirty)
+    {
+        NV_max_dirty = (NV_max_dirty == 0) ? 32 : (NV_max_dirty * 2);
+        NV_dirty = realloc(NV_dirty, NV_max_dirty * sizeof(*NV_dirty));
+        if(NV_dirty == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+    }
+
+    pD = &NV_dirty[NV_n_dirty++];
+    pD->ofs = ofs;
+    pD->len = len;
+    pD->xfer = NV_dirty_xfer;
+    pD->bofs = NV_dbuf_len;
+    nv_dirty_copy(pD);
+}
+
+/*!
+ * @brief Write a complete image to a temp file, and rename it.
+ * @param pImage - image to write, NV_ramLength bytes
+ * @returns file descriptor of the new file
+ *
+ * Either the old or the new file exists after a crash, never a mix.
+ */
+static int nv_write_image(const uint8_t *pImage)
+{
+    char *tmpname;
+    char *cp;
+    size_t n;
+    int fd;
+    int r;
+
+    n = strlen(NV_filename) + 5;
+    tmpname = calloc(1, n);
+    if(tmpname == NULL)
+    {
+        FATAL_printf("NV no ram\n");
+    }
+    snprintf(tmpname, n, "%s.tmp", NV_filename);
+
+    fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+    {
+        FATAL_perror(tmpname);
+    }
+    r = (int)pwrite(fd, pImage, NV_ramLength, 0);
+    if(r != (int)NV_ramLength)
+    {
+        FATAL_printf("%s: Cannot write %d bytes, wrote: %d instead\n",
+                     tmpname,
+                     NV_ramLength,
+                     r);
+    }
+    nv_sync(fd, NV_FSYNC_COMMIT);
+
+    if(0 != rename(tmpname, NV_filename))
+    {
+        FATAL_perror(NV_filename);
+    }
+
+    if(NV_fsync_mode != NV_FSYNC_NEVER)
+    {
+        /* make the rename itself durable */
+        cp = strrchr(tmpname, '/');
+        if(cp == NULL)
+        {
+            strcpy(tmpname, ".");
+        }
+        else
+        {
+            cp[(cp == tmpname) ? 1 : 0] = 0;
+        }
+        r = open(tmpname, O_RDONLY | O_DIRECTORY);
+        if(r >= 0)
+        {
+            (void)fsync(r);
+            close(r);
+        }
+    }
+    free((void *)tmpname);
+    return (fd);
+}
+
+/*!
+ * @brief Rewrite the whole simulation file from the NV image
+ *
+ * Used when the file is created, or does not match the image size.
+ */
+static void nv_rewrite(void)
+{
+    int fd;
+
+    fd = nv_write_image(NV_ramSim);
+    if(NV_fd >= 0)
+    {
+        close(NV_fd);
+    }
+    NV_fd = fd;
+    NV_n_dirty = 0;
+}
+
+/*
+  CRC32 (the zlib/ethernet one) of a buffer.
+
+  Public function defined in nv_linux.h
+ */
+uint32_t NV_LINUX_crc32(const uint8_t *pData, size_t len)
+{
+    static const uint32_t nibble_tab[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+        0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+        0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    uint32_t crc;
+
+    crc = 0xffffffff;
+    while(len--)
+    {
+        crc ^= *pData++;
+        crc = (crc >> 4) ^ nibble_tab[crc & 0x0f];
+        crc = (crc >> 4) ^ nibble_tab[crc & 0x0f];
+    }
+    return (~crc);
+}
+
+/*!
+ * @brief Queue the dirty ranges as one journal transaction (journal mode)
+ *
+ * Called with the NV lock held, the "nv-journal" thread writes it.
+ */
+static void nv_journal_commit(void)
+{
+    struct nv_jtxn *pT;
+    struct nv_jrec *pR;
+    struct nv_dirty *pD;
+    uint8_t *pPayload;
+    size_t need;
+    bool was_empty;
+    int x;
+
+    if(NV_n_dirty == 0)
+    {
+        return;
+    }
+
+    need = sizeof(*pT);
+    for(x = 0 ; x < NV_n_dirty ; x++)
+    {
+        need += NV_JREC_SIZE(NV_dirty[x].len);
+    }
+
+    if((NV_jbuf_len + need) > NV_jbuf_size)
+    {
+        NV_jbuf_size = (NV_jbuf_len + need) * 2;
+        NV_jbuf = realloc(NV_jbuf, NV_jbuf_size);
+        if(NV_jbuf == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+    }
+
+    pT = (struct nv_jtxn *)(NV_jbuf + NV_jbuf_len);
+    pPayload = (uint8_t *)(pT + 1);
+    pR = (struct nv_jrec *)pPayload;
+    for(x = 0 ; x < NV_n_dirty ; x++)
+    {
+        pD = &NV_dirty[x];
+        pR->ofs = pD->ofs;
+        pR->len = pD->len;
+        /* zero the padding, then the data */
+        memset(((uint8_t *)(pR + 1)) + (pD->len & ~3), 0, 4);
+        memcpy((void *)(pR + 1), NV_ramSim + pD->ofs, pD->len);
+        pR = (struct nv_jrec *)(((uint8_t *)pR) + NV_JREC_SIZE(pD->len));
+    }
+    pT->magic = NV_JOURNAL_MAGIC;
+    pT->image_len = NV_ramLength;
+    pT->len   = (uint32_t)(need - sizeof(*pT));
+    pT->crc   = NV_LINUX_crc32(pPayload, pT->len);
+
+    was_empty = (NV_jbuf_len == 0);
+    NV_jbuf_len += need;
+    NV_n_dirty = 0;
+
+    if(was_empty)
+    {
+        /* start of a new group */
+        SEMAPHORE_put(NV_journal_sem);
+    }
+}
+
+/*!
+ * @brief Write queued journal transactions, checkpoint if the journal is big
+ *
+ * Called by the "nv-journal" thread and NV_LINUX_sync(), never with
+ * the NV lock held.
+ */
+static void nv_journal_flush(void)
+{
+    uint8_t *pOut;
+    size_t   out_len;
+    size_t   out_size;
+    uint8_t *pSnapshot;
+    int r;
+    int fd;
+
+    MUTEX_lock(NV_journal_mutex, -1);
+
+    /* take the queued group, NV operations continue into an empty one */
+    pSnapshot = NULL;
+    NVOCTP_LOCK();
+    pOut = NV_jbuf;
+    out_len = NV_jbuf_len;
+    out_size = NV_jbuf_size;
+    NV_jbuf = NV_jbuf_spare;
+    NV_jbuf_size = NV_jbuf_spare_size;
+    NV_jbuf_len = 0;
+    if((NV_journal_size + out_len) > NV_journal_max)
+    {
+        /* image as of the last transaction in this group */
+        pSnapshot = malloc(NV_ramLength);
+        if(pSnapshot == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        memcpy(pSnapshot, NV_ramSim, NV_ramLength);
+    }
+    NVOCTP_UNLOCK();
+
+    if(out_len)
+    {
+        /* one sequential write, one sync per group */
+        r = (int)pwrite(NV_journal_fd, pOut, out_len, NV_journal_size);
+        if(r != (int)out_len)
+        {
+            FATAL_printf("%s: Cannot write %d bytes, wrote: %d instead\n",
+                         NV_journal_name,
+                         (int)out_len,
+                         r);
+        }
+        nv_sync(NV_journal_fd, NV_FSYNC_COMMIT);
+        NV_journal_size += out_len;
+        LOG_printf(LOG_DBG_NV_dbg, "nvram: journal: %d bytes, total %d\n",
+                   (int)out_len, (int)NV_journal_size);
+    }
+
+    NV_jbuf_spare = pOut;
+    NV_jbuf_spare_size = out_size;
+
+    if(pSnapshot)
+    {
+        /* the image now holds everything in the journal, start over */
+        fd = nv_write_image(pSnapshot);
+        close(fd);
+        free((void *)pSnapshot);
+        if(0 != ftruncate(NV_journal_fd, 0))
+        {
+            FATAL_perror(NV_journal_name);
+        }
+        nv_sync(NV_journal_fd, NV_FSYNC_COMMIT);
+        NV_journal_size = 0;
+        LOG_printf(LOG_DBG_NV_dbg, "nvram: journal: checkpoint\n");
+    }
+
+    MUTEX_unLock(NV_journal_mutex);
+}
+
+/*!
+ * @brief Group commit thread, bounds how long an NV update stays queued
+ * @param cookie - not used
+ */
+static intptr_t nv_journal_thread(intptr_t cookie)
+{
+    (void)(cookie);
+    for(;;)
+    {
+        /* wait for the first transaction of a group */
+        SEMAPHORE_waitWithTimeout(NV_journal_sem, -1);
+        /* let the group fill up */
+        TIMER_sleep(NV_journal_mSecs);
+        nv_journal_flush();
+    }
+    return (0);
+}
+
+/*!
+ * @brief Set NV_journal_name from the NV filename
+ */
+static void nv_journal_name_init(void)
+{
+    int n;
+
+    if(NV_journal_name == NULL)
+    {
+        n = (int)strlen(NV_filename) + 9;
+        NV_journal_name = calloc(1, n);
+        if(NV_journal_name == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        snprintf(NV_journal_name, n, "%s.journal", NV_filename);
+    }
+}
+
+/*!
+ * @brief Apply complete journal transactions to the NV image
+ * @param fd - the journal file
+ * @param filesize - size of the journal file
+ * @returns number of transactions applied
+ *
+ * Stops at the first torn or corrupt transaction (ie: power was lost
+ * while it was written) or one written for a different image size.
+ */
+static int nv_journal_apply(int fd, int64_t filesize)
+{
+    struct nv_jtxn t;
+    struct nv_jrec *pR;
+    uint8_t *pPayload;
+    uint8_t *pEnd;
+    size_t pos;
+    int n_txn;
+
+    pos = 0;
+    n_txn = 0;
+    pPayload = NULL;
+    while(filesize > 0)
+    {
+        if(pread(fd, &t, sizeof(t), pos) != sizeof(t))
+        {
+            break;
+        }
+        if((t.magic != NV_JOURNAL_MAGIC) ||
+           (t.image_len != NV_ramLength) ||
+           ((int64_t)(pos + sizeof(t) + t.len) > filesize))
+        {
+            break;
+        }
+        pPayload = realloc(pPayload, t.len);
+        if(pPayload == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        if((pread(fd, pPayload, t.len, pos + sizeof(t)) !=
+            (ssize_t)(t.len)) ||
+           (NV_LINUX_crc32(pPayload, t.len) != t.crc))
+        {
+            break;
+        }
+
+        /* all of it is good, apply it */
+        pR = (struct nv_jrec *)pPayload;
+        pEnd = pPayload + t.len;
+        while((uint8_t *)(pR + 1) <= pEnd)
+        {
+            if(((((uint8_t *)pR) + NV_JREC_SIZE(pR->len)) > pEnd) ||
+               ((pR->ofs + pR->len) > NV_ramLength))
+            {
+                FATAL_printf("%s: bad record at %d\n",
+                             NV_journal_name, (int)pos);
+            }
+            memcpy(NV_ramSim + pR->ofs, (void *)(pR + 1), pR->len);
+            pR = (struct nv_jrec *)(((uint8_t *)pR) + NV_JREC_SIZE(pR->len));
+        }
+        pos += sizeof(t) + t.len;
+        n_txn++;
+    }
+    if(pPayload)
+    {
+        free((void *)pPayload);
+    }
+
+    LOG_printf(LOG_DBG_NV_dbg,
+               "nvram: journal: replayed %d transactions, %d of %d bytes\n",
+               n_txn, (int)pos, (int)filesize);
+    return (n_txn);
+}
+
+/*!
+ * @brief Open the journal, apply complete transactions to the image
+ *
+ * If anything was applied the image is written and the journal emptied.
+ */
+static void nv_journal_replay(void)
+{
+    int64_t filesize;
+    int n_txn;
+    int fd;
+
+    nv_journal_name_init();
+
+    NV_journal_size = 0;
+    if(!NV_use_journal)
+    {
+        /* left over from a run in journal mode? */
+        if(STREAM_FS_getSize(NV_journal_name) <= 0)
+        {
+            return;
+        }
+    }
+
+    NV_journal_fd = open(NV_journal_name, O_RDWR | O_CREAT, 0666);
+    if(NV_journal_fd < 0)
+    {
+        FATAL_perror(NV_journal_name);
+    }
+
+    filesize = (int64_t)lseek(NV_journal_fd, 0, SEEK_END);
+    if(!CONFIG_NV_RESTORE || (filesize <= 0))
+    {
+        /* nothing to replay */
+        filesize = 0;
+    }
+
+    n_txn = nv_journal_apply(NV_journal_fd, filesize);
+
+    if(n_txn && NV_is_mapped)
+    {
+        /* the map is the file */
+        if(0 != msync(NV_ramSim, NV_ramLength, MS_SYNC))
+        {
+            FATAL_perror(NV_filename);
+        }
+    }
+    else if(n_txn)
+    {
+        /* checkpoint, the image now has it all */
+        fd = nv_write_image(NV_ramSim);
+        if(NV_fd >= 0)
+        {
+            close(NV_fd);
+        }
+        NV_fd = fd;
+    }
+
+    if(!NV_use_journal)
+    {
+        close(NV_journal_fd);
+        NV_journal_fd = -1;
+        (void)unlink(NV_journal_name);
+        return;
+    }
+
+    if(filesize != 0)
+    {
+        if(0 != ftruncate(NV_journal_fd, 0))
+        {
+            FATAL_perror(NV_journal_name);
+        }
+        nv_sync(NV_journal_fd, NV_FSYNC_COMMIT);
+    }
+}
+
+/*!
+ * @brief One item collected by nv_migrate()
+ */
+struct nv_migrate_item {
+    NVOCTP_itemHdr_t hdr;
+    uint8_t         *pData;
+};
+
+/*!
+ * @brief qsort() helper, order items by their old header offset
+ */
+static int nv_migrate_cmp(const void *a, const void *b)
+{
+    const struct nv_migrate_item *pA = a;
+    const struct nv_migrate_item *pB = b;
+
+    return ((pA->hdr.hofs < pB->hdr.hofs) ? -1 :
+            ((pA->hdr.hofs > pB->hdr.hofs) ? 1 : 0));
+}
+
+/*!
+ * @brief Read the newest active copy of every item in the NV file
+ * @param filesize - size of the existing file
+ * @param ppItems - set to a malloc()ed array, in the original order
+ * @param pN - set to the number of items
+ * @param pPageSize - set to the page size of the file
+ * @returns the malloc()ed file image pItems point into, NULL if none
+ *
+ * The file is assumed to have the configured number of pages, or two
+ * (the default), of any valid page size. Journal transactions not yet
+ * checkpointed into the file are applied to the copy. The file itself
+ * is only read, the configured geometry is restored before returning.
+ */
+static uint8_t *nv_collect_items(int64_t filesize,
+                                 struct nv_migrate_item **ppItems,
+                                 int *pN,
+                                 uint32_t *pPageSize)
+{
+    struct nv_migrate_item *pItems;
+    uint8_t  *pSave;
+    uint8_t  *pOld;
+    unsigned  saveLength;
+    uint32_t  savePageSize;
+    uint32_t  saveEndPage;
+    uint32_t  oldPageSize;
+    uint32_t  npages;
+    uint32_t  srcPg;
+    uint32_t  pg;
+    uint32_t  x;
+    int       n_items;
+    int       fd;
+    intptr_t  s;
+    bool      ok;
+
+    *ppItems = NULL;
+    *pN = 0;
+
+    /* what page size did the file use? */
+    oldPageSize = 0;
+    for(x = 0 ; x < 2 ; x++)
+    {
+        npages = (x == 0) ? (nvEndPage - nvBegPage + 1) : 2;
+        if(((filesize % npages) == 0) &&
+           ((filesize / npages) >= NV_MIN_PAGE_SIZE) &&
+           ((filesize / npages) <= NV_MAX_PAGE_SIZE) &&
+           (((filesize / npages) & 3) == 0))
+        {
+            oldPageSize = (uint32_t)(filesize / npages);
+            break;
+        }
+    }
+    if(oldPageSize == 0)
+    {
+        return (NULL);
+    }
+    *pPageSize = oldPageSize;
+
+    pOld = malloc((size_t)filesize);
+    if(pOld == NULL)
+    {
+        FATAL_printf("NV no ram\n");
+    }
+    s = STREAM_createRdFile(NV_filename);
+    if(s == 0)
+    {
+        free((void *)pOld);
+        return (NULL);
+    }
+    ok = (STREAM_rdBytes(s, pOld, (size_t)filesize, 0) == (int)filesize);
+    STREAM_close(s);
+
+    /* switch to the geometry of the file */
+    saveLength   = NV_ramLength;
+    savePageSize = nvPageSize;
+    saveEndPage  = nvEndPage;
+    pSave        = NV_ramSim;
+    NV_ramSim    = pOld;
+    NV_ramLength = (unsigned)filesize;
+    nvPageSize   = oldPageSize;
+    nvEndPage    = nvBegPage + npages - 1;
+
+    /* updates not yet checkpointed into the file */
+    nv_journal_name_init();
+    if(ok && (STREAM_FS_getSize(NV_journal_name) > 0))
+    {
+        fd = open(NV_journal_name, O_RDONLY);
+        if(fd >= 0)
+        {
+            nv_journal_apply(fd, STREAM_FS_getSize(NV_journal_name));
+            close(fd);
+        }
+    }
+
+    /* the active page, or the one being compacted has everything */
+    srcPg = NVOCTP_NULLPAGE;
+    for(pg = nvBegPage ; ok && (pg <= nvEndPage) ; pg++)
+    {
+        NVOCTP_pageHdr_t pHdr;
+
+        NVOCTP_flashRead(pg, NVOCTP_PGHDROFS, NVOCTP_PGHDRLEN,
+                         (uint8_t *)&pHdr);
+        if((pHdr.signature == nvSignature) &&
+           ((pHdr.state == NVOCTP_PGACTIVE) ||
+            ((pHdr.state == NVOCTP_PGXFER) && (srcPg == NVOCTP_NULLPAGE))))
+        {
+            srcPg = pg;
+        }
+    }
+
+    n_items = 0;
+    pItems = NULL;
+    if(ok && (srcPg != NVOCTP_NULLPAGE))
+    {
+        /* the index finds the newest active copy of each item */
+        failW = NVINTF_SUCCESS;
+        NVOCTP_indexBuild(srcPg, NVOCTP_findOffset(srcPg, nvPageSize));
+        ok = idxOk;
+        pItems = calloc(idxMask + 1, sizeof(*pItems));
+        if(pItems == NULL)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        for(x = 0 ; ok && (x <= idxMask) ; x++)
+        {
+            if(idxTab[x].cmpid == NVOCTP_INVCMPID)
+            {
+                continue;
+            }
+            NVOCTP_readHeader(srcPg, idxTab[x].hofs, &(pItems[n_items].hdr));
+            pItems[n_items].pData = NVOCTP_FLASHADDR(srcPg,
+                                                     idxTab[x].hofs -
+                                                     pItems[n_items].hdr.len);
+            n_items++;
+        }
+        qsort(pItems, n_items, sizeof(*pItems), nv_migrate_cmp);
+    }
+    else
+    {
+        ok = false;
+    }
+    idxOk = false;
+
+    /* back to the configured geometry */
+    NV_ramSim    = pSave;
+    NV_ramLength = saveLength;
+    nvPageSize   = savePageSize;
+    nvEndPage    = saveEndPage;
+
+    if(!ok)
+    {
+        if(pItems)
+        {
+            free((void *)pItems);
+        }
+        free((void *)pOld);
+        return (NULL);
+    }
+
+    *ppItems = pItems;
+    *pN = n_items;
+    return (pOld);
+}
+
+/*!
+ * @brief Copy the items of an NV file with a different geometry
+ * @param filesize - size of the existing file
+ * @returns true if the items are now in NV_ramSim (and on disk)
+ *
+ * NV_ramSim must be the new, erased image. Only the page size of the
+ * old file differs, see nv_collect_items(). The items are written, in
+ * the original order, to a freshly activated first page.
+ */
+static bool nv_migrate(int64_t filesize)
+{
+    struct nv_migrate_item *pItems;
+    uint8_t  *pOld;
+    uint32_t  oldPageSize;
+    uint32_t  x;
+    int       n_items;
+
+    pOld = nv_collect_items(filesize, &pItems, &n_items, &oldPageSize);
+    if(pOld == NULL)
+    {
+        return (false);
+    }
+
+    failW = NVINTF_SUCCESS;
+    pgCycle = 0;
+    NVOCTP_setPageActive(nvBegPage);
+    pgOff = NVOCTP_PGDATAOFS;
+    for(x = 0 ; x < (uint32_t)n_items ; x++)
+    {
+        NVOCTP_writeItem(&(pItems[x].hdr), activePg, 0, 0,
+                         pItems[x].hdr.len, pItems[x].pData);
+        if(failW != NVINTF_SUCCESS)
+        {
+            FATAL_printf("nvram: %s: %d items do not fit in "
+                         "%d byte pages\n",
+                         NV_filename, n_items, (int)nvPageSize);
+        }
+    }
+    NV_n_dirty = 0;
+    nv_rewrite();
+
+    /* the old journal is now part of the image */
+    if(STREAM_FS_getSize(NV_journal_name) > 0)
+    {
+        (void)unlink(NV_journal_name);
+    }
+    LOG_printf(LOG_ALWAYS,
+               "nvram: %s: migrated %d items from %d to %d byte pages\n",
+               NV_filename, n_items, (int)oldPageSize, (int)nvPageSize);
+
+    free((void *)pItems);
+    free((void *)pOld);
+    return (true);
+}
+
+/*
+  Call a function for every item in the NV file.
+
+  Public function defined in nv_linux.h
+ */
+int NV_LINUX_forEachItem(NV_LINUX_itemFn_t fn, void *cookie)
+{
+    struct nv_migrate_item *pItems;
+    NVINTF_itemID_t id;
+    uint8_t  *pOld;
+    uint32_t  pageSize;
+    int64_t   filesize;
+    int       n_items;
+    int       x;
+
+    if(nvMutex)
+    {
+        NVOCTP_LOCK();
+    }
+
+    pOld = NULL;
+    filesize = STREAM_FS_getSize(NV_filename);
+    if(filesize > 0)
+    {
+        pOld = nv_collect_items(filesize, &pItems, &n_items, &pageSize);
+    }
+
+    if((failF != NVINTF_NOTREADY) && (activePg != NVOCTP_NULLPAGE))
+    {
+        /* the index was borrowed, it describes the live image again */
+        NVOCTP_indexBuild(activePg, pgOff);
+    }
+
+    if(nvMutex)
+    {
+        NVOCTP_UNLOCK();
+    }
+
+    if(pOld == NULL)
+    {
+        return (-1);
+    }
+
+    for(x = 0 ; x < n_items ; x++)
+    {
+        id.systemID = (uint8_t)(pItems[x].hdr.sysid);
+        id.itemID   = (uint16_t)(pItems[x].hdr.itmid);
+        id.subID    = (uint16_t)(pItems[x].hdr.subid);
+        (*fn)(cookie, id, pItems[x].hdr.len, pItems[x].pData);
+    }
+
+    free((void *)pItems);
+    free((void *)pOld);
+    return (n_items);
+}
+
+/*
+  Write any queued NV journal transactions now.
+
+  Public function defined in nv_linux.h
+ */
+void NV_LINUX_sync(void)
+{
+    if(NV_backend == NV_BACKEND_KVLOG)
+    {
+        NV_KVLOG_sync();
+        return;
+    }
+    if(NV_journal_fd >= 0)
+    {
+        nv_journal_flush();
+        return;
+    }
+    if(nvMutex == 0)
+    {
+        return;
+    }
+
+    NVOCTP_LOCK();
+    if(NV_is_mapped)
+    {
+        /* msync-interval-msecs or fsync = never left it to later */
+        NV_msync_pending = false;
+        if(0 != msync(NV_ramSim, NV_ramLength, MS_SYNC))
+        {
+            FATAL_perror(NV_filename);
+        }
+    }
+    else if((NV_fd >= 0) && (NV_fsync_mode == NV_FSYNC_NEVER))
+    {
+        if(0 != fdatasync(NV_fd))
+        {
+            FATAL_perror(NV_filename);
+        }
+    }
+    NVOCTP_UNLOCK();
+}
+
+/*!
+ * @brief msync() the pages holding the dirty ranges (mmap mode)
+ */
+static void nv_msync_dirty(void)
+{
+    struct nv_dirty *pD;
+    uintptr_t pgsize;
+    uintptr_t beg, end;
+    int x;
+
+    if(NV_n_dirty == 0)
+    {
+        return;
+    }
+
+    if(NV_msync_mSecs > 0)
+    {
+        /* the msync thread will get it */
+        NV_msync_pending = true;
+        NV_n_dirty = 0;
+        return;
+    }
+
+    if(NV_fsync_mode == NV_FSYNC_NEVER)
+    {
+        /* page cache handles it */
+        NV_n_dirty = 0;
+        return;
+    }
+
+    pgsize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    beg = end = 0;
+    for(x = 0 ; x < NV_n_dirty ; x++)
+    {
+        pD = &NV_dirty[x];
+        if(beg == 0)
+        {
+            beg = (uintptr_t)(NV_ramSim + pD->ofs);
+            end = beg + pD->len;
+        }
+        else
+        {
+            /* one msync() covering every range up to the next sync */
+            if((uintptr_t)(NV_ramSim + pD->ofs) < beg)
+            {
+                beg = (uintptr_t)(NV_ramSim + pD->ofs);
+            }
+            if((uintptr_t)(NV_ramSim + pD->ofs + pD->len) > end)
+            {
+                end = (uintptr_t)(NV_ramSim + pD->ofs + pD->len);
+            }
+        }
+        if(((x + 1) < NV_n_dirty) &&
+           ((NV_fsync_mode == NV_FSYNC_COMMIT) || !nv_dirty_ordered(x)))
+        {
+            continue;
+        }
+        beg = beg & ~(pgsize - 1);
+        if(0 != msync((void *)beg, end - beg, MS_SYNC))
+        {
+            FATAL_perror(NV_filename);
+        }
+        beg = 0;
+    }
+    NV_n_dirty = 0;
+}
+
+/*!
+ * @brief Thread that periodically msync()s the NV map
+ * @param cookie - not used
+ */
+static intptr_t nv_msync_thread(intptr_t cookie)
+{
+    bool pending;
+
+    (void)(cookie);
+    for(;;)
+    {
+        TIMER_sleep(NV_msync_mSecs);
+
+        /* holding the lock keeps NV_LINUX_load() from moving the map */
+        NVOCTP_LOCK();
+        pending = NV_msync_pending;
+        NV_msync_pending = false;
+        if(pending && NV_is_mapped &&
+           (0 != msync(NV_ramSim, NV_ramLength, MS_SYNC)))
+        {
+            FATAL_perror(NV_filename);
+        }
+        NVOCTP_UNLOCK();
+    }
+    return (0);
+}
+
+/*!
+ * @brief Wake the "nv-compact" thread if the active page needs it
+ *
+ * Called with the NV lock held, after each NV operation.
+ */
+static void nv_compact_check(void)
+{
+    uint32_t threshold;
+
+    if((NV_compact_thread == 0) || NV_compact_pending || NV_compact_bg)
+    {
+        return;
+    }
+
+    threshold = (nvPageSize * (uint32_t)NV_compact_pct) / 100;
+    /* only worth it if at least half the threshold comes back */
+    if(((nvPageSize - pgOff) < threshold) &&
+       (NV_compact_stale >= (threshold / 2)))
+    {
+        NV_compact_pending = true;
+        SEMAPHORE_put(NV_compact_sem);
+    }
+}
+
+/*!
+ * @brief Thread that compacts the active page before it is full
+ * @param cookie - not used
+ */
+static intptr_t nv_compact_thread(intptr_t cookie)
+{
+    uint32_t threshold;
+
+    (void)(cookie);
+
+    /*
+     * This runs at the same priority as the writers: it holds the NV
+     * lock (which does not inherit priority) for the whole compaction,
+     * a lower priority would only make them wait longer. Its own waits
+     * for the lock are not counted as foreground waits.
+     */
+    for(;;)
+    {
+        SEMAPHORE_waitWithTimeout(NV_compact_sem, -1);
+
+        MUTEX_lock(nvMutex, -1);
+        NV_compact_pending = false;
+        /* a writer may have compacted it meanwhile */
+        threshold = (nvPageSize * (uint32_t)NV_compact_pct) / 100;
+        if((failF == NVINTF_SUCCESS) &&
+           ((nvPageSize - pgOff) < threshold) &&
+           (NV_compact_stale >= (threshold / 2)))
+        {
+            NV_compact_bg = true;
+            (void)NVOCTP_compactPage(activePg, NULL);
+            NV_LINUX_save();
+            NV_compact_bg = false;
+            LOG_printf(LOG_DBG_NV_dbg,
+                       "nvram: background compaction, %d bytes free\n",
+                       (int)(nvPageSize - pgOff));
+        }
+        NVOCTP_UNLOCK();
+    }
+    return (0);
+}
+
+/*!
+ * @brief Map the NV simulation file, creating it if required (mmap mode)
+ */
+static void nv_map_file(void)
+{
+    int64_t filesize;
+    void *p;
+
+    filesize = STREAM_FS_getSize(NV_filename);
+    if(!CONFIG_NV_RESTORE || (filesize != NV_ramLength))
+    {
+        LOG_printf(LOG_DBG_NV_dbg,
+                   "nvram: creating: %s\n", NV_filename);
+        /* simuate erased data, then write the file from that */
+        NV_ramSim = calloc(1, NV_ramLength);
+        if(!NV_ramSim)
+        {
+            FATAL_printf("NV no ram\n");
+        }
+        memset(NV_ramSim, NVOCTP_ERASEDBYTE, NV_ramLength);
+        if(!CONFIG_NV_RESTORE || (filesize <= 0) || !nv_migrate(filesize))
+        {
+            nv_rewrite();
+        }
+        free((void *)NV_ramSim);
+        NV_ramSim = NULL;
+    }
+    else
+    {
+        NV_fd = open(NV_filename, O_RDWR);
+        if(NV_fd < 0)
+        {
+            FATAL_perror(NV_filename);
+        }
+    }
+
+    p = mmap(NULL, NV_ramLength, PROT_READ | PROT_WRITE, MAP_SHARED, NV_fd, 0);
+    if(p == MAP_FAILED)
+    {
+        FATAL_perror(NV_filename);
+    }
+    NV_ramSim = (uint8_t *)p;
+    NV_is_mapped = true;
+    LOG_printf(LOG_DBG_NV_dbg,
+               "nvram: mapped: %s, length=%d\n",
+               NV_filename,
+               NV_ramLength);
+}
+
+/*!
+ * @brief  Save the NV simulation to disk
+ */
+void NV_LINUX_save(void)
+{
+    struct nv_dirty *pD;
+    int x;
+    int r;
+
+    if(NV_txn_depth > 0)
+    {
+        /* NVOCTP_commitTxnApi() saves it all */
+        return;
+    }
+
+    nv_compact_check();
+
+    if(NV_journal_fd >= 0)
+    {
+        nv_journal_commit();
+        return;
+    }
+
+    if(NV_is_mapped)
+    {
+        nv_msync_dirty();
+        return;
+    }
+
+    if(NV_fd < 0)
+    {
+        LOG_printf(LOG_DBG_NV_dbg, "nvram: save: %s, length=%d\n",
+                   NV_filename,
+                   NV_ramLength);
+        nv_rewrite();
+        return;
+    }
+
+    if(NV_n_dirty == 0)
+    {
+        return;
+    }
+
+    for(x = 0 ; x < NV_n_dirty ; x++)
+    {
+        pD = &NV_dirty[x];
+        LOG_printf(LOG_DBG_NV_rdwr, "nvram: save: ofs=0x%04x, len=%d\n",
+                   (unsigned)(pD->ofs), (int)(pD->len));
+        /* as written, a later write to the same bytes has its own range */
+        r = (int)pwrite(NV_fd, NV_dbuf + pD->bofs, pD->len, pD->ofs);
+        if(r != (int)(pD->len))
+        {
+            FATAL_printf("%s: Cannot write %d bytes, wrote: %d instead\n",
+                         NV_filename,
+                         (int)(pD->len),
+                         r);
+        }
+        /* the last one is covered by the commit sync below */
+        if(((x + 1) < NV_n_dirty) && nv_dirty_ordered(x))
+        {
+            nv_sync(NV_fd, NV_FSYNC_ORDERED);
+        }
+    }
+    NV_n_dirty = 0;
+    nv_sync(NV_fd, NV_FSYNC_COMMIT);
+}
+
+/*!
+ * @brief Load the NV simulation file from disk.
+ */
+void NV_LINUX_load(void)
+{
+    int r;
+    int64_t filesize;
+    intptr_t s;
+
+    NV_ramLength = (nvEndPage - nvBegPage + 1) * nvPageSize;
+
+    /* any previous image is gone */
+    idxOk = false;
+    if(NV_is_mapped)
+    {
+        munmap((void *)NV_ramSim, NV_ramLength);
+        NV_is_mapped = false;
+    }
+    else if(NV_ramSim)
+    {
+        free((void *)NV_ramSim);
+    }
+    NV_ramSim = NULL;
+    if(NV_fd >= 0)
+    {
+        close(NV_fd);
+        NV_fd = -1;
+    }
+    NV_n_dirty = 0;
+    if(NV_journal_fd >= 0)
+    {
+        /* anything queued belongs to the old image */
+        NV_LINUX_sync();
+        close(NV_journal_fd);
+        NV_journal_fd = -1;
+    }
+
+    if(NV_filename == NULL)
+    {
+        /* the filename should be specified in the ini file */
+        BUG_HERE("missing nv filename");
+    }
+
+    if(NV_use_mmap && !NV_use_journal)
+    {
+        nv_map_file();
+        nv_journal_replay();
+        return;
+    }
+
+    /* Get memory for the NV implimentation */
+    NV_ramSim = calloc(1,NV_ramLength);
+    if(!NV_ramSim)
+    {
+        FATAL_printf("NV no ram\n");
+    }
+
+    /* simuate erased data */
+    memset(NV_ramSim, NVOCTP_ERASEDBYTE, NV_ramLength);
+
+    /* Load Linux NV RAM simulation */
+
+    if(!CONFIG_NV_RESTORE)
+    {
+        LOG_printf(LOG_DBG_NV_dbg, "config: No load NV, clearing old NV file\n");
+        goto over_write;
+    }
+
+    filesize = STREAM_FS_getSize(NV_filename);
     /* if the file exists then load it */
     if(filesize == NV_ramLength)
     {
@@ -1929,6 +3840,7 @@ void NV_LINUX_load(void)
             FATAL_perror(NV_filename);
         }
         r = STREAM_rdBytes(s, NV_ramSim, NV_ramLength, 0);
+        STREAM_close(s);
         if(r != ((int)NV_ramLength))
         {
             FATAL_printf("nvram: %s, expected %d, got %d\n",
@@ -1936,19 +3848,38 @@ void NV_LINUX_load(void)
                          NV_ramLength,
                          r);
         }
+        /* later saves update this file in place */
+        NV_fd = open(NV_filename, O_RDWR);
+        if(NV_fd < 0)
+        {
+            FATAL_perror(NV_filename);
+        }
         LOG_printf(LOG_DBG_NV_dbg,
                    "nvram: Loaded: %s, length=%d\n",
                    NV_filename,
                    NV_ramLength);
     }
+    else if((filesize > 0) && nv_migrate(filesize))
+    {
+        /* the page size has changed, items were copied */
+    }
     else
     {
+        if(filesize > 0)
+        {
+            LOG_printf(LOG_ERROR,
+                       "nvram: %s: not an NV file for any known page size, "
+                       "starting over\n", NV_filename);
+        }
     over_write:
         LOG_printf(LOG_DBG_NV_dbg,
                    "nvram: creating: %s\n", NV_filename);
         /* we just write it */
-        NV_LINUX_save();
+        nv_rewrite();
     }
+
+    /* replay even if journal mode has since been turned off */
+    nv_journal_replay();
 }
 
 /*
@@ -1977,17 +3908,119 @@ int NV_LINUX_INI_settings(struct ini_parser *pINI, bool *handled)
         return (0);
     }
 
+    if(INI_itemMatches(pINI, "nv", "backend"))
+    {
+        const struct ini_flag_name *pF;
+        bool is_not;
+
+        *handled = true;
+        pF = INI_flagLookup(nv_backends, pINI->item_value, &is_not);
+        if((pF == NULL) || is_not)
+        {
+            INI_syntaxError(pINI, "unknown nv backend: %s\n",
+                            pINI->item_value);
+            return (-1);
+        }
+        NV_backend = (int)(pF->value);
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "fsync"))
+    {
+        const struct ini_flag_name *pF;
+        bool is_not;
+
+        *handled = true;
+        pF = INI_flagLookup(nv_fsync_modes, pINI->item_value, &is_not);
+        if((pF == NULL) || is_not)
+        {
+            INI_syntaxError(pINI, "unknown fsync mode: %s\n",
+                            pINI->item_value);
+            return (-1);
+        }
+        NV_fsync_mode = (int)(pF->value);
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "mmap"))
+    {
+        NV_use_mmap = INI_valueAsBool(pINI);
+        *handled = true;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "msync-interval-msecs"))
+    {
+        NV_msync_mSecs = INI_valueAsInt(pINI);
+        *handled = true;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "journal"))
+    {
+        NV_use_journal = INI_valueAsBool(pINI);
+        *handled = true;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "journal-delay-msecs"))
+    {
+        NV_journal_mSecs = INI_valueAsInt(pINI);
+        *handled = true;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "journal-max-bytes"))
+    {
+        NV_journal_max = (unsigned)INI_valueAsInt(pINI);
+        *handled = true;
+        return (0);
+    }
+
     if(INI_itemMatches(pINI, "nv", "page-size-bytes"))
     {
-        nvPageSize = INI_valueAsInt(pINI);
+        int v;
+
+        *handled = true;
+        v = INI_valueAsInt(pINI);
+        if((v < NV_MIN_PAGE_SIZE) || (v > NV_MAX_PAGE_SIZE) || (v & 3))
+        {
+            INI_syntaxError(pINI, "page-size-bytes must be a multiple of 4, "
+                            "from %d to %d\n",
+                            NV_MIN_PAGE_SIZE, NV_MAX_PAGE_SIZE);
+            return (-1);
+        }
+        nvPageSize = (uint32_t)v;
+        return (0);
+    }
+
+    if(INI_itemMatches(pINI, "nv", "compact-free-percent"))
+    {
+        int v;
+
         *handled = true;
+        v = INI_valueAsInt(pINI);
+        if((v < 0) || (v > 90))
+        {
+            INI_syntaxError(pINI, "compact-free-percent must be 0..90\n");
+            return (-1);
+        }
+        NV_compact_pct = v;
         return (0);
     }
 
     if(INI_itemMatches(pINI, "nv", "num-pages"))
     {
-        nvEndPage = nvBegPage + INI_valueAsInt(pINI);
+        int v;
+
         *handled = true;
+        v = INI_valueAsInt(pINI);
+        if(v < 2)
+        {
+            INI_syntaxError(pINI, "num-pages must be at least 2\n");
+            return (-1);
+        }
+        nvEndPage = nvBegPage + v - 1;
         return (0);
     }
 
@@ -2003,8 +4036,8 @@ int NV_LINUX_INI_settings(struct ini_parser *pINI, bool *handled)
         return (0);
     }
 
-    /* unknown */
-    return (0);
+    /* kvlog-* settings, or unknown */
+    return (NV_KVLOG_INI_settings(pINI, handled));
 }
 
 /*!
@@ -2133,8 +4166,13 @@ static uint8_t NVOCTP_initNvApi(void *param)
         }
         /* Find the active page offset for next NV item write */
         pgOff = NVOCTP_findOffset(activePg, nvPageSize);
+        /* Drop an item the last power cycle did not finish writing */
+        pgOff = NVOCTP_trimTorn(activePg, pgOff);
     }
 
+    /* From here on lookups use the index */
+    NVOCTP_indexBuild(activePg, pgOff);
+
 #if defined (NVOCTP_DIAGNOSTICS)
     {
         uint8_t err;
@@ -2147,8 +4185,9 @@ static uint8_t NVOCTP_initNvApi(void *param)
             /* Assume this is the first time, */
             memset(&diags, 0, sizeof(diags));
             /* Space available for everything else */
-            diags.available = (uint16_t)(nvPageSize - (pgOff + NVOCTP_ITEMHDRLEN
-                                                       + sizeof(diags)));
+            diags.available = (uint16_t)NVOCTP_MIN(nvPageSize -
+                                                 (pgOff + NVOCTP_ITEMHDRLEN
+                                                  + sizeof(diags)), 0xFFFF);
         }
         /* Remember this reset */
         diags.resets += 1;
@@ -2159,6 +4198,72 @@ static uint8_t NVOCTP_initNvApi(void *param)
     return (failW);
 }
 
+/*
+  Return NV compaction statistics.
+
+  Public function defined in nv_linux.h
+ */
+void NV_LINUX_getStats(struct nv_linux_stats *pStats)
+{
+    if(nvMutex)
+    {
+        NVOCTP_LOCK();
+    }
+    *pStats = NV_stats;
+    if(nvMutex)
+    {
+        NVOCTP_UNLOCK();
+    }
+}
+
+/*
+  Log NV compaction statistics.
+
+  Public function defined in nv_linux.h
+ */
+void NV_LINUX_statsReport(void)
+{
+    struct nv_linux_stats st;
+    uint32_t avail;
+    uint64_t n;
+    uint64_t secs;
+
+    if(NV_backend == NV_BACKEND_KVLOG)
+    {
+        NV_KVLOG_statsReport();
+        return;
+    }
+    if(nvMutex == 0)
+    {
+        return;
+    }
+    NVOCTP_LOCK();
+    st = NV_stats;
+    avail = nvPageSize - pgOff;
+    NVOCTP_UNLOCK();
+
+    n = st.n_compact_fg + st.n_compact_bg;
+    secs = (TIMER_getNowNs() - NV_stats_start_nSecs) / 1000000000ULL;
+
+    LOG_printf(LOG_ALWAYS,
+               "nvram: %llu compactions in %llu secs "
+               "(%llu by writers, %llu background), "
+               "avg %llu usecs, max %llu usecs, %d of %d bytes free\n",
+               (unsigned long long)n,
+               (unsigned long long)secs,
+               (unsigned long long)st.n_compact_fg,
+               (unsigned long long)st.n_compact_bg,
+               (unsigned long long)(n ? (st.compact_nSecs / n / 1000) : 0),
+               (unsigned long long)(st.compact_max_nSecs / 1000),
+               (int)avail, (int)nvPageSize);
+    LOG_printf(LOG_ALWAYS,
+               "nvram: %llu waits for the NV lock, "
+               "total %llu usecs, max %llu usecs\n",
+               (unsigned long long)st.n_lock_waits,
+               (unsigned long long)(st.lock_wait_nSecs / 1000),
+               (unsigned long long)(st.lock_wait_max_nSecs / 1000));
+}
+
 /*
   Initialize the NV simulation.
 
@@ -2175,6 +4280,46 @@ void NV_LINUX_init(void)
         (void)NVOCTP_restoreCache;
         nvMutex = MUTEX_create("nv-mutex");
     }
+
+    if((NV_journal_fd >= 0) && (NV_journal_thread == 0))
+    {
+        NV_journal_sem = SEMAPHORE_create("nv-journal-sem", 0);
+        NV_journal_mutex = MUTEX_create("nv-journal-mutex");
+        NV_journal_thread = THREAD_create("nv-journal",
+                                          nv_journal_thread,
+                                          0,
+                                          THREAD_FLAGS_DEFAULT);
+        if(NV_journal_thread == 0)
+        {
+            FATAL_printf("Cannot create nv-journal thread\n");
+        }
+    }
+
+    if((NV_compact_pct > 0) && (NV_compact_thread == 0))
+    {
+        NV_compact_sem = SEMAPHORE_create("nv-compact-sem", 0);
+        NV_compact_thread = THREAD_create("nv-compact",
+                                          nv_compact_thread,
+                                          0,
+                                          THREAD_FLAGS_DEFAULT);
+        if(NV_compact_thread == 0)
+        {
+            FATAL_printf("Cannot create nv-compact thread\n");
+        }
+    }
+    NV_stats_start_nSecs = TIMER_getNowNs();
+
+    if(NV_is_mapped && (NV_msync_mSecs > 0) && (NV_msync_thread == 0))
+    {
+        NV_msync_thread = THREAD_create("nv-msync",
+                                        nv_msync_thread,
+                                        0,
+                                        THREAD_FLAGS_DEFAULT);
+        if(NV_msync_thread == 0)
+        {
+            FATAL_printf("Cannot create nv-msync thread\n");
+        }
+    }
 }
 
 /**
@@ -2189,6 +4334,12 @@ void NV_LINUX_init(void)
  */
 void NVOCTP_loadApiPtrs(NVINTF_nvFuncts_t *pfn)
 {
+    if(NV_backend == NV_BACKEND_KVLOG)
+    {
+        NV_KVLOG_loadApiPtrs(pfn);
+        return;
+    }
+
     /* Load caller's structure with pointers to the NV API functions */
     pfn->initNV      = &NVOCTP_initNvApi;
     pfn->compactNV   = &NVOCTP_compactNvApi;
@@ -2198,6 +4349,8 @@ void NVOCTP_loadApiPtrs(NVINTF_nvFuncts_t *pfn)
     pfn->writeItem   = &NVOCTP_writeItemApi;
     pfn->writeItemEx = &NVOCTP_writeItemExApi;
     pfn->getItemLen  = &NVOCTP_getItemLenApi;
+    pfn->beginTxn    = &NVOCTP_beginTxnApi;
+    pfn->commitTxn   = &NVOCTP_commitTxnApi;
 }
 
 /*
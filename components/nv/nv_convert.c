@@ -0,0 +1,228 @@
+/******************************************************************************
+ @file nv_convert.c
+
+ @brief TIMAC 2.0 API NV simulation file to key/value log converter
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+/*
+ * OVERVIEW
+ * ========
+ *
+ * Copies the items of an NV simulation file (the flash backend) into a
+ * new key/value log (the kvlog backend), see nv_kvlog.h.
+ *
+ * Build & run with:
+ *
+ *     make tools
+ *     ./host_nv_convert CFGFILE...
+ *
+ * The config files are read like the collector reads them, so
+ * "[nv] filename", page-size-bytes and num-pages name the file to read
+ * and "[nv] kvlog-filename" the log to create. The NV file is not
+ * changed, queued journal transactions are included. The log must not
+ * exist yet. Then set "[nv] backend = kvlog".
+ */
+
+#include "compiler.h"
+#include "nvintf.h"
+#include "nv_linux.h"
+#include "nv_kvlog.h"
+#include "ini_file.h"
+#include "timer.h"
+#include "log.h"
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! One item read from the NV file */
+struct conv_item {
+    NVINTF_itemID_t id;
+    uint32_t        len;
+    uint8_t        *pData;
+};
+
+/*! The items, in the order they were written */
+static struct conv_item *conv_items;
+static int               conv_n_items;
+
+/*! kvlog file name, from the config file */
+static const char *conv_kvname = "nv-kvlog.bin";
+
+/*!
+ * @brief INI callback, the [nv] section goes to the NV driver
+ */
+static int conv_ini_cb(struct ini_parser *pINI, bool *handled)
+{
+    if(INI_itemMatches(pINI, "nv", "kvlog-filename"))
+    {
+        conv_kvname = INI_itemValue_strdup(pINI);
+    }
+    return (NV_LINUX_INI_settings(pINI, handled));
+}
+
+/*!
+ * @brief NV_LINUX_forEachItem() callback, keep a copy of the item
+ */
+static void conv_item_cb(void *cookie,
+                         NVINTF_itemID_t id,
+                         uint32_t len,
+                         const uint8_t *pData)
+{
+    struct conv_item *pI;
+
+    (void)(cookie);
+
+    /* NV driver diagnostics belong to the flash backend */
+    if(id.systemID == NVINTF_SYSID_NVDRVR)
+    {
+        return;
+    }
+
+    conv_items = realloc(conv_items,
+                         (conv_n_items + 1) * sizeof(*conv_items));
+    if(conv_items == NULL)
+    {
+        fprintf(stderr, "ERROR: no memory\n");
+        exit(1);
+    }
+    pI = &conv_items[conv_n_items++];
+    pI->id = id;
+    pI->len = len;
+    pI->pData = malloc(len ? len : 1);
+    if(pI->pData == NULL)
+    {
+        fprintf(stderr, "ERROR: no memory\n");
+        exit(1);
+    }
+    memcpy(pI->pData, pData, len);
+}
+
+/*!
+ * @brief the converter main program
+ * @param argc - arg count
+ * @param argv - arg vector
+ * @returns zero on success
+ */
+int main(int argc, char **argv)
+{
+    NVINTF_nvFuncts_t kv;
+    struct nv_kvlog_stats st;
+    int x;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s CFGFILE...\n", argv[0]);
+        exit(1);
+    }
+
+    STREAM_init();
+    TIMER_init();
+    LOG_init("/dev/stderr");
+
+    for(x = 1 ; x < argc ; x++)
+    {
+        if(INI_read(argv[x], conv_ini_cb, 0) != 0)
+        {
+            fprintf(stderr, "ERROR: cannot read %s\n", argv[x]);
+            exit(1);
+        }
+    }
+
+    if(STREAM_FS_getSize(conv_kvname) > 0)
+    {
+        fprintf(stderr, "ERROR: %s exists, remove it first\n", conv_kvname);
+        exit(1);
+    }
+
+    if(NV_LINUX_forEachItem(conv_item_cb, NULL) < 0)
+    {
+        fprintf(stderr, "ERROR: no valid NV file to convert\n");
+        exit(1);
+    }
+
+    /* a new log, one transaction holds every item */
+    linux_CONFIG_NV_RESTORE = false;
+    NV_KVLOG_loadApiPtrs(&kv);
+    if(kv.initNV(NULL) != NVINTF_SUCCESS)
+    {
+        fprintf(stderr, "ERROR: cannot create %s\n", conv_kvname);
+        exit(1);
+    }
+    kv.beginTxn();
+    for(x = 0 ; x < conv_n_items ; x++)
+    {
+        if(kv.createItem(conv_items[x].id, conv_items[x].len,
+                         conv_items[x].pData) != NVINTF_SUCCESS)
+        {
+            fprintf(stderr, "ERROR: cannot add item %d/%d/%d\n",
+                    conv_items[x].id.systemID,
+                    conv_items[x].id.itemID,
+                    conv_items[x].id.subID);
+            exit(1);
+        }
+    }
+    kv.commitTxn();
+
+    NV_KVLOG_getStats(&st);
+    printf("%s: %u items, %llu data bytes, %llu byte log\n",
+           conv_kvname,
+           (unsigned)(st.n_items),
+           (unsigned long long)(st.live_bytes),
+           (unsigned long long)(st.log_bytes));
+    return (0);
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
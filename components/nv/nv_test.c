@@ -0,0 +1,1263 @@
+/******************************************************************************
+ @file nv_test.c
+
+ @brief TIMAC 2.0 API NV benchmark and power loss simulation
+
+ Group: WCS LPC
+ $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+
+ ******************************************************************************
+ $License: BSD3 2016 $
+  
+   Copyright (c) 2015, Texas Instruments Incorporated
+   All rights reserved.
+  
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+  
+   *  Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+  
+   *  Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+  
+   *  Neither the name of Texas Instruments Incorporated nor the names of
+      its contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+  
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************
+ $Release Name: TI-15.4Stack Linux x64 SDK$
+ $Release Date: Sept 27, 2017 (2.04.00.13)$
+ *****************************************************************************/
+
+/*
+ * OVERVIEW
+ * ========
+ *
+ * Benchmark and crash consistency check for the Linux NV driver.
+ *
+ * Build & run with:
+ *
+ *     make testapps
+ *     ./host_nv_test bench [NOPS [CFGFILE]]
+ *     ./host_nv_test crash [NROUNDS [CFGFILE [corrupt]]]
+ *
+ * CFGFILE is read for its [nv] section (backend, fsync, mmap, journal ...),
+ * other sections are ignored, the NV file is deleted and recreated by each
+ * run. "make testapps" runs 20 crash rounds with the collector.cfg.
+ *
+ * Both replay the collector's use of NV (see csf_linux.c) through the
+ * NVINTF API, from a seeded random mix of:
+ *   - joins: a device record and the device count, in one transaction
+ *   - device frame counter updates, the whole device record is written
+ *   - coordinator frame counter updates
+ *   - leaves: delete a device record and update the count
+ *   - blacklist churn: add or remove a blacklist record and its count
+ *
+ * "bench" reports operations per second, bytes written and syncs per
+ * operation, page compactions and latency percentiles per kind.
+ *
+ * "crash" simulates power loss. Each round a child process runs the
+ * workload from a new file and power fails part way through, at a
+ * random pwrite() or sync call or after a random operation. The file
+ * I/O calls are wrapped by this program, which keeps the old content
+ * of every 512 byte sector written since the file was last synced by
+ * fdatasync()/fsync() (or, for a shared map, the range by msync()).
+ * When power fails a random subset of those sectors is put back, as a
+ * disk writes back the page cache in any order, a file that grew may
+ * lose its new size, and the child exits. With "corrupt", one sector
+ * not synced is also filled with garbage; the NV format has no
+ * checksums and is not designed to survive that. Directory changes
+ * (create, rename) and truncation are taken as durable at once.
+ * A second child then loads the file with NV_LINUX_init() and checks
+ * that every item equals the model after some prefix of the operations,
+ * the operation in flight may be half done unless it was one journal
+ * transaction. It reports how many completed operations were lost.
+ */
+
+#include "compiler.h"
+#include "nvintf.h"
+#include "nv_linux.h"
+#include "ini_file.h"
+#include "timer.h"
+#include "log.h"
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+/*! NV item IDs, as used by csf_linux.c */
+#define TEST_NV_DEVICELIST_ENTRIES_ID 0x0004
+#define TEST_NV_DEVICELIST_ID         0x0005
+#define TEST_NV_BLACKLIST_ENTRIES_ID  0x0002
+#define TEST_NV_BLACKLIST_ID          0x0003
+#define TEST_NV_FRAMECOUNTER_ID       0x0006
+
+/*! number of device slots, fits the default 4K page */
+#define TEST_MAX_DEVICES   100
+/*! number of blacklist slots */
+#define TEST_MAX_BLACKLIST 10
+/*! largest item, about a Llc_deviceListItem_t */
+#define TEST_ITEM_LEN      24
+
+/*! flat item numbering used by the model */
+#define TEST_ITEM_DEV(n)   (n)
+#define TEST_ITEM_DEVCNT   (TEST_MAX_DEVICES)
+#define TEST_ITEM_BL(n)    (TEST_MAX_DEVICES + 1 + (n))
+#define TEST_ITEM_BLCNT    (TEST_MAX_DEVICES + 1 + TEST_MAX_BLACKLIST)
+#define TEST_ITEM_FC       (TEST_ITEM_BLCNT + 1)
+#define TEST_N_ITEMS       (TEST_ITEM_FC + 1)
+
+/*! kinds of operations */
+#define TEST_OP_JOIN   0
+#define TEST_OP_DEVFC  1
+#define TEST_OP_FC     2
+#define TEST_OP_LEAVE  3
+#define TEST_OP_BL     4
+#define TEST_N_OPS     5
+
+static const char * const test_op_names[TEST_N_OPS] = {
+    "join", "device fc", "coord fc", "leave", "blacklist"
+};
+
+/*!
+ * @brief What NV should hold, and the random generator driving it
+ */
+struct test_model {
+    uint32_t rng;
+    uint16_t n_dev;
+    uint16_t n_bl;
+    uint8_t  len[TEST_N_ITEMS];
+    uint8_t  data[TEST_N_ITEMS][TEST_ITEM_LEN];
+};
+
+/*!
+ * @brief Shared with the crash test children
+ */
+struct test_shared {
+    volatile int ops_done;
+    int          lost;
+    int          mixed;
+    int          ok;
+};
+
+/*! NV driver under test */
+static NVINTF_nvFuncts_t test_nv;
+
+/*! NV file names (flash and kvlog backends), from the config file */
+static const char *test_filename = "nv-simulation.bin";
+static const char *test_kvname = "nv-kvlog.bin";
+
+/*! wrapped system call counters */
+static uint64_t test_n_pwrite;
+static uint64_t test_b_pwrite;
+static uint64_t test_n_sync;
+
+/*! crash test: pwrite() or sync call number where power fails, 0 = never */
+static uint64_t test_fault_at;
+static uint64_t test_n_fault_pts;
+static bool     test_fault_corrupt;
+
+/*! crash test: keep what is not yet durable, set in the worker only */
+static bool     test_power_model;
+
+/*! disks write whole sectors, nv_linux.c relies on that (NV_SECTOR_SIZE) */
+#define TEST_SECTOR_SIZE 512
+
+/*! most files and maps with data not yet synced at one time */
+#define TEST_MAX_FILES 8
+#define TEST_MAX_MAPS  4
+
+/*!
+ * @brief A file written since it was last synced
+ *
+ * Writes reach the file (the page cache) at once, so the NV driver reads
+ * back what it wrote. Each sector's content as of the last sync is kept
+ * here, a power failure puts back a random subset of them.
+ */
+struct test_file {
+    dev_t    dev;
+    ino_t    ino;
+    int      fd;        /* the file opened again, it survives close() */
+    off_t    size;      /* file size when last synced */
+    int      n_sec;
+    int      max_sec;
+    off_t   *pOfs;      /* sectors written since the last sync */
+    uint8_t *pOld;      /* and their content at the last sync */
+};
+
+/*!
+ * @brief A shared writable map, only msync() makes its stores durable
+ */
+struct test_map {
+    uint8_t *pAddr;
+    size_t   len;
+    off_t    ofs;
+    int      fd;        /* the mapped file opened again */
+    uint8_t *pSynced;   /* the file as of the last msync() */
+};
+
+static struct test_file test_files[TEST_MAX_FILES];
+static int              test_n_files;
+static struct test_map  test_maps[TEST_MAX_MAPS];
+static int              test_n_maps;
+
+/*! the NV driver writes from several threads */
+static pthread_mutex_t  test_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * @brief Open the file behind fd again, for reading and writing
+ *
+ * The NV driver opens some files write only, the old sector content must
+ * be read back and put back through a descriptor that survives close().
+ */
+static int test_reopen(int fd)
+{
+    char name[40];
+    int r;
+
+    snprintf(name, sizeof(name), "/proc/self/fd/%d", fd);
+    r = open(name, O_RDWR);
+    if(r < 0)
+    {
+        perror(name);
+        _exit(2);
+    }
+    return (r);
+}
+
+/*!
+ * @brief Find (or start) the unsynced data of the file behind fd
+ * @returns pointer to the entry, NULL if the table is full
+ */
+static struct test_file *test_file_get(int fd, bool create)
+{
+    struct test_file *pF;
+    struct stat st;
+    int x;
+
+    if(0 != fstat(fd, &st))
+    {
+        return (NULL);
+    }
+    for(x = 0 ; x < test_n_files ; x++)
+    {
+        if((test_files[x].dev == st.st_dev) &&
+           (test_files[x].ino == st.st_ino))
+        {
+            return (&test_files[x]);
+        }
+    }
+    if(!create || (test_n_files == TEST_MAX_FILES))
+    {
+        return (NULL);
+    }
+    pF = &test_files[test_n_files++];
+    memset(pF, 0, sizeof(*pF));
+    pF->dev = st.st_dev;
+    pF->ino = st.st_ino;
+    pF->fd = test_reopen(fd);
+    pF->size = st.st_size;
+    return (pF);
+}
+
+/*!
+ * @brief Remember a sector's durable content before it is overwritten
+ */
+static void test_file_note(struct test_file *pF, off_t ofs,
+                           const uint8_t *pOld)
+{
+    int x;
+
+    for(x = 0 ; x < pF->n_sec ; x++)
+    {
+        if(pF->pOfs[x] == ofs)
+        {
+            return;
+        }
+    }
+    if(pF->n_sec == pF->max_sec)
+    {
+        pF->max_sec = pF->max_sec ? (pF->max_sec * 2) : 64;
+        pF->pOfs = realloc(pF->pOfs, pF->max_sec * sizeof(off_t));
+        pF->pOld = realloc(pF->pOld, pF->max_sec * TEST_SECTOR_SIZE);
+        if((pF->pOfs == NULL) || (pF->pOld == NULL))
+        {
+            _exit(2);
+        }
+    }
+    pF->pOfs[pF->n_sec] = ofs;
+    if(pOld)
+    {
+        memcpy(pF->pOld + (pF->n_sec * TEST_SECTOR_SIZE), pOld,
+               TEST_SECTOR_SIZE);
+    }
+    else
+    {
+        /* read it, past the end of the file reads as zeros */
+        memset(pF->pOld + (pF->n_sec * TEST_SECTOR_SIZE), 0,
+               TEST_SECTOR_SIZE);
+        (void)syscall(SYS_pread64, pF->fd,
+                      pF->pOld + (pF->n_sec * TEST_SECTOR_SIZE),
+                      TEST_SECTOR_SIZE, ofs);
+    }
+    pF->n_sec++;
+}
+
+/*!
+ * @brief Everything written to a file is durable now
+ */
+static void test_file_synced(int fd)
+{
+    struct test_file *pF;
+    struct stat st;
+    int x;
+
+    pF = test_file_get(fd, false);
+    if(pF)
+    {
+        (void)close(pF->fd);
+        free(pF->pOfs);
+        free(pF->pOld);
+        *pF = test_files[--test_n_files];
+    }
+
+    /* fdatasync() also writes the file's dirty mapped pages */
+    if(0 == fstat(fd, &st))
+    {
+        for(x = 0 ; x < test_n_maps ; x++)
+        {
+            struct stat mst;
+
+            if((0 == fstat(test_maps[x].fd, &mst)) &&
+               (mst.st_dev == st.st_dev) && (mst.st_ino == st.st_ino))
+            {
+                memcpy(test_maps[x].pSynced, test_maps[x].pAddr,
+                       test_maps[x].len);
+            }
+        }
+    }
+}
+
+/*!
+ * @brief Power fails: the disk keeps a random subset of what was not
+ *        synced, written in no particular order, then the child dies
+ *
+ * With "corrupt", one of the sectors not synced is left with garbage.
+ * Must be called with test_lock held.
+ */
+static void test_power_fail(void)
+{
+    uint8_t junk[TEST_SECTOR_SIZE];
+    int n_unsynced;
+    int bad;
+    size_t s;
+    int x;
+    int y;
+
+    /* pick the sector to garble, counting every unsynced one */
+    n_unsynced = 0;
+    for(x = 0 ; x < test_n_maps ; x++)
+    {
+        struct test_map *pM = &test_maps[x];
+
+        for(s = 0 ; s < pM->len ; s += TEST_SECTOR_SIZE)
+        {
+            n_unsynced += (0 != memcmp(pM->pAddr + s, pM->pSynced + s,
+                                       TEST_SECTOR_SIZE));
+        }
+    }
+    for(x = 0 ; x < test_n_files ; x++)
+    {
+        n_unsynced += test_files[x].n_sec;
+    }
+    bad = (test_fault_corrupt && n_unsynced) ? (rand() % n_unsynced) : -1;
+    for(y = 0 ; y < TEST_SECTOR_SIZE ; y++)
+    {
+        junk[y] = (uint8_t)rand();
+    }
+
+    for(x = 0 ; x < test_n_maps ; x++)
+    {
+        struct test_map *pM = &test_maps[x];
+
+        for(s = 0 ; s < pM->len ; s += TEST_SECTOR_SIZE)
+        {
+            if(0 == memcmp(pM->pAddr + s, pM->pSynced + s,
+                           TEST_SECTOR_SIZE))
+            {
+                continue;
+            }
+            if(bad-- == 0)
+            {
+                memcpy(pM->pAddr + s, junk, TEST_SECTOR_SIZE);
+            }
+            else if(rand() & 1)
+            {
+                /* this page never reached the disk */
+                memcpy(pM->pAddr + s, pM->pSynced + s, TEST_SECTOR_SIZE);
+            }
+        }
+    }
+
+    for(x = 0 ; x < test_n_files ; x++)
+    {
+        struct test_file *pF = &test_files[x];
+        struct stat st;
+
+        for(y = 0 ; y < pF->n_sec ; y++)
+        {
+            if(bad-- == 0)
+            {
+                (void)syscall(SYS_pwrite64, pF->fd, junk,
+                              TEST_SECTOR_SIZE, pF->pOfs[y]);
+            }
+            else if(rand() & 1)
+            {
+                (void)syscall(SYS_pwrite64, pF->fd,
+                              pF->pOld + (y * TEST_SECTOR_SIZE),
+                              TEST_SECTOR_SIZE, pF->pOfs[y]);
+            }
+        }
+        /* the new file size may not have reached the disk either */
+        if((0 == fstat(pF->fd, &st)) && (st.st_size > pF->size) &&
+           (rand() & 1))
+        {
+            (void)syscall(SYS_ftruncate, pF->fd, pF->size);
+        }
+    }
+    _exit(0);
+}
+
+/*!
+ * @brief Count a pwrite() or sync, power fails at the chosen one
+ *
+ * Must be called with test_lock held.
+ */
+static void test_fault_point(void)
+{
+    test_n_fault_pts++;
+    if(test_fault_at && (test_n_fault_pts == test_fault_at))
+    {
+        test_power_fail();
+    }
+}
+
+/*!
+ * @brief Wrapper, counts writes and keeps what is not yet durable
+ */
+ssize_t pwrite(int fd, const void *buf, size_t n, off_t ofs)
+{
+    struct test_file *pF;
+    ssize_t r;
+    off_t sec;
+
+    pthread_mutex_lock(&test_lock);
+    test_n_pwrite++;
+    test_b_pwrite += n;
+    if(test_power_model && n)
+    {
+        pF = test_file_get(fd, true);
+        if(pF == NULL)
+        {
+            fprintf(stderr, "ERROR: too many unsynced files\n");
+            _exit(2);
+        }
+        for(sec = ofs - (ofs % TEST_SECTOR_SIZE) ;
+            sec < (off_t)(ofs + n) ; sec += TEST_SECTOR_SIZE)
+        {
+            test_file_note(pF, sec, NULL);
+        }
+    }
+    r = (ssize_t)syscall(SYS_pwrite64, fd, buf, n, ofs);
+    if(test_power_model)
+    {
+        /* power fails with this write in the page cache */
+        test_fault_point();
+    }
+    pthread_mutex_unlock(&test_lock);
+    return (r);
+}
+
+/*!
+ * @brief Wrapper, counts syncs, the file's data is durable after it
+ */
+int fdatasync(int fd)
+{
+    int r;
+
+    pthread_mutex_lock(&test_lock);
+    test_n_sync++;
+    if(test_power_model)
+    {
+        /* power fails before the sync completes */
+        test_fault_point();
+    }
+    r = (int)syscall(SYS_fdatasync, fd);
+    if(test_power_model && (r == 0))
+    {
+        test_file_synced(fd);
+    }
+    pthread_mutex_unlock(&test_lock);
+    return (r);
+}
+
+/*!
+ * @brief Wrapper, counts syncs, the file's data is durable after it
+ */
+int fsync(int fd)
+{
+    int r;
+
+    pthread_mutex_lock(&test_lock);
+    test_n_sync++;
+    if(test_power_model)
+    {
+        test_fault_point();
+    }
+    r = (int)syscall(SYS_fsync, fd);
+    if(test_power_model && (r == 0))
+    {
+        test_file_synced(fd);
+    }
+    pthread_mutex_unlock(&test_lock);
+    return (r);
+}
+
+/*!
+ * @brief Wrapper, counts syncs, the range of the map is durable after it
+ */
+int msync(void *addr, size_t len, int flags)
+{
+    uint8_t *pBeg = (uint8_t *)addr;
+    uint8_t *pEnd = pBeg + len;
+    int r;
+    int x;
+
+    pthread_mutex_lock(&test_lock);
+    test_n_sync++;
+    if(test_power_model)
+    {
+        test_fault_point();
+    }
+    r = (int)syscall(SYS_msync, addr, len, flags);
+    for(x = 0 ; (r == 0) && (x < test_n_maps) ; x++)
+    {
+        struct test_map *pM = &test_maps[x];
+        uint8_t *pB = (pBeg > pM->pAddr) ? pBeg : pM->pAddr;
+        uint8_t *pE = (pEnd < (pM->pAddr + pM->len)) ?
+            pEnd : (pM->pAddr + pM->len);
+
+        if(pB < pE)
+        {
+            memcpy(pM->pSynced + (pB - pM->pAddr), pB, pE - pB);
+        }
+    }
+    pthread_mutex_unlock(&test_lock);
+    return (r);
+}
+
+/*!
+ * @brief Wrapper, tracks shared writable file maps
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t ofs)
+{
+    void *p;
+
+    p = (void *)syscall(SYS_mmap, addr, len, prot, flags, fd, ofs);
+    if((p == MAP_FAILED) || !test_power_model || (fd < 0) ||
+       !(flags & MAP_SHARED) || !(prot & PROT_WRITE))
+    {
+        return (p);
+    }
+
+    pthread_mutex_lock(&test_lock);
+    if(test_n_maps == TEST_MAX_MAPS)
+    {
+        fprintf(stderr, "ERROR: too many maps\n");
+        _exit(2);
+    }
+    test_maps[test_n_maps].pAddr = p;
+    test_maps[test_n_maps].len = len;
+    test_maps[test_n_maps].ofs = ofs;
+    test_maps[test_n_maps].fd = test_reopen(fd);
+    test_maps[test_n_maps].pSynced = malloc(len);
+    if(test_maps[test_n_maps].pSynced == NULL)
+    {
+        _exit(2);
+    }
+    /* what is there now is assumed to be on the disk */
+    memcpy(test_maps[test_n_maps].pSynced, p, len);
+    test_n_maps++;
+    pthread_mutex_unlock(&test_lock);
+    return (p);
+}
+
+/*!
+ * @brief Wrapper, pages not msync()ed stay unsynced file data
+ */
+int munmap(void *addr, size_t len)
+{
+    struct test_file *pF;
+    size_t s;
+    int x;
+
+    pthread_mutex_lock(&test_lock);
+    for(x = 0 ; x < test_n_maps ; x++)
+    {
+        struct test_map *pM = &test_maps[x];
+
+        if(pM->pAddr != addr)
+        {
+            continue;
+        }
+        pF = NULL;
+        for(s = 0 ; s < pM->len ; s += TEST_SECTOR_SIZE)
+        {
+            if(0 == memcmp(pM->pAddr + s, pM->pSynced + s,
+                           TEST_SECTOR_SIZE))
+            {
+                continue;
+            }
+            if(pF == NULL)
+            {
+                pF = test_file_get(pM->fd, true);
+                if(pF == NULL)
+                {
+                    _exit(2);
+                }
+            }
+            test_file_note(pF, pM->ofs + (off_t)s, pM->pSynced + s);
+        }
+        (void)close(pM->fd);
+        free(pM->pSynced);
+        *pM = test_maps[--test_n_maps];
+        break;
+    }
+    pthread_mutex_unlock(&test_lock);
+    return ((int)syscall(SYS_munmap, addr, len));
+}
+
+/*!
+ * @brief INI callback, the [nv] section goes to the NV driver
+ *
+ * Other sections are skipped so the collector.cfg can be used as is.
+ */
+static int test_ini_cb(struct ini_parser *pINI, bool *handled)
+{
+    if(!INI_itemMatches(pINI, "nv", NULL))
+    {
+        *handled = true;
+        return (0);
+    }
+    if(INI_itemMatches(pINI, "nv", "filename"))
+    {
+        test_filename = INI_itemValue_strdup(pINI);
+    }
+    if(INI_itemMatches(pINI, "nv", "kvlog-filename"))
+    {
+        test_kvname = INI_itemValue_strdup(pINI);
+    }
+    return (NV_LINUX_INI_settings(pINI, handled));
+}
+
+/*!
+ * @brief Small deterministic random number generator (xorshift32)
+ */
+static uint32_t test_rand(struct test_model *pM)
+{
+    pM->rng ^= pM->rng << 13;
+    pM->rng ^= pM->rng >> 17;
+    pM->rng ^= pM->rng << 5;
+    return (pM->rng);
+}
+
+/*!
+ * @brief Return the NV ID of a model item
+ */
+static NVINTF_itemID_t test_item_id(int item)
+{
+    NVINTF_itemID_t id;
+
+    id.systemID = NVINTF_SYSID_APP;
+    id.subID = 0;
+    if(item < TEST_ITEM_DEVCNT)
+    {
+        id.itemID = TEST_NV_DEVICELIST_ID;
+        id.subID = (uint16_t)item;
+    }
+    else if(item == TEST_ITEM_DEVCNT)
+    {
+        id.itemID = TEST_NV_DEVICELIST_ENTRIES_ID;
+    }
+    else if(item < TEST_ITEM_BLCNT)
+    {
+        id.itemID = TEST_NV_BLACKLIST_ID;
+        id.subID = (uint16_t)(item - TEST_ITEM_BL(0));
+    }
+    else if(item == TEST_ITEM_BLCNT)
+    {
+        id.itemID = TEST_NV_BLACKLIST_ENTRIES_ID;
+    }
+    else
+    {
+        id.itemID = TEST_NV_FRAMECOUNTER_ID;
+    }
+    return (id);
+}
+
+/*!
+ * @brief Write an item to the model, and NV if bWrite
+ */
+static void test_put(struct test_model *pM, bool bWrite,
+                     int item, const void *pData, int len)
+{
+    pM->len[item] = (uint8_t)len;
+    memcpy(pM->data[item], pData, len);
+    if(bWrite)
+    {
+        uint8_t err;
+
+        err = test_nv.writeItem(test_item_id(item), (uint16_t)len,
+                                pM->data[item]);
+        if(err != NVINTF_SUCCESS)
+        {
+            fprintf(stderr, "ERROR: write of item %d failed (%d)\n",
+                    item, (int)err);
+            exit(1);
+        }
+    }
+}
+
+/*!
+ * @brief Delete an item from the model, and NV if bWrite
+ */
+static void test_del(struct test_model *pM, bool bWrite, int item)
+{
+    pM->len[item] = 0;
+    if(bWrite)
+    {
+        (void)test_nv.deleteItem(test_item_id(item));
+    }
+}
+
+/*!
+ * @brief Pick a random used (or unused) slot
+ * @returns slot number, or -1 if there is none
+ */
+static int test_slot(struct test_model *pM, int first, int n, bool used)
+{
+    int start;
+    int x;
+
+    start = (int)(test_rand(pM) % (uint32_t)n);
+    for(x = 0 ; x < n ; x++)
+    {
+        if((pM->len[first + ((start + x) % n)] != 0) == used)
+        {
+            return ((start + x) % n);
+        }
+    }
+    return (-1);
+}
+
+/*!
+ * @brief Do the next random operation
+ * @param pM - the model
+ * @param bWrite - also apply it to NV, else only the model
+ * @returns kind of operation done, TEST_OP_*
+ */
+static int test_step(struct test_model *pM, bool bWrite)
+{
+    uint8_t buf[TEST_ITEM_LEN];
+    uint32_t fc;
+    uint32_t r;
+    int op;
+    int n;
+    int x;
+
+    r = test_rand(pM) % 100;
+    op = (r < 10) ? TEST_OP_JOIN :
+         (r < 75) ? TEST_OP_DEVFC :
+         (r < 85) ? TEST_OP_FC :
+         (r < 93) ? TEST_OP_LEAVE : TEST_OP_BL;
+
+    /* need a device to update or remove */
+    if(((op == TEST_OP_DEVFC) || (op == TEST_OP_LEAVE)) && (pM->n_dev == 0))
+    {
+        op = TEST_OP_JOIN;
+    }
+    if((op == TEST_OP_JOIN) && (pM->n_dev == TEST_MAX_DEVICES))
+    {
+        op = TEST_OP_LEAVE;
+    }
+
+    if(bWrite && (op != TEST_OP_DEVFC) && (op != TEST_OP_FC))
+    {
+        test_nv.beginTxn();
+    }
+
+    switch(op)
+    {
+    case TEST_OP_JOIN:
+        n = test_slot(pM, TEST_ITEM_DEV(0), TEST_MAX_DEVICES, false);
+        for(x = 0 ; x < TEST_ITEM_LEN ; x++)
+        {
+            buf[x] = (uint8_t)test_rand(pM);
+        }
+        /* rx frame counter starts at zero */
+        memset(buf + TEST_ITEM_LEN - 4, 0, 4);
+        test_put(pM, bWrite, TEST_ITEM_DEV(n), buf, TEST_ITEM_LEN);
+        pM->n_dev++;
+        test_put(pM, bWrite, TEST_ITEM_DEVCNT, &(pM->n_dev), 2);
+        break;
+    case TEST_OP_DEVFC:
+        n = test_slot(pM, TEST_ITEM_DEV(0), TEST_MAX_DEVICES, true);
+        memcpy(buf, pM->data[TEST_ITEM_DEV(n)], TEST_ITEM_LEN);
+        memcpy(&fc, buf + TEST_ITEM_LEN - 4, 4);
+        fc += 100;
+        memcpy(buf + TEST_ITEM_LEN - 4, &fc, 4);
+        test_put(pM, bWrite, TEST_ITEM_DEV(n), buf, TEST_ITEM_LEN);
+        break;
+    case TEST_OP_FC:
+        memcpy(&fc, pM->data[TEST_ITEM_FC], 4);
+        fc = pM->len[TEST_ITEM_FC] ? (fc + 100) : 100;
+        test_put(pM, bWrite, TEST_ITEM_FC, &fc, 4);
+        break;
+    case TEST_OP_LEAVE:
+        n = test_slot(pM, TEST_ITEM_DEV(0), TEST_MAX_DEVICES, true);
+        test_del(pM, bWrite, TEST_ITEM_DEV(n));
+        pM->n_dev--;
+        test_put(pM, bWrite, TEST_ITEM_DEVCNT, &(pM->n_dev), 2);
+        break;
+    default:
+    case TEST_OP_BL:
+        n = (int)(test_rand(pM) % TEST_MAX_BLACKLIST);
+        if(pM->len[TEST_ITEM_BL(n)])
+        {
+            test_del(pM, bWrite, TEST_ITEM_BL(n));
+            pM->n_bl--;
+        }
+        else
+        {
+            for(x = 0 ; x < 12 ; x++)
+            {
+                buf[x] = (uint8_t)test_rand(pM);
+            }
+            test_put(pM, bWrite, TEST_ITEM_BL(n), buf, 12);
+            pM->n_bl++;
+        }
+        test_put(pM, bWrite, TEST_ITEM_BLCNT, &(pM->n_bl), 2);
+        break;
+    }
+
+    if(bWrite && (op != TEST_OP_DEVFC) && (op != TEST_OP_FC))
+    {
+        test_nv.commitTxn();
+    }
+    return (op);
+}
+
+/*!
+ * @brief Start the NV driver
+ * @param cfgname - config file name or NULL
+ * @param fresh - delete the NV file (and journal) first
+ */
+static void test_nv_start(const char *cfgname, bool fresh)
+{
+    char name[256];
+
+    if(cfgname && (INI_read(cfgname, test_ini_cb, 0) != 0))
+    {
+        fprintf(stderr, "ERROR: cannot read %s\n", cfgname);
+        exit(1);
+    }
+    if(fresh)
+    {
+        (void)unlink(test_filename);
+        (void)unlink(test_kvname);
+        snprintf(name, sizeof(name), "%s.journal", test_filename);
+        (void)unlink(name);
+    }
+    linux_CONFIG_NV_RESTORE = true;
+    NV_LINUX_init();
+    NVOCTP_loadApiPtrs(&test_nv);
+    if(test_nv.initNV(NULL) != NVINTF_SUCCESS)
+    {
+        fprintf(stderr, "ERROR: NV init failed\n");
+        exit(1);
+    }
+}
+
+/*!
+ * @brief qsort() helper
+ */
+static int test_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return ((x < y) ? -1 : ((x > y) ? 1 : 0));
+}
+
+/*!
+ * @brief Run the benchmark
+ * @param n_ops - number of operations
+ * @param cfgname - config file name or NULL
+ */
+static void test_bench(int n_ops, const char *cfgname)
+{
+    struct nv_linux_stats st;
+    struct test_model m;
+    uint64_t *pLat[TEST_N_OPS];
+    int n_lat[TEST_N_OPS];
+    uint64_t t0;
+    uint64_t t1;
+    uint64_t t;
+    int op;
+    int x;
+
+    memset(&m, 0, sizeof(m));
+    m.rng = 1;
+    for(op = 0 ; op < TEST_N_OPS ; op++)
+    {
+        pLat[op] = calloc(n_ops, sizeof(uint64_t));
+        n_lat[op] = 0;
+    }
+
+    test_nv_start(cfgname, true);
+    test_n_pwrite = test_b_pwrite = test_n_sync = 0;
+
+    t0 = TIMER_getNowNs();
+    for(x = 0 ; x < n_ops ; x++)
+    {
+        t = TIMER_getNowNs();
+        op = test_step(&m, true);
+        pLat[op][n_lat[op]++] = TIMER_getNowNs() - t;
+    }
+    /* anything still queued counts */
+    NV_LINUX_sync();
+    t1 = TIMER_getNowNs();
+    NV_LINUX_getStats(&st);
+
+    printf("%d operations in %.3f secs, %.0f ops/sec\n",
+           n_ops, (double)(t1 - t0) / 1e9,
+           (double)n_ops * 1e9 / (double)(t1 - t0));
+    printf("%.1f bytes, %.3f writes, %.3f syncs per operation\n",
+           (double)test_b_pwrite / n_ops,
+           (double)test_n_pwrite / n_ops,
+           (double)test_n_sync / n_ops);
+    printf("%llu compactions (%llu by writers, %llu background), "
+           "max %llu usecs\n",
+           (unsigned long long)(st.n_compact_fg + st.n_compact_bg),
+           (unsigned long long)st.n_compact_fg,
+           (unsigned long long)st.n_compact_bg,
+           (unsigned long long)(st.compact_max_nSecs / 1000));
+    printf("%llu waits for the NV lock, max %llu usecs\n",
+           (unsigned long long)st.n_lock_waits,
+           (unsigned long long)(st.lock_wait_max_nSecs / 1000));
+    printf("%-10s %8s %10s %10s %10s %10s (usecs)\n",
+           "", "count", "p50", "p99", "p99.9", "max");
+    for(op = 0 ; op < TEST_N_OPS ; op++)
+    {
+        int n = n_lat[op];
+
+        if(n == 0)
+        {
+            continue;
+        }
+        qsort(pLat[op], n, sizeof(uint64_t), test_cmp_u64);
+        printf("%-10s %8d %10.1f %10.1f %10.1f %10.1f\n",
+               test_op_names[op], n,
+               (double)pLat[op][n / 2] / 1000.0,
+               (double)pLat[op][(n * 99) / 100] / 1000.0,
+               (double)pLat[op][(n * 999) / 1000] / 1000.0,
+               (double)pLat[op][n - 1] / 1000.0);
+        free(pLat[op]);
+    }
+}
+
+/*!
+ * @brief Crash test child: run until power fails
+ */
+static void test_crash_worker(struct test_shared *pS, int round,
+                              int n_ops, const char *cfgname)
+{
+    struct test_model m;
+    int stop;
+    int x;
+
+    memset(&m, 0, sizeof(m));
+    m.rng = (uint32_t)round + 1;
+    srand(round);
+
+    /* power fails at a random write or sync, or after an operation */
+    test_n_fault_pts = 0;
+    test_fault_at = 1 + ((uint64_t)rand() % (uint64_t)(n_ops * 4));
+    stop = 1 + (rand() % n_ops);
+    test_power_model = true;
+
+    test_nv_start(cfgname, true);
+
+    for(x = 0 ; x < stop ; x++)
+    {
+        (void)test_step(&m, true);
+        pS->ops_done = x + 1;
+    }
+    pthread_mutex_lock(&test_lock);
+    test_power_fail();
+}
+
+/*!
+ * @brief Does every item match either model?
+ * @param pHave - what NV has
+ * @param pA - the older model
+ * @param pB - the model one operation later
+ * @param pMixed - set if items come from both
+ */
+static bool test_matches(const struct test_model *pHave,
+                         const struct test_model *pA,
+                         const struct test_model *pB,
+                         bool *pMixed)
+{
+    bool isA;
+    bool isB;
+    bool anyA;
+    bool anyB;
+    int x;
+
+    anyA = anyB = false;
+    for(x = 0 ; x < TEST_N_ITEMS ; x++)
+    {
+        isA = (pHave->len[x] == pA->len[x]) &&
+            (0 == memcmp(pHave->data[x], pA->data[x], pA->len[x]));
+        isB = (pHave->len[x] == pB->len[x]) &&
+            (0 == memcmp(pHave->data[x], pB->data[x], pB->len[x]));
+        if(!isA && !isB)
+        {
+            return (false);
+        }
+        anyA |= (isA && !isB);
+        anyB |= (isB && !isA);
+    }
+    *pMixed = anyA && anyB;
+    return (true);
+}
+
+/*!
+ * @brief Crash test child: recover and check
+ */
+static void test_crash_verify(struct test_shared *pS, int round,
+                              const char *cfgname)
+{
+    struct test_model have;
+    struct test_model a;
+    struct test_model b;
+    NVINTF_itemID_t id;
+    uint32_t len;
+    bool mixed;
+    int x;
+
+    test_nv_start(cfgname, false);
+
+    memset(&have, 0, sizeof(have));
+    for(x = 0 ; x < TEST_N_ITEMS ; x++)
+    {
+        id = test_item_id(x);
+        len = test_nv.getItemLen(id);
+        if(len > TEST_ITEM_LEN)
+        {
+            _exit(1);
+        }
+        if(len && (test_nv.readItem(id, 0, (uint16_t)len, have.data[x]) !=
+                   NVINTF_SUCCESS))
+        {
+            _exit(1);
+        }
+        have.len[x] = (uint8_t)len;
+    }
+
+    /* find the newest prefix of operations NV matches */
+    memset(&a, 0, sizeof(a));
+    a.rng = (uint32_t)round + 1;
+    b = a;
+    (void)test_step(&b, false);
+    pS->ok = 0;
+    for(x = 0 ; x <= pS->ops_done ; x++)
+    {
+        if(test_matches(&have, &a, &b, &mixed))
+        {
+            pS->ok = 1;
+            pS->lost = pS->ops_done - x;
+            pS->mixed = mixed;
+            if(pS->lost == 0)
+            {
+                break;
+            }
+        }
+        a = b;
+        (void)test_step(&b, false);
+    }
+    _exit(pS->ok ? 0 : 1);
+}
+
+/*!
+ * @brief Run a child process
+ * @returns exit status
+ */
+static int test_child(void (*fn)(struct test_shared *, int, const char *),
+                      struct test_shared *pS, int round, const char *cfgname)
+{
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid == 0)
+    {
+        fn(pS, round, cfgname);
+        _exit(0);
+    }
+    if((pid < 0) || (waitpid(pid, &status, 0) != pid) ||
+       !WIFEXITED(status))
+    {
+        return (-1);
+    }
+    return (WEXITSTATUS(status));
+}
+
+/*! crash test worker operation count */
+static int test_crash_ops;
+
+/*!
+ * @brief test_child() adapter for the worker
+ */
+static void test_crash_worker_fn(struct test_shared *pS, int round,
+                                 const char *cfgname)
+{
+    test_crash_worker(pS, round, test_crash_ops, cfgname);
+}
+
+/*!
+ * @brief Run the power loss simulation
+ * @param n_rounds - number of simulated power failures
+ * @param cfgname - config file name or NULL
+ */
+static int test_crash(int n_rounds, const char *cfgname)
+{
+    struct test_shared *pS;
+    int n_fail;
+    int n_mixed;
+    int n_lost;
+    int max_lost;
+    int round;
+
+    pS = mmap(NULL, sizeof(*pS), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(pS == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    test_crash_ops = 500;
+    n_fail = n_mixed = n_lost = max_lost = 0;
+    for(round = 0 ; round < n_rounds ; round++)
+    {
+        memset(pS, 0, sizeof(*pS));
+        if(test_child(test_crash_worker_fn, pS, round, cfgname) != 0)
+        {
+            printf("round %d: worker failed\n", round);
+            n_fail++;
+            continue;
+        }
+        if(test_child(test_crash_verify, pS, round, cfgname) != 0)
+        {
+            printf("round %d: INCONSISTENT after %d operations\n",
+                   round, pS->ops_done);
+            n_fail++;
+            continue;
+        }
+        n_mixed += pS->mixed;
+        n_lost += pS->lost;
+        if(pS->lost > max_lost)
+        {
+            max_lost = pS->lost;
+        }
+    }
+
+    printf("%d rounds: %d inconsistent, %d with a half done operation, "
+           "%d lost completed operations (at most %d in a round)\n",
+           n_rounds, n_fail, n_mixed, n_lost, max_lost);
+    return (n_fail ? 1 : 0);
+}
+
+/*!
+ * @brief the test main program
+ * @param argc - arg count
+ * @param argv - arg vector
+ * @returns zero on success
+ */
+int main(int argc, char **argv)
+{
+    const char *cfgname;
+    int n;
+
+    if((argc < 2) ||
+       ((strcmp(argv[1], "bench") != 0) && (strcmp(argv[1], "crash") != 0)))
+    {
+        fprintf(stderr, "Usage: %s bench [NOPS [CFGFILE]]\n", argv[0]);
+        fprintf(stderr, "       %s crash [NROUNDS [CFGFILE [corrupt]]]\n",
+                argv[0]);
+        exit(1);
+    }
+    n = (argc > 2) ? atoi(argv[2]) : 0;
+    cfgname = (argc > 3) ? argv[3] : NULL;
+    test_fault_corrupt = (argc > 4) && (strcmp(argv[4], "corrupt") == 0);
+
+    STREAM_init();
+    TIMER_init();
+    LOG_init("/dev/stderr");
+
+    if(strcmp(argv[1], "bench") == 0)
+    {
+        test_bench((n > 0) ? n : 100000, cfgname);
+        return (0);
+    }
+    return (test_crash((n > 0) ? n : 100, cfgname));
+}
+
+/*
+ *  ========================================
+ *  Texas Instruments Micro Controller Style
+ *  ========================================
+ *  Local Variables:
+ *  mode: c
+ *  c-file-style: "bsd"
+ *  tab-width: 4
+ *  c-basic-offset: 4
+ *  indent-tabs-mode: nil
+ *  End:
+ *  vim:set  filetype=c tabstop=4 shiftwidth=4 expandtab=true
+ */
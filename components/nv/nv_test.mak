@@ -0,0 +1,83 @@
+#############################################################
+# @file nv_test.mak
+#
+# @brief TIMAC 2.0 NV benchmark and power loss simulation makefile
+#
+# Group: WCS LPC
+# $Target Devices: Linux: AM335x, Embedded Devices: CC1310, CC1350, CC1352$
+#
+#############################################################
+# $License: BSD3 2016 $
+#  
+#   Copyright (c) 2015, Texas Instruments Incorporated
+#   All rights reserved.
+#  
+#   Redistribution and use in source and binary forms, with or without
+#   modification, are permitted provided that the following conditions
+#   are met:
+#  
+#   *  Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+#  
+#   *  Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+#  
+#   *  Neither the name of Texas Instruments Incorporated nor the names of
+#      its contributors may be used to endorse or promote products derived
+#      from this software without specific prior written permission.
+#  
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+#   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+#   THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+#   PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+#   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+#   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+#   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+#   OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+#   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+#   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+#   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#############################################################
+# $Release Name: TI-15.4Stack Linux x64 SDK$
+# $Release Date: Sept 27, 2017 (2.04.00.13)$
+#############################################################
+
+# Built via "make testapps" from the library makefile
+_default: _app
+
+include ../../scripts/front_matter.mak
+
+#include files in common
+CFLAGS += -I../common/inc
+
+APP_NAME=nv_test
+
+C_SOURCES =
+C_SOURCES += nv_test.c
+
+APP_LIBS    += libnv.a
+APP_LIBS    += libcommon.a
+
+APP_LIBDIRS += ${OBJDIR}
+APP_LIBDIRS += ../common/${OBJDIR}
+
+include ../../scripts/app.mak
+
+# Crash test the [nv] settings the collector ships with, the NV files
+# are created in the object directory
+ifeq (${ARCH},host)
+_default: _crash_collector_cfg
+
+_crash_collector_cfg: _app
+	${HIDE}echo "Crash test: collector.cfg"
+	${HIDE}cd ${OBJDIR} && ../../${APPFILE} crash 20 ../../../../example/collector/collector.cfg
+endif
+
+#  ========================================
+#  Texas Instruments Micro Controller Style
+#  ========================================
+#  Local Variables:
+#  mode: makefile-gmake
+#  End:
+#  vim:set  filetype=make
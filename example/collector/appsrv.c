@@ -72,10 +72,13 @@
 #include "mutex.h"
 #include "threads.h"
 #include "timer.h"
+#include "workers.h"
+#include "evloop.h"
 
 #include "stream.h"
 #include "stream_socket.h"
 #include "stream_uart.h"
+#include "stream_shm.h"
 
 /******************************************************************************
  Typedefs
@@ -83,7 +86,7 @@
 
 
 struct appsrv_connection {
-    /*! Is this item busy (broadcasting) */
+    /*! Has the current broadcast been sent to this item */
     bool is_busy;
     /*! If something has gone wrong this is set to true */
     bool is_dead;
@@ -96,13 +99,22 @@ struct appsrv_connection {
     /*! The socket interface to the gateway */
     struct mt_msg_interface socket_interface;
 
-    /*! Thread id for the socket interface */
-    intptr_t thread_id_s2appsrv;
+    /*! Name of the socket interface */
+    char iface_name[30];
+
+    /*! Event loop registration for the socket */
+    intptr_t ev_h;
+
+    /*! Used to cycle the marker lines in the log */
+    int star_line_char;
 
     /*! Next connection in the list */
     struct appsrv_connection *pNext;
 };
 
+static void appsrv_npi_state_cb(struct mt_msg_interface *pMI,
+                                enum mt_msg_iface_state new_state);
+
 /******************************************************************************
  GLOBAL Variables
 *****************************************************************************/
@@ -113,8 +125,17 @@ struct mt_msg_interface *API_MAC_msg_interface;
 struct socket_cfg appClient_socket_cfg;
 /*! Configuration for apimac if using a socket (ie: npi server) */
 struct socket_cfg npi_socket_cfg;
+/*! Configuration for apimac if using shared memory to the npi server */
+struct shm_cfg    npi_shm_cfg = {
+    .name                 = "/npi_server2",
+    .cs                   = 'c',
+    .ring_size            = 0,
+    .attach_timeout_mSecs = 5000
+};
 /*! UART configuration for apimac if talking to UART instead of npi */
 struct uart_cfg   uart_cfg;
+/*! Number of worker threads that handle gateway requests */
+int appsrv_n_workers = APPSRV_N_WORKERS_DEFAULT;
 
 /*! Generic template for all gateway interfaces
   Note: These parameters can be modified via the ini file
@@ -188,6 +209,7 @@ struct mt_msg_interface npi_mt_interface = {
     .len_2bytes                = true,
     .rx_handler_cookie         = 0,
     .is_dead                   = false,
+    .state_cb                  = appsrv_npi_state_cb,
     .flush_timeout_mSecs       = 100
 };
 
@@ -197,7 +219,14 @@ struct mt_msg_interface npi_mt_interface = {
 
 static intptr_t all_connections_mutex;
 static struct appsrv_connection *all_connections;
-static intptr_t all_connections_mutex;
+
+/*! Held for the duration of a broadcast, see appsrv_connection_remove() */
+static intptr_t broadcast_mutex;
+
+/*! Worker threads that handle requests from all gateway connections */
+static intptr_t appsrv_workers;
+/*! Watches all gateway connections, feeds the workers */
+static intptr_t appsrv_evloop;
 
 /*******************************************************************
  * LOCAL FUNCTIONS
@@ -217,6 +246,29 @@ static void unlock_connection_list(void)
     MUTEX_unLock(all_connections_mutex);
 }
 
+/*!
+ * @brief Called when the npi server connection goes down or comes back
+ * @param pMI - the npi interface
+ * @param new_state - the new state
+ */
+static void appsrv_npi_state_cb(struct mt_msg_interface *pMI,
+                                enum mt_msg_iface_state new_state)
+{
+    switch(new_state)
+    {
+    case MT_MSG_IFACE_STATE_down:
+        LOG_printf(LOG_ERROR, "%s: npi server connection lost\n",
+                   pMI->dbg_name);
+        break;
+    case MT_MSG_IFACE_STATE_connecting:
+        break;
+    case MT_MSG_IFACE_STATE_up:
+        LOG_printf(LOG_ALWAYS, "%s: npi server connection restored\n",
+                   pMI->dbg_name);
+        break;
+    }
+}
+
 /*!
  * @brief send a data confirm to the gateway
  * @param status - the status value to send
@@ -549,6 +601,9 @@ void appsrv_broadcast(struct mt_msg *pMsg)
     struct appsrv_connection *pCONN;
     struct mt_msg *pClone;
 
+    /* one broadcast at a time, connections are not freed during it */
+    MUTEX_lock(broadcast_mutex, -1);
+
     /* mark all connections as "ready to broadcast" */
     lock_connection_list();
 
@@ -616,6 +671,8 @@ next_connection:
         pCONN->is_busy = false;
     }
     unlock_connection_list();
+
+    MUTEX_unLock(broadcast_mutex);
 }
 
 /*!
@@ -1212,96 +1269,14 @@ static void appsrv_handle_appClient_request( struct appsrv_connection *pCONN,
 }
 
 /*
- * @brief specific connection thread
- * @param cookie - opaque parameter that is the connection details.
- *
- * The server thread creates these as needed
+ * @brief Remove a dead connection and release it
+ * @param pCONN - the connection
  *
- * This thread lives until the connection dies.
+ * Called from the ready callback, after the event loop has been
+ * told to forget the socket.
  */
-static intptr_t s2appsrv_thread(intptr_t cookie)
+static void appsrv_connection_remove(struct appsrv_connection *pCONN)
 {
-    struct appsrv_connection *pCONN;
-    struct mt_msg *pMsg;
-    int r;
-    char iface_name[30];
-    char star_line[30];
-    int star_line_char;
-
-    pCONN = (struct appsrv_connection *)(cookie);
-    if( pCONN == NULL )
-    {
-        BUG_HERE("pCONN is null?\n");
-    }
-
-    /* create our upstream interface */
-    (void)snprintf(iface_name,
-                   sizeof(iface_name),
-                   "s2u-%d-iface",
-                   pCONN->connection_id);
-    pCONN->socket_interface.dbg_name = iface_name;
-
-    /* Create our interface */
-    r = MT_MSG_interfaceCreate(&(pCONN->socket_interface));
-    if(r != 0)
-    {
-        BUG_HERE("Cannot create socket interface?\n");
-    }
-
-    /* Add this connection to the list. */
-    lock_connection_list();
-    pCONN->pNext = all_connections;
-    pCONN->is_busy = false;
-    all_connections = pCONN;
-    unlock_connection_list();
-
-    star_line_char = 0;
-    /* Wait for messages to come in from the socket.. */
-    for(;;)
-    {
-        /* Did the other guy die? */
-        if(pCONN->is_dead)
-        {
-            break;
-        }
-
-        /* did the socket die? */
-        if(pCONN->socket_interface.is_dead)
-        {
-            pCONN->is_dead = true;
-            continue;
-        }
-
-        /* get our message */
-        pMsg = MT_MSG_LIST_remove(&(pCONN->socket_interface),
-                                  &(pCONN->socket_interface.rx_list), 1000);
-        if(pMsg == NULL)
-        {
-            /* must have timed out. */
-            continue;
-        }
-
-        pMsg->pLogPrefix = "web-request";
-
-        /* Print a *MARKER* line in the log to help trace this message */
-        star_line_char++;
-        /* Cycle through the letters AAAA, BBBB, CCCC .... */
-        star_line_char = star_line_char % 26;
-        memset((void *)(star_line),
-               star_line_char + 'A',
-               sizeof(star_line) - 1);
-        star_line[sizeof(star_line) - 1] = 0;
-        LOG_printf(LOG_DBG_MT_MSG_traffic, "START MSG: %s\n", star_line);
-
-        /* Actually process the request */
-        appsrv_handle_appClient_request(pCONN, pMsg);
-
-        /* Same *MARKER* line at the end of the message */
-        LOG_printf(LOG_DBG_MT_MSG_traffic, "END MSG: %s\n", star_line);
-        MT_MSG_free(pMsg);
-        pMsg = NULL;
-    }
-
     /* There is an interock here.
      * FIRST: We set "is_dead"
      *   The broadcast code will skip this item.
@@ -1309,14 +1284,11 @@ static intptr_t s2appsrv_thread(intptr_t cookie)
      * HOWEVER
      *   Q: What happens if we die in the middle of broadcasting?
      *   A: We must wait until the broad cast is complete
-     *      We know this by checking the bcast_state.
+     *      The broadcaster holds the broadcast mutex until then.
      */
-    while(pCONN->is_busy)
-    {
-        /* we must wait ... a broadcast is active. */
-        /* so sleep alittle and try again */
-        TIMER_sleep(10);
-    }
+    pCONN->is_dead = true;
+    MUTEX_lock(broadcast_mutex, -1);
+    MUTEX_unLock(broadcast_mutex);
 
     /* we can now remove this DEAD connection from the list. */
     lock_connection_list();
@@ -1345,6 +1317,9 @@ static intptr_t s2appsrv_thread(intptr_t cookie)
         }
     }
     unlock_connection_list();
+
+    LOG_printf(LOG_APPSRV_CONNECTIONS, "%s: closed\n", pCONN->dbg_name);
+
     /* socket is dead */
     /* we need to destroy the interface */
     MT_MSG_interfaceDestroy(&(pCONN->socket_interface));
@@ -1353,18 +1328,126 @@ static intptr_t s2appsrv_thread(intptr_t cookie)
     SOCKET_ACCEPT_destroy(pCONN->socket_interface.hndl);
 
     /* we can free this now */
+    if(pCONN->dbg_name)
+    {
+        free((void *)(pCONN->dbg_name));
+    }
     free((void *)pCONN);
+}
 
-    /* we do not destroy free the connection */
-    /* this is done in the uart thread */
-    return 0;
+/*
+ * @brief A connection is readable, called on a worker thread
+ * @param ev_h - the event loop registration
+ * @param cookie - opaque parameter that is the connection details.
+ *
+ * The event loop does not watch this connection again until we
+ * return, so requests from one connection are handled in order.
+ */
+static void appsrv_connection_ready(intptr_t ev_h, intptr_t cookie)
+{
+    struct appsrv_connection *pCONN;
+    struct mt_msg *pMsg;
+    char star_line[30];
+    int r;
+
+    pCONN = (struct appsrv_connection *)(cookie);
+
+    /* read what has arrived, requests go on the rx_list */
+    r = MT_MSG_rxReady(&(pCONN->socket_interface));
+
+    for(;;)
+    {
+        pMsg = MT_MSG_LIST_remove(&(pCONN->socket_interface),
+                                  &(pCONN->socket_interface.rx_list), 0);
+        if(pMsg == NULL)
+        {
+            break;
+        }
+
+        pMsg->pLogPrefix = "web-request";
+
+        /* Print a *MARKER* line in the log to help trace this message */
+        pCONN->star_line_char++;
+        /* Cycle through the letters AAAA, BBBB, CCCC .... */
+        pCONN->star_line_char = pCONN->star_line_char % 26;
+        memset((void *)(star_line),
+               pCONN->star_line_char + 'A',
+               sizeof(star_line) - 1);
+        star_line[sizeof(star_line) - 1] = 0;
+        LOG_printf(LOG_DBG_MT_MSG_traffic, "START MSG: %s\n", star_line);
+
+        /* Actually process the request */
+        appsrv_handle_appClient_request(pCONN, pMsg);
+
+        /* Same *MARKER* line at the end of the message */
+        LOG_printf(LOG_DBG_MT_MSG_traffic, "END MSG: %s\n", star_line);
+        MT_MSG_free(pMsg);
+        pMsg = NULL;
+    }
+
+    /* did the socket die? */
+    if((r < 0) || pCONN->socket_interface.is_dead)
+    {
+        pCONN->is_dead = true;
+    }
+
+    if(pCONN->is_dead)
+    {
+        /* forget the socket before it is closed */
+        EVLOOP_remove(ev_h);
+        appsrv_connection_remove(pCONN);
+    }
+}
+
+/*
+ * @brief Setup a newly accepted connection
+ * @param pCONN - the connection details.
+ *
+ * No thread is created, the connection is added to the event
+ * loop and requests are handled by the worker pool.
+ */
+static void appsrv_connection_start(struct appsrv_connection *pCONN)
+{
+    int r;
+
+    /* create our upstream interface */
+    (void)snprintf(pCONN->iface_name,
+                   sizeof(pCONN->iface_name),
+                   "s2u-%d-iface",
+                   pCONN->connection_id);
+    pCONN->socket_interface.dbg_name = pCONN->iface_name;
+    pCONN->socket_interface.no_rx_thread = true;
+
+    /* Create our interface */
+    r = MT_MSG_interfaceCreate(&(pCONN->socket_interface));
+    if(r != 0)
+    {
+        BUG_HERE("Cannot create socket interface?\n");
+    }
+
+    /* Add this connection to the list. */
+    lock_connection_list();
+    pCONN->pNext = all_connections;
+    pCONN->is_busy = false;
+    all_connections = pCONN;
+    unlock_connection_list();
+
+    pCONN->ev_h = EVLOOP_add(appsrv_evloop,
+                             STREAM_SOCKET_getFd(pCONN->socket_interface.hndl),
+                             appsrv_connection_ready,
+                             (intptr_t)(pCONN));
+    if(pCONN->ev_h == 0)
+    {
+        BUG_HERE("Cannot watch connection?\n");
+    }
+    LOG_printf(LOG_APPSRV_CONNECTIONS, "%s: accepted\n", pCONN->dbg_name);
 }
 
 /*
  * @brief This thread handles all connections from the nodeJS/gateway client.
  *
- * This server thread spawns off threads that handle
- * each connection from each gateway app.
+ * This server thread accepts connections from gateway apps and adds
+ * them to the event loop, requests are handled by the worker pool.
  */
 
 static intptr_t appsrv_server_thread(intptr_t _notused)
@@ -1438,25 +1521,7 @@ static intptr_t appsrv_server_thread(intptr_t _notused)
         /* we have a connection */
         pCONN->is_dead = false;
 
-        /* create our connection threads */
-
-        /* set name final use */
-        (void)snprintf(buf, sizeof(buf),
-                       "connection-%d",
-                       pCONN->connection_id);
-        pCONN->dbg_name = strdup(buf);
-        if(pCONN->dbg_name == NULL)
-        {
-            BUG_HERE("no memory\n");
-        }
-
-        (void)snprintf(buf, sizeof(buf),
-                       "thread-u2s-%d",
-                       pCONN->connection_id);
-        pCONN->thread_id_s2appsrv = THREAD_create(buf,
-                                                  s2appsrv_thread,
-                                                  (intptr_t)(pCONN),
-                                                  THREAD_FLAGS_DEFAULT);
+        appsrv_connection_start(pCONN);
 
         pCONN = NULL;
 
@@ -1505,6 +1570,23 @@ void APP_main(void)
         BUG_HERE("cannot create connection list mutex\n");
     }
 
+    broadcast_mutex = MUTEX_create("appsrv-broadcast");
+    if(broadcast_mutex == 0)
+    {
+        BUG_HERE("cannot create broadcast mutex\n");
+    }
+
+    appsrv_workers = WORKERS_create("appsrv-worker", appsrv_n_workers);
+    if(appsrv_workers == 0)
+    {
+        BUG_HERE("cannot create appsrv workers\n");
+    }
+    appsrv_evloop = EVLOOP_create("appsrv-evloop", appsrv_workers);
+    if(appsrv_evloop == 0)
+    {
+        BUG_HERE("cannot create appsrv event loop\n");
+    }
+
     Collector_init();
     r = MT_DEVICE_version_info.transport |
         MT_DEVICE_version_info.product |
@@ -1541,30 +1623,15 @@ void APP_main(void)
 
     collector_thread_id = THREAD_create("collector-thread",
                                         collector_thread, 0, THREAD_FLAGS_DEFAULT);
-
-
-    for(;;)
+    if((server_thread_id == 0) || (collector_thread_id == 0))
     {
-        /* every 10 seconds.. */
-        /* 10 seconds is an arbitrary value */
-        TIMER_sleep(10 * 1000);
-        r = 0;
+        BUG_HERE("cannot create application threads\n");
+    }
 
-        if(THREAD_isAlive(collector_thread_id))
-        {
-            r += 1;
-        }
 
-        if(THREAD_isAlive(server_thread_id))
-        {
-            r += 1;
-        }
-        /* we stay here while both *2* threads are alive */
-        if(r != 2)
-        {
-            break;
-        }
-    }
+    /* we stay here while both *2* threads are alive,
+     * the collector thread never exits, so wait for the server */
+    THREAD_join(server_thread_id, -1);
 
     /* wait at most (N) seconds then we just 'die' */
     r = 0;
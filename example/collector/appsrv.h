@@ -76,10 +76,20 @@ extern struct socket_cfg       appClient_socket_cfg;
  */
 extern struct mt_msg_interface npi_mt_interface;
 extern struct socket_cfg       npi_socket_cfg;
+extern struct shm_cfg          npi_shm_cfg;
 
 extern struct mt_msg_interface uart_mt_interface;
 extern struct uart_cfg         uart_cfg;
 
+/*! Default number of threads that handle gateway requests */
+#define APPSRV_N_WORKERS_DEFAULT 4
+
+/*!
+ * Number of threads that handle gateway requests, this does not
+ * grow with the number of gateway connections.
+ */
+extern int appsrv_n_workers;
+
 /******************************************************************************
  Function Prototypes
  *****************************************************************************/
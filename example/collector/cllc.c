@@ -124,6 +124,11 @@
 /*! percent filter */
 #define CONFIG_PERCENTFILTER              0xFF
 
+/*! Association table hash chain end marker */
+#define CLLC_ASSOC_NONE                   0xFFFF
+/*! Number of association status bits with a bitset */
+#define CLLC_ASSOC_STATUS_BITS            16
+
 /******************************************************************************
  Security constants and definitions
  *****************************************************************************/
@@ -164,7 +169,7 @@ typedef struct
 /* Task pending events */
 uint16_t Cllc_events = 0;
 /* Association table */
-Cllc_associated_devices_t Cllc_associatedDevList[CONFIG_MAX_DEVICES];
+Cllc_associated_devices_t *Cllc_associatedDevList = NULL;
 Cllc_statistics_t Cllc_statistics;
 
 /**
@@ -191,7 +196,18 @@ STATIC uint8_t chanMask[APIMAC_154G_CHANNEL_BITMAP_SIZ];
 /* Linked list to store incoming PAN descriptors */
 STATIC panDescList_t *pPANDesclist = NULL;
 /* number of devices associated with the coordinator */
-STATIC uint8_t Cllc_numOfDevices = 0;
+STATIC uint16_t Cllc_numOfDevices = 0;
+/* number of entries allocated in the association table */
+STATIC uint16_t assocSize = 0;
+/* number of 32 bit words in each association table bitset */
+STATIC uint16_t assocWords = 0;
+/* association table hash chains by short address */
+STATIC uint16_t *assocShortHead = NULL;
+STATIC uint16_t *assocShortNext = NULL;
+/* association table entries in use, one bit per entry */
+STATIC uint32_t *assocInUse = NULL;
+/* association table entries with each status bit set */
+STATIC uint32_t *assocStatusSet[CLLC_ASSOC_STATUS_BITS];
 /* copy of MAC API callbacks */
 STATIC ApiMac_callbacks_t macCallbacksCopy = { 0 };
 /* copy of CLLC callbacks */
@@ -306,7 +322,13 @@ static bool findInList(ApiMac_panDesc_t *pData);
 static uint8_t findBestChannel(uint8_t *pResults);
 static uint16_t findChannel(uint16_t panID,uint8_t channel);
 
-static Cllc_associated_devices_t *findDevice(uint16_t shortAddr);
+static void assocAlloc(void);
+static void assocReset(void);
+static void assocInsert(uint16_t idx);
+static void assocRemove(uint16_t idx);
+static int assocScan(uint16_t from, uint16_t to, uint16_t mask,
+                     uint16_t value, uint16_t any);
+static int assocFindFree(void);
 static void updateState(Cllc_states_t state);
 static void sendAsyncReq(uint8_t frameType);
 static void joinPermitExpired(void);
@@ -370,8 +392,11 @@ void Cllc_init(ApiMac_callbacks_t *pMacCbs, Cllc_callbacks_t *pCllcCbs)
     }
 
     /* initialize association table */
-    memset(Cllc_associatedDevList, 0xFF,
-           (sizeof(Cllc_associated_devices_t) * CONFIG_MAX_DEVICES));
+    if(Cllc_associatedDevList == NULL)
+    {
+        assocAlloc();
+    }
+    assocReset();
 
     ApiMac_mlmeSetReqBool(ApiMac_attribute_RxOnWhenIdle,true);
 
@@ -525,10 +550,10 @@ void Cllc_startNetwork(void)
 
  Public function defined in cllc.h
  */
-void Cllc_restoreNetwork(Llc_netInfo_t *pNetworkInfo, uint8_t numDevices,
+void Cllc_restoreNetwork(Llc_netInfo_t *pNetworkInfo, uint16_t numDevices,
 		Llc_deviceListItem_t *pDevList)
 {
-    uint8_t i = 0;
+    uint16_t i = 0;
 
     /* set state */
     updateState(Cllc_states_initRestoringCoordinator);
@@ -619,27 +644,103 @@ ApiMac_status_t Cllc_setJoinPermit(uint32_t duration)
  */
 void Cllc_removeDevice(ApiMac_sAddrExt_t *pExtAddr)
 {
-    int8_t i = 0;
     uint16_t shortAddr = Csf_getDeviceShort(pExtAddr);
 
     if(shortAddr != CSF_INVALID_SHORT_ADDR)
     {
-        for(i = 0; i < CONFIG_MAX_DEVICES; i++)
+        Cllc_associated_devices_t *pItem = Cllc_findDevice(shortAddr);
+
+        if(pItem != NULL)
         {
-            if(Cllc_associatedDevList[i].shortAddr == shortAddr)
+            /* Clear the entry - delete */
+            assocRemove((uint16_t)(pItem - Cllc_associatedDevList));
+            /* remove from NV */
+            Csf_removeDeviceListItem(pExtAddr);
+        }
+    }
+}
+
+/*!
+ Find a device in the association table
+
+ Public function defined in cllc.h
+ */
+Cllc_associated_devices_t *Cllc_findDevice(uint16_t shortAddr)
+{
+    uint16_t idx = CLLC_ASSOC_NONE;
+
+    if((assocSize > 0) && (shortAddr != CSF_INVALID_SHORT_ADDR))
+    {
+        idx = assocShortHead[shortAddr % assocSize];
+        while((idx != CLLC_ASSOC_NONE)
+              && (Cllc_associatedDevList[idx].shortAddr != shortAddr))
+        {
+            idx = assocShortNext[idx];
+        }
+    }
+
+    return ((idx != CLLC_ASSOC_NONE) ? &Cllc_associatedDevList[idx] : NULL);
+}
+
+/*!
+ Change the status bits of an association table entry
+
+ Public function defined in cllc.h
+ */
+void Cllc_updateDeviceStatus(Cllc_associated_devices_t *pDev,
+                             uint16_t clearBits, uint16_t setBits)
+{
+    uint16_t idx = (uint16_t)(pDev - Cllc_associatedDevList);
+    uint16_t status = (uint16_t)((pDev->status & ~clearBits) | setBits);
+    uint16_t changed = (uint16_t)(status ^ pDev->status);
+    uint32_t bit = (uint32_t)1 << (idx % 32);
+    int b;
+
+    pDev->status = status;
+
+    /* Only entries in use are in the bitsets */
+    if(assocInUse[idx / 32] & bit)
+    {
+        for(b = 0; changed != 0; b++, changed >>= 1)
+        {
+            if(changed & 1)
             {
-                /* Clear the entry - delete */
-                memset(&Cllc_associatedDevList[i], 0xFF,
-                       sizeof(Cllc_associated_devices_t));
-                /* remove from NV */
-                Csf_removeDeviceListItem(pExtAddr);
-                /* The corresponding device is removed, return from the function call */
-                return;
+                assocStatusSet[b][idx / 32] ^= bit;
             }
         }
     }
 }
 
+/*!
+ Find the next device in the association table by status
+
+ Public function defined in cllc.h
+ */
+Cllc_associated_devices_t *Cllc_findDeviceStatus(uint16_t mask,
+                                                 uint16_t value,
+                                                 uint16_t any,
+                                             Cllc_associated_devices_t *pAfter)
+{
+    int idx;
+
+    if(pAfter == NULL)
+    {
+        idx = assocScan(0, assocSize, mask, value, any);
+    }
+    else
+    {
+        uint16_t after = (uint16_t)(pAfter - Cllc_associatedDevList);
+
+        idx = assocScan(after + 1, assocSize, mask, value, any);
+        if(idx < 0)
+        {
+            idx = assocScan(0, after, mask, value, any);
+        }
+    }
+
+    return ((idx >= 0) ? &Cllc_associatedDevList[idx] : NULL);
+}
+
 /*!
  Send disassociation request.
 
@@ -1234,26 +1335,29 @@ static void maintainAssocTable(ApiMac_deviceDescriptor_t *pDevInfo,
 {
     if(mode == false)
     {
-        Cllc_associated_devices_t *pItem;
+        int idx;
         /* table is not filled yet */
-        if(Cllc_numOfDevices < CONFIG_MAX_DEVICES)
+        if(Cllc_numOfDevices < assocSize)
         {
-            pItem = &Cllc_associatedDevList[Cllc_numOfDevices];
+            idx = Cllc_numOfDevices;
             Cllc_numOfDevices++;
         }
         else
         {
             /* look for an empty slot */
-            pItem = findDevice(CSF_INVALID_SHORT_ADDR);
+            idx = assocFindFree();
         }
 
-        if(pItem != NULL)
+        if(idx >= 0)
         {
+            Cllc_associated_devices_t *pItem = &Cllc_associatedDevList[idx];
+
             /* insert one of the blank spaces in the table */
             pItem->shortAddr = pDevInfo->shortAddress;
             memcpy(&pItem->capInfo, pCapInfo, sizeof(ApiMac_capabilityInfo_t));
             pItem->rssi = rssi;
             pItem->status = status;
+            assocInsert((uint16_t)idx);
         }
     }
     else if(mode == true)
@@ -1261,13 +1365,13 @@ static void maintainAssocTable(ApiMac_deviceDescriptor_t *pDevInfo,
         uint16_t shortAddr = Csf_getDeviceShort(&pDevInfo->extAddress);
         if(shortAddr != CSF_INVALID_SHORT_ADDR)
         {
-            static Cllc_associated_devices_t *pItem;
+            Cllc_associated_devices_t *pItem;
 
-            pItem = findDevice(shortAddr);
+            pItem = Cllc_findDevice(shortAddr);
             if(pItem != NULL)
             {
                 pItem->rssi = rssi;
-                pItem->status = status;
+                Cllc_updateDeviceStatus(pItem, 0xFFFF, status);
             }
         }
     }
@@ -1387,27 +1491,224 @@ static void dataIndCb(ApiMac_mcpsDataInd_t *pData)
 }
 
 /*!
- * @brief      Find the associated device table entry matching an
- *             extended address.
+ * @brief       Allocate the association table and its indexes
  *
- * @param      shortAddr - device's short address
+ * The size is CONFIG_MAX_DEVICES, from the configuration file. If the
+ * memory is not available the table is left empty, so no device can
+ * join.
+ */
+static void assocAlloc(void)
+{
+    uint16_t maxDevices = (uint16_t)CONFIG_MAX_DEVICES;
+    bool ok;
+    int b;
+
+    /* Csf_malloc() sizes are 16 bits */
+    if((sizeof(Cllc_associated_devices_t) * maxDevices) > 0xFFFF)
+    {
+        assocSize = 0;
+        return;
+    }
+
+    assocWords = (uint16_t)((maxDevices + 31) / 32);
+
+    Cllc_associatedDevList = Csf_malloc((uint16_t)
+                              (sizeof(Cllc_associated_devices_t) * maxDevices));
+    assocShortHead = Csf_malloc((uint16_t)(sizeof(uint16_t) * maxDevices));
+    assocShortNext = Csf_malloc((uint16_t)(sizeof(uint16_t) * maxDevices));
+    assocInUse = Csf_malloc((uint16_t)(sizeof(uint32_t) * assocWords));
+    ok = ((Cllc_associatedDevList != NULL) && (assocShortHead != NULL)
+          && (assocShortNext != NULL) && (assocInUse != NULL));
+
+    for(b = 0; b < CLLC_ASSOC_STATUS_BITS; b++)
+    {
+        assocStatusSet[b] = Csf_malloc((uint16_t)
+                                       (sizeof(uint32_t) * assocWords));
+        ok = ok && (assocStatusSet[b] != NULL);
+    }
+
+    assocSize = ok ? maxDevices : 0;
+}
+
+/*!
+ * @brief       Empty the association table
+ */
+static void assocReset(void)
+{
+    int b;
+
+    if(assocSize > 0)
+    {
+        memset(Cllc_associatedDevList, 0xFF,
+               (sizeof(Cllc_associated_devices_t) * assocSize));
+        memset(assocShortHead, 0xFF, (sizeof(uint16_t) * assocSize));
+        memset(assocInUse, 0, (sizeof(uint32_t) * assocWords));
+        for(b = 0; b < CLLC_ASSOC_STATUS_BITS; b++)
+        {
+            memset(assocStatusSet[b], 0, (sizeof(uint32_t) * assocWords));
+        }
+    }
+    Cllc_numOfDevices = 0;
+}
+
+/*!
+ * @brief       Add a filled in association table entry to the indexes
+ *
+ * @param       idx - association table index
+ */
+static void assocInsert(uint16_t idx)
+{
+    Cllc_associated_devices_t *pItem = &Cllc_associatedDevList[idx];
+    uint16_t status = pItem->status;
+    uint16_t head = (uint16_t)(pItem->shortAddr % assocSize);
+    uint32_t bit = (uint32_t)1 << (idx % 32);
+    int b;
+
+    assocShortNext[idx] = assocShortHead[head];
+    assocShortHead[head] = idx;
+
+    assocInUse[idx / 32] |= bit;
+    for(b = 0; status != 0; b++, status >>= 1)
+    {
+        if(status & 1)
+        {
+            assocStatusSet[b][idx / 32] |= bit;
+        }
+    }
+}
+
+/*!
+ * @brief       Remove an association table entry and clear it
+ *
+ * @param       idx - association table index
+ */
+static void assocRemove(uint16_t idx)
+{
+    Cllc_associated_devices_t *pItem = &Cllc_associatedDevList[idx];
+    uint16_t *pLink = &assocShortHead[pItem->shortAddr % assocSize];
+    uint32_t bit = (uint32_t)1 << (idx % 32);
+    int b;
+
+    while(*pLink != idx)
+    {
+        pLink = &assocShortNext[*pLink];
+    }
+    *pLink = assocShortNext[idx];
+
+    assocInUse[idx / 32] &= ~bit;
+    for(b = 0; b < CLLC_ASSOC_STATUS_BITS; b++)
+    {
+        assocStatusSet[b][idx / 32] &= ~bit;
+    }
+
+    memset(pItem, 0xFF, sizeof(Cllc_associated_devices_t));
+}
+
+/*!
+ * @brief       Find the first association table entry in a range by status
+ *
+ * @param       from - first index to check
+ * @param       to - index after the last one to check
+ * @param       mask - status bits to compare
+ * @param       value - required value of the mask bits
+ * @param       any - if not zero, at least one of these bits must be set
+ *
+ * @return      index of the entry, -1 if none
+ *
+ * Works on 32 entries at a time, combining the status bitsets.
+ */
+static int assocScan(uint16_t from, uint16_t to, uint16_t mask,
+                     uint16_t value, uint16_t any)
+{
+    uint16_t w;
+
+    if(from >= to)
+    {
+        return (-1);
+    }
+
+    for(w = (uint16_t)(from / 32); w <= (uint16_t)((to - 1) / 32); w++)
+    {
+        uint32_t m = assocInUse[w];
+        int b;
+
+        for(b = 0; (b < CLLC_ASSOC_STATUS_BITS) && (m != 0); b++)
+        {
+            uint16_t sb = (uint16_t)(1 << b);
+
+            if(mask & sb)
+            {
+                m &= (value & sb) ? assocStatusSet[b][w] : ~assocStatusSet[b][w];
+            }
+        }
+
+        if((any != 0) && (m != 0))
+        {
+            uint32_t a = 0;
+
+            for(b = 0; b < CLLC_ASSOC_STATUS_BITS; b++)
+            {
+                if(any & (1 << b))
+                {
+                    a |= assocStatusSet[b][w];
+                }
+            }
+            m &= a;
+        }
+
+        /* Only the part of the word inside the range */
+        if(w == (from / 32))
+        {
+            m &= ~(uint32_t)0 << (from % 32);
+        }
+        if((w == ((to - 1) / 32)) && ((to % 32) != 0))
+        {
+            m &= ~(~(uint32_t)0 << (to % 32));
+        }
+
+        if(m != 0)
+        {
+            int idx = w * 32;
+
+            while((m & 1) == 0)
+            {
+                m >>= 1;
+                idx++;
+            }
+            return (idx);
+        }
+    }
+
+    return (-1);
+}
+
+/*!
+ * @brief       Find an association table entry that is not in use
  *
- * @return     pointer to the associated device table entry,
- *             NULL if not found.
+ * @return      index of the entry, -1 if the table is full
  */
-static Cllc_associated_devices_t *findDevice(uint16_t shortAddr)
+static int assocFindFree(void)
 {
-    int x;
+    uint16_t w;
 
-    for(x = 0; (x < CONFIG_MAX_DEVICES); x++)
+    for(w = 0; w < assocWords; w++)
     {
-        /* Make sure the entry is valid. */
-        if(shortAddr == Cllc_associatedDevList[x].shortAddr)
+        uint32_t m = ~assocInUse[w];
+
+        if(m != 0)
         {
-            return (&Cllc_associatedDevList[x]);
+            int idx = w * 32;
+
+            while((m & 1) == 0)
+            {
+                m >>= 1;
+                idx++;
+            }
+            return ((idx < assocSize) ? idx : -1);
         }
     }
-    return (NULL);
+
+    return (-1);
 }
 
 /*!
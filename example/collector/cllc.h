@@ -144,8 +144,11 @@ typedef struct
     uint32_t otherStats;
 } Cllc_statistics_t;
 
-/*! Association table */
-extern Cllc_associated_devices_t Cllc_associatedDevList[CONFIG_MAX_DEVICES];
+/*!
+ Association table, CONFIG_MAX_DEVICES entries allocated by Cllc_init().
+ Change an entry's status only with Cllc_updateDeviceStatus().
+ */
+extern Cllc_associated_devices_t *Cllc_associatedDevList;
 /*! Cllc statistics */
 extern Cllc_statistics_t Cllc_statistics;
 
@@ -246,7 +249,7 @@ extern void Cllc_startNetwork(void);
  * @param       numDevices - number of devices in association table
  * @param       pDevList - list of devices
  */
-extern void Cllc_restoreNetwork(Llc_netInfo_t *pNetworkInfo, uint8_t numDevices,
+extern void Cllc_restoreNetwork(Llc_netInfo_t *pNetworkInfo, uint16_t numDevices,
 		Llc_deviceListItem_t *pDevList);
 /*!
  * @brief       Remove device from the network.
@@ -260,6 +263,45 @@ extern void Cllc_restoreNetwork(Llc_netInfo_t *pNetworkInfo, uint8_t numDevices,
  */
 extern void Cllc_removeDevice(ApiMac_sAddrExt_t *pExtAddr);
 
+/*!
+ * @brief       Find a device in the association table
+ *
+ * @param       shortAddr - short address of the device
+ *
+ * @return      pointer to the association table entry, NULL if not found
+ */
+extern Cllc_associated_devices_t *Cllc_findDevice(uint16_t shortAddr);
+
+/*!
+ * @brief       Change the status bits of an association table entry
+ *
+ * @param       pDev - association table entry
+ * @param       clearBits - status bits to clear
+ * @param       setBits - status bits to set, after clearing
+ */
+extern void Cllc_updateDeviceStatus(Cllc_associated_devices_t *pDev,
+                                    uint16_t clearBits, uint16_t setBits);
+
+/*!
+ * @brief       Find the next device in the association table by status
+ *              <BR>
+ *              Matches an entry when (status & mask) == value and, if any
+ *              is not zero, at least one of the any bits is set. The cost
+ *              grows with the table size / 32, not with the table size.
+ *
+ * @param       mask - status bits to compare
+ * @param       value - required value of the mask bits
+ * @param       any - if not zero, at least one of these bits must be set
+ * @param       pAfter - start after this entry and wrap around, stopping
+ *                       before it. NULL to search from the first entry.
+ *
+ * @return      pointer to the association table entry, NULL if none
+ */
+extern Cllc_associated_devices_t *Cllc_findDeviceStatus(uint16_t mask,
+                                                        uint16_t value,
+                                                        uint16_t any,
+                                            Cllc_associated_devices_t *pAfter);
+
 /*!
  * @brief       Set Join Permit PIB value.
  *              <BR>
@@ -59,6 +59,7 @@
 #include "collector.h"
 
 #include "log.h"
+#include "timer.h"
 
 #include "oad_protocol.h"
 #include "oad_storage.h"
@@ -99,6 +100,10 @@
 /* Tracking timeouts */
 #define TRACKING_CNF_DELAY_TIME 2000 /* in milliseconds */
 #define TRACKING_TIMEOUT_TIME (CONFIG_POLLING_INTERVAL * 3) /*in milliseconds*/
+/* Tracking scheduler, association table index not in the heap */
+#define TRACKING_NONE 0xFFFF
+/* true if TIMER_getNow() time a is before b, allows for rollover */
+#define TRACKING_BEFORE(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
 /* Initial delay before broadcast transmissions are started in FH mode */
 #define BROADCAST_CMD_START_TIME 60000
 
@@ -158,6 +163,21 @@ typedef struct
     char oad_file[256];
 }oadFile_t;
 
+/*! Tracking request waiting for a data confirm and response */
+typedef struct
+{
+    /*! true if this slot holds a request */
+    bool inUse;
+    /*! MSDU handle of the data request */
+    uint8_t msduHandle;
+    /*! association table index of the device */
+    uint16_t idx;
+    /*! short address, to notice the entry was reused */
+    uint16_t shortAddr;
+    /*! TIMER_getNow() time the response is due by */
+    uint32_t deadline;
+} trackingSlot_t;
+
 /******************************************************************************
  Global variables
  *****************************************************************************/
@@ -186,6 +206,31 @@ static uint16_t devicePanId = 0xFFFF;
 /*! Device's Outgoing MSDU Handle values */
 static uint8_t deviceTxMsduHandle = 0;
 
+/*! MSDU Handle of the last message sent by sendMsg() */
+static uint8_t lastTxMsduHandle = 0;
+
+/*!
+ Tracking scheduler: the alive devices waiting for their next tracking
+ request, as a min-heap of association table indexes keyed by due time
+ */
+static uint16_t trackingSize = 0;
+static uint16_t trackingCount = 0;
+static uint16_t *trackingHeap = NULL;
+static uint16_t *trackingHeapPos = NULL;
+static uint32_t *trackingDue = NULL;
+
+/*! Tracking requests sent and not yet answered */
+static trackingSlot_t trackingSlots[TRACKING_CONCURRENT_LIMIT];
+static uint8_t trackingOutstanding = 0;
+
+/*! Time of the last tracking request, for TRACKING_SPACING_TIME */
+static uint32_t trackingLastSend = 0;
+static bool trackingSent = false;
+
+/*! Time the tracking clock is set to expire at */
+static uint32_t trackingWakeAt = 0;
+static bool trackingArmed = false;
+
 static bool fhEnabled = false;
 
 static oadFile_t oad_file_list[MAX_OAD_FILES] = {{0}};
@@ -219,7 +264,20 @@ static bool sendMsg(Smsgs_cmdIds_t type, uint16_t dstShortAddr, bool rxOnIdle,
 static void generateConfigRequests(void);
 static void generateTrackingRequests(void);
 static void generateBroadcastCmd(void);
-static void sendTrackingRequest(Cllc_associated_devices_t *pDev);
+static bool sendTrackingRequest(Cllc_associated_devices_t *pDev,
+                                uint32_t now);
+static void trackingInit(void);
+static void trackingSwap(uint16_t a, uint16_t b);
+static void trackingSiftUp(uint16_t pos);
+static void trackingSiftDown(uint16_t pos);
+static void trackingSchedule(uint16_t idx, uint32_t due);
+static uint16_t trackingPop(void);
+static void trackingAdd(Cllc_associated_devices_t *pDev);
+static trackingSlot_t *trackingFindSlot(uint8_t msduHandle);
+static trackingSlot_t *trackingFindDevSlot(uint16_t idx);
+static void trackingFreeSlot(trackingSlot_t *pSlot);
+static void trackingNotActive(Cllc_associated_devices_t *pDev, bool timeout);
+static void trackingArm(uint32_t now);
 static void commStatusIndCB(ApiMac_mlmeCommStatusInd_t *pCommStatusInd);
 static void pollIndCB(ApiMac_mlmePollInd_t *pPollInd);
 static void processDataRetry(ApiMac_sAddr_t *pAddr);
@@ -331,6 +389,9 @@ void Collector_init(void)
     /* Initialize the Coordinator Logical Link Controller */
     Cllc_init(&Collector_macCallbacks, &cllcCallbacks);
 
+    /* Size the tracking scheduler to the association table */
+    trackingInit();
+
     /* Register the MAC Callbacks */
     ApiMac_registerCallbacks(&Collector_macCallbacks);
 
@@ -805,8 +866,9 @@ static void cllcStartedCB(Llc_netInfo_t *pStartedInfo)
     /* updated the user */
     Csf_networkUpdate(restarted, pStartedInfo);
 
-    /* Start the tracking clock */
-    Csf_setTrackingClock(TRACKING_DELAY_TIME);
+    /* Start the tracking clock, if any device is already scheduled */
+    trackingArmed = false;
+    trackingArm(TIMER_getNow());
 }
 
 /*!
@@ -911,14 +973,15 @@ static void dataCnfCB(ApiMac_mcpsDataCnf_t *pDataCnf)
                 if(pDataCnf->status != ApiMac_status_success)
                 {
                     /* Try to send again */
-                    pDev->status &= ~ASSOC_CONFIG_SENT;
+                    Cllc_updateDeviceStatus(pDev, ASSOC_CONFIG_SENT, 0);
                     Csf_setConfigClock(CONFIG_DELAY);
                 }
                 else
                 {
-                    pDev->status |= ASSOC_CONFIG_SENT;
-                    pDev->status |= ASSOC_CONFIG_RSP;
-                    pDev->status |= CLLC_ASSOC_STATUS_ALIVE;
+                    Cllc_updateDeviceStatus(pDev, 0, (ASSOC_CONFIG_SENT
+                                    | ASSOC_CONFIG_RSP
+                                    | CLLC_ASSOC_STATUS_ALIVE));
+                    trackingAdd(pDev);
                     Csf_setConfigClock(CONFIG_RESPONSE_DELAY);
                 }
             }
@@ -938,43 +1001,47 @@ static void dataCnfCB(ApiMac_mcpsDataCnf_t *pDataCnf)
         }
         else
         {
-            /* Tracking Request */
-            Cllc_associated_devices_t *pDev;
-            pDev = findDeviceStatusBit(ASSOC_TRACKING_SENT,
-                                       ASSOC_TRACKING_SENT);
-            if(pDev != NULL)
+            /* Tracking Request, or another message to one device */
+            trackingSlot_t *pSlot = trackingFindSlot(pDataCnf->msduHandle);
+            if(pSlot != NULL)
             {
+                Cllc_associated_devices_t *pDev;
+                pDev = &Cllc_associatedDevList[pSlot->idx];
+
                 if(pDataCnf->status == ApiMac_status_success)
                 {
-                    /* Make sure the retry is clear */
-                    pDev->status &= ~ASSOC_TRACKING_RETRY;
+                    /* Make sure the retry is clear, wait for the response */
+                    Cllc_updateDeviceStatus(pDev, ASSOC_TRACKING_RETRY, 0);
+
+                    /* Update stats */
+                    Collector_statistics.trackingReqRequestSent++;
                 }
                 else
                 {
+                    uint32_t now = TIMER_getNow();
+                    uint16_t idx = pSlot->idx;
+
+                    trackingFreeSlot(pSlot);
+                    Cllc_updateDeviceStatus(pDev, ASSOC_TRACKING_SENT, 0);
+
                     if(pDev->status & ASSOC_TRACKING_RETRY)
                     {
                         /* We already tried to resend */
-                        pDev->status &= ~ASSOC_TRACKING_RETRY;
-                        pDev->status |= ASSOC_TRACKING_ERROR;
+                        Cllc_updateDeviceStatus(pDev, ASSOC_TRACKING_RETRY,
+                                                ASSOC_TRACKING_ERROR);
+                        trackingNotActive(pDev, false);
                     }
                     else
                     {
                         /* Go ahead and retry */
-                        pDev->status |= ASSOC_TRACKING_RETRY;
+                        Cllc_updateDeviceStatus(pDev, 0, ASSOC_TRACKING_RETRY);
+                        trackingSchedule(idx, (now + TRACKING_CNF_DELAY_TIME));
                     }
 
-                    pDev->status &= ~ASSOC_TRACKING_SENT;
-
-                    /* Try to send again or another */
-                    Csf_setTrackingClock(TRACKING_CNF_DELAY_TIME);
+                    /* The slot is free, send to another device */
+                    trackingArm(now);
                 }
             }
-
-            /* Update stats */
-            if(pDataCnf->status == ApiMac_status_success)
-            {
-                Collector_statistics.trackingReqRequestSent++;
-            }
         }
     }
 }
@@ -1058,8 +1125,8 @@ static void dataIndCB(ApiMac_mcpsDataInd_t *pDataInd)
                 if (pDev != NULL)
                 {
                     /* Clear the sent flag and set the response flag */
-                    pDev->status &= ~ASSOC_CONFIG_SENT;
-                    pDev->status |= ASSOC_CONFIG_RSP;
+                    Cllc_updateDeviceStatus(pDev, ASSOC_CONFIG_SENT,
+                                            ASSOC_CONFIG_RSP);
                 }
                 Util_setEvent(&Collector_events, COLLECTOR_CONFIG_EVT);
                 Csf_deviceRawDataUpdate(pDataInd);
@@ -1123,7 +1190,7 @@ static void processStartEvent(void)
 
         numDevices = Csf_getNumDeviceListEntries();
         /* Restore with the network and device information */
-        Cllc_restoreNetwork(&netInfo, (uint8_t)numDevices, NULL);
+        Cllc_restoreNetwork(&netInfo, numDevices, NULL);
 
         restarted = true;
     }
@@ -1176,8 +1243,7 @@ static void processConfigResponse(ApiMac_mcpsDataInd_t *pDataInd)
         if(pDev != NULL)
         {
             /* Clear the sent flag and set the response flag */
-            pDev->status &= ~ASSOC_CONFIG_SENT;
-            pDev->status |= ASSOC_CONFIG_RSP;
+            Cllc_updateDeviceStatus(pDev, ASSOC_CONFIG_SENT, ASSOC_CONFIG_RSP);
         }
         /* Report the config response */
         Csf_deviceConfigUpdate(&pDataInd->srcAddr, pDataInd->rssi,
@@ -1204,13 +1270,20 @@ static void processTrackingResponse(ApiMac_mcpsDataInd_t *pDataInd)
         pDev = findDevice(&pDataInd->srcAddr);
         if(pDev != NULL)
         {
-            if(pDev->status & ASSOC_TRACKING_SENT)
+            uint16_t idx = (uint16_t)(pDev - Cllc_associatedDevList);
+            trackingSlot_t *pSlot = trackingFindDevSlot(idx);
+
+            if(pSlot != NULL)
             {
-                pDev->status &= ~ASSOC_TRACKING_SENT;
-                pDev->status |= ASSOC_TRACKING_RSP;
+                uint32_t now = TIMER_getNow();
 
-                /* Setup for next tracking */
-                Csf_setTrackingClock( TRACKING_DELAY_TIME);
+                trackingFreeSlot(pSlot);
+                Cllc_updateDeviceStatus(pDev, (ASSOC_TRACKING_SENT
+                                | ASSOC_TRACKING_RETRY), ASSOC_TRACKING_RSP);
+
+                /* Setup for next tracking of this device */
+                trackingSchedule(idx, (now + TRACKING_DELAY_TIME));
+                trackingArm(now);
 
                 /* Retry config request */
                 processConfigRetry();
@@ -1402,32 +1475,13 @@ static void processOadData(ApiMac_mcpsDataInd_t *pDataInd)
  */
 static Cllc_associated_devices_t *findDevice(ApiMac_sAddr_t *pAddr)
 {
-    int x;
-    Cllc_associated_devices_t *pItem = NULL;
-
     /* Check for invalid parameters */
-    if((pAddr == NULL) || (pAddr->addrMode == ApiMac_addrType_none))
+    if((pAddr == NULL) || (pAddr->addrMode != ApiMac_addrType_short))
     {
         return (NULL);
     }
 
-    for(x = 0; x < CONFIG_MAX_DEVICES; x++)
-    {
-        /* Make sure the entry is valid. */
-        if(Cllc_associatedDevList[x].shortAddr != CSF_INVALID_SHORT_ADDR)
-        {
-            if(pAddr->addrMode == ApiMac_addrType_short)
-            {
-                if(pAddr->addr.shortAddr == Cllc_associatedDevList[x].shortAddr)
-                {
-                    pItem = &Cllc_associatedDevList[x];
-                    break;
-                }
-            }
-        }
-    }
-
-    return (pItem);
+    return (Cllc_findDevice(pAddr->addr.shortAddr));
 }
 
 /*!
@@ -1440,23 +1494,7 @@ static Cllc_associated_devices_t *findDevice(ApiMac_sAddr_t *pAddr)
  */
 static Cllc_associated_devices_t *findDeviceStatusBit(uint16_t mask, uint16_t statusBit)
 {
-    int x;
-    Cllc_associated_devices_t *pItem = NULL;
-
-    for(x = 0; x < CONFIG_MAX_DEVICES; x++)
-    {
-        /* Make sure the entry is valid. */
-        if(Cllc_associatedDevList[x].shortAddr != CSF_INVALID_SHORT_ADDR)
-        {
-            if((Cllc_associatedDevList[x].status & mask) == statusBit)
-            {
-                pItem = &Cllc_associatedDevList[x];
-                break;
-            }
-        }
-    }
-
-    return (pItem);
+    return (Cllc_findDeviceStatus(mask, statusBit, 0, NULL));
 }
 
 /*!
@@ -1547,6 +1585,7 @@ static bool sendMsg(Smsgs_cmdIds_t type, uint16_t dstShortAddr, bool rxOnIdle,
     dataReq.dstPanId = devicePanId;
 
     dataReq.msduHandle = getMsduHandle(type);
+    lastTxMsduHandle = dataReq.msduHandle;
 
     dataReq.txOptions.ack = true;
     if(rxOnIdle == false)
@@ -1623,7 +1662,7 @@ static void sendBroadcastMsg(Smsgs_cmdIds_t type, uint16_t len,
  */
 static void generateConfigRequests(void)
 {
-    int x;
+    Cllc_associated_devices_t *pDev;
 
     if(CERTIFICATION_TEST_MODE)
     {
@@ -1633,63 +1672,45 @@ static void generateConfigRequests(void)
     }
 
     /* Clear any timed out transactions */
-    for(x = 0; x < CONFIG_MAX_DEVICES; x++)
+    while((pDev = Cllc_findDeviceStatus(
+                    (CLLC_ASSOC_STATUS_ALIVE | ASSOC_CONFIG_MASK),
+                    (CLLC_ASSOC_STATUS_ALIVE | ASSOC_CONFIG_MASK), 0, NULL))
+          != NULL)
     {
-        if((Cllc_associatedDevList[x].shortAddr != CSF_INVALID_SHORT_ADDR)
-           && (Cllc_associatedDevList[x].status & CLLC_ASSOC_STATUS_ALIVE))
-        {
-            if((Cllc_associatedDevList[x].status &
-               (ASSOC_CONFIG_SENT | ASSOC_CONFIG_RSP))
-               == (ASSOC_CONFIG_SENT | ASSOC_CONFIG_RSP))
-            {
-                Cllc_associatedDevList[x].status &= ~(ASSOC_CONFIG_SENT
-                                | ASSOC_CONFIG_RSP);
-            }
-        }
+        Cllc_updateDeviceStatus(pDev, (ASSOC_CONFIG_SENT | ASSOC_CONFIG_RSP), 0);
     }
 
     /* Make sure we are only sending one config request at a time */
     if(findDeviceStatusBit(ASSOC_CONFIG_MASK, ASSOC_CONFIG_SENT) == NULL)
     {
-        /* Run through all of the devices */
-        for(x = 0; x < CONFIG_MAX_DEVICES; x++)
+        /*
+         The first device that has not been sent or already received
+         a config request
+         */
+        pDev = Cllc_findDeviceStatus(
+                        (CLLC_ASSOC_STATUS_ALIVE | ASSOC_CONFIG_MASK),
+                        CLLC_ASSOC_STATUS_ALIVE, 0, NULL);
+        if(pDev != NULL)
         {
-            /* Make sure the entry is valid. */
-            if((Cllc_associatedDevList[x].shortAddr != CSF_INVALID_SHORT_ADDR)
-               && (Cllc_associatedDevList[x].status & CLLC_ASSOC_STATUS_ALIVE))
+            ApiMac_sAddr_t dstAddr;
+            Collector_status_t stat;
+
+            /* Set up the destination address */
+            dstAddr.addrMode = ApiMac_addrType_short;
+            dstAddr.addr.shortAddr = pDev->shortAddr;
+
+            /* Send the Config Request */
+            stat = Collector_sendConfigRequest(
+                            &dstAddr, (CONFIG_FRAME_CONTROL),
+                            (CONFIG_REPORTING_INTERVAL),
+                            (CONFIG_POLLING_INTERVAL));
+            if(stat == Collector_status_success)
             {
-                uint16_t status = Cllc_associatedDevList[x].status;
-
                 /*
-                 Has the device been sent or already received a config request?
+                 Mark as the message has been sent and expecting a response
                  */
-                if(((status & (ASSOC_CONFIG_SENT | ASSOC_CONFIG_RSP)) == 0))
-                {
-                    ApiMac_sAddr_t dstAddr;
-                    Collector_status_t stat;
-
-                    /* Set up the destination address */
-                    dstAddr.addrMode = ApiMac_addrType_short;
-                    dstAddr.addr.shortAddr =
-                        Cllc_associatedDevList[x].shortAddr;
-
-                    /* Send the Config Request */
-                    stat = Collector_sendConfigRequest(
-                                    &dstAddr, (CONFIG_FRAME_CONTROL),
-                                    (CONFIG_REPORTING_INTERVAL),
-                                    (CONFIG_POLLING_INTERVAL));
-                    if(stat == Collector_status_success)
-                    {
-                        /*
-                         Mark as the message has been sent and expecting a response
-                         */
-                        Cllc_associatedDevList[x].status |= ASSOC_CONFIG_SENT;
-                        Cllc_associatedDevList[x].status &= ~ASSOC_CONFIG_RSP;
-                    }
-
-                    /* Only do one at a time */
-                    break;
-                }
+                Cllc_updateDeviceStatus(pDev, ASSOC_CONFIG_RSP,
+                                        ASSOC_CONFIG_SENT);
             }
         }
     }
@@ -1697,144 +1718,77 @@ static void generateConfigRequests(void)
 
 
 /*!
- * @brief      Generate Config Requests for all associate devices
- *             that need one.
+ * @brief      Tracking scheduler tick. Report the devices that did not
+ *             answer in time and send tracking requests to the devices
+ *             that are due, up to TRACKING_CONCURRENT outstanding and
+ *             no closer together than TRACKING_SPACING_TIME.
  */
 static void generateTrackingRequests(void)
 {
-    int x;
+    uint32_t now = TIMER_getNow();
+    int i;
+
+    /* The clock that brought us here has expired */
+    trackingArmed = false;
 
-    /* Run through all of the devices, looking for previous activity */
-    for(x = 0; x < CONFIG_MAX_DEVICES; x++)
+    if(CERTIFICATION_TEST_MODE)
     {
-        if(CERTIFICATION_TEST_MODE)
-        {
-            /* In Certification mode only back to back uplink
-             * data traffic shall be supported*/
-            return;
-        }
-        /* Make sure the entry is valid. */
-        if((Cllc_associatedDevList[x].shortAddr != CSF_INVALID_SHORT_ADDR)
-             && (Cllc_associatedDevList[x].status & CLLC_ASSOC_STATUS_ALIVE))
+        /* In Certification mode only back to back uplink
+         * data traffic shall be supported*/
+        return;
+    }
+
+    /* Timeout occured, notify the user that the tracking failed */
+    for(i = 0; i < TRACKING_CONCURRENT_LIMIT; i++)
+    {
+        trackingSlot_t *pSlot = &trackingSlots[i];
+
+        if(pSlot->inUse && !TRACKING_BEFORE(now, pSlot->deadline))
         {
-            uint16_t status = Cllc_associatedDevList[x].status;
+            Cllc_associated_devices_t *pDev;
+            pDev = &Cllc_associatedDevList[pSlot->idx];
 
-            /*
-             Has the device been sent a tracking request or received a
-             tracking response?
-             */
-            if(status & ASSOC_TRACKING_RETRY)
+            trackingFreeSlot(pSlot);
+            if((pDev->shortAddr == pSlot->shortAddr)
+               && (pDev->status & CLLC_ASSOC_STATUS_ALIVE))
             {
-                sendTrackingRequest(&Cllc_associatedDevList[x]);
-                return;
+                trackingNotActive(pDev, true);
             }
-            else if((status & (ASSOC_TRACKING_SENT | ASSOC_TRACKING_RSP
-                               | ASSOC_TRACKING_ERROR)))
-            {
-                Cllc_associated_devices_t *pDev = NULL;
-                int y;
-
-                if(status & (ASSOC_TRACKING_SENT | ASSOC_TRACKING_ERROR))
-                {
-                    ApiMac_deviceDescriptor_t devInfo;
-                    Llc_deviceListItem_t item;
-                    ApiMac_sAddr_t devAddr;
-
-                    /*
-                     Timeout occured, notify the user that the tracking
-                     failed.
-                     */
-                    memset(&devInfo, 0, sizeof(ApiMac_deviceDescriptor_t));
-
-                    devAddr.addrMode = ApiMac_addrType_short;
-                    devAddr.addr.shortAddr =
-                        Cllc_associatedDevList[x].shortAddr;
-
-                    if(Csf_getDevice(&devAddr, &item))
-                    {
-                        memcpy(&devInfo.extAddress,
-                               &item.devInfo.extAddress,
-                               sizeof(ApiMac_sAddrExt_t));
-                    }
-                    devInfo.shortAddress = Cllc_associatedDevList[x].shortAddr;
-                    devInfo.panID = devicePanId;
-                    Csf_deviceNotActiveUpdate(&devInfo,
-                        ((status & ASSOC_TRACKING_SENT) ? true : false));
-
-                    /* Not responding, so remove the alive marker */
-                    Cllc_associatedDevList[x].status
-                            &= ~(CLLC_ASSOC_STATUS_ALIVE
-                                | ASSOC_CONFIG_SENT | ASSOC_CONFIG_RSP);
-                }
-
-                /* Clear the tracking bits */
-                Cllc_associatedDevList[x].status  &= ~(ASSOC_TRACKING_ERROR
-                                | ASSOC_TRACKING_SENT | ASSOC_TRACKING_RSP);
-
-                /* Find the next valid device */
-                y = x;
-                while(pDev == NULL)
-                {
-                    /* Check for rollover */
-                    if(y == (CONFIG_MAX_DEVICES-1))
-                    {
-                        /* Move to the beginning */
-                        y = 0;
-                    }
-                    else
-                    {
-                        /* Move the the next device */
-                        y++;
-                    }
-
-                    if(y == x)
-                    {
-                        /* We've come back around */
-                        break;
-                    }
+        }
+    }
 
-                    /*
-                     Is the entry valid and active */
-                    if((Cllc_associatedDevList[y].shortAddr
-                                    != CSF_INVALID_SHORT_ADDR)
-                         && (Cllc_associatedDevList[y].status
-                                   & CLLC_ASSOC_STATUS_ALIVE))
-                    {
-                        pDev = &Cllc_associatedDevList[y];
-                    }
-                }
+    while((trackingCount > 0) && (trackingOutstanding < TRACKING_CONCURRENT)
+          && !TRACKING_BEFORE(now, trackingDue[trackingHeap[0]]))
+    {
+        Cllc_associated_devices_t *pDev;
+        uint16_t idx;
 
-                if(pDev == NULL)
-                {
-                    /* Another device wasn't found, send to same device */
-                    pDev = &Cllc_associatedDevList[x];
-                }
+        if(trackingSent && (TRACKING_SPACING_TIME > 0)
+           && TRACKING_BEFORE(now, trackingLastSend + TRACKING_SPACING_TIME))
+        {
+            break;
+        }
 
-                sendTrackingRequest(pDev);
+        idx = trackingPop();
+        pDev = &Cllc_associatedDevList[idx];
 
-                /* Only do one at a time */
-                return;
-            }
+        /* Dropped, gone quiet or already waiting for an answer */
+        if((pDev->shortAddr == CSF_INVALID_SHORT_ADDR)
+           || ((pDev->status & CLLC_ASSOC_STATUS_ALIVE) == 0)
+           || (pDev->status & ASSOC_TRACKING_SENT))
+        {
+            continue;
         }
-    }
 
-    /* If no activity found, find the first active device */
-    for(x = 0; x < CONFIG_MAX_DEVICES; x++)
-    {
-        /* Make sure the entry is valid. */
-        if((Cllc_associatedDevList[x].shortAddr != CSF_INVALID_SHORT_ADDR)
-              && (Cllc_associatedDevList[x].status & CLLC_ASSOC_STATUS_ALIVE))
+        if(sendTrackingRequest(pDev, now) == false)
         {
-            sendTrackingRequest(&Cllc_associatedDevList[x]);
+            /* The MAC queue is full, try again later */
+            trackingSchedule(idx, (now + TRACKING_CNF_DELAY_TIME));
             break;
         }
     }
 
-    if(x == CONFIG_MAX_DEVICES)
-    {
-        /* No device found, Setup delay for next tracking message */
-        Csf_setTrackingClock(TRACKING_DELAY_TIME);
-    }
+    trackingArm(now);
 }
 
 /*!
@@ -1858,32 +1812,383 @@ static void generateBroadcastCmd(void)
  * @brief      Generate Tracking Requests for a device
  *
  * @param      pDev - pointer to the device's associate device table entry
+ * @param      now - TIMER_getNow() time
+ *
+ * @return     true if sent, false if not
  */
-static void sendTrackingRequest(Cllc_associated_devices_t *pDev)
+static bool sendTrackingRequest(Cllc_associated_devices_t *pDev,
+                                uint32_t now)
 {
     uint8_t cmdId = Smsgs_cmdIds_trackingReq;
+    int i;
 
     /* Send the Tracking Request */
    if((sendMsg(Smsgs_cmdIds_trackingReq, pDev->shortAddr,
             pDev->capInfo.rxOnWhenIdle,
             (SMSGS_TRACKING_REQUEST_MSG_LENGTH),
-            &cmdId)) == true)
+            &cmdId)) == false)
     {
-        /* Mark as Tracking Request sent */
-        pDev->status |= ASSOC_TRACKING_SENT;
+        return (false);
+    }
 
-        /* Setup Timeout for response */
-        Csf_setTrackingClock(TRACKING_TIMEOUT_TIME);
+    /* Mark as Tracking Request sent */
+    Cllc_updateDeviceStatus(pDev, ASSOC_TRACKING_RSP, ASSOC_TRACKING_SENT);
 
-        /* Update stats */
-        Collector_statistics.trackingRequestAttempts++;
+    /* Setup Timeout for response */
+    for(i = 0; i < TRACKING_CONCURRENT_LIMIT; i++)
+    {
+        trackingSlot_t *pSlot = &trackingSlots[i];
+
+        if(pSlot->inUse == false)
+        {
+            pSlot->inUse = true;
+            pSlot->msduHandle = lastTxMsduHandle;
+            pSlot->idx = (uint16_t)(pDev - Cllc_associatedDevList);
+            pSlot->shortAddr = pDev->shortAddr;
+            pSlot->deadline = now + TRACKING_TIMEOUT_TIME;
+            trackingOutstanding++;
+            break;
+        }
+    }
+
+    trackingLastSend = now;
+    trackingSent = true;
+
+    /* Update stats */
+    Collector_statistics.trackingRequestAttempts++;
+
+    return (true);
+}
+
+/*!
+ * @brief      Allocate the tracking scheduler, one heap entry per
+ *             association table entry
+ */
+static void trackingInit(void)
+{
+    uint16_t maxDevices = (uint16_t)CONFIG_MAX_DEVICES;
+
+    /* Csf_malloc() sizes are 16 bits */
+    if((sizeof(uint32_t) * maxDevices) > 0xFFFF)
+    {
+        return;
+    }
+
+    trackingHeap = Csf_malloc((uint16_t)(sizeof(uint16_t) * maxDevices));
+    trackingHeapPos = Csf_malloc((uint16_t)(sizeof(uint16_t) * maxDevices));
+    trackingDue = Csf_malloc((uint16_t)(sizeof(uint32_t) * maxDevices));
+    if((trackingHeap == NULL) || (trackingHeapPos == NULL)
+       || (trackingDue == NULL))
+    {
+        LOG_printf(LOG_ERROR, "Tracking scheduler: no memory\n");
+        return;
+    }
+
+    memset(trackingHeapPos, 0xFF, (sizeof(uint16_t) * maxDevices));
+    memset(trackingSlots, 0, sizeof(trackingSlots));
+    trackingCount = 0;
+    trackingOutstanding = 0;
+    trackingSize = maxDevices;
+}
+
+/*!
+ * @brief      Exchange two tracking heap entries
+ *
+ * @param      a - heap position
+ * @param      b - heap position
+ */
+static void trackingSwap(uint16_t a, uint16_t b)
+{
+    uint16_t idx = trackingHeap[a];
+
+    trackingHeap[a] = trackingHeap[b];
+    trackingHeap[b] = idx;
+    trackingHeapPos[trackingHeap[a]] = a;
+    trackingHeapPos[trackingHeap[b]] = b;
+}
+
+/*!
+ * @brief      Move a tracking heap entry up to its place
+ *
+ * @param      pos - heap position
+ */
+static void trackingSiftUp(uint16_t pos)
+{
+    while(pos > 0)
+    {
+        uint16_t parent = (uint16_t)((pos - 1) / 2);
+
+        if(!TRACKING_BEFORE(trackingDue[trackingHeap[pos]],
+                            trackingDue[trackingHeap[parent]]))
+        {
+            break;
+        }
+        trackingSwap(pos, parent);
+        pos = parent;
+    }
+}
+
+/*!
+ * @brief      Move a tracking heap entry down to its place
+ *
+ * @param      pos - heap position
+ */
+static void trackingSiftDown(uint16_t pos)
+{
+    for(;;)
+    {
+        uint32_t child = (2 * (uint32_t)pos) + 1;
+        uint16_t first = pos;
+
+        if((child < trackingCount)
+           && TRACKING_BEFORE(trackingDue[trackingHeap[child]],
+                              trackingDue[trackingHeap[first]]))
+        {
+            first = (uint16_t)child;
+        }
+        child++;
+        if((child < trackingCount)
+           && TRACKING_BEFORE(trackingDue[trackingHeap[child]],
+                              trackingDue[trackingHeap[first]]))
+        {
+            first = (uint16_t)child;
+        }
+        if(first == pos)
+        {
+            break;
+        }
+        trackingSwap(pos, first);
+        pos = first;
+    }
+}
+
+/*!
+ * @brief      Set when a device gets its next tracking request, adding
+ *             it to the heap if it isn't there
+ *
+ * @param      idx - association table index
+ * @param      due - TIMER_getNow() time
+ */
+static void trackingSchedule(uint16_t idx, uint32_t due)
+{
+    uint16_t pos;
+
+    if(idx >= trackingSize)
+    {
+        return;
+    }
+
+    pos = trackingHeapPos[idx];
+    if(pos == TRACKING_NONE)
+    {
+        pos = trackingCount++;
+        trackingHeap[pos] = idx;
+        trackingHeapPos[idx] = pos;
+        trackingDue[idx] = due;
+        trackingSiftUp(pos);
+    }
+    else if(TRACKING_BEFORE(due, trackingDue[idx]))
+    {
+        trackingDue[idx] = due;
+        trackingSiftUp(pos);
     }
     else
     {
-        ApiMac_sAddr_t devAddr;
-        devAddr.addrMode = ApiMac_addrType_short;
-        devAddr.addr.shortAddr = pDev->shortAddr;
-        processDataRetry(&devAddr);
+        trackingDue[idx] = due;
+        trackingSiftDown(pos);
+    }
+}
+
+/*!
+ * @brief      Remove the device that is due first from the heap
+ *
+ * @return     association table index
+ */
+static uint16_t trackingPop(void)
+{
+    uint16_t idx = trackingHeap[0];
+
+    trackingCount--;
+    if(trackingCount > 0)
+    {
+        trackingSwap(0, trackingCount);
+        trackingSiftDown(0);
+    }
+    trackingHeapPos[idx] = TRACKING_NONE;
+
+    return (idx);
+}
+
+/*!
+ * @brief      Start tracking a device that was heard from, unless it is
+ *             already scheduled or waiting for a tracking response
+ *
+ * @param      pDev - pointer to the device's associate device table entry
+ */
+static void trackingAdd(Cllc_associated_devices_t *pDev)
+{
+    uint16_t idx = (uint16_t)(pDev - Cllc_associatedDevList);
+
+    if((idx < trackingSize) && (trackingHeapPos[idx] == TRACKING_NONE)
+       && ((pDev->status & ASSOC_TRACKING_SENT) == 0))
+    {
+        uint32_t now = TIMER_getNow();
+
+        trackingSchedule(idx, (now + TRACKING_DELAY_TIME));
+        trackingArm(now);
+    }
+}
+
+/*!
+ * @brief      Find the outstanding tracking request with an MSDU handle
+ *
+ * @param      msduHandle - from the data confirm
+ *
+ * @return     pointer to the slot, NULL if not a tracking request
+ */
+static trackingSlot_t *trackingFindSlot(uint8_t msduHandle)
+{
+    int i;
+
+    for(i = 0; i < TRACKING_CONCURRENT_LIMIT; i++)
+    {
+        if(trackingSlots[i].inUse
+           && (trackingSlots[i].msduHandle == msduHandle))
+        {
+            return (&trackingSlots[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+/*!
+ * @brief      Find the outstanding tracking request for a device
+ *
+ * @param      idx - association table index
+ *
+ * @return     pointer to the slot, NULL if none
+ */
+static trackingSlot_t *trackingFindDevSlot(uint16_t idx)
+{
+    int i;
+
+    for(i = 0; i < TRACKING_CONCURRENT_LIMIT; i++)
+    {
+        if(trackingSlots[i].inUse && (trackingSlots[i].idx == idx))
+        {
+            return (&trackingSlots[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+/*!
+ * @brief      Release an outstanding tracking request
+ *
+ * @param      pSlot - slot from trackingFindSlot() or trackingFindDevSlot()
+ */
+static void trackingFreeSlot(trackingSlot_t *pSlot)
+{
+    pSlot->inUse = false;
+    trackingOutstanding--;
+}
+
+/*!
+ * @brief      Tell the user a device stopped answering tracking requests
+ *             and stop tracking it until it is heard from again
+ *
+ * @param      pDev - pointer to the device's associate device table entry
+ * @param      timeout - true if no response, false if the request
+ *                       could not be delivered
+ */
+static void trackingNotActive(Cllc_associated_devices_t *pDev, bool timeout)
+{
+    ApiMac_deviceDescriptor_t devInfo;
+    Llc_deviceListItem_t item;
+    ApiMac_sAddr_t devAddr;
+
+    memset(&devInfo, 0, sizeof(ApiMac_deviceDescriptor_t));
+
+    devAddr.addrMode = ApiMac_addrType_short;
+    devAddr.addr.shortAddr = pDev->shortAddr;
+
+    if(Csf_getDevice(&devAddr, &item))
+    {
+        memcpy(&devInfo.extAddress,
+               &item.devInfo.extAddress,
+               sizeof(ApiMac_sAddrExt_t));
+    }
+    devInfo.shortAddress = pDev->shortAddr;
+    devInfo.panID = devicePanId;
+    Csf_deviceNotActiveUpdate(&devInfo, timeout);
+
+    /* Not responding, so remove the alive marker and the tracking bits */
+    Cllc_updateDeviceStatus(pDev, (CLLC_ASSOC_STATUS_ALIVE
+                    | ASSOC_CONFIG_SENT | ASSOC_CONFIG_RSP
+                    | ASSOC_TRACKING_MASK), 0);
+}
+
+/*!
+ * @brief      Set the tracking clock for the next thing the scheduler
+ *             has to do: a response deadline or the next device due
+ *
+ * @param      now - TIMER_getNow() time
+ */
+static void trackingArm(uint32_t now)
+{
+    uint32_t wake = 0;
+    bool found = false;
+    int i;
+
+    for(i = 0; i < TRACKING_CONCURRENT_LIMIT; i++)
+    {
+        if(trackingSlots[i].inUse
+           && (!found || TRACKING_BEFORE(trackingSlots[i].deadline, wake)))
+        {
+            wake = trackingSlots[i].deadline;
+            found = true;
+        }
+    }
+
+    if((trackingCount > 0) && (trackingOutstanding < TRACKING_CONCURRENT))
+    {
+        uint32_t due = trackingDue[trackingHeap[0]];
+
+        if(trackingSent && TRACKING_BEFORE(due, trackingLastSend
+                                           + TRACKING_SPACING_TIME))
+        {
+            due = trackingLastSend + TRACKING_SPACING_TIME;
+        }
+        if(!found || TRACKING_BEFORE(due, wake))
+        {
+            wake = due;
+            found = true;
+        }
+    }
+
+    if(!found)
+    {
+        return;
+    }
+
+    /* Leave the clock alone if it already expires at that time */
+    if(trackingArmed && (trackingWakeAt == wake))
+    {
+        return;
+    }
+
+    trackingWakeAt = wake;
+    trackingArmed = true;
+    if(TRACKING_BEFORE(now, wake))
+    {
+        Csf_setTrackingClock(wake - now);
+    }
+    else
+    {
+        /* Already due, Csf_setTrackingClock(0) would stop the clock */
+        Csf_setTrackingClock(1);
     }
 }
 
@@ -1904,7 +2209,7 @@ static void commStatusIndCB(ApiMac_mlmeCommStatusInd_t *pCommStatusInd)
             if(pDev)
             {
                 /* Mark as inactive and clear config and tracking states */
-                pDev->status = 0;
+                Cllc_updateDeviceStatus(pDev, 0xFFFF, 0);
             }
         }
     }
@@ -1972,26 +2277,15 @@ static void processDataRetry(ApiMac_sAddr_t *pAddr)
         if(pItem)
         {
             /* Set device status to alive */
-            pItem->status |= CLLC_ASSOC_STATUS_ALIVE;
+            Cllc_updateDeviceStatus(pItem, 0, CLLC_ASSOC_STATUS_ALIVE);
 
             /* Check to see if we need to send it a config */
             if((pItem->status & (ASSOC_CONFIG_RSP | ASSOC_CONFIG_SENT)) == 0)
             {
                 processConfigRetry();
             }
-            /* Check to see if we need to send it a tracking message */
-            if((pItem->status & (ASSOC_TRACKING_SENT| ASSOC_TRACKING_RETRY)) == 0)
-            {
-                /* Make sure we aren't already doing a tracking message */
-                if(((Collector_events & COLLECTOR_TRACKING_TIMEOUT_EVT) == 0)
-                    && (Csf_isTrackingTimerActive() == false)
-                    && (findDeviceStatusBit(ASSOC_TRACKING_MASK,
-                                            ASSOC_TRACKING_SENT) == NULL))
-                {
-                    /* Setup for next tracking */
-                    Csf_setTrackingClock(TRACKING_DELAY_TIME);
-                }
-            }
+            /* Make sure it gets tracking messages */
+            trackingAdd(pItem);
         }
     }
 }
@@ -100,7 +100,14 @@ extern bool linux_CONFIG_FH_ENABLE;
 #define CONFIG_MAX_BEACONS_RECD      200
 
 /*! maximum devices in association table */
-#define CONFIG_MAX_DEVICES           50
+extern int linux_CONFIG_MAX_DEVICES;
+#define CONFIG_MAX_DEVICES           linux_CONFIG_MAX_DEVICES
+#define CONFIG_MAX_DEVICES_DEFAULT   50
+/*!
+ Largest CONFIG_MAX_DEVICES, the association table and its indexes
+ are allocated with Csf_malloc() which takes a 16 bit size
+ */
+#define CONFIG_MAX_DEVICES_LIMIT     5000
 
 /*!
  Setting beacon order to 15 will disable the beacon, 8 is a good value for
@@ -166,6 +173,17 @@ extern int linux_CONFIG_POLLING_INTERVAL;
 extern int linux_TRACKING_DELAY_TIME;
 #define TRACKING_DELAY_TIME         linux_TRACKING_DELAY_TIME
 
+/*! maximum tracking requests waiting for a response at the same time */
+extern int linux_TRACKING_CONCURRENT;
+#define TRACKING_CONCURRENT         linux_TRACKING_CONCURRENT
+#define TRACKING_CONCURRENT_DEFAULT 4
+#define TRACKING_CONCURRENT_LIMIT   16
+
+/*! minimum time in ms between two tracking request transmissions */
+extern int linux_TRACKING_SPACING_TIME;
+#define TRACKING_SPACING_TIME         linux_TRACKING_SPACING_TIME
+#define TRACKING_SPACING_TIME_DEFAULT 100
+
 /*! Application traffic profile */
 #if (((CONFIG_PHY_ID >= APIMAC_MRFSK_STD_PHY_ID_BEGIN) && (CONFIG_PHY_ID <= APIMAC_MRFSK_GENERIC_PHY_ID_BEGIN)) || \
     ((CONFIG_PHY_ID >= APIMAC_GENERIC_US_915_PHY_132) && (CONFIG_PHY_ID <= APIMAC_GENERIC_ETSI_863_PHY_133)))
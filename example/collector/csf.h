@@ -68,6 +68,8 @@ extern "C"
 
 /*! CSF Events - Key Event */
 #define CSF_KEY_EVENT 0x0001
+/*! CSF Events - Frame counter checkpoint */
+#define CSF_FRAME_COUNTER_EVENT 0x0002
 
 #define CSF_INVALID_SHORT_ADDR   0xFFFF
 
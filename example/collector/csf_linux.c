@@ -64,6 +64,7 @@
 #include "nv_linux.h"
 
 #include "log.h"
+#include "fatal.h"
 #include "mutex.h"
 #include "ti_semaphore.h"
 #include "timer.h"
@@ -141,6 +142,14 @@
 #define CSF_NV_FRAMECOUNTER_ID 0x0006
 /* NV Item ID - reset reason */
 #define CSF_NV_RESET_REASON_ID 0x0007
+/*
+ NV Item ID - device list records beyond the first CSF_NV_SUBIDS_PER_ID,
+ one item ID per block of sub IDs starting here
+ */
+#define CSF_NV_DEVICELIST_EXT_ID 0x0100
+
+/* NV sub IDs are 10 bits, larger lists continue in another item ID */
+#define CSF_NV_SUBIDS_PER_ID 1024
 
 /* Maximum number of black list entries */
 #define CSF_MAX_BLACKLIST_ENTRIES 10
@@ -152,7 +161,9 @@
  Maximum sub ID for a blacklist item, this is failsafe.  This is
  not the maximum number of items in the list
  */
-#define CSF_MAX_BLACKLIST_IDS (2*CONFIG_MAX_DEVICES)
+#define CSF_MAX_BLACKLIST_IDS \
+    (((2*CONFIG_MAX_DEVICES) < CSF_NV_SUBIDS_PER_ID) ? \
+     (2*CONFIG_MAX_DEVICES) : CSF_NV_SUBIDS_PER_ID)
 
 /*
  Maximum sub ID for a device list item, this is failsafe.  This is
@@ -160,6 +171,9 @@
  */
 #define CSF_MAX_DEVICELIST_IDS (2*CONFIG_MAX_DEVICES)
 
+/* Number of hash chains in each device table index */
+#define CSF_DEVTABLE_BUCKETS CSF_MAX_DEVICELIST_IDS
+
 /* timeout value for trickle timer initialization */
 #define TRICKLE_TIMEOUT_VALUE       20
 
@@ -169,13 +183,19 @@
 #define CONFIG_TIMEOUT_VALUE 1000
 
 /*
- The increment value needed to save a frame counter. Example, setting this
- constant to 100, means that the frame counter will be saved when the new
- frame counter is 100 more than the last saved frame counter.  Also, when
- the get frame counter function reads the value from NV it will add this value
- to the read value.
+ Frame counters are kept in RAM and the ones that changed are written to
+ NV together, as one checkpoint, this often (in milliseconds). After a
+ crash the device frame counters restart from the last checkpoint.
  */
-#define FRAME_COUNTER_SAVE_WINDOW     25
+#define FRAME_COUNTER_CHECKPOINT_TIME 10000
+
+/*
+ The coordinator frame counter is saved this far ahead of the one in use,
+ so a restart never reuses a value that may have been sent. It is saved
+ (and synced) outside a checkpoint once half the margin is used, the
+ other half covers the frames sent while that save is written.
+ */
+#define FRAME_COUNTER_SAVE_MARGIN     1000
 
 /* Value returned from findDeviceListIndex() when not found */
 #define DEVICE_INDEX_NOT_FOUND  -1
@@ -224,6 +244,8 @@ static intptr_t joinClkHandle;
 static intptr_t configClkHandle;
 /* handle for broadcast interval */
 static intptr_t broadcastClkHandle;
+/* handle for frame counter checkpoints */
+static intptr_t frameCounterClkHandle;
 
 extern intptr_t semaphore0;
 /* Non-volatile function pointers */
@@ -255,6 +277,9 @@ static Clock_Handle trackingClkHandle;
 static Clock_Struct broadcastClkStruct;
 static Clock_Handle broadcastClkHandle;
 
+static Clock_Struct frameCounterClkStruct;
+static Clock_Handle frameCounterClkHandle;
+
 /* Clock/timer resources for CLLC */
 /* trickle timer */
 STATIC Clock_Struct tricklePAClkStruct;
@@ -274,6 +299,36 @@ STATIC Clock_Handle configClkHandle;
 /* NV Function Pointers */
 static NVINTF_nvFuncts_t *pNV = NULL;
 
+/*
+ RAM copy of the device list records in NV, so lookups never read NV.
+ Allocated and loaded once by devTableLoad() and written through by
+ every function that changes the device list records.
+ */
+static struct
+{
+    /* CSF_MAX_DEVICELIST_IDS records, indexed like the NV records */
+    Llc_deviceListItem_t *items;
+    bool *inUse;
+    /* hash chains by extended and by short address, -1 terminated */
+    int *extHead;
+    int *extNext;
+    int *shortHead;
+    int *shortNext;
+    uint16_t numEntries;
+    /* there is no unused index below this one */
+    int firstFree;
+    /* Csf_getDeviceItem() position, -1 after any change */
+    int lastDevIndex;
+    int lastIdx;
+    /* records with a frame counter newer than NV, and a list of them */
+    bool *fcDirty;
+    int *fcDirtyList;
+    int fcNumDirty;
+#if IS_HLOS
+    intptr_t lock;
+#endif
+} devTable;
+
 /* Permit join setting */
 static bool permitJoining = false;
 
@@ -282,6 +337,10 @@ static bool started = false;
 /* The last saved coordinator frame counter */
 static uint32_t lastSavedCoordinatorFrameCounter = 0;
 
+/* The coordinator frame counter in use, and if it changed since saved */
+static uint32_t coordinatorFrameCounter = 0;
+static bool coordinatorFrameCounterChanged = false;
+
 #if defined(MT_CSF)
 /*! NV driver item ID for reset reason */
 static const NVINTF_itemID_t nvResetId = NVID_RESET;
@@ -324,6 +383,7 @@ static void processPCTrickleTimeoutCallback_WRAPPER(intptr_t thandle, intptr_t c
 static void processJoinTimeoutCallback_WRAPPER(intptr_t thandle, intptr_t cookie);
 static void processConfigTimeoutCallback_WRAPPER(intptr_t thandle, intptr_t cookie);
 static void processBroadcastTimeoutCallback_WRAPPER(intptr_t thandle, intptr_t cookie);
+static void processFrameCounterCallback_WRAPPER(intptr_t thandle, intptr_t cookie);
 
 #ifndef IS_HEADLESS
 char* getConsoleCmd(void);
@@ -334,16 +394,31 @@ void initConsoleCmd(void);
 
 static void processTackingTimeoutCallback(UArg a0);
 static void processBroadcastTimeoutCallback(UArg a0);
+static void processFrameCounterCallback(UArg a0);
 static void processKeyChangeCallback(uint8_t keysPressed);
 static void processPATrickleTimeoutCallback(UArg a0);
 static void processPCTrickleTimeoutCallback(UArg a0);
 static void processJoinTimeoutCallback(UArg a0);
 static void processConfigTimeoutCallback(UArg a0);
 static bool addDeviceListItem(Llc_deviceListItem_t *pItem);
-static void updateDeviceListItem(Llc_deviceListItem_t *pItem);
 static int findDeviceListIndex(ApiMac_sAddrExt_t *pAddr);
 static int findUnusedDeviceListIndex(void);
+static void setDeviceListItemID(NVINTF_itemID_t *pId, int idx);
+static void devTableLoad(void);
+static void devTableReset(void);
+static void devTableLock(void);
+static void devTableUnlock(void);
+static int devTableExtBucket(ApiMac_sAddrExt_t *pAddr);
+static int devTableFindShort(uint16_t shortAddr);
+static int devTableFindAddr(ApiMac_sAddr_t *pDevAddr);
+static void devTableStore(int idx, Llc_deviceListItem_t *pItem);
+static void devTableRemove(int idx);
+static void beginNvTxn(void);
+static void commitNvTxn(void);
 static void saveNumDeviceListEntries(uint16_t numEntries);
+static void initializeFrameCounterClock(void);
+static void saveCoordinatorFrameCounter(void);
+static void checkpointFrameCounters(void);
 static int findBlackListIndex(ApiMac_sAddr_t *pAddr);
 static int findUnusedBlackListIndex(void);
 static uint16_t getNumBlackListEntries(void);
@@ -412,6 +487,9 @@ void Csf_init(void *sem)
     /* Init NV */
     nvFps.initNV(NULL);
 
+    /* Read the device list once, lookups use the RAM copy */
+    devTableLoad();
+
 #else
    /* Save off the NV Function Pointers */
 #ifdef NV_RESTORE
@@ -429,6 +507,9 @@ void Csf_init(void *sem)
         Csf_clearAllNVItems();
     }
 
+    /* Read the device list once, lookups use the RAM copy */
+    devTableLoad();
+
 
 #ifndef IS_HEADLESS
     /* Initialize the LCD */
@@ -478,6 +559,9 @@ void Csf_init(void *sem)
     }
 #endif
 #endif //IS_HLOS
+
+    /* Start saving frame counter checkpoints */
+    initializeFrameCounterClock();
 }
 
 /*!
@@ -488,6 +572,13 @@ void Csf_init(void *sem)
  */
 void Csf_processEvents(void)
 {
+    if(Csf_events & CSF_FRAME_COUNTER_EVENT)
+    {
+        /* Write the frame counters that changed */
+        checkpointFrameCounters();
+
+        Util_clearEvent(&Csf_events, CSF_FRAME_COUNTER_EVENT);
+    }
 
 #if (!defined(IS_HEADLESS) && defined(IS_HLOS))
 
@@ -1308,6 +1399,15 @@ static void processTackingTimeoutCallback_WRAPPER(intptr_t timer_handle,
     processTackingTimeoutCallback(0);
 }
 
+/* Wrap HLOS to embedded callback */
+static void processFrameCounterCallback_WRAPPER(intptr_t timer_handle,
+                                                intptr_t cookie)
+{
+    (void)timer_handle;
+    (void)cookie;
+    processFrameCounterCallback(0);
+}
+
 /* Wrap HLOS to embedded callback */
 static void processBroadcastTimeoutCallback_WRAPPER(intptr_t timer_handle,
                                                   intptr_t cookie)
@@ -1707,25 +1807,12 @@ void Csf_setConfigClock(uint32_t delay)
  */
 uint16_t Csf_getNumDeviceListEntries(void)
 {
-    uint16_t numEntries = 0;
+    uint16_t numEntries;
 
-    if(pNV != NULL)
-    {
-        NVINTF_itemID_t id;
-        uint8_t stat;
+    devTableLock();
+    numEntries = devTable.numEntries;
+    devTableUnlock();
 
-        /* Setup NV ID for the number of entries in the device list */
-        id.systemID = NVINTF_SYSID_APP;
-        id.itemID = CSF_NV_DEVICELIST_ENTRIES_ID;
-        id.subID = 0;
-
-        /* Read the number of device list items from NV */
-        stat = pNV->readItem(id, 0, sizeof(uint16_t), &numEntries);
-        if(stat != NVINTF_SUCCESS)
-        {
-            numEntries = 0;
-        }
-    }
     return (numEntries);
 }
 
@@ -1782,55 +1869,25 @@ bool Csf_getDeviceExtended(uint16_t shortAddr, ApiMac_sAddrExt_t *pExtAddr)
  */
 bool Csf_getDevice(ApiMac_sAddr_t *pDevAddr, Llc_deviceListItem_t *pItem)
 {
-    if((pNV != NULL) && (pItem != NULL))
+    bool ret = false;
+
+    if((pDevAddr != NULL) && (pItem != NULL))
     {
-        uint16_t numEntries;
+        int idx;
 
-        numEntries = Csf_getNumDeviceListEntries();
+        devTableLock();
 
-        if(numEntries > 0)
+        idx = devTableFindAddr(pDevAddr);
+        if(idx != DEVICE_INDEX_NOT_FOUND)
         {
-            NVINTF_itemID_t id;
-            uint8_t stat;
-            int subId = 0;
-            int readItems = 0;
-
-            /* Setup NV ID for the device list records */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
-
-            while((readItems < numEntries) && (subId
-                                               < CSF_MAX_DEVICELIST_IDS))
-            {
-                Llc_deviceListItem_t item;
-
-                id.subID = (uint16_t)subId;
-
-                /* Read Network Information from NV */
-                stat = pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t),
-                                     &item);
-                if(stat == NVINTF_SUCCESS)
-                {
-                    if(((pDevAddr->addrMode == ApiMac_addrType_short)
-                        && (pDevAddr->addr.shortAddr
-                            == item.devInfo.shortAddress))
-                       || ((pDevAddr->addrMode == ApiMac_addrType_extended)
-                           && (memcmp(&pDevAddr->addr.extAddr,
-                                      &item.devInfo.extAddress,
-                                      (APIMAC_SADDR_EXT_LEN))
-                               == 0)))
-                    {
-                        memcpy(pItem, &item, sizeof(Llc_deviceListItem_t));
-                        return (true);
-                    }
-                    readItems++;
-                }
-                subId++;
-            }
+            memcpy(pItem, &devTable.items[idx], sizeof(Llc_deviceListItem_t));
+            ret = true;
         }
+
+        devTableUnlock();
     }
 
-    return (false);
+    return (ret);
 }
 
 /*!
@@ -1840,48 +1897,47 @@ bool Csf_getDevice(ApiMac_sAddr_t *pDevAddr, Llc_deviceListItem_t *pItem)
  */
 bool Csf_getDeviceItem(uint16_t devIndex, Llc_deviceListItem_t *pItem)
 {
-    if((pNV != NULL) && (pItem != NULL))
-    {
-        uint16_t numEntries;
+    bool ret = false;
 
-        numEntries = Csf_getNumDeviceListEntries();
+    if(pItem != NULL)
+    {
+        devTableLock();
 
-        if(numEntries > 0)
+        if(devIndex < devTable.numEntries)
         {
-            NVINTF_itemID_t id;
-            uint8_t stat;
-            int subId = 0;
-            int readItems = 0;
-
-            /* Setup NV ID for the device list records */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
+            int idx = 0;
+            int n = 0;
 
-            while((readItems < numEntries) && (subId
-                                               < CSF_MAX_DEVICELIST_IDS))
+            /* Callers walk the whole list, carry on from the last one */
+            if((devTable.lastDevIndex >= 0)
+               && (devIndex > devTable.lastDevIndex))
             {
-                Llc_deviceListItem_t item;
-
-                id.subID = (uint16_t)subId;
+                idx = devTable.lastIdx;
+                n = devTable.lastDevIndex;
+            }
 
-                /* Read Network Information from NV */
-                stat = pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t),
-                                     &item);
-                if(stat == NVINTF_SUCCESS)
+            for( ; idx < CSF_MAX_DEVICELIST_IDS; idx++)
+            {
+                if(devTable.inUse[idx])
                 {
-                    if(readItems == devIndex)
+                    if(n == devIndex)
                     {
-                        memcpy(pItem, &item, sizeof(Llc_deviceListItem_t));
-                        return (true);
+                        memcpy(pItem, &devTable.items[idx],
+                               sizeof(Llc_deviceListItem_t));
+                        devTable.lastDevIndex = devIndex;
+                        devTable.lastIdx = idx;
+                        ret = true;
+                        break;
                     }
-                    readItems++;
+                    n++;
                 }
-                subId++;
             }
         }
+
+        devTableUnlock();
     }
 
-    return (false);
+    return (ret);
 }
 
 /*!
@@ -1921,48 +1977,43 @@ void Csf_updateFrameCounter(ApiMac_sAddr_t *pDevAddr, uint32_t frameCntr)
 {
     if((pNV != NULL) && (pNV->writeItem != NULL))
     {
+        devTableLock();
+
         if(pDevAddr == NULL)
         {
             /* Update this device's frame counter */
-            if((frameCntr >=
-                (lastSavedCoordinatorFrameCounter + FRAME_COUNTER_SAVE_WINDOW)))
+            coordinatorFrameCounter = frameCntr;
+            coordinatorFrameCounterChanged = true;
+
+            /*
+             Don't wait for the checkpoint if half the margin saved is
+             used up, a restart must never reuse a frame counter.
+             */
+            if((frameCntr + (FRAME_COUNTER_SAVE_MARGIN / 2)) >=
+               lastSavedCoordinatorFrameCounter)
             {
-                NVINTF_itemID_t id;
-
-                /* Setup NV ID */
-                id.systemID = NVINTF_SYSID_APP;
-                id.itemID = CSF_NV_FRAMECOUNTER_ID;
-                id.subID = 0;
-
-                /* Write the NV item */
-                if(pNV->writeItem(id, sizeof(uint32_t), &frameCntr)
-                                == NVINTF_SUCCESS)
-                {
-                    lastSavedCoordinatorFrameCounter = frameCntr;
-                }
+                saveCoordinatorFrameCounter();
+                NV_LINUX_sync();
             }
         }
         else
         {
-            /* Child frame counter update */
-            Llc_deviceListItem_t devItem;
+            /* Child frame counter update, saved by the next checkpoint */
+            int idx = devTableFindAddr(pDevAddr);
 
-            /* Is the device in our database? */
-            if(Csf_getDevice(pDevAddr, &devItem))
+            if((idx != DEVICE_INDEX_NOT_FOUND)
+               && (frameCntr > devTable.items[idx].rxFrameCounter))
             {
-                /*
-                 Don't save every update, only save if the new frame
-                 counter falls outside the save window.
-                 */
-                if((devItem.rxFrameCounter + FRAME_COUNTER_SAVE_WINDOW)
-                                <= frameCntr)
+                devTable.items[idx].rxFrameCounter = frameCntr;
+                if(devTable.fcDirty[idx] == false)
                 {
-                    /* Update the frame counter */
-                    devItem.rxFrameCounter = frameCntr;
-                    updateDeviceListItem(&devItem);
+                    devTable.fcDirty[idx] = true;
+                    devTable.fcDirtyList[devTable.fcNumDirty++] = idx;
                 }
             }
         }
+
+        devTableUnlock();
     }
 }
 
@@ -1994,8 +2045,15 @@ bool Csf_getFrameCounter(ApiMac_sAddr_t *pDevAddr, uint32_t *pFrameCntr)
                 if(pNV->readItem(id, 0, sizeof(uint32_t), pFrameCntr)
                                 == NVINTF_SUCCESS)
                 {
-                    /* Set to the next window */
-                    *pFrameCntr += FRAME_COUNTER_SAVE_WINDOW;
+                    /*
+                     The saved value is already FRAME_COUNTER_SAVE_MARGIN
+                     past any frame counter sent before, start from it.
+                     It is also what NV holds now, the first update saves
+                     again since none of the margin is left.
+                     */
+                    devTableLock();
+                    lastSavedCoordinatorFrameCounter = *pFrameCntr;
+                    devTableUnlock();
                     return(true);
                 }
                 else
@@ -2034,6 +2092,10 @@ void Csf_removeDeviceListItem(ApiMac_sAddrExt_t *pAddr)
     {
         int index;
 
+        /* The record, the count and the RAM copy change together */
+        devTableLock();
+        beginNvTxn();
+
         /* Does the item exist? */
         index = findDeviceListIndex(pAddr);
         if(index != DEVICE_INDEX_NOT_FOUND)
@@ -2043,21 +2105,19 @@ void Csf_removeDeviceListItem(ApiMac_sAddrExt_t *pAddr)
 
             /* Setup NV ID for the device list record */
             id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
-            id.subID = (uint16_t)index;
+            setDeviceListItemID(&id, index);
 
             stat = pNV->deleteItem(id);
             if(stat == NVINTF_SUCCESS)
             {
                 /* Update the number of entries */
-                uint16_t numEntries = Csf_getNumDeviceListEntries();
-                if(numEntries > 0)
-                {
-                    numEntries--;
-                    saveNumDeviceListEntries(numEntries);
-                }
+                devTableRemove(index);
+                saveNumDeviceListEntries(devTable.numEntries);
             }
         }
+
+        commitNvTxn();
+        devTableUnlock();
     }
 }
 
@@ -2092,6 +2152,10 @@ void Csf_clearAllNVItems(void)
         NVINTF_itemID_t id;
         uint16_t entries;
 
+        /* All or nothing, and written once */
+        devTableLock();
+        beginNvTxn();
+
         /* Clear Network Information */
         id.systemID = NVINTF_SYSID_APP;
         id.itemID = CSF_NV_NETWORK_INFO_ID;
@@ -2132,7 +2196,7 @@ void Csf_clearAllNVItems(void)
         id.itemID = CSF_NV_DEVICELIST_ID;
         for(entries = 0; entries < CSF_MAX_DEVICELIST_IDS; entries++)
         {
-            id.subID = entries;
+            setDeviceListItemID(&id, entries);
             pNV->deleteItem(id);
         }
 
@@ -2141,6 +2205,12 @@ void Csf_clearAllNVItems(void)
         id.itemID = CSF_NV_FRAMECOUNTER_ID;
         id.subID = 0;
         pNV->deleteItem(id);
+
+        commitNvTxn();
+
+        /* Forget the RAM copy of the device list */
+        devTableReset();
+        devTableUnlock();
     }
 }
 
@@ -2157,6 +2227,9 @@ bool Csf_addBlackListItem(ApiMac_sAddr_t *pAddr)
     if((pNV != NULL) && (pAddr != NULL)
        && (pAddr->addrMode != ApiMac_addrType_none))
     {
+        /* The record and the count change together */
+        beginNvTxn();
+
         if(findBlackListIndex(pAddr))
         {
             retVal = true;
@@ -2186,6 +2259,8 @@ bool Csf_addBlackListItem(ApiMac_sAddr_t *pAddr)
                 }
             }
         }
+
+        commitNvTxn();
     }
 
     return (retVal);
@@ -2274,6 +2349,21 @@ static void processBroadcastTimeoutCallback(UArg a0)
     Semaphore_post(collectorSem);
 }
 
+/*!
+ * @brief       Frame counter checkpoint handler function.
+ *
+ * @param       a0 - ignored
+ */
+static void processFrameCounterCallback(UArg a0)
+{
+    (void)a0; /* Parameter is not used */
+
+    Util_setEvent(&Csf_events, CSF_FRAME_COUNTER_EVENT);
+
+    /* Wake up the application thread when it waits for clock event */
+    Semaphore_post(collectorSem);
+}
+
 /*!
  * @brief       Join permit timeout handler function.
  *
@@ -2362,6 +2452,10 @@ static bool addDeviceListItem(Llc_deviceListItem_t *pItem)
 
     if((pNV != NULL) && (pItem != NULL))
     {
+        /* The record, the count and the RAM copy change together */
+        devTableLock();
+        beginNvTxn();
+
         if(findDeviceListIndex(&pItem->devInfo.extAddress)
                         != DEVICE_INDEX_NOT_FOUND)
         {
@@ -2369,167 +2463,519 @@ static bool addDeviceListItem(Llc_deviceListItem_t *pItem)
         }
         else
         {
-            uint8_t stat;
-            NVINTF_itemID_t id;
-            uint16_t numEntries = Csf_getNumDeviceListEntries();
-
             /* Check the maximum size */
-            if(numEntries < CSF_MAX_DEVICELIST_ENTRIES)
+            if(devTable.numEntries < CSF_MAX_DEVICELIST_ENTRIES)
             {
+                uint8_t stat;
+                NVINTF_itemID_t id;
+                int idx = findUnusedDeviceListIndex();
+
                 /* Setup NV ID for the device list record */
                 id.systemID = NVINTF_SYSID_APP;
-                id.itemID = CSF_NV_DEVICELIST_ID;
-                id.subID = (uint16_t)findUnusedDeviceListIndex();
+                setDeviceListItemID(&id, idx);
 
                 /* write the device list record */
                 stat = pNV->writeItem(id, sizeof(Llc_deviceListItem_t), pItem);
                 if(stat == NVINTF_SUCCESS)
                 {
                     /* Update the number of entries */
-                    numEntries++;
-                    saveNumDeviceListEntries(numEntries);
+                    devTableStore(idx, pItem);
+                    saveNumDeviceListEntries(devTable.numEntries);
                     retVal = true;
                 }
             }
         }
+
+        commitNvTxn();
+        devTableUnlock();
     }
 
     return (retVal);
 }
 
 /*!
- * @brief       Update an entry in the device list
+ * @brief       Find entry in device list
  *
- * @param       pItem - pointer to the device list entry
+ * @param       pAddr - address to of device to find
+ *
+ * @return      sub index into the device list, -1 (DEVICE_INDEX_NOT_FOUND)
+ *              if not found
  */
-static void updateDeviceListItem(Llc_deviceListItem_t *pItem)
+static int findDeviceListIndex(ApiMac_sAddrExt_t *pAddr)
 {
-    if((pNV != NULL) && (pItem != NULL))
+    int idx = DEVICE_INDEX_NOT_FOUND;
+
+    if(pAddr != NULL)
     {
-        int idx;
+        devTableLock();
 
-        idx = findDeviceListIndex(&pItem->devInfo.extAddress);
-        if(idx != DEVICE_INDEX_NOT_FOUND)
+        idx = devTable.extHead[devTableExtBucket(pAddr)];
+        while((idx >= 0)
+              && (memcmp(pAddr, &devTable.items[idx].devInfo.extAddress,
+                         APIMAC_SADDR_EXT_LEN) != 0))
         {
-            NVINTF_itemID_t id;
+            idx = devTable.extNext[idx];
+        }
 
-            /* Setup NV ID for the device list record */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
-            id.subID = (uint16_t)idx;
+        devTableUnlock();
+    }
 
-            /* write the device list record */
-            pNV->writeItem(id, sizeof(Llc_deviceListItem_t), pItem);
-        }
+    return ((idx >= 0) ? idx : DEVICE_INDEX_NOT_FOUND);
+}
+
+/*!
+ * @brief       Find an unused device list index
+ *
+ * @return      index that is not in use
+ */
+static int findUnusedDeviceListIndex(void)
+{
+    int subId;
+
+    devTableLock();
+
+    subId = devTable.firstFree;
+    while((subId < CSF_MAX_DEVICELIST_IDS) && devTable.inUse[subId])
+    {
+        subId++;
     }
+    devTable.firstFree = subId;
+
+    devTableUnlock();
+
+    return (subId);
 }
 
 /*!
- * @brief       Find entry in device list
+ * @brief       Setup the NV ID of a device list record
  *
- * @param       pAddr - address to of device to find
+ * @param       pId - NV ID to fill in
+ * @param       idx - device list index
  *
- * @return      sub index into the device list, -1 (DEVICE_INDEX_NOT_FOUND)
- *              if not found
+ * NV sub IDs are only 10 bits wide, so every CSF_NV_SUBIDS_PER_ID
+ * records after the first block use the next extended item ID.
  */
-static int findDeviceListIndex(ApiMac_sAddrExt_t *pAddr)
+static void setDeviceListItemID(NVINTF_itemID_t *pId, int idx)
+{
+    pId->systemID = NVINTF_SYSID_APP;
+    if(idx < CSF_NV_SUBIDS_PER_ID)
+    {
+        pId->itemID = CSF_NV_DEVICELIST_ID;
+    }
+    else
+    {
+        pId->itemID = (uint16_t)(CSF_NV_DEVICELIST_EXT_ID +
+                                 (idx / CSF_NV_SUBIDS_PER_ID) - 1);
+    }
+    pId->subID = (uint16_t)(idx % CSF_NV_SUBIDS_PER_ID);
+}
+
+/*!
+ * @brief       Read the device list records from NV into the RAM copy
+ *
+ * Called once at startup, after this every lookup uses the RAM copy.
+ * If the stored number of entries does not match the records found
+ * it is corrected.
+ */
+static void devTableLoad(void)
 {
-    if((pNV != NULL) && (pAddr != NULL))
+#if IS_HLOS
+    if(devTable.lock == 0)
+    {
+        devTable.lock = MUTEX_create("csf-devtable");
+    }
+#endif
+
+    if(devTable.items == NULL)
+    {
+        /* The size is from the configuration file, it never changes */
+        devTable.items = calloc(CSF_MAX_DEVICELIST_IDS,
+                                sizeof(Llc_deviceListItem_t));
+        devTable.inUse = calloc(CSF_MAX_DEVICELIST_IDS, sizeof(bool));
+        devTable.extHead = calloc(CSF_DEVTABLE_BUCKETS, sizeof(int));
+        devTable.extNext = calloc(CSF_MAX_DEVICELIST_IDS, sizeof(int));
+        devTable.shortHead = calloc(CSF_DEVTABLE_BUCKETS, sizeof(int));
+        devTable.shortNext = calloc(CSF_MAX_DEVICELIST_IDS, sizeof(int));
+        devTable.fcDirty = calloc(CSF_MAX_DEVICELIST_IDS, sizeof(bool));
+        devTable.fcDirtyList = calloc(CSF_MAX_DEVICELIST_IDS, sizeof(int));
+        if((devTable.items == NULL) || (devTable.inUse == NULL)
+           || (devTable.extHead == NULL) || (devTable.extNext == NULL)
+           || (devTable.shortHead == NULL) || (devTable.shortNext == NULL)
+           || (devTable.fcDirty == NULL) || (devTable.fcDirtyList == NULL))
+        {
+            FATAL_printf("No memory for the device list\n");
+        }
+    }
+
+    devTableLock();
+    devTableReset();
+
+    if((pNV != NULL) && (pNV->readItem != NULL))
     {
+        NVINTF_itemID_t id;
         uint16_t numEntries;
+        int idx;
 
-        numEntries = Csf_getNumDeviceListEntries();
+        /* Setup NV ID for the number of entries in the device list */
+        id.systemID = NVINTF_SYSID_APP;
+        id.itemID = CSF_NV_DEVICELIST_ENTRIES_ID;
+        id.subID = 0;
 
-        if(numEntries > 0)
+        if(pNV->readItem(id, 0, sizeof(uint16_t), &numEntries)
+           != NVINTF_SUCCESS)
         {
-            NVINTF_itemID_t id;
-            uint8_t stat;
-            int subId = 0;
-            int readItems = 0;
+            numEntries = 0;
+        }
 
-            /* Setup NV ID for the device list records */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
+        for(idx = 0; idx < CSF_MAX_DEVICELIST_IDS; idx++)
+        {
+            Llc_deviceListItem_t item;
 
-            while((readItems < numEntries) && (subId
-                                               < CSF_MAX_DEVICELIST_IDS))
-            {
-                Llc_deviceListItem_t item;
+            setDeviceListItemID(&id, idx);
 
-                id.subID = (uint16_t)subId;
+            /* Read the device list record from NV */
+            if(pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t), &item)
+               == NVINTF_SUCCESS)
+            {
+                devTableStore(idx, &item);
+            }
+        }
 
-                /* Read Network Information from NV */
-                stat = pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t),
-                                     &item);
-                if(stat == NVINTF_SUCCESS)
-                {
-                    /* Is the address the same */
-                    if(memcmp(pAddr, &item.devInfo.extAddress,
-                              (APIMAC_SADDR_EXT_LEN))
-                       == 0)
-                    {
-                        return (subId);
-                    }
-                    readItems++;
-                }
-                subId++;
+        if(numEntries != devTable.numEntries)
+        {
+#if IS_HLOS
+            LOG_printf(LOG_ERROR,
+                       "device list: %d entries stored, %d records found\n",
+                       (int)numEntries, (int)devTable.numEntries);
+#endif
+            if(pNV->writeItem != NULL)
+            {
+                saveNumDeviceListEntries(devTable.numEntries);
             }
         }
     }
 
-    return (DEVICE_INDEX_NOT_FOUND);
+    devTableUnlock();
 }
 
 /*!
- * @brief       Find an unused device list index
+ * @brief       Empty the RAM copy of the device list
+ */
+static void devTableReset(void)
+{
+    int x;
+
+    for(x = 0; x < CSF_MAX_DEVICELIST_IDS; x++)
+    {
+        devTable.inUse[x] = false;
+        devTable.fcDirty[x] = false;
+    }
+    devTable.fcNumDirty = 0;
+    for(x = 0; x < CSF_DEVTABLE_BUCKETS; x++)
+    {
+        devTable.extHead[x] = -1;
+        devTable.shortHead[x] = -1;
+    }
+    devTable.numEntries = 0;
+    devTable.firstFree = 0;
+    devTable.lastDevIndex = -1;
+}
+
+/*!
+ * @brief       Lock the RAM copy of the device list
  *
- * @return      index that is not in use
+ * The lock is recursive, hold it across an NV update and the matching
+ * change of the RAM copy so other threads never see them disagree.
  */
-static int findUnusedDeviceListIndex(void)
+static void devTableLock(void)
 {
-    int subId = 0;
+#if IS_HLOS
+    if(devTable.lock != 0)
+    {
+        MUTEX_lock(devTable.lock, -1);
+    }
+#endif
+}
 
-    if(pNV != NULL)
+/*!
+ * @brief       Unlock the RAM copy of the device list
+ */
+static void devTableUnlock(void)
+{
+#if IS_HLOS
+    if(devTable.lock != 0)
     {
-        uint16_t numEntries;
+        MUTEX_unLock(devTable.lock);
+    }
+#endif
+}
+
+/*!
+ * @brief       Hash an extended address into a device table chain
+ *
+ * @param       pAddr - extended address
+ *
+ * @return      chain index
+ */
+static int devTableExtBucket(ApiMac_sAddrExt_t *pAddr)
+{
+    const uint8_t *p = (const uint8_t *)pAddr;
+    uint32_t h = 2166136261u;
+    int x;
 
-        numEntries = Csf_getNumDeviceListEntries();
+    /* FNV-1a */
+    for(x = 0; x < APIMAC_SADDR_EXT_LEN; x++)
+    {
+        h = (h ^ p[x]) * 16777619u;
+    }
+    return ((int)(h % CSF_DEVTABLE_BUCKETS));
+}
 
-        if(numEntries > 0)
+/*!
+ * @brief       Find a device table entry by short address
+ *
+ * @param       shortAddr - short address of the device
+ *
+ * @return      device list index, DEVICE_INDEX_NOT_FOUND if not found
+ */
+static int devTableFindShort(uint16_t shortAddr)
+{
+    int idx;
+
+    idx = devTable.shortHead[shortAddr % CSF_DEVTABLE_BUCKETS];
+    while((idx >= 0)
+          && (devTable.items[idx].devInfo.shortAddress != shortAddr))
+    {
+        idx = devTable.shortNext[idx];
+    }
+    return ((idx >= 0) ? idx : DEVICE_INDEX_NOT_FOUND);
+}
+
+/*!
+ * @brief       Find a device table entry by short or extended address
+ *
+ * @param       pDevAddr - address of the device
+ *
+ * @return      device list index, DEVICE_INDEX_NOT_FOUND if not found
+ */
+static int devTableFindAddr(ApiMac_sAddr_t *pDevAddr)
+{
+    int idx = DEVICE_INDEX_NOT_FOUND;
+
+    if(pDevAddr->addrMode == ApiMac_addrType_short)
+    {
+        idx = devTableFindShort(pDevAddr->addr.shortAddr);
+    }
+    else if(pDevAddr->addrMode == ApiMac_addrType_extended)
+    {
+        idx = findDeviceListIndex(&pDevAddr->addr.extAddr);
+    }
+    return (idx);
+}
+
+/*!
+ * @brief       Add or replace an entry in the RAM copy of the device list
+ *
+ * @param       idx - device list index, as used for the NV record
+ * @param       pItem - the record written to NV
+ */
+static void devTableStore(int idx, Llc_deviceListItem_t *pItem)
+{
+    int b;
+
+    if(devTable.inUse[idx])
+    {
+        /* the addresses may change, so relink it */
+        devTableRemove(idx);
+    }
+
+    memcpy(&devTable.items[idx], pItem, sizeof(Llc_deviceListItem_t));
+    devTable.inUse[idx] = true;
+    devTable.numEntries++;
+    devTable.lastDevIndex = -1;
+
+    b = devTableExtBucket(&pItem->devInfo.extAddress);
+    devTable.extNext[idx] = devTable.extHead[b];
+    devTable.extHead[b] = idx;
+
+    b = pItem->devInfo.shortAddress % CSF_DEVTABLE_BUCKETS;
+    devTable.shortNext[idx] = devTable.shortHead[b];
+    devTable.shortHead[b] = idx;
+}
+
+/*!
+ * @brief       Remove an entry from the RAM copy of the device list
+ *
+ * @param       idx - device list index, as used for the NV record
+ */
+static void devTableRemove(int idx)
+{
+    int *pLink;
+
+    if(!devTable.inUse[idx])
+    {
+        return;
+    }
+
+    pLink = &devTable.extHead[devTableExtBucket(
+                                  &devTable.items[idx].devInfo.extAddress)];
+    while(*pLink != idx)
+    {
+        pLink = &devTable.extNext[*pLink];
+    }
+    *pLink = devTable.extNext[idx];
+
+    pLink = &devTable.shortHead[devTable.items[idx].devInfo.shortAddress
+                                % CSF_DEVTABLE_BUCKETS];
+    while(*pLink != idx)
+    {
+        pLink = &devTable.shortNext[*pLink];
+    }
+    *pLink = devTable.shortNext[idx];
+
+    devTable.inUse[idx] = false;
+    devTable.numEntries--;
+    devTable.lastDevIndex = -1;
+    if(idx < devTable.firstFree)
+    {
+        devTable.firstFree = idx;
+    }
+}
+
+/*!
+ * @brief       Start a group of NV updates that are applied as one
+ *
+ * Other threads do not see a half done group and it is written to
+ * disk once, by commitNvTxn(). Does nothing if the NV driver does
+ * not support transactions.
+ */
+static void beginNvTxn(void)
+{
+    if((pNV != NULL) && (pNV->beginTxn != NULL))
+    {
+        (void)pNV->beginTxn();
+    }
+}
+
+/*!
+ * @brief       Finish a group of NV updates started by beginNvTxn()
+ */
+static void commitNvTxn(void)
+{
+    if((pNV != NULL) && (pNV->commitTxn != NULL))
+    {
+        (void)pNV->commitTxn();
+    }
+}
+
+/*!
+ * @brief       Start the periodic frame counter checkpoint clock
+ */
+static void initializeFrameCounterClock(void)
+{
+#if IS_HLOS
+    frameCounterClkHandle = TIMER_CB_create("frameCounterTimer",
+        processFrameCounterCallback_WRAPPER,
+        0,
+        FRAME_COUNTER_CHECKPOINT_TIME,
+        true);
+#else
+    frameCounterClkHandle = Timer_construct(&frameCounterClkStruct,
+                                            processFrameCounterCallback,
+                                            FRAME_COUNTER_CHECKPOINT_TIME,
+                                            FRAME_COUNTER_CHECKPOINT_TIME,
+                                            true,
+                                            0);
+#endif
+}
+
+/*!
+ * @brief       Save the coordinator frame counter plus the margin,
+ *              called with the device table locked
+ */
+static void saveCoordinatorFrameCounter(void)
+{
+    NVINTF_itemID_t id;
+    uint32_t frameCntr = coordinatorFrameCounter + FRAME_COUNTER_SAVE_MARGIN;
+
+    /* Setup NV ID */
+    id.systemID = NVINTF_SYSID_APP;
+    id.itemID = CSF_NV_FRAMECOUNTER_ID;
+    id.subID = 0;
+
+    /* Write the NV item */
+    if(pNV->writeItem(id, sizeof(uint32_t), &frameCntr) == NVINTF_SUCCESS)
+    {
+        lastSavedCoordinatorFrameCounter = frameCntr;
+        coordinatorFrameCounterChanged = false;
+    }
+}
+
+/*!
+ * @brief       Write every frame counter changed since the last
+ *              checkpoint, as one NV transaction
+ */
+static void checkpointFrameCounters(void)
+{
+    if((pNV == NULL) || (pNV->writeItem == NULL))
+    {
+        return;
+    }
+
+    devTableLock();
+
+    if((devTable.fcNumDirty > 0) || coordinatorFrameCounterChanged)
+    {
+        bool coordinatorSaved = coordinatorFrameCounterChanged;
+        int kept = 0;
+        int x;
+
+        beginNvTxn();
+
+        if(coordinatorFrameCounterChanged)
         {
-            NVINTF_itemID_t id;
+            saveCoordinatorFrameCounter();
+        }
 
-            int readItems = 0;
-            /* Setup NV ID for the device list records */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
+        for(x = 0; x < devTable.fcNumDirty; x++)
+        {
+            int idx = devTable.fcDirtyList[x];
+            bool saved = true;
 
-            while((readItems < numEntries) && (subId
-                                               < CSF_MAX_DEVICELIST_IDS))
+            /* A removed record has nothing to save */
+            if(devTable.inUse[idx])
             {
-                Llc_deviceListItem_t item;
-                uint8_t stat;
+                NVINTF_itemID_t id;
 
-                id.subID = (uint16_t)subId;
+                id.systemID = NVINTF_SYSID_APP;
+                setDeviceListItemID(&id, idx);
+                saved = (pNV->writeItem(id, sizeof(Llc_deviceListItem_t),
+                                        &devTable.items[idx])
+                         == NVINTF_SUCCESS);
+            }
 
-                /* Read Network Information from NV */
-                stat = pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t),
-                                     &item);
-                if(stat == NVINTF_NOTFOUND)
-                {
-                    /* Use this sub id */
-                    break;
-                }
-                else if(stat == NVINTF_SUCCESS)
-                {
-                    readItems++;
-                }
-                subId++;
+            if(saved)
+            {
+                devTable.fcDirty[idx] = false;
+            }
+            else
+            {
+                /* Try again at the next checkpoint */
+                devTable.fcDirtyList[kept++] = idx;
             }
         }
+        devTable.fcNumDirty = kept;
+
+        commitNvTxn();
+
+        /* the margin saved may be all that is left, make it durable */
+        if(coordinatorSaved)
+        {
+            NV_LINUX_sync();
+        }
     }
 
-    return (subId);
+    devTableUnlock();
 }
 
 /*!
@@ -2725,6 +3171,9 @@ void removeBlackListItem(ApiMac_sAddr_t *pAddr)
     {
         int index;
 
+        /* The record and the count change together */
+        beginNvTxn();
+
         /* Does the item exist? */
         index = findBlackListIndex(pAddr);
         if(index > 0)
@@ -2749,6 +3198,8 @@ void removeBlackListItem(ApiMac_sAddr_t *pAddr)
                 }
             }
         }
+
+        commitNvTxn();
     }
 }
 
@@ -2780,55 +3231,27 @@ static bool removeDevice(ApiMac_sAddr_t addr)
  */
 static void removeTheFirstDevice(void)
 {
-    if(pNV != NULL)
-    {
-        uint16_t numEntries;
-
-        numEntries = Csf_getNumDeviceListEntries();
-
-        if(numEntries > 0)
-        {
-            NVINTF_itemID_t id;
-            uint16_t subId = 0;
+    Llc_deviceListItem_t item;
 
-            /* Setup NV ID for the device list records */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
+    /* The first device in the list */
+    if(Csf_getDeviceItem(0, &item))
+    {
+        ApiMac_sAddr_t addr;
 
-            while(subId < CSF_MAX_DEVICELIST_IDS)
-            {
-                Llc_deviceListItem_t item;
-                uint8_t stat;
+        /* Send a disassociate to the device */
+        Cllc_sendDisassociationRequest(item.devInfo.shortAddress,
+                                       item.capInfo.rxOnWhenIdle);
+        /* Remove device from the NV list */
+        Cllc_removeDevice(&item.devInfo.extAddress);
 
-                id.subID = (uint16_t)subId;
+        /* Remove it from the Device list */
+        Csf_removeDeviceListItem(&item.devInfo.extAddress);
 
-                /* Read Network Information from NV */
-                stat = pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t),
-                                     &item);
-                if(stat == NVINTF_SUCCESS)
-                {
-                    /* Found the first device in the list */
-                    ApiMac_sAddr_t addr;
-
-                    /* Send a disassociate to the device */
-                    Cllc_sendDisassociationRequest(item.devInfo.shortAddress,
-                                                   item.capInfo.rxOnWhenIdle);
-                    /* Remove device from the NV list */
-                    Cllc_removeDevice(&item.devInfo.extAddress);
-
-                    /* Remove it from the Device list */
-                    Csf_removeDeviceListItem(&item.devInfo.extAddress);
-
-                    /* Add the device to the black list so it can't join again */
-                    addr.addrMode = ApiMac_addrType_extended;
-                    memcpy(&addr.addr.extAddr, &item.devInfo.extAddress,
-                           (APIMAC_SADDR_EXT_LEN));
-                    Csf_addBlackListItem(&addr);
-                    break;
-                }
-                subId++;
-            }
-        }
+        /* Add the device to the black list so it can't join again */
+        addr.addrMode = ApiMac_addrType_extended;
+        memcpy(&addr.addr.extAddr, &item.devInfo.extAddress,
+               (APIMAC_SADDR_EXT_LEN));
+        Csf_addBlackListItem(&addr);
     }
 }
 #endif
@@ -2842,37 +3265,11 @@ static void removeTheFirstDevice(void)
 static uint16_t getTheFirstDevice(void)
 {
     uint16_t found = CSF_INVALID_SHORT_ADDR;
-    if(pNV != NULL)
-    {
-        uint16_t numEntries;
-
-        numEntries = Csf_getNumDeviceListEntries();
-
-        if(numEntries > 0)
-        {
-            NVINTF_itemID_t id;
-
-            /* Setup NV ID for the device list records */
-            id.systemID = NVINTF_SYSID_APP;
-            id.itemID = CSF_NV_DEVICELIST_ID;
-            id.subID = 0;
-
-            while(id.subID < CSF_MAX_DEVICELIST_IDS)
-            {
-                Llc_deviceListItem_t item;
-                uint8_t stat;
+    Llc_deviceListItem_t item;
 
-                /* Read Network Information from NV */
-                stat = pNV->readItem(id, 0, sizeof(Llc_deviceListItem_t),
-                                     &item);
-                if(stat == NVINTF_SUCCESS)
-                {
-                    found = item.devInfo.shortAddress;
-                    break;
-                }
-                id.subID++;
-            }
-        }
+    if(Csf_getDeviceItem(0, &item))
+    {
+        found = item.devInfo.shortAddress;
     }
     return(found);
 }
@@ -2901,48 +3298,35 @@ void Csf_freeDeviceInformationList(size_t n, Csf_deviceInformation_t *p)
 int Csf_getDeviceInformationList(Csf_deviceInformation_t **ppDeviceInfo)
 {
     Csf_deviceInformation_t *pThis;
-    Llc_deviceListItem_t    tmp;
     uint16_t actual;
-    uint16_t subId;
-    int n;
-    NVINTF_itemID_t id;
+    int idx;
 
-    /* get number of connected devices */
-    n = Csf_getNumDeviceListEntries();
-    /* initialize device list pointer */
+    devTableLock();
 
-    pThis = calloc(n+1, sizeof(*pThis));
+    /* initialize device list pointer */
+    pThis = calloc(devTable.numEntries + 1, sizeof(*pThis));
     *ppDeviceInfo = pThis;
     if(pThis == NULL)
     {
+        devTableUnlock();
         LOG_printf(LOG_ERROR, "No memory for device list\n");
         return 0;
     }
 
-    /* Setup NV ID for the device list records */
-    id.systemID = NVINTF_SYSID_APP;
-    id.itemID = CSF_NV_DEVICELIST_ID;
-    subId = 0;
+    /* Copy the Entries */
     actual = 0;
-    /* Read the Entries */
-    while((subId < CSF_MAX_DEVICELIST_IDS) && (actual < n))
+    for(idx = 0; idx < CSF_MAX_DEVICELIST_IDS; idx++)
     {
-        uint8_t stat;
-
-        id.subID = subId;
-        /* Read Device Information from NV */
-        stat = pNV->readItem(id, 0,
-                             sizeof(tmp),
-                             &tmp);
-        if(stat == NVINTF_SUCCESS)
+        if(devTable.inUse[idx])
         {
-            pThis->devInfo = tmp.devInfo;
-            pThis->capInfo = tmp.capInfo;
+            pThis->devInfo = devTable.items[idx].devInfo;
+            pThis->capInfo = devTable.items[idx].capInfo;
             actual++;
             pThis++;
         }
-        subId++;
-     }
+    }
+
+    devTableUnlock();
 
     /* return actual number of devices connected */
     return actual;
@@ -55,10 +55,15 @@
 #include "stream.h"
 #include "stream_socket.h"  /* We use a socket in our app */
 #include "stream_uart.h"    /* and a uart. */
+#include "stream_shm.h"     /* or shared memory to the npi server */
+#include "mutex.h"
+#include "threads.h"
+#include "ti_semaphore.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
 
 #include "cllc.h"
 #include "nvintf.h"
@@ -80,6 +85,8 @@ uint8_t linux_FH_ASYNC_CHANNEL_MASK[APIMAC_154G_CHANNEL_BITMAP_SIZ] = FH_ASYNC_C
 int linux_CONFIG_REPORTING_INTERVAL = CONFIG_REPORTING_INTERVAL_DEFAULT;
 int linux_CONFIG_POLLING_INTERVAL = CONFIG_POLLING_INTERVAL_DEFAULT;
 int linux_TRACKING_DELAY_TIME = TRACKING_DELAY_TIME_DEFAULT;
+int linux_TRACKING_CONCURRENT = TRACKING_CONCURRENT_DEFAULT;
+int linux_TRACKING_SPACING_TIME = TRACKING_SPACING_TIME_DEFAULT;
 uint8_t linux_CONFIG_SCAN_DURATION = CONFIG_SCAN_DURATION_DEFAULT;
 char linux_CONFIG_FH_NETNAME[32] = CONFIG_FH_NETNAME_DEFAULT;
 int linux_CONFIG_DWELL_TIME = CONFIG_DWELL_TIME_DEFAULT;
@@ -93,6 +100,7 @@ bool linux_CONFIG_SECURE = CONFIG_SECURE_DEFAULT;
 int  linux_CONFIG_PAN_ID = CONFIG_PAN_ID_DEFAULT;
 bool linux_CONFIG_FH_ENABLE = CONFIG_FH_ENABLE_DEFAULT;
 int  linux_CONFIG_COORD_SHORT_ADDR = CONFIG_COORD_SHORT_ADDR_DEFAULT;
+int  linux_CONFIG_MAX_DEVICES = CONFIG_MAX_DEVICES_DEFAULT;
 int  linux_CONFIG_MAC_BEACON_ORDER = CONFIG_MAC_BEACON_ORDER_DEFAULT;
 int  linux_CONFIG_MAC_SUPERFRAME_ORDER = CONFIG_MAC_SUPERFRAME_ORDER_DEFAULT;
 int linux_CONFIG_MIN_BE = CONFIG_MIN_BE_DEFAULT;
@@ -100,6 +108,12 @@ int linux_CONFIG_MAX_BE = CONFIG_MAX_BE_DEFAULT;
 int linux_CONFIG_MAC_MAX_CSMA_BACKOFFS = CONFIG_MAC_MAX_CSMA_BACKOFFS_DEFAULT;
 int linux_CONFIG_MAX_RETRIES = CONFIG_MAX_RETRIES_DEFAULT;
 
+/* Collect lock contention statistics, see MUTEX_profileEnable() */
+static bool mutex_profile = false;
+
+/* SIGUSR1 puts this, the report thread waits on it */
+static intptr_t report_sem;
+
 /*!
  * Called from the linux config file parser as each channel mask is parsed
  * from the configuration file. This allows the user to override/set
@@ -225,6 +239,10 @@ static int my_SOCKET_INI_settings(struct ini_parser *pINI, bool *handled)
     {
         r = SOCKET_INI_settingsOne(pINI, handled, &appClient_socket_cfg);
     }
+    if(INI_itemMatches(pINI, "npi-shm-cfg", NULL))
+    {
+        r = SHM_INI_settingsOne(pINI, handled, &npi_shm_cfg);
+    }
     return r;
 }
 
@@ -283,6 +301,25 @@ static int my_APP_settings(struct ini_parser *pINI, bool *handled)
         return 0;
     }
 
+    if(INI_itemMatches(pINI, NULL, "appsrv-workers"))
+    {
+        appsrv_n_workers = INI_valueAsInt(pINI);
+        if(appsrv_n_workers <= 0)
+        {
+            INI_syntaxError(pINI, "appsrv-workers must be > 0\n");
+            return (-1);
+        }
+        *handled = true;
+        return 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "mutex-profile"))
+    {
+        mutex_profile = INI_valueAsBool(pINI);
+        *handled = true;
+        return 0;
+    }
+
     if(INI_itemMatches(pINI, NULL, "interface"))
     {
         if(0 == strcmp("socket", pINI->item_value))
@@ -297,6 +334,15 @@ static int my_APP_settings(struct ini_parser *pINI, bool *handled)
             *handled = true;
             return 0;
         }
+        if(0 == strcmp("shm", pINI->item_value))
+        {
+            /* same npi server, but over shared memory */
+            npi_mt_interface.s_cfg = NULL;
+            npi_mt_interface.m_cfg = &npi_shm_cfg;
+            API_MAC_msg_interface = &npi_mt_interface;
+            *handled = true;
+            return 0;
+        }
     }
 
     if(INI_itemMatches(pINI, NULL, "load-nv-sim"))
@@ -363,6 +409,20 @@ static int my_APP_settings(struct ini_parser *pINI, bool *handled)
 		return 0;
 	}
 
+	if(INI_itemMatches(pINI, NULL, "config-max-devices"))
+	{
+		linux_CONFIG_MAX_DEVICES = INI_valueAsInt(pINI);
+		if((linux_CONFIG_MAX_DEVICES <= 0) ||
+		   (linux_CONFIG_MAX_DEVICES > CONFIG_MAX_DEVICES_LIMIT))
+		{
+			INI_syntaxError(pINI, "config-max-devices must be 1..%d\n",
+			                CONFIG_MAX_DEVICES_LIMIT);
+			return (-1);
+		}
+		*handled = true;
+		return 0;
+	}
+
 	if(INI_itemMatches(pINI, NULL, "config-max-retries"))
 	{
 		linux_CONFIG_MAX_RETRIES = INI_valueAsInt(pINI);
@@ -391,6 +451,32 @@ static int my_APP_settings(struct ini_parser *pINI, bool *handled)
         return 0;
     }
 
+    if(INI_itemMatches(pINI, NULL, "config-tracking-concurrent"))
+    {
+        linux_TRACKING_CONCURRENT = INI_valueAsInt(pINI);
+        if((linux_TRACKING_CONCURRENT <= 0) ||
+           (linux_TRACKING_CONCURRENT > TRACKING_CONCURRENT_LIMIT))
+        {
+            INI_syntaxError(pINI, "config-tracking-concurrent must be 1..%d\n",
+                            TRACKING_CONCURRENT_LIMIT);
+            return (-1);
+        }
+        *handled = true;
+        return 0;
+    }
+
+    if(INI_itemMatches(pINI, NULL, "config-tracking-spacing"))
+    {
+        linux_TRACKING_SPACING_TIME = INI_valueAsInt(pINI);
+        if(linux_TRACKING_SPACING_TIME < 0)
+        {
+            INI_syntaxError(pINI, "config-tracking-spacing must be >= 0\n");
+            return (-1);
+        }
+        *handled = true;
+        return 0;
+    }
+
     if(INI_itemMatches(pINI, NULL, "config-scan-duration"))
     {
         linux_CONFIG_SCAN_DURATION = (uint8_t)INI_valueAsInt(pINI);
@@ -580,6 +666,8 @@ static int cfg_callback(struct ini_parser *pINI, bool *handled)
         my_SOCKET_INI_settings,
         my_MT_MSG_INI_settings,
         my_APP_settings,
+        THREAD_INI_settingsNth,
+        NV_LINUX_INI_settings,
         /* Terminate list */
         NULL
     };
@@ -596,6 +684,66 @@ static int cfg_callback(struct ini_parser *pINI, bool *handled)
     return 0;
 }
 
+/*!
+ * @brief SIGUSR1 handler, ask the report thread for a report
+ *
+ * A semaphore put is safe in a signal handler, logging is not.
+ */
+static void report_signal(int signo)
+{
+    (void)(signo);
+    SEMAPHORE_put(report_sem);
+}
+
+/*!
+ * @brief Log how late timer callbacks ran since the previous report
+ */
+static void timer_report(void)
+{
+    struct timer_cb_stats st;
+
+    TIMER_CB_getStats(&st);
+    TIMER_CB_clearStats();
+
+    LOG_printf(LOG_ALWAYS,
+               "timers: %llu callbacks, avg %llu usecs late, "
+               "max %llu usecs\n",
+               (unsigned long long)st.n_fired,
+               (unsigned long long)(st.n_fired ?
+                                    (st.jitter_total_nSecs /
+                                     st.n_fired / 1000) : 0),
+               (unsigned long long)(st.jitter_max_nSecs / 1000));
+    LOG_printf(LOG_ALWAYS,
+               "timers: late <10us: %u, <100us: %u, <1ms: %u, "
+               "<10ms: %u, more: %u\n",
+               (unsigned)st.jitter_histogram[0],
+               (unsigned)st.jitter_histogram[1],
+               (unsigned)st.jitter_histogram[2],
+               (unsigned)st.jitter_histogram[3],
+               (unsigned)st.jitter_histogram[4]);
+}
+
+/*!
+ * @brief Log thread usage, timer jitter, NV compaction (and lock
+ *        contention) reports
+ */
+static intptr_t report_thread(intptr_t cookie)
+{
+    (void)(cookie);
+    for(;;)
+    {
+        SEMAPHORE_waitWithTimeout(report_sem, -1);
+        THREAD_statsReport();
+        timer_report();
+        NV_LINUX_statsReport();
+        if(mutex_profile)
+        {
+            MUTEX_profileReport();
+        }
+    }
+    return 0;
+}
+
 /* Our main */
 int main(int argc, char **argv)
 {
@@ -634,9 +782,22 @@ int main(int argc, char **argv)
         }
     }
 
+    if(mutex_profile)
+    {
+        MUTEX_profileEnable(true);
+    }
+
+    /* kill -USR1 <pid> logs the thread (and lock contention) reports */
+    report_sem = SEMAPHORE_create("report-sem", 0);
+    THREAD_create("report-thread", report_thread, 0, THREAD_FLAGS_DEFAULT);
+    signal(SIGUSR1, report_signal);
+
     /* Begin application */
     APP_main();
 
+    /* do not lose NV updates still queued for the journal */
+    NV_LINUX_sync();
+
     exit(0);
 }
 
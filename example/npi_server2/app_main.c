@@ -50,9 +50,11 @@
 #include "stream.h"
 #include "stream_socket.h"
 #include "stream_uart.h"
+#include "stream_shm.h"
 #include "fatal.h"
 #include "log.h"
 #include "mutex.h"
+#include "latch.h"
 #include <string.h>
 #include <malloc.h>
 
@@ -60,11 +62,12 @@
 
 struct uart_cfg my_uart_cfg;
 struct socket_cfg my_socket_cfg;
+struct shm_cfg my_shm_cfg;
 struct mt_msg_interface common_uart_interface;
 static intptr_t uart_thread_id;
-static bool     uart_thread_ready;
 static intptr_t server_thread_id;
-static bool     server_thread_ready;
+/* opens when both the uart and server threads are ready */
+static intptr_t threads_ready;
 static intptr_t uart_mutex;
 
 struct mt_msg_interface socket_interface_template;
@@ -72,14 +75,13 @@ struct mt_msg_interface socket_interface_template;
 struct npi_connection {
     /* has something gone wrong this is set to true */
     bool     is_dead;
-    bool     u2s_busy;
     bool     s2u_busy;
     char     *dbg_name;
 
-    /* set to true when the socket side is ready to proceed */
-    bool     socket_ready;
-    /* set to true when the uart side is ready to proceed */
-    bool     uart_ready;
+    /* opens when both the socket and uart sides are ready to proceed */
+    intptr_t ready_latch;
+    /* opens when the uart to socket thread is no longer busy */
+    intptr_t u2s_done;
     /* what connection number is this? */
     int  connection_id;
 
@@ -162,6 +164,10 @@ void APP_defaults(void)
         BUG_HERE("No memory\n");
     }
 
+    /* shared memory is only used if the cfg file names it */
+    my_shm_cfg.name = NULL;
+    my_shm_cfg.cs = 's';
+
     common_uart_interface.dbg_name = strdup("uart");
     common_uart_interface.frame_sync = true;
     common_uart_interface.include_chksum = true;
@@ -249,15 +255,11 @@ static intptr_t u2s_thread(intptr_t cookie)
     struct mt_msg *pMsg;
 
     pCONN = (struct npi_connection *)(cookie);
-    pCONN->uart_ready = true;
 
-    /* it should be ready *QUICKLY* */
-    while(!(pCONN->socket_ready))
-    {
-        TIMER_sleep(10);
-    }
+    /* the socket side should be ready *QUICKLY* */
+    LATCH_countDown(pCONN->ready_latch);
+    LATCH_wait(pCONN->ready_latch, -1);
 
-    pCONN->u2s_busy = true;
     for(;;)
     {
         /* is our uart dead? */
@@ -303,13 +305,12 @@ static intptr_t u2s_thread(intptr_t cookie)
         /* we don't need this any more */
         MT_MSG_free(pMsg);
     }
-    pCONN->u2s_busy = false;
+    LATCH_countDown(pCONN->u2s_done);
 
     /* wait for the socket to uart thread to die */
-    while(THREAD_isAlive(pCONN->thread_id_s2u))
-    {
-        TIMER_sleep(1000);
-    }
+    THREAD_join(pCONN->thread_id_s2u, -1);
+    THREAD_destroy(pCONN->thread_id_s2u);
+    pCONN->thread_id_s2u = 0;
     lock_connection_list();
     /* remove this connection from the list. */
     {
@@ -347,6 +348,8 @@ static intptr_t u2s_thread(intptr_t cookie)
     unlock_connection_list();
 
     /* Now we can release the pCONN */
+    LATCH_destroy(pCONN->u2s_done);
+    LATCH_destroy(pCONN->ready_latch);
     free((void *)(pCONN));
     return 0;
 }
@@ -466,15 +469,9 @@ static intptr_t s2u_thread(intptr_t cookie)
         BUG_HERE("Cannot create socket interface?\n");
     }
 
-    /* we are ready .. so mark */
-    pCONN->socket_ready = true;
-
-    /* wait for uart to sync */
-    /* this should be fast ... so we just poll */
-    while (!(pCONN->uart_ready))
-    {
-        TIMER_sleep(10);
-    }
+    /* we are ready .. so mark, and wait for uart to sync */
+    LATCH_countDown(pCONN->ready_latch);
+    LATCH_wait(pCONN->ready_latch, -1);
 
     star_line_char = 0;
     /* Wait for messages to come in from the socket.. */
@@ -548,11 +545,8 @@ static intptr_t s2u_thread(intptr_t cookie)
     }
     pCONN->s2u_busy = false;
 
-    while( pCONN->u2s_busy ){
-        // wake up the other side
-        LOG_printf(LOG_DBG_MT_MSG_traffic, "Wait for u2s to finish\n");
-        TIMER_sleep( 250 );
-    }
+    LOG_printf(LOG_DBG_MT_MSG_traffic, "Wait for u2s to finish\n");
+    LATCH_wait(pCONN->u2s_done, -1);
 
     /* socket is dead */
     /* we need to destroy the interface */
@@ -599,13 +593,9 @@ static intptr_t uart_thread(intptr_t _notused)
         common_uart_interface.u_cfg->devname);
 #endif //IS_HEADLESS
 
-    uart_thread_ready = true;
     /* wait for the server to come up */
-
-    while(!server_thread_ready)
-    {
-        TIMER_sleep(10);
-    }
+    LATCH_countDown(threads_ready);
+    LATCH_wait(threads_ready, -1);
 
     /* process incomming (non-sreq, non-fragment) messages on the uart. */
     for(;;)
@@ -660,12 +650,94 @@ static intptr_t uart_thread(intptr_t _notused)
         unlock_connection_list();
     }
 
-    uart_thread_ready = 0;
     /* Destroy the uart */
     MT_MSG_interfaceDestroy(&common_uart_interface);
     return 0;
 }
 
+/*!
+ * @brief Allocate a new (not yet started) connection
+ * @param connection_id - the id for this connection
+ * @returns the connection
+ */
+static struct npi_connection *alloc_connection(int connection_id)
+{
+    struct npi_connection *pCONN;
+    char buf[30];
+
+    pCONN = calloc(1, sizeof(*pCONN));
+    if(pCONN == NULL)
+    {
+        BUG_HERE("No memory\n");
+    }
+    pCONN->connection_id = connection_id;
+
+    /* clone the connection details */
+    pCONN->socket_interface = socket_interface_template;
+
+    (void)snprintf(buf,sizeof(buf), "connection-%d", pCONN->connection_id);
+    pCONN->dbg_name = strdup(buf);
+    if(pCONN->dbg_name == NULL)
+    {
+        BUG_HERE("No memory\n");
+    }
+    MT_MSG_LIST_create(&(pCONN->areq_list), pCONN->dbg_name, "areq");
+
+    pCONN->ready_latch = LATCH_create(pCONN->dbg_name, 2);
+    pCONN->u2s_done = LATCH_create(pCONN->dbg_name, 1);
+    if((pCONN->ready_latch == 0) || (pCONN->u2s_done == 0))
+    {
+        BUG_HERE("No memory\n");
+    }
+    return (pCONN);
+}
+
+/*!
+ * @brief Add a connection to the list and start its threads
+ * @param pCONN - the connection, the threads own it after this.
+ */
+static void start_connection(struct npi_connection *pCONN)
+{
+    char buf[30];
+
+    /* we have a connection */
+    pCONN->is_dead = false;
+
+    /* add to the list of connections. */
+    lock_connection_list();
+    pCONN->pNext = all_connections;
+    all_connections = pCONN;
+    unlock_connection_list();
+
+    /* create our connection threads */
+    (void)snprintf(buf, sizeof(buf),
+              "u2s-%d",
+              pCONN->connection_id);
+    pCONN->thread_id_u2s = THREAD_create(buf,
+                                          u2s_thread,
+                                          (intptr_t)(pCONN),
+                                          THREAD_FLAGS_DEFAULT);
+    if( pCONN->thread_id_u2s == 0 )
+    {
+        BUG_HERE("Cannot create uart to socket thread for connection: %d\n",
+                 pCONN->connection_id );
+    }
+
+    (void)snprintf(buf, sizeof(buf),
+              "s2u-%d",
+              pCONN->connection_id);
+    pCONN->thread_id_s2u = THREAD_create(buf,
+                                          s2u_thread,
+                                          (intptr_t)(pCONN),
+                                          THREAD_FLAGS_DEFAULT);
+
+    if( pCONN->thread_id_s2u == 0 )
+    {
+        BUG_HERE("Cannot create socket to uart thread for connection: %d\n",
+                 pCONN->connection_id );
+    }
+}
+
 static intptr_t server_thread(intptr_t _notused)
 {
     (void)(_notused);
@@ -674,7 +746,6 @@ static intptr_t server_thread(intptr_t _notused)
     intptr_t server_handle;
     struct npi_connection *pCONN;
     int connection_id;
-    char buf[30];
 
     pCONN = NULL;
     connection_id = 0;
@@ -707,11 +778,20 @@ static intptr_t server_thread(intptr_t _notused)
 #endif //IS_HEADLESS
 
     /* we are ready.. */
-    server_thread_ready = true;
+    LATCH_countDown(threads_ready);
+    LATCH_wait(threads_ready, -1);
 
-    while(!uart_thread_ready)
+    /* a co-located client can also use shared memory */
+    if(my_shm_cfg.name)
     {
-        TIMER_sleep(10);
+        pCONN = alloc_connection(connection_id++);
+        pCONN->socket_interface.m_cfg = &my_shm_cfg;
+
+        LOG_printf(LOG_ALWAYS, "Shared memory connection: %s Id: %d\n",
+            my_shm_cfg.name, pCONN->connection_id);
+
+        start_connection(pCONN);
+        pCONN = NULL;
     }
 
     /* Wait for connections :-) */
@@ -724,23 +804,7 @@ static intptr_t server_thread(intptr_t _notused)
         }
         if(pCONN == NULL)
         {
-            pCONN = calloc(1, sizeof(*pCONN));
-            if(pCONN == NULL)
-            {
-                BUG_HERE("No memory\n");
-            }
-            pCONN->connection_id = connection_id++;
-
-            /* clone the connection details */
-            pCONN->socket_interface = socket_interface_template;
-
-            (void)snprintf(buf,sizeof(buf), "connection-%d", pCONN->connection_id);
-            pCONN->dbg_name = strdup(buf);
-            if(pCONN->dbg_name == NULL)
-            {
-                BUG_HERE("No memory\n");
-            }
-            MT_MSG_LIST_create(&(pCONN->areq_list), pCONN->dbg_name, "areq");
+            pCONN = alloc_connection(connection_id++);
         }
 
         /* wait for a connection.. */
@@ -754,27 +818,6 @@ static intptr_t server_thread(intptr_t _notused)
             LOG_printf(LOG_ALWAYS, "No new server connections\n");
             continue;
         }
-        /* we have a connection */
-        pCONN->is_dead = false;
-
-        /* add to the list of connections. */
-        lock_connection_list();
-        pCONN->pNext = all_connections;
-        all_connections = pCONN;
-        unlock_connection_list();
-
-        /* create our connection threads */
-
-        /* set name final use */
-        (void)snprintf(buf, sizeof(buf),
-                  "connection-%d",
-                  pCONN->connection_id);
-        pCONN->dbg_name = strdup(buf);
-        if(pCONN->dbg_name == NULL)
-        {
-            BUG_HERE("No memory\n");
-        }
-
         LOG_printf(LOG_ALWAYS, "Socket connection established. Port %s Id: %d\n",
             my_socket_cfg.service, pCONN->connection_id);
 
@@ -783,32 +826,7 @@ static intptr_t server_thread(intptr_t _notused)
             my_socket_cfg.service, pCONN->connection_id);
 #endif //IS_HEADLESS
 
-        (void)snprintf(buf, sizeof(buf),
-                  "u2s-%d",
-                  pCONN->connection_id);
-        pCONN->thread_id_u2s = THREAD_create(buf,
-                                              u2s_thread,
-                                              (intptr_t)(pCONN),
-                                              THREAD_FLAGS_DEFAULT);
-        if( pCONN->thread_id_u2s == 0 )
-        {
-            BUG_HERE("Cannot create uart to socket thread for connection: %d\n",
-                     pCONN->connection_id );
-        }
-
-        (void)snprintf(buf, sizeof(buf),
-                  "s2u-%d",
-                  pCONN->connection_id);
-        pCONN->thread_id_s2u = THREAD_create(buf,
-                                              s2u_thread,
-                                              (intptr_t)(pCONN),
-                                              THREAD_FLAGS_DEFAULT);
-
-        if( pCONN->thread_id_u2s == 0 )
-        {
-            BUG_HERE("Cannot create socket to uart thread for connection: %d\n",
-                     pCONN->connection_id );
-        }
+        start_connection(pCONN);
         /* We passed the connection pointer to the thread */
         /* we no longer need this, so set the pointer to null */
         pCONN = NULL;
@@ -822,6 +840,12 @@ void APP_main(void)
     int r;
     struct npi_connection *pCONN;
 
+    threads_ready = LATCH_create("threads-ready", 2);
+    if(threads_ready == 0)
+    {
+        BUG_HERE("No memory\n");
+    }
+
     uart_thread_id   = THREAD_create("uart-thread",
                                      uart_thread,
                                      0,
@@ -831,30 +855,12 @@ void APP_main(void)
                                      0,
                                      THREAD_FLAGS_DEFAULT);
 
-    for(;;)
-    {
-        /* every 30 seconds.. */
-        /* no specific reason... for that time */
-        TIMER_sleep(30 * 1000);
-        r = 0;
-        if(THREAD_isAlive(uart_thread_id))
-        {
-            r += 1;
-        }
-        if(THREAD_isAlive(server_thread_id))
-        {
-            r += 1;
-        }
-        /* Keep looping as long either
-           the downstream (uart) side is alive
-           or the upstream server side is alive.
-         */
-        if(r == 0)
-        {
-            /* once both are dead... break */
-            break;
-        }
-    }
+    /* Keep going as long either
+       the downstream (uart) side is alive
+       or the upstream server side is alive.
+     */
+    THREAD_join(uart_thread_id, -1);
+    THREAD_join(server_thread_id, -1);
 
     /* wait at most 10 seconds then we just 'die' */
     r = 0;
@@ -54,6 +54,7 @@
 #include "fatal.h"
 #include "stream_socket.h"  /* we use a socket in our app */
 #include "stream_uart.h"    /* and a uart. */
+#include "threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -92,6 +93,10 @@ static int my_SOCKET_INI_settings(struct ini_parser *pINI, bool *handled)
     {
         r = SOCKET_INI_settingsOne(pINI, handled, &my_socket_cfg);
     }
+    if(INI_itemMatches(pINI, "shm-cfg", NULL))
+    {
+        r = SHM_INI_settingsOne(pINI, handled, &my_shm_cfg);
+    }
     return r;
 }
 
@@ -142,6 +147,7 @@ static ini_rd_callback * const ini_cb_table[] = {
     my_SOCKET_INI_settings,
     my_MT_MSG_INI_settings,
     my_APP_settings,
+    THREAD_INI_settingsNth,
     /* Terminate list */
     NULL
 };
@@ -46,12 +46,14 @@
 #include "stream.h"
 #include "stream_uart.h"
 #include "stream_socket.h"
+#include "stream_shm.h"
 #include "log.h"
 
 #include "mt_msg.h"
 
 extern struct uart_cfg my_uart_cfg;
 extern struct socket_cfg my_socket_cfg;
+extern struct shm_cfg my_shm_cfg;
 
 extern struct mt_msg_interface common_uart_interface;
 extern struct mt_msg_interface socket_interface_template;
@@ -111,6 +111,7 @@ _prelink:
 # Do we need any extra libs?
 # Yes, the host apps are pthread based..
 EXTRA_APP_LIBS += -lpthread
+EXTRA_APP_LIBS += -lrt
 
 # this builds the "host_foo" or "bbb_foo" app
 # STEP 1: the OBJECT directory
@@ -111,6 +111,15 @@ testapps: ${_TEST_MAKEFILES:%=testapp_%}
 testapp_%:
 	${MAKE} -f $* ${MAKEFLAGS}
 
+#========================================
+# And any command line tools that go with the library
+_TOOL_MAKEFILES=${wildcard *_tool.mak}
+
+tools: ${_TOOL_MAKEFILES:%=tool_%}
+
+tool_%:
+	${MAKE} -f $* ${MAKEFLAGS}
+
 
 
 #  ========================================